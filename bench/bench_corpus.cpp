@@ -0,0 +1,232 @@
+/**
+ * @file bench/bench_corpus.cpp
+ *
+ * @brief Implementation of the benchmark input generatorsbuild_header/
+ */
+#include "bench_corpus.hpp"
+#include <cmath>
+#include <cstdio>
+
+/** Size of the grid built by the generators
+ */
+struct GridSize {
+	int rows;					///< number of rows of quads (from pole to pole)
+	int cols;					///< number of columns of quads (around the axis)
+};
+
+/** Helper function: choose a grid with at least n_faces triangles
+ */
+static GridSize GetGridSize(int n_faces)
+{
+	GridSize ret;
+	ret.cols = static_cast<int>(ceil(sqrt(n_faces / 2.0)));
+	if(ret.cols < 3) { ret.cols = 3; }
+	ret.rows = (n_faces + 2*ret.cols - 1) / (2*ret.cols);
+	if(ret.rows < 2) { ret.rows = 2; }
+	return ret;
+}
+
+/** Helper function: position, normal and texture coordinates of a grid vertex
+ * @param[out] pos A field of size 3
+ * @param[out] normal A field of size 3
+ * @param[out] uv A field of size 2
+ */
+static void GetGridVertex(GridSize const& grid, int row, int col, float* pos, float* normal, float* uv)
+{
+	double const pi    = 3.14159265358979323846;
+	double const theta = pi * row / grid.rows;
+	double const phi   = 2.0 * pi * col / grid.cols;
+	normal[0] = static_cast<float>(sin(theta) * cos(phi));
+	normal[1] = static_cast<float>(cos(theta));
+	normal[2] = static_cast<float>(sin(theta) * sin(phi));
+	for(int i=0; i<3; i++) { pos[i] = 2.0f * normal[i]; }
+	uv[0] = static_cast<float>(col) / grid.cols;
+	uv[1] = static_cast<float>(row) / grid.rows;
+}
+
+/** Helper function: the pixel pattern of the synthetic images
+ */
+static unsigned int GetPatternValue(int x, int y)
+{
+	return static_cast<unsigned int>((x / 8) * 37 + y * 11);
+}
+
+/** Helper function: the color of a pattern value
+ */
+static unsigned int GetPatternColor(unsigned int v)
+{
+	return 0xff000000 | (((v * 13) & 0xff) << 16) | (((v * 7) & 0xff) << 8) | (v & 0xff);
+}
+
+/** Helper function: appends a little endian value of n bytes
+ */
+static void AppendLE(std::vector<unsigned char>& out, unsigned int v, int n)
+{
+	for(int i=0; i<n; i++) {
+		out.push_back(static_cast<unsigned char>(v & 0xff));
+		v >>= 8;
+	}
+}
+
+int GenerateOBJ(std::ostream& os, int n_faces)
+{
+	GridSize const grid = GetGridSize(n_faces);
+	char line[256];
+	float pos[3], normal[3], uv[2];
+	os << "# synthetic benchmark mesh\n";
+	for(int i=0; i<=grid.rows; i++) {
+		for(int j=0; j<=grid.cols; j++) {
+			GetGridVertex(grid, i, j, pos, normal, uv);
+			sprintf(line, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n",
+			        pos[0], pos[1], pos[2], uv[0], uv[1], normal[0], normal[1], normal[2]);
+			os << line;
+		}
+	}
+	os << "g bench\ns 1\n";
+	int const stride = grid.cols + 1;
+	for(int i=0; i<grid.rows; i++) {
+		for(int j=0; j<grid.cols; j++) {
+			//obj indices are 1-based:
+			int const a = i*stride + j + 1;
+			int const b = a + 1;
+			int const c = a + stride;
+			int const d = c + 1;
+			sprintf(line, "f %d/%d/%d %d/%d/%d %d/%d/%d\nf %d/%d/%d %d/%d/%d %d/%d/%d\n",
+			        a, a, a, c, c, c, b, b, b, b, b, b, c, c, c, d, d, d);
+			os << line;
+		}
+	}
+	return 2 * grid.rows * grid.cols;
+}
+
+void GenerateIcon(PS2Icon& icon, int n_faces)
+{
+	GridSize const grid = GetGridSize(n_faces);
+	int const n_vertices = 6 * grid.rows * grid.cols;
+	std::vector<float> positions(n_vertices * 3), normals(n_vertices * 3), uvs(n_vertices * 2);
+	//corners of the two triangles of a quad, as (row, col) offsets:
+	static int const corners[6][2] = { {0, 0}, {1, 0}, {0, 1}, {0, 1}, {1, 0}, {1, 1} };
+	int v = 0;
+	for(int i=0; i<grid.rows; i++) {
+		for(int j=0; j<grid.cols; j++) {
+			for(int k=0; k<6; k++, v++) {
+				GetGridVertex(grid, i + corners[k][0], j + corners[k][1], &positions[v*3], &normals[v*3], &uvs[v*2]);
+			}
+		}
+	}
+	icon.SetGeometry(&positions[0], &normals[0], &uvs[0], n_vertices);
+	std::vector<unsigned int> texture;
+	GenerateImage(texture, 128, 128);
+	icon.SetTextureData(&texture[0]);
+}
+
+void GenerateImage(std::vector<unsigned int>& pixels, int width, int height)
+{
+	pixels.resize(static_cast<size_t>(width) * height);
+	for(int y=0; y<height; y++) {
+		for(int x=0; x<width; x++) {
+			pixels[static_cast<size_t>(y) * width + x] = GetPatternColor(GetPatternValue(x, y));
+		}
+	}
+}
+
+void GenerateBMP(std::vector<unsigned char>& out, int width, int height, int bpp)
+{
+	int const n_colors   = (bpp <= 8) ? (1 << bpp) : 0;
+	int const pitch      = ((width * bpp + 31) / 32) * 4;
+	unsigned int const offset = 14 + 40 + 4 * n_colors;
+	out.clear();
+	out.reserve(offset + static_cast<size_t>(pitch) * height);
+	//file header:
+	out.push_back('B'); out.push_back('M');
+	AppendLE(out, offset + pitch * height, 4);
+	AppendLE(out, 0, 4);
+	AppendLE(out, offset, 4);
+	//info header:
+	AppendLE(out, 40, 4);
+	AppendLE(out, width, 4);
+	AppendLE(out, height, 4);
+	AppendLE(out, 1, 2);
+	AppendLE(out, bpp, 2);
+	AppendLE(out, 0, 4);					//uncompressed
+	AppendLE(out, pitch * height, 4);
+	AppendLE(out, 2835, 4);
+	AppendLE(out, 2835, 4);
+	AppendLE(out, 0, 4);					//biClrUsed: full palette
+	AppendLE(out, 0, 4);
+	for(int i=0; i<n_colors; i++) {
+		AppendLE(out, GetPatternColor(i) & 0x00ffffff, 4);
+	}
+	//rows are stored bottom row first:
+	for(int y=height-1; y>=0; y--) {
+		size_t const row_start = out.size();
+		if(bpp <= 8) {
+			unsigned int acc = 0;
+			int n_bits = 0;
+			for(int x=0; x<width; x++) {
+				acc = (acc << bpp) | (GetPatternValue(x, y) & (n_colors - 1));
+				n_bits += bpp;
+				if(n_bits == 8) { out.push_back(static_cast<unsigned char>(acc)); acc = 0; n_bits = 0; }
+			}
+			if(n_bits > 0) { out.push_back(static_cast<unsigned char>(acc << (8 - n_bits))); }
+		} else {
+			for(int x=0; x<width; x++) {
+				AppendLE(out, GetPatternColor(GetPatternValue(x, y)), bpp / 8);
+			}
+		}
+		while(out.size() - row_start < static_cast<size_t>(pitch)) { out.push_back(0); }
+	}
+}
+
+/** Helper function: the color of a TGA pixel in the file's pixel format
+ */
+static unsigned int GetTGAPixel(int x, int y, int bpp)
+{
+	unsigned int const c = GetPatternColor(GetPatternValue(x, y));
+	if(bpp == 16) {
+		return 0x8000 | (((c >> 19) & 0x1f) << 10) | (((c >> 11) & 0x1f) << 5) | ((c >> 3) & 0x1f);
+	}
+	return c;
+}
+
+void GenerateTGA(std::vector<unsigned char>& out, int width, int height, int bpp, bool rle)
+{
+	int const bytes = bpp / 8;
+	out.clear();
+	//header:
+	out.push_back(0);						//no image id
+	out.push_back(0);						//no color map
+	out.push_back(rle ? 10 : 2);
+	AppendLE(out, 0, 4); out.push_back(0);	//color map specification
+	AppendLE(out, 0, 2);
+	AppendLE(out, 0, 2);
+	AppendLE(out, width, 2);
+	AppendLE(out, height, 2);
+	out.push_back(static_cast<unsigned char>(bpp));
+	out.push_back((bpp == 32) ? 8 : ((bpp == 16) ? 1 : 0));	//alpha bits; origin lower left
+	for(int y=height-1; y>=0; y--) {
+		if(!rle) {
+			for(int x=0; x<width; x++) { AppendLE(out, GetTGAPixel(x, y, bpp), bytes); }
+			continue;
+		}
+		//packets do not cross rows; repeated pixels become run packets, all others raw packets:
+		int x = 0;
+		while(x < width) {
+			unsigned int const p = GetTGAPixel(x, y, bpp);
+			int n = 1;
+			while((x + n < width) && (n < 128) && (GetTGAPixel(x + n, y, bpp) == p)) { n++; }
+			if(n > 1) {
+				out.push_back(static_cast<unsigned char>(0x80 | (n - 1)));
+				AppendLE(out, p, bytes);
+			} else {
+				while((x + n < width) && (n < 128) &&
+				      ((x + n + 1 >= width) || (GetTGAPixel(x + n, y, bpp) != GetTGAPixel(x + n + 1, y, bpp)))) {
+					n++;
+				}
+				out.push_back(static_cast<unsigned char>(n - 1));
+				for(int i=0; i<n; i++) { AppendLE(out, GetTGAPixel(x + i, y, bpp), bytes); }
+			}
+			x += n;
+		}
+	}
+}
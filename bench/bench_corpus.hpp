@@ -0,0 +1,57 @@
+/**
+ * @file bench/bench_corpus.hpp
+ *
+ * @brief Generators for the synthetic input files of the benchmarksbuild_header/
+ */
+#ifndef __BENCH_CORPUS_HPP_INCLUDE_GUARD__
+#define __BENCH_CORPUS_HPP_INCLUDE_GUARD__
+
+#include <iostream>
+#include <vector>
+#include "../include/ps2_ps2icon.hpp"
+
+/** Write a synthetic Wavefront OBJ file
+ * The mesh is a closed, sphere-like grid with positions, texture coordinates and normals,
+ * written as it is generated, so files of millions of faces need no extra memory.
+ * @param[out] os Destination stream
+ * @param[in] n_faces Minimum number of triangles; the grid is rounded up to whole rows
+ * @return The number of triangles written
+ */
+int GenerateOBJ(std::ostream& os, int n_faces);
+
+/** Fill an icon with synthetic geometry and texture
+ * @param[out] icon Receives the geometry and the texture
+ * @param[in] n_faces Minimum number of triangles; the grid is rounded up to whole rows
+ * @throw std::bad_alloc
+ */
+void GenerateIcon(PS2Icon& icon, int n_faces);
+
+/** Get a synthetic 32 bit ARGB image
+ * The image is made of horizontal runs of 8 pixels, so it also compresses with RLE.
+ * @param[out] pixels Receives width*height pixels, top row first
+ * @param[in] width Image width in pixels
+ * @param[in] height Image height in pixels
+ * @throw std::bad_alloc
+ */
+void GenerateImage(std::vector<unsigned int>& pixels, int width, int height);
+
+/** Write a synthetic BMP file
+ * @param[out] out Receives the complete file
+ * @param[in] width Image width in pixels
+ * @param[in] height Image height in pixels
+ * @param[in] bpp Bits per pixel: 1, 4 or 8 (palettized), 24 or 32
+ * @throw std::bad_alloc
+ */
+void GenerateBMP(std::vector<unsigned char>& out, int width, int height, int bpp);
+
+/** Write a synthetic TGA file
+ * @param[out] out Receives the complete file
+ * @param[in] width Image width in pixels
+ * @param[in] height Image height in pixels
+ * @param[in] bpp Bits per pixel: 16, 24 or 32
+ * @param[in] rle If true, the image is written run length encoded (TGA image type 10)
+ * @throw std::bad_alloc
+ */
+void GenerateTGA(std::vector<unsigned char>& out, int width, int height, int bpp, bool rle);
+
+#endif
@@ -0,0 +1,555 @@
+/**
+ * @file bench/ps2icon_bench.cpp
+ *
+ * @brief Benchmarks for the file formats and conversion stepsbuild_header/
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "bench_corpus.hpp"
+#include "../include/ps2_ps2icon.hpp"
+#include "../include/ps2_iconsys.hpp"
+#include "../include/ps2_title_codec.hpp"
+#include "../include/obj_loader.hpp"
+#include "../include/batch_util.hpp"
+#include "../gbLib/include/gbException.hpp"
+#include "../gbLib/include/gbImageLoader.hpp"
+
+#ifdef WIN32
+#	include <windows.h>
+#else
+#	include <time.h>
+#endif
+
+/** Settings from the command line
+ */
+struct BenchOptions {
+	bool quick;							///< small inputs and short measurements
+	bool json;							///< write results as JSON instead of CSV
+	int max_faces;						///< largest mesh size measured
+	double min_time;					///< minimum measuring time per benchmark in seconds
+	std::string work_dir;				///< directory for temporary files
+	std::string filter;					///< only run benchmarks whose name contains this string
+	char const* output_file;			///< destination of the results (NULL: stdout)
+	/** Constructor
+	 */
+	BenchOptions(): quick(false), json(false), max_faces(100000), min_time(0.5), output_file(NULL) {}
+};
+
+/** The measurements of a single benchmark
+ */
+struct BenchResult {
+	std::string name;					///< name of the benchmark
+	int param;							///< size parameter (faces or image width)
+	int iterations;						///< number of timed iterations
+	double min_ns;						///< fastest iteration in nanoseconds
+	double median_ns;					///< median iteration in nanoseconds
+	size_t bytes;						///< bytes processed per iteration
+};
+
+/** A benchmark; Run() performs one iteration
+ */
+class BenchCase {
+public:
+	/** Perform one iteration
+	 * @throw Ghulbus::gbException
+	 * @throw std::bad_alloc
+	 */
+	virtual void Run()=0;
+	/** Get the number of bytes processed by one iteration
+	 */
+	virtual size_t GetBytes() const=0;
+	/** Destructor
+	 */
+	virtual ~BenchCase() {}
+};
+
+BenchOptions options;					///< settings from the command line
+std::vector<BenchResult> results;		///< results of all benchmarks run so far
+volatile unsigned int bench_sink = 0;	///< keeps results alive so the compiler can not drop the work
+
+/** Get a monotonic time stamp
+ * @return Time in seconds from an arbitrary starting point
+ */
+double GetTime()
+{
+#ifdef WIN32
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return static_cast<double>(count.QuadPart) / static_cast<double>(freq.QuadPart);
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+/** Helper function: get the size of a file
+ */
+size_t GetFileSize(std::string const& fname)
+{
+	std::ifstream fin(fname.c_str(), std::ios_base::in | std::ios_base::binary);
+	fin.seekg(0, std::ios_base::end);
+	return static_cast<size_t>(fin.tellg());
+}
+
+/** Helper function: write a file in one go
+ * @throw Ghulbus::gbException GB_FAILED indicates a file access error
+ */
+void WriteWholeFile(std::string const& fname, std::vector<unsigned char> const& data)
+{
+	std::ofstream fout(fname.c_str(), std::ios_base::out | std::ios_base::binary);
+	fout.write(reinterpret_cast<char const*>(&data[0]), data.size());
+	fout.close();
+	if(fout.fail()) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Benchmark input could not be written" ) );
+	}
+}
+
+/** Helper function: path of a temporary file in the work directory
+ */
+std::string GetWorkFile(char const* name)
+{
+	return JoinPath(options.work_dir, std::string("bench_") + name + ".tmp");
+}
+
+/** Time a benchmark and record the result
+ * The case is run once to warm up, then repeatedly until options.min_time has passed
+ * and at least 5 iterations were timed.
+ * @param[in] name Name of the benchmark
+ * @param[in] param Size parameter
+ * @param[in,out] bench The benchmark
+ */
+void Measure(char const* name, int param, BenchCase& bench)
+{
+	if(strstr(name, options.filter.c_str()) == NULL) { return; }
+	std::cerr << " * " << name << " " << param << "..." << std::flush;
+	bench.Run();
+	std::vector<double> times;
+	double const start = GetTime();
+	do {
+		double const t0 = GetTime();
+		bench.Run();
+		times.push_back(GetTime() - t0);
+	} while( (times.size() < 5) || (GetTime() - start < options.min_time) );
+	std::sort(times.begin(), times.end());
+	BenchResult r;
+	r.name       = name;
+	r.param      = param;
+	r.iterations = static_cast<int>(times.size());
+	r.min_ns     = times.front() * 1e9;
+	r.median_ns  = times[times.size() / 2] * 1e9;
+	r.bytes      = bench.GetBytes();
+	results.push_back(r);
+	std::cerr << "done." << std::endl;
+}
+
+/** Writing an icon file
+ */
+class IconWriteCase: public BenchCase {
+private:
+	PS2Icon const& m_icon;
+	std::string m_file;
+public:
+	IconWriteCase(PS2Icon const& icon, std::string const& file): m_icon(icon), m_file(file) {}
+	void Run() { m_icon.WriteFile(m_file.c_str()); }
+	size_t GetBytes() const { return m_icon.GetSerializedSize(); }
+};
+
+/** Reading an icon file
+ */
+class IconReadCase: public BenchCase {
+private:
+	PS2Icon m_icon;
+	std::string m_file;
+	size_t m_size;
+public:
+	explicit IconReadCase(std::string const& file): m_file(file), m_size(::GetFileSize(file)) {}
+	void Run() { m_icon.Load(m_file.c_str()); bench_sink += m_icon.GetNVertices(); }
+	size_t GetBytes() const { return m_size; }
+};
+
+/** Parsing an OBJ file
+ */
+class OBJReadCase: public BenchCase {
+private:
+	OBJ_FileLoader m_loader;
+	std::string m_file;
+	OBJ_Mesh::STORAGE m_storage;
+	size_t m_size;
+public:
+	OBJReadCase(std::string const& file, OBJ_Mesh::STORAGE storage)
+		:m_file(file), m_storage(storage), m_size(::GetFileSize(file)) {}
+	void Run() { m_loader.Load(m_file.c_str(), m_storage); bench_sink += m_loader.GetNMeshes(); }
+	size_t GetBytes() const { return m_size; }
+};
+
+/** Writing an OBJ file
+ */
+class OBJWriteCase: public BenchCase {
+private:
+	OBJ_FileLoader const& m_loader;
+	std::string m_file;
+	size_t m_size;
+public:
+	OBJWriteCase(OBJ_FileLoader const& loader, std::string const& file, size_t size)
+		:m_loader(loader), m_file(file), m_size(size) {}
+	void Run() { m_loader.WriteFile(m_file.c_str()); }
+	size_t GetBytes() const { return m_size; }
+};
+
+/** Converting an OBJ mesh to unindexed triangles
+ */
+class UnindexedCase: public BenchCase {
+private:
+	OBJ_Mesh const& m_mesh;
+	std::vector<float> m_geometry, m_normals, m_texture;
+public:
+	explicit UnindexedCase(OBJ_Mesh const& mesh)
+		:m_mesh(mesh), m_geometry(mesh.GetNFaces() * 9), m_normals(mesh.GetNFaces() * 9), m_texture(mesh.GetNFaces() * 9) {}
+	void Run() {
+		m_mesh.GetMeshGeometryUnindexed(&m_geometry[0], &m_normals[0], &m_texture[0], 1.0f);
+		bench_sink += static_cast<unsigned int>(m_geometry[0]);
+	}
+	size_t GetBytes() const { return 3 * m_geometry.size() * sizeof(float); }
+};
+
+/** Loading an image and converting it to 32 bit
+ */
+class ImageLoadCase: public BenchCase {
+private:
+	GhulbusUtil::gbImageLoader m_loader;
+	GhulbusUtil::gbImageLoader::gbImageType* m_type;
+	std::string m_file;
+	bool m_map;
+	size_t m_size;
+	std::vector<unsigned int> m_pixels;
+public:
+	ImageLoadCase(std::string const& file, GhulbusUtil::gbImageLoader::gbImageType* type, bool map)
+		:m_type(type), m_file(file), m_map(map), m_size(::GetFileSize(file)) {}
+	void Run() {
+		if(m_map) {
+			m_loader.Map(m_file.c_str(), m_type, GhulbusUtil::gbImageLoader::ROWS_BOTTOM_UP);
+		} else {
+			m_loader.Load(m_file.c_str(), m_type, GhulbusUtil::gbImageLoader::ROWS_BOTTOM_UP);
+		}
+		m_pixels.resize(static_cast<size_t>(m_loader.GetWidth()) * m_loader.GetHeight());
+		m_loader.GetImageData32(&m_pixels[0]);
+		bench_sink += m_pixels[0];
+	}
+	size_t GetBytes() const { return m_size; }
+};
+
+/** Number of titles converted per iteration of the title benchmarks
+ */
+static int const N_TITLES = 1000;
+
+/** Decoding icon.sys files from memory
+ */
+class IconSysDecodeCase: public BenchCase {
+private:
+	std::vector<unsigned char> m_data;
+public:
+	IconSysDecodeCase() {
+		IconSys icon_sys;
+		icon_sys.SetTitle("Benchmark Save Data 0123456789");
+		icon_sys.SetLinebreak(10);
+		unsigned char const* p = static_cast<unsigned char const*>(icon_sys.GetFileData());
+		m_data.assign(p, p + IconSys::GetFileSize());
+	}
+	void Run() {
+		for(int i=0; i<N_TITLES; i++) {
+			IconSys icon_sys(&m_data[0], m_data.size());
+			bench_sink += icon_sys.GetTitle()[0];
+		}
+	}
+	size_t GetBytes() const { return N_TITLES * IconSys::GetHeaderSize(); }
+};
+
+/** Setting the title of an icon.sys file
+ */
+class IconSysEncodeCase: public BenchCase {
+private:
+	IconSys m_iconSys;
+public:
+	void Run() {
+		for(int i=0; i<N_TITLES; i++) {
+			m_iconSys.SetTitle((i & 1) ? "Benchmark Save Data 0123456789" : "Another Title (Slot 2)");
+			bench_sink += m_iconSys.GetTitle()[0];
+		}
+	}
+	size_t GetBytes() const { return N_TITLES * static_cast<size_t>(PS2TitleCodec::TITLE_BYTES); }
+};
+
+/** Raw title conversion
+ */
+class TitleCodecCase: public BenchCase {
+private:
+	bool m_encode;
+	char m_ascii[PS2TitleCodec::TITLE_CHARS + 1];
+	unsigned char m_sjis[PS2TitleCodec::TITLE_BYTES];
+public:
+	explicit TitleCodecCase(bool encode): m_encode(encode) {
+		strcpy(m_ascii, "Benchmark Save Data 0123456789!?");
+		PS2TitleCodec::Encode(m_ascii, m_sjis);
+	}
+	void Run() {
+		for(int i=0; i<N_TITLES; i++) {
+			if(m_encode) {
+				bench_sink += PS2TitleCodec::Encode(m_ascii, m_sjis);
+			} else {
+				bench_sink += PS2TitleCodec::Decode(m_sjis, m_ascii);
+			}
+		}
+	}
+	size_t GetBytes() const { return N_TITLES * static_cast<size_t>(PS2TitleCodec::TITLE_BYTES); }
+};
+
+/** Run the icon benchmarks for one mesh size
+ */
+void RunIconBenchmarks(int n_faces)
+{
+	PS2Icon icon;
+	GenerateIcon(icon, n_faces);
+	std::string const file = GetWorkFile("icon");
+	PS2Icon::TextureEncoding_T const encodings[2] = { PS2Icon::TEXTURE_UNCOMPRESSED, PS2Icon::TEXTURE_RLE };
+	char const* const write_names[2] = { "ps2icon_write_uncompressed", "ps2icon_write_rle" };
+	char const* const read_names[2]  = { "ps2icon_read_uncompressed", "ps2icon_read_rle" };
+	for(int i=0; i<2; i++) {
+		icon.SetTextureEncoding(encodings[i]);
+		IconWriteCase write_case(icon, file);
+		Measure(write_names[i], n_faces, write_case);
+		if(strstr(read_names[i], options.filter.c_str()) != NULL) {
+			icon.WriteFile(file.c_str());
+			IconReadCase read_case(file);
+			Measure(read_names[i], n_faces, read_case);
+		}
+	}
+	remove(file.c_str());
+}
+
+/** Run the OBJ benchmarks for one mesh size
+ */
+void RunOBJBenchmarks(int n_faces)
+{
+	std::string const in_file  = GetWorkFile("in_obj");
+	std::string const out_file = GetWorkFile("out_obj");
+	{
+		std::ofstream fout(in_file.c_str(), std::ios_base::out | std::ios_base::binary);
+		GenerateOBJ(fout, n_faces);
+	}
+	{
+		OBJReadCase read_double(in_file, OBJ_AttributeArray::STORAGE_DOUBLE);
+		Measure("obj_read_double", n_faces, read_double);
+		OBJReadCase read_fixed(in_file, OBJ_AttributeArray::STORAGE_FIXED16);
+		Measure("obj_read_fixed16", n_faces, read_fixed);
+	}
+	OBJ_FileLoader loader;
+	loader.Load(in_file.c_str(), OBJ_AttributeArray::STORAGE_FLOAT);
+	OBJWriteCase write_case(loader, out_file, ::GetFileSize(in_file));
+	Measure("obj_write", n_faces, write_case);
+	UnindexedCase unindexed_case(*loader.GetMesh(0));
+	Measure("obj_unindexed", n_faces, unindexed_case);
+	remove(in_file.c_str());
+	remove(out_file.c_str());
+}
+
+/** Run the image benchmarks for one image size
+ */
+void RunImageBenchmarks(int width)
+{
+	static int const bmp_bpp[] = { 1, 4, 8, 24, 32 };
+	static int const tga_bpp[] = { 16, 24, 32 };
+	GhulbusUtil::gbImageType_BMP_T bmp_type;
+	GhulbusUtil::gbImageType_TGA_T tga_type;
+	std::string const file = GetWorkFile("image");
+	std::vector<unsigned char> data;
+	char name[64];
+	for(size_t i=0; i<sizeof(bmp_bpp)/sizeof(bmp_bpp[0]); i++) {
+		GenerateBMP(data, width, width, bmp_bpp[i]);
+		WriteWholeFile(file, data);
+		sprintf(name, "image_bmp%d_load", bmp_bpp[i]);
+		ImageLoadCase load_case(file, &bmp_type, false);
+		Measure(name, width, load_case);
+		sprintf(name, "image_bmp%d_map", bmp_bpp[i]);
+		ImageLoadCase map_case(file, &bmp_type, true);
+		Measure(name, width, map_case);
+	}
+	for(size_t i=0; i<sizeof(tga_bpp)/sizeof(tga_bpp[0]); i++) {
+		for(int rle=0; rle<2; rle++) {
+			GenerateTGA(data, width, width, tga_bpp[i], (rle != 0));
+			WriteWholeFile(file, data);
+			sprintf(name, "image_tga%d%s_load", tga_bpp[i], rle ? "_rle" : "");
+			ImageLoadCase load_case(file, &tga_type, false);
+			Measure(name, width, load_case);
+			sprintf(name, "image_tga%d%s_map", tga_bpp[i], rle ? "_rle" : "");
+			ImageLoadCase map_case(file, &tga_type, true);
+			Measure(name, width, map_case);
+		}
+	}
+	remove(file.c_str());
+}
+
+/** Run the icon.sys benchmarks
+ */
+void RunIconSysBenchmarks()
+{
+	IconSysDecodeCase decode_case;
+	Measure("iconsys_decode", N_TITLES, decode_case);
+	IconSysEncodeCase encode_case;
+	Measure("iconsys_encode", N_TITLES, encode_case);
+	TitleCodecCase title_decode(false);
+	Measure("title_decode", N_TITLES, title_decode);
+	TitleCodecCase title_encode(true);
+	Measure("title_encode", N_TITLES, title_encode);
+}
+
+/** Write the results
+ * @param[out] os Destination stream
+ */
+void PrintResults(std::ostream& os)
+{
+	char line[512];
+	if(options.json) {
+		os << "{\n  \"format\": \"ps2icon_bench/1\",\n  \"results\": [\n";
+	} else {
+		os << "benchmark,param,iterations,min_ns,median_ns,bytes,mb_per_s\n";
+	}
+	for(size_t i=0; i<results.size(); i++) {
+		BenchResult const& r = results[i];
+		double const mb_per_s = (r.median_ns > 0.0) ? (r.bytes / (r.median_ns * 1e-9) / (1024.0 * 1024.0)) : 0.0;
+		if(options.json) {
+			sprintf(line, "    {\"benchmark\": \"%s\", \"param\": %d, \"iterations\": %d, \"min_ns\": %.0f, "
+			              "\"median_ns\": %.0f, \"bytes\": %lu, \"mb_per_s\": %.2f}%s\n",
+			        r.name.c_str(), r.param, r.iterations, r.min_ns, r.median_ns,
+			        static_cast<unsigned long>(r.bytes), mb_per_s, (i + 1 < results.size()) ? "," : "");
+		} else {
+			sprintf(line, "%s,%d,%d,%.0f,%.0f,%lu,%.2f\n", r.name.c_str(), r.param, r.iterations,
+			        r.min_ns, r.median_ns, static_cast<unsigned long>(r.bytes), mb_per_s);
+		}
+		os << line;
+	}
+	if(options.json) {
+		os << "  ]\n}\n";
+	}
+}
+
+/** Print a help text on screen
+ * @param[in] self Name of the executable (e.g. obtained from argv[0])
+ */
+void PrintHelp(char* self)
+{
+	std::cout << " Usage: " << self << " [OPTION]..."                                         << "\n"
+			  << "Measure the file formats and conversion steps of the PS2 IconSys library."   << "\n"
+			  << "\n"
+			  << "  -h, --help           display this help"                                     << "\n"
+			  << "  -q, --quick          Small inputs and short measurements"                   << "\n"
+			  << "      --json           Write results as JSON instead of CSV"                  << "\n"
+			  << "  -o, --output-file    Write results to a file instead of the screen"         << "\n"
+			  << "      --filter         Only run benchmarks whose name contains this string"   << "\n"
+			  << "      --max-faces      Largest mesh measured; sizes grow from 1000 in steps"  << "\n"
+			  << "                       of 10 (default 100000)"                                << "\n"
+			  << "      --min-time       Minimum measuring time per benchmark in seconds"       << "\n"
+			  << "      --work-dir       Directory for temporary files (default: current)"      << "\n"
+			  << "      --generate-obj   Write a synthetic OBJ file with --faces triangles and exit" << "\n"
+			  << "      --generate-icon  Write a synthetic icon with --faces triangles and exit"  << "\n"
+			  << "      --faces          Number of triangles for --generate-obj/--generate-icon"  << "\n"
+			  << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	char const* generate_obj  = NULL;
+	char const* generate_icon = NULL;
+	int n_faces = 10000;
+	for(int i=1; i<argc; i++) {
+		if( (strcmp( argv[i], "-h" ) == 0) || (strcmp( argv[i], "--help" ) == 0) ) {
+			PrintHelp(argv[0]);
+			exit(0);
+		} else if( (strcmp( argv[i], "-q" ) == 0) || (strcmp( argv[i], "--quick" ) == 0) ) {
+			options.quick = true;
+		} else if( strcmp( argv[i], "--json" ) == 0 ) {
+			options.json = true;
+		} else if(i < argc-1) {
+			if( (strcmp( argv[i], "-o" ) == 0) || (strcmp( argv[i], "--output-file" ) == 0) ) {
+				options.output_file = argv[++i];
+			} else if( strcmp( argv[i], "--filter" ) == 0 ) {
+				options.filter = argv[++i];
+			} else if( strcmp( argv[i], "--max-faces" ) == 0 ) {
+				options.max_faces = atoi(argv[++i]);
+			} else if( strcmp( argv[i], "--min-time" ) == 0 ) {
+				options.min_time = atof(argv[++i]);
+			} else if( strcmp( argv[i], "--work-dir" ) == 0 ) {
+				options.work_dir = argv[++i];
+			} else if( strcmp( argv[i], "--generate-obj" ) == 0 ) {
+				generate_obj = argv[++i];
+			} else if( strcmp( argv[i], "--generate-icon" ) == 0 ) {
+				generate_icon = argv[++i];
+			} else if( strcmp( argv[i], "--faces" ) == 0 ) {
+				n_faces = atoi(argv[++i]);
+			} else {
+				std::cout << "Invalid argument." << std::endl << std::endl;
+				PrintHelp(argv[0]);
+				exit(1);
+			}
+		} else {
+			std::cout << "Invalid argument." << std::endl << std::endl;
+			PrintHelp(argv[0]);
+			exit(1);
+		}
+	}
+
+	try {
+		if(generate_obj || generate_icon) {
+			if(generate_obj) {
+				std::ofstream fout(generate_obj, std::ios_base::out | std::ios_base::binary);
+				int const n = GenerateOBJ(fout, n_faces);
+				fout.close();
+				if(fout.fail()) {
+					std::cout << "File write error: \"" << generate_obj << "\"" << std::endl;
+					exit(1);
+				}
+				std::cout << " * Wrote " << n << " triangles to \"" << generate_obj << "\"" << std::endl;
+			}
+			if(generate_icon) {
+				PS2Icon icon;
+				GenerateIcon(icon, n_faces);
+				icon.WriteFile(generate_icon);
+				std::cout << " * Wrote " << (icon.GetNVertices() / 3) << " triangles to \"" << generate_icon << "\"" << std::endl;
+			}
+			return 0;
+		}
+
+		if(options.quick) {
+			if(options.max_faces > 10000) { options.max_faces = 10000; }
+			options.min_time = std::min(options.min_time, 0.05);
+		}
+		RunIconSysBenchmarks();
+		for(int faces=1000; faces<=options.max_faces; faces*=10) {
+			RunOBJBenchmarks(faces);
+			RunIconBenchmarks(faces);
+		}
+		RunImageBenchmarks(128);
+		if(!options.quick) {
+			RunImageBenchmarks(1024);
+		}
+	} catch(Ghulbus::gbException& e) {
+		std::cout << "\nBenchmark failed: " << e.GetErrorString() << std::endl;
+		exit(1);
+	}
+
+	if(options.output_file) {
+		std::ofstream fout(options.output_file, std::ios_base::out);
+		PrintResults(fout);
+	} else {
+		PrintResults(std::cout);
+	}
+	return 0;
+}
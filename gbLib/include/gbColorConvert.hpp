@@ -0,0 +1,73 @@
+/**
+ * @file include/gbColorConvert.hpp
+ *
+ * ghulbusUtil - A collection of useful stuff
+ *
+ * @brief gbUtil Block conversion of pixel data to 32 bit color
+ *
+ * @version 1.1
+ * @author Andreas Weis
+ *
+ */
+
+#ifndef _GHULBUSUTIL_COLORCONVERT_HPP_INCLUDE_GUARD_
+#define _GHULBUSUTIL_COLORCONVERT_HPP_INCLUDE_GUARD_
+
+#include <cstddef>
+
+#include "gbColor.hpp"
+
+namespace GhulbusUtil {
+	/** Instruction sets used by the color conversion functions
+	 */
+	enum gbColorConvertISA_T {
+		GB_ISA_SCALAR = 0,				///< plain C++
+		GB_ISA_SSE2,					///< x86 SSE2
+		GB_ISA_SSSE3,					///< x86 SSSE3 (byte shuffles)
+		GB_ISA_AVX2,					///< x86 AVX2 (256 bit integer operations and gathers)
+		GB_ISA_NEON						///< ARM NEON
+	};
+
+	/** Get the instruction set used by the color conversion functions
+	 * @return The best instruction set supported by both the build and the processor,
+	 *         unless lowered by SetColorConvertISA()
+	 */
+	gbColorConvertISA_T GetColorConvertISA();
+	/** Restrict the instruction set used by the color conversion functions
+	 * @param[in] isa The instruction set to use; if the processor does not support it,
+	 *                the best supported one is used instead.
+	 * @note The results do not depend on the instruction set; this is meant for benchmarks.
+	 *       Must not be called while conversions are running on other threads.
+	 */
+	void SetColorConvertISA(gbColorConvertISA_T isa);
+
+	/** Convert 24 bit pixels to 32 bit color
+	 * @param[in] src A field of (n*3) bytes holding blue, green and red per pixel
+	 * @param[out] dst A field of at least size n; alpha is set to 0xff
+	 * @param[in] n Number of pixels
+	 */
+	void ConvertBGR24ToARGB32(unsigned char const* src, GhulbusGraphics::GBCOLOR* dst, size_t n);
+	/** Convert 32 bit pixels to 32 bit color
+	 * @param[in] src A field of (n*4) bytes holding blue, green, red and alpha per pixel
+	 * @param[out] dst A field of at least size n
+	 * @param[in] n Number of pixels
+	 */
+	void ConvertBGRA32ToARGB32(unsigned char const* src, GhulbusGraphics::GBCOLOR* dst, size_t n);
+	/** Convert 16 bit pixels to 32 bit color
+	 * @param[in] src A field of (n*2) bytes holding one little endian @c ARRRRRGGGGGBBBBB value per pixel
+	 * @param[out] dst A field of at least size n; each channel is multiplied by 8, alpha is set to 0xff
+	 * @param[in] n Number of pixels
+	 * @note The alpha bit is ignored.
+	 */
+	void ConvertRGB555ToARGB32(unsigned char const* src, GhulbusGraphics::GBCOLOR* dst, size_t n);
+	/** Convert palette indices to 32 bit color
+	 * @param[in] src A field of n bytes holding one palette index per pixel
+	 * @param[in] palette The palette; must have an entry for every index appearing in src
+	 * @param[out] dst A field of at least size n
+	 * @param[in] n Number of pixels
+	 */
+	void ConvertPaletteToARGB32(unsigned char const* src, GhulbusGraphics::GBCOLOR const* palette,
+	                            GhulbusGraphics::GBCOLOR* dst, size_t n);
+};
+
+#endif
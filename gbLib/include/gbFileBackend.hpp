@@ -0,0 +1,171 @@
+/**
+ * @file include/gbFileBackend.hpp
+ *
+ * ghulbusUtil - A collection of useful stuff
+ *
+ * @brief gbUtil Pluggable file access for the loaders
+ *
+ * @version 1.1
+ * @author Andreas Weis
+ *
+ */
+
+#ifndef _GHULBUSUTIL_FILEBACKEND_HPP_INCLUDE_GUARD_
+#define _GHULBUSUTIL_FILEBACKEND_HPP_INCLUDE_GUARD_
+
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gbException.hpp"
+#include "gbMappedFile.hpp"
+#include "gbThreadPool.hpp"
+
+namespace GhulbusUtil {
+	/** Interface for reading and writing complete files
+	 * All loaders read their files with gbMappedFile::Open() and write them with a single
+	 * call to WriteFile() of the current backend, so replacing the backend changes how
+	 * files are accessed throughout the program.
+	 * @note Implementations must allow calls from multiple threads at once.
+	 */
+	class gbFileBackend {
+	public:
+		/** Destructor
+		 */
+		virtual ~gbFileBackend();
+		/** Open a file for reading
+		 * @param[in] fname Full path to the file
+		 * @param[out] file Receives the contents of the file
+		 * @throw Ghulbus::gbException GB_FAILED indicates a file access error
+		 * @throw std::bad_alloc
+		 */
+		virtual void OpenFile(char const* fname, gbMappedFile& file)=0;
+		/** Write a complete file, replacing an existing file of the same name
+		 * @param[in] fname Full path to the file
+		 * @param[in] data A field of size bytes
+		 * @param[in] size Size of the file in bytes
+		 * @throw Ghulbus::gbException GB_FAILED indicates a file access error
+		 * @throw std::bad_alloc
+		 */
+		virtual void WriteFile(char const* fname, void const* data, size_t size)=0;
+		/** Announce that a file will be opened soon
+		 * @param[in] fname Full path to the file
+		 * @note The default implementation does nothing.
+		 * @throw std::bad_alloc
+		 */
+		virtual void Prefetch(char const* fname);
+		/** Wait until all files passed to WriteFile() are written
+		 * @note The default implementation does nothing.
+		 * @throw Ghulbus::gbException GB_FAILED indicates that a write failed
+		 */
+		virtual void Flush();
+	};
+
+	/** Accesses files directly from the calling thread
+	 * Files are mapped into memory for reading; this is the default backend.
+	 */
+	class gbDirectFileBackend: public gbFileBackend {
+	public:
+		void OpenFile(char const* fname, gbMappedFile& file);
+		void WriteFile(char const* fname, void const* data, size_t size);
+	};
+
+	/** Reads files ahead and writes files behind on a set of I/O threads
+	 * Files announced with Prefetch() are read in the order of the calls, at most a fixed
+	 * number ahead of the furthest one that was opened so far. WriteFile() copies the data
+	 * and returns immediately; the write fails only in Flush(). Opening a file waits for
+	 * pending writes to it, so a program sees the same contents as with direct access.
+	 * Files that were not announced, or whose read failed, are opened directly.
+	 */
+	class gbPrefetchFileBackend: public gbFileBackend {
+	private:
+		/** A file announced with Prefetch()
+		 */
+		struct ReadEntry {
+			enum State_T { QUEUED, READING, DONE, INVALID };
+			std::string name;						///< path to the file
+			State_T state;							///< progress of the read
+			std::vector<unsigned char> data;		///< file contents once DONE
+		};
+		/** A file passed to WriteFile()
+		 */
+		struct WriteEntry {
+			std::string name;						///< path to the file
+			std::vector<unsigned char> data;		///< file contents
+			bool writing;							///< set while an I/O thread writes the file
+		};
+		int m_nAhead;								///< number of files read ahead
+		std::deque<ReadEntry> m_reads;				///< all announced files, in order of Prefetch()
+		std::map<std::string, size_t> m_readIndex;	///< entry of every announced file that is still usable
+		size_t m_nextRead;							///< first entry of m_reads not handed to an I/O thread
+		size_t m_nextEvict;							///< first entry of m_reads whose data may still be held
+		size_t m_openedEnd;							///< one past the furthest entry that was opened
+		std::list<WriteEntry> m_writes;				///< pending writes, in order of WriteFile()
+		std::vector<std::string> m_failedWrites;	///< files that could not be written
+		bool m_shutdown;							///< set by the destructor to stop the I/O threads
+		gbMutex m_mutex;							///< protects all of the above
+		gbCondition m_work;							///< signaled when there is new work for the I/O threads
+		gbCondition m_done;							///< signaled when a read or write completes
+		std::vector<gbThread*> m_threads;			///< the I/O threads
+	public:
+		/** Constructor
+		 * @param[in] n_ahead Number of files read ahead, also the limit for pending writes;
+		 *                    should be at least the number of threads opening files
+		 * @param[in] n_threads Number of I/O threads
+		 * @throw Ghulbus::gbException GB_ILLEGALPARAMETER indicates n_ahead or n_threads < 1;
+		 *                             GB_FAILED indicates that no I/O thread could be created
+		 * @throw std::bad_alloc
+		 */
+		gbPrefetchFileBackend(int n_ahead, int n_threads);
+		/** Destructor
+		 * @note Waits for all pending writes; failures are discarded unless Flush() is called first
+		 */
+		~gbPrefetchFileBackend();
+		void OpenFile(char const* fname, gbMappedFile& file);
+		void WriteFile(char const* fname, void const* data, size_t size);
+		void Prefetch(char const* fname);
+		/** @copydoc gbFileBackend::Flush()
+		 * @note GetFailedWrites() lists the files that could not be written.
+		 */
+		void Flush();
+		/** Get the files that could not be written since the last call
+		 * @param[out] files Receives the paths to the files
+		 */
+		void GetFailedWrites(std::vector<std::string>& files);
+	private:
+		/** Internal helper function: entry point of the I/O threads
+		 */
+		static void IOThread(void* user);
+		/** Internal helper function: processes reads and writes until shutdown
+		 */
+		void ProcessIO();
+		/** Internal helper function: finishes all pending writes and stops the I/O threads
+		 */
+		void StopThreads();
+		/** Internal helper function: releases the data of entries that fell out of the window
+		 * @note Must be called with m_mutex locked
+		 */
+		void Evict();
+		/** Internal helper function: checks for a pending write to a file
+		 * @note Must be called with m_mutex locked
+		 */
+		bool IsWritePending(std::string const& name) const;
+		gbPrefetchFileBackend(gbPrefetchFileBackend const&);				///< private copy constructor (not implemented!)
+		gbPrefetchFileBackend& operator=(gbPrefetchFileBackend const&);	///< private copy assignment (not implemented!)
+	};
+
+	/** Get the current file backend
+	 * @return The backend set with SetFileBackend(), or a gbDirectFileBackend
+	 */
+	gbFileBackend& GetFileBackend();
+	/** Replace the file backend
+	 * @param[in] backend The new backend, or NULL to restore direct access; must stay valid until replaced
+	 * @note Must not be called while files are accessed from other threads.
+	 */
+	void SetFileBackend(gbFileBackend* backend);
+};
+
+#endif
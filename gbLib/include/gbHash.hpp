@@ -0,0 +1,60 @@
+/**
+ * @file include/gbHash.hpp
+ *
+ * ghulbusUtil - A collection of useful stuff
+ *
+ * @brief gbUtil Fast non-cryptographic hashing
+ *
+ * @version 1.1
+ * @author Andreas Weis
+ *
+ */
+
+#ifndef _GHULBUSUTIL_HASH_HPP_INCLUDE_GUARD_
+#define _GHULBUSUTIL_HASH_HPP_INCLUDE_GUARD_
+
+#include <cstddef>
+
+namespace GhulbusUtil {
+	/** Incremental computation of the 64 bit xxHash (XXH64)
+	 * Feeding data in several Update() calls gives the same digest as a single call
+	 * over the concatenated data. The digest is independent of the byte order of the host.
+	 * @note Not suitable where collisions may be provoked on purpose.
+	 */
+	class gbHash64 {
+	private:
+		unsigned long long m_acc[4];			///< Accumulators for the 32 byte stripes
+		unsigned long long m_seed;				///< Seed of the current hash
+		unsigned long long m_totalSize;			///< Number of bytes hashed so far
+		unsigned char m_buffer[32];				///< Incomplete stripe
+		size_t m_bufferSize;					///< Number of bytes in m_buffer
+	public:
+		/** Constructor
+		 * @param[in] seed Seed value
+		 */
+		explicit gbHash64(unsigned long long seed = 0);
+		/** Start a new hash
+		 * @param[in] seed Seed value
+		 */
+		void Reset(unsigned long long seed = 0);
+		/** Add data to the hash
+		 * @param[in] data A field of size bytes
+		 * @param[in] size Number of bytes to hash
+		 */
+		void Update(void const* data, size_t size);
+		/** Get the hash of all data added since the last Reset()
+		 * @return The digest; further data may still be added afterwards
+		 */
+		unsigned long long GetDigest() const;
+	};
+
+	/** Hash a block of memory with XXH64
+	 * @param[in] data A field of size bytes
+	 * @param[in] size Number of bytes to hash
+	 * @param[in] seed Seed value
+	 * @return The digest
+	 */
+	unsigned long long gbHashXXH64(void const* data, size_t size, unsigned long long seed = 0);
+};
+
+#endif
@@ -13,14 +13,56 @@
 #ifndef _GHULBUSUTIL_IMAGELOADER_HPP_INCLUDE_GUARD_
 #define _GHULBUSUTIL_IMAGELOADER_HPP_INCLUDE_GUARD_
 
+#include <cstddef>
 #include <fstream>
+#include <vector>
 
 #include "gbException.hpp"
 #include "gbColor.hpp"
+#include "gbMappedFile.hpp"
 
 /** Root namespace of the ghulbusUtil Library
  */
 namespace GhulbusUtil {
+	/** Pixel layouts of a gbImageView
+	 */
+	enum gbPixelFormat_T {
+		GB_PIXEL_INDEX8,				///< one byte palette index per pixel
+		GB_PIXEL_RGB555,				///< 16 bit little endian @c ARRRRRGGGGGBBBBB; the alpha bit is ignored
+		GB_PIXEL_BGR24,					///< blue, green, red; alpha is 0xff
+		GB_PIXEL_BGRX32,				///< blue, green, red, unused byte; alpha is 0
+		GB_PIXEL_BGRA32					///< blue, green, red, alpha
+	};
+
+	/** Read-only view of the pixels of an image
+	 * @note The view does not own the pixels; it is valid as long as the object it was obtained from.
+	 */
+	struct gbImageView {
+		unsigned char const* data;		///< first pixel of the first row
+		ptrdiff_t pitch;				///< distance between rows in bytes; negative if rows are reversed in memory
+		int width;						///< image width in pixels
+		int height;						///< image height in pixels
+		gbPixelFormat_T format;			///< layout of the pixels
+		unsigned int const* palette;	///< palette for GB_PIXEL_INDEX8 (NULL otherwise)
+		/** Constructor
+		 * @note Constructs an empty view
+		 */
+		gbImageView();
+		/** Get a row of the image
+		 * @param[in] row Index of the row
+		 * @return Pointer to the first pixel of the row
+		 */
+		unsigned char const* GetRow(int row) const { return data + row * pitch; }
+	};
+
+	/** Convert a row of an image view to 32 bit color
+	 * @param[in] view The image
+	 * @param[in] row Index of the row
+	 * @param[out] pData A field of at least size view.width
+	 * @throw Ghulbus::gbException GB_ILLEGALPARAMETER indicates an invalid row
+	 */
+	void GetRowData32(gbImageView const& view, int row, GhulbusGraphics::GBCOLOR* pData);
+
 	/** Used for loading image files
 	*/
 	class gbImageLoader {
@@ -30,43 +72,104 @@ namespace GhulbusUtil {
 		class gbImageType {
 		public:
 			/** Read image data from file
-			 * @param[in] file           An open filestream to the image file
+			 * @param[in] file           An open stream to the image file
 			 * @param[out] width         The image's width in pixels
 			 * @param[out] height        The image's height in pixels
 			 * @param[out] bpp           Bits per pixel
 			 * @param[in,out] pp_data    A field containing the image data; Memory will be allocated by ReadFile() itself! 
 			 * @param[in,out] pp_palette A field containing palette data; Memory will be allocated by ReadFile() itself! 
+			 * @param[in] bottom_up      If true, the first row in pp_data is the bottom row of the image;
+			 *                           otherwise it is the top row. Rows are stored in this order while
+			 *                           reading, so no flipping is required afterwards.
 			 * @throw std::bad_alloc
 			 */
-			virtual void ReadFile(std::ifstream& file, int* width, int* height, int* bpp, 
-								unsigned char** pp_data, unsigned int** pp_palette)=0;
+			virtual void ReadFile(std::istream& file, int* width, int* height, int* bpp, 
+								unsigned char** pp_data, unsigned int** pp_palette, bool bottom_up)=0;
 			/** Check if the file is of a specific image type
-			 * @param[in] file An open filestream to the image file
+			 * @param[in] file An open stream to the image file
 			 * @return True if the file can be read using the current image type, false otherwise 
 			 */
-			virtual bool CheckFile(std::ifstream const& file)=0;
+			virtual bool CheckFile(std::istream const& file)=0;
+			/** Locate the pixels of an image file held in memory, so they can be used in place
+			 * @param[in] file_data      The complete image file
+			 * @param[in] file_size      Size of the field file_data in bytes
+			 * @param[in] bottom_up      Requested row order of the view (see ReadFile())
+			 * @param[out] view          Receives the pixels; points into file_data
+			 * @param[out] bpp           Bits per pixel
+			 * @return True on success; false if the image must be decoded with ReadFile(),
+			 *         e.g. because it is compressed or palettized
+			 * @note The default implementation always returns false.
+			 */
+			virtual bool MapFile(unsigned char const* file_data, size_t file_size, bool bottom_up,
+			                     gbImageView* view, int* bpp);
 			/** Destructor
 			 */
 			virtual ~gbImageType();
 		};
+		/** Order of the rows in the image data
+		 */
+		enum RowOrder_T {
+			ROWS_TOP_DOWN,				///< first row is the top row of the image
+			ROWS_BOTTOM_UP				///< first row is the bottom row of the image
+		};
 	private:
 		unsigned char* m_data;			///< Pointer to image data
 		unsigned int* m_palette;		///< Pointer to color palette
 		int m_width;					///< Image width (pixels)
 		int m_height;					///< Image height (pixels)
 		int m_bpp;						///< Bits per pixel
+		gbMappedFile m_file;			///< the image file, if mapped (see Map())
+		gbImageView m_view;				///< the pixels, either in m_data or in m_file
 	public:
+		/** Constructor
+		 * @note Constructs an empty image; use Load() to read an image file
+		 */
+		gbImageLoader();
 		/** Constructor
 		 * @param[in] fname Full path to the image file that is to be loaded
 		 * @param[in,out] img_type The image type loading strategy, specified as gbImageType object;
+		 * @param[in] order Order of the rows in the image data
 		 * @throw Ghulbus::gbException GB_FAILED usually indicates a file read error; 
 		 *                             GB_NOTIMPLEMENTED;
 		 * @throw std::bad_alloc
 		 */
-		gbImageLoader(char const* fname, gbImageType* img_type);
+		gbImageLoader(char const* fname, gbImageType* img_type, RowOrder_T order = ROWS_TOP_DOWN);
 		/** Destructor
 		 */
 		~gbImageLoader();
+		/** Replace the current image with the contents of an image file
+		 * @param[in] fname Full path to the image file that is to be loaded
+		 * @param[in,out] img_type The image type loading strategy, specified as gbImageType object;
+		 * @param[in] order Order of the rows in the image data
+		 * @throw Ghulbus::gbException GB_FAILED usually indicates a file read error; 
+		 *                             GB_NOTIMPLEMENTED;
+		 * @throw std::bad_alloc
+		 */
+		void Load(char const* fname, gbImageType* img_type, RowOrder_T order = ROWS_TOP_DOWN);
+		/** Replace the current image with an image file held in memory
+		 * @param[in] data The complete image file; it is not referenced after the call
+		 * @param[in] size Size of the field data in bytes
+		 * @param[in,out] img_type The image type loading strategy, specified as gbImageType object;
+		 * @param[in] order Order of the rows in the image data
+		 * @throw Ghulbus::gbException GB_FAILED usually indicates a corrupted file;
+		 *                             GB_NOTIMPLEMENTED;
+		 * @throw std::bad_alloc
+		 */
+		void Load(void const* data, size_t size, gbImageType* img_type, RowOrder_T order = ROWS_TOP_DOWN);
+		/** Replace the current image with the contents of an image file, avoiding copies where possible
+		 * Uncompressed images with a pixel layout listed in gbPixelFormat_T are accessed directly
+		 * in a memory mapping of the file; all other images are decoded as by Load().
+		 * @param[in] fname Full path to the image file that is to be loaded
+		 * @param[in,out] img_type The image type loading strategy, specified as gbImageType object;
+		 * @param[in] order Order of the rows in the image data
+		 * @throw Ghulbus::gbException GB_FAILED usually indicates a file read error; 
+		 *                             GB_NOTIMPLEMENTED;
+		 * @throw std::bad_alloc
+		 */
+		void Map(char const* fname, gbImageType* img_type, RowOrder_T order = ROWS_TOP_DOWN);
+		/** Release the current image
+		 */
+		void Clear();
 		/** Get the image's width
 		 * @return Image width in pixels
 		 */
@@ -83,8 +186,17 @@ namespace GhulbusUtil {
 		 * @return True if a palette is present, false otherwise
 		 */
 		bool HasPalette() const;
+		/** Check whether the pixels are read directly from the image file
+		 * @return True if the image was mapped by Map(), false if it was decoded
+		 */
+		bool IsMapped() const;
+		/** Get the pixels without copying
+		 * @return View of the image data; valid until the image is released or replaced
+		 */
+		gbImageView const& GetView() const;
 		/** Get the image data as read from the file
-		 * @param[out] pData A field of at least size width*height*bpp
+		 * @param[out] pData A field of at least size width*height*(bytes per pixel);
+		 *                   images with less than 8 bits per pixel use one byte per pixel
 		 */
 		void GetImageData(unsigned char* pData) const;
 		/** Get the image data in unmapped GBCOLORs
@@ -92,14 +204,33 @@ namespace GhulbusUtil {
 		 * @throw Ghulbus::gbException GB_FAILED indicates an unexpected color depth
 		 */
 		void GetImageData32(GhulbusGraphics::GBCOLOR* pData) const;
+		/** Get a single row of the image data in unmapped GBCOLORs
+		 * @param[in] row Index of the row, in the row order the image was loaded with
+		 * @param[out] pData A field of at least size width
+		 * @throw Ghulbus::gbException GB_FAILED indicates an unexpected color depth;
+		 *                             GB_ILLEGALPARAMETER indicates an invalid row
+		 */
+		void GetRowData32(int row, GhulbusGraphics::GBCOLOR* pData) const;
 		/** Get the palette data
 		 * @param[out] pPal A field of at least size (2^bpp)
 		 * @throw Ghulbus::gbException GB_FAILED indicates that no palette data is present
 		 */
 		void GetPaletteData(GhulbusGraphics::GBCOLOR* pPal) const;
 		/** Flips the image vertically
+		 * @note Prefer loading with the required RowOrder_T, which avoids the extra pass.
+		 *       Mapped images are flipped by reversing the view, without touching the pixels.
+		 * @throw std::bad_alloc
 		 */
 		void FlipV();
+	private:
+		/** Internal helper function: decodes an image file with img_type
+		 * @param[in,out] file An open stream to the image file
+		 * @param[in,out] img_type The image type loading strategy
+		 * @param[in] order Order of the rows in the image data
+		 * @throw Ghulbus::gbException GB_FAILED; GB_NOTIMPLEMENTED;
+		 * @throw std::bad_alloc
+		 */
+		void ReadStream(std::istream& file, gbImageType* img_type, RowOrder_T order);
 	};
 
 	/** Writes image data to a TGA image file
@@ -107,9 +238,35 @@ namespace GhulbusUtil {
 	 * @param[in] data Field containing the image data as 32bit ARGB
 	 * @param[in] width Image width in pixels
 	 * @param[in] height Image height in pixels
-	 * @throw Ghulbus::gbException GB_FAILED indicates a file access error
+	 * @param[in] bottom_up If true, the first row in data is the bottom row of the image
+	 * @param[in] rle If true, the image is written run length encoded (TGA image type 10)
+	 * @throw Ghulbus::gbException GB_FAILED indicates a file access error;
+	 *                             GB_ILLEGALPARAMETER indicates an image too large for TGA
+	 * @throw std::bad_alloc
+	 */
+	void WriteImage(char const* fname, GhulbusGraphics::GBCOLOR const* data, int width, int height,
+	                bool bottom_up = false, bool rle = false);
+	/** Writes image data to a TGA image in memory
+	 * @param[out] out Receives the complete TGA file; previous contents are replaced.
+	 *                 Reusing the same vector for several images avoids reallocations.
+	 * @param[in] data Field containing the image data as 32bit ARGB
+	 * @param[in] width Image width in pixels
+	 * @param[in] height Image height in pixels
+	 * @param[in] bottom_up If true, the first row in data is the bottom row of the image
+	 * @param[in] rle If true, the image is written run length encoded (TGA image type 10)
+	 * @throw Ghulbus::gbException GB_ILLEGALPARAMETER indicates an image too large for TGA
+	 * @throw std::bad_alloc
+	 */
+	void WriteImage(std::vector<unsigned char>& out, GhulbusGraphics::GBCOLOR const* data, int width, int height,
+	                bool bottom_up = false, bool rle = false);
+
+	/** Swap the rows of an image in place, turning it upside down
+	 * @param[in,out] data The image data
+	 * @param[in] pitch Size of a row in bytes
+	 * @param[in] height Number of rows
+	 * @throw std::bad_alloc
 	 */
-	void WriteImage(char const* fname, GhulbusGraphics::GBCOLOR const* data, int width, int height);
+	void FlipRows(unsigned char* data, int pitch, int height);
 
 	/** Get a loading strategy for BMP files; use in gbImageLoader
 	 * @remark This approach uses static objects and is therefore *not* thread-safe
@@ -119,9 +276,11 @@ namespace GhulbusUtil {
 	private:
 		unsigned int m_file_offset;			///< offset of file pointer (if multiple images are stored in the same file)
 	public:
-		void ReadFile(std::ifstream& file, int* width, int* height, int* bpp, 
-			unsigned char** pp_data, unsigned int** pp_palette);
-		bool CheckFile(std::ifstream const& file);
+		void ReadFile(std::istream& file, int* width, int* height, int* bpp, 
+			unsigned char** pp_data, unsigned int** pp_palette, bool bottom_up);
+		bool CheckFile(std::istream const& file);
+		bool MapFile(unsigned char const* file_data, size_t file_size, bool bottom_up,
+		             gbImageView* view, int* bpp);
 		gbImageType_BMP_T();
 		virtual ~gbImageType_BMP_T();
 	};
@@ -134,9 +293,11 @@ namespace GhulbusUtil {
 	private:
 		unsigned int m_file_offset;			///< offset of file pointer (if multiple images are stored in the same file)
 	public:
-		void ReadFile(std::ifstream& file, int* width, int* height, int* bpp, 
-			unsigned char** pp_data, unsigned int** pp_palette);
-		bool CheckFile(std::ifstream const& file);
+		void ReadFile(std::istream& file, int* width, int* height, int* bpp, 
+			unsigned char** pp_data, unsigned int** pp_palette, bool bottom_up);
+		bool CheckFile(std::istream const& file);
+		bool MapFile(unsigned char const* file_data, size_t file_size, bool bottom_up,
+		             gbImageView* view, int* bpp);
 		gbImageType_TGA_T();
 		virtual ~gbImageType_TGA_T();
 	};
@@ -0,0 +1,74 @@
+/**
+ * @file include/gbImageResample.hpp
+ *
+ * ghulbusUtil - A collection of useful stuff
+ *
+ * @brief gbUtil Image resampling
+ *
+ * @version 1.1
+ * @author Andreas Weis
+ *
+ */
+
+#ifndef _GHULBUSUTIL_IMAGERESAMPLE_HPP_INCLUDE_GUARD_
+#define _GHULBUSUTIL_IMAGERESAMPLE_HPP_INCLUDE_GUARD_
+
+#include "gbException.hpp"
+#include "gbColor.hpp"
+#include "gbImageLoader.hpp"
+
+namespace GhulbusUtil {
+	/** Reconstruction filters for ResampleImage()
+	 */
+	enum gbResampleFilter_T {
+		GB_RESAMPLE_BOX,				///< area average; exact for integer reduction factors
+		GB_RESAMPLE_BILINEAR,			///< triangle filter
+		GB_RESAMPLE_LANCZOS3			///< windowed sinc with 3 lobes; sharpest, may ring at hard edges
+	};
+
+	/** Resample an image to a different size
+	 * @param[in] src The image to resample; rows are converted to 32 bit one at a time,
+	 *                so no 32 bit copy of the whole source is made. Images opened with
+	 *                gbImageLoader::Map() are read straight from the file mapping.
+	 * @param[out] dst A field of size dst_width*dst_height receiving the image as 32bit ARGB,
+	 *                 with the same row order as src
+	 * @param[in] dst_width Width of the resampled image in pixels
+	 * @param[in] dst_height Height of the resampled image in pixels
+	 * @param[in] filter Reconstruction filter; when reducing, it is widened to the reduction factor
+	 * @param[in] gamma_correct If true, color channels are treated as sRGB and averaged in linear light
+	 * @throw Ghulbus::gbException GB_ILLEGALPARAMETER indicates an empty source or destination
+	 * @throw std::bad_alloc
+	 */
+	void ResampleImage(gbImageLoader const& src, GhulbusGraphics::GBCOLOR* dst, int dst_width, int dst_height,
+	                   gbResampleFilter_T filter = GB_RESAMPLE_BOX, bool gamma_correct = false);
+	/** Resample an image to a different size
+	 * @param[in] src The image to resample; rows are converted to 32 bit one at a time
+	 * @param[out] dst A field of size dst_width*dst_height receiving the image as 32bit ARGB,
+	 *                 with the same row order as src
+	 * @param[in] dst_width Width of the resampled image in pixels
+	 * @param[in] dst_height Height of the resampled image in pixels
+	 * @param[in] filter Reconstruction filter; when reducing, it is widened to the reduction factor
+	 * @param[in] gamma_correct If true, color channels are treated as sRGB and averaged in linear light
+	 * @throw Ghulbus::gbException GB_ILLEGALPARAMETER indicates an empty source or destination
+	 * @throw std::bad_alloc
+	 */
+	void ResampleImage(gbImageView const& src, GhulbusGraphics::GBCOLOR* dst, int dst_width, int dst_height,
+	                   gbResampleFilter_T filter = GB_RESAMPLE_BOX, bool gamma_correct = false);
+	/** Resample an image to a different size
+	 * @param[in] src Field of size src_width*src_height containing the image as 32bit ARGB
+	 * @param[in] src_width Width of the source image in pixels
+	 * @param[in] src_height Height of the source image in pixels
+	 * @param[out] dst A field of size dst_width*dst_height receiving the resampled image
+	 * @param[in] dst_width Width of the resampled image in pixels
+	 * @param[in] dst_height Height of the resampled image in pixels
+	 * @param[in] filter Reconstruction filter; when reducing, it is widened to the reduction factor
+	 * @param[in] gamma_correct If true, color channels are treated as sRGB and averaged in linear light
+	 * @throw Ghulbus::gbException GB_ILLEGALPARAMETER indicates an empty source or destination
+	 * @throw std::bad_alloc
+	 */
+	void ResampleImage(GhulbusGraphics::GBCOLOR const* src, int src_width, int src_height,
+	                   GhulbusGraphics::GBCOLOR* dst, int dst_width, int dst_height,
+	                   gbResampleFilter_T filter = GB_RESAMPLE_BOX, bool gamma_correct = false);
+};
+
+#endif
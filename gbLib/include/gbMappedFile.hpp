@@ -0,0 +1,126 @@
+/**
+ * @file include/gbMappedFile.hpp
+ *
+ * ghulbusUtil - A collection of useful stuff
+ *
+ * @brief gbUtil Memory mapped files and bounds-checked memory reading
+ *
+ * @version 1.1
+ * @author Andreas Weis
+ *
+ */
+
+#ifndef _GHULBUSUTIL_MAPPEDFILE_HPP_INCLUDE_GUARD_
+#define _GHULBUSUTIL_MAPPEDFILE_HPP_INCLUDE_GUARD_
+
+#include <cstddef>
+
+#include "gbException.hpp"
+
+namespace GhulbusUtil {
+	/** Read-only access to the complete contents of a file
+	 * The file is mapped into memory if the platform supports it;
+	 * otherwise its contents are read into a buffer with a single call.
+	 * Files are opened through the current gbFileBackend (see GetFileBackend()),
+	 * which may provide the contents from a buffer read ahead of time instead.
+	 */
+	class gbMappedFile {
+	private:
+		unsigned char const* m_data;	///< Pointer to the file contents
+		size_t m_size;					///< Size of the file in bytes
+		unsigned char* m_buffer;		///< Buffer holding the file contents if mapping failed
+		void* m_mapping;				///< Start of the mapped view (or NULL)
+#ifdef WIN32
+		void* m_hFile;					///< Win32 file handle
+		void* m_hMapping;				///< Win32 file mapping handle
+#endif
+	public:
+		/** Constructor
+		 * @note Constructs an empty object; use Open() to access a file
+		 */
+		gbMappedFile();
+		/** Constructor
+		 * @param[in] fname Full path to the file that is to be opened
+		 * @throw Ghulbus::gbException GB_FAILED indicates a file access error
+		 * @throw std::bad_alloc
+		 */
+		gbMappedFile(char const* fname);
+		/** Destructor
+		 */
+		~gbMappedFile();
+		/** Open a file through the current gbFileBackend, closing the currently opened file first
+		 * @param[in] fname Full path to the file that is to be opened
+		 * @throw Ghulbus::gbException GB_FAILED indicates a file access error
+		 * @throw std::bad_alloc
+		 */
+		void Open(char const* fname);
+		/** Open a file directly, bypassing the gbFileBackend; closes the currently opened file first
+		 * @param[in] fname Full path to the file that is to be opened
+		 * @throw Ghulbus::gbException GB_FAILED indicates a file access error
+		 * @throw std::bad_alloc
+		 */
+		void OpenDirect(char const* fname);
+		/** Take the contents from a buffer, closing the currently opened file first
+		 * @param[in] buffer A field of size bytes allocated with new[] (or NULL if size is 0);
+		 *                   the object takes ownership
+		 * @param[in] size Size of the buffer in bytes
+		 */
+		void Assign(unsigned char* buffer, size_t size);
+		/** Release the current file
+		 */
+		void Close();
+		/** Get the file contents
+		 * @return Pointer to the first byte of the file or NULL if the file is empty
+		 */
+		unsigned char const* GetData() const;
+		/** Get the size of the file
+		 * @return The size of the file in bytes
+		 */
+		size_t GetSize() const;
+	private:
+		gbMappedFile(gbMappedFile const&);				///< private copy constructor (not implemented!)
+		gbMappedFile& operator=(gbMappedFile const&);	///< private copy assignment (not implemented!)
+	};
+
+	/** Sequential, bounds-checked reading from a memory buffer
+	 */
+	class gbMemoryReader {
+	private:
+		unsigned char const* m_data;	///< Start of the buffer
+		size_t m_size;					///< Size of the buffer in bytes
+		size_t m_pos;					///< Current read position
+	public:
+		/** Constructor
+		 * @param[in] data Pointer to the buffer; must stay valid for the lifetime of the reader
+		 * @param[in] size Size of the buffer in bytes
+		 */
+		gbMemoryReader(void const* data, size_t size);
+		/** Copy data from the buffer and advance the read position
+		 * @param[out] dst A field of at least size n
+		 * @param[in] n Number of bytes to read
+		 * @throw Ghulbus::gbException GB_FAILED indicates a read beyond the end of the buffer
+		 */
+		void Read(void* dst, size_t n);
+		/** Advance the read position without copying
+		 * @param[in] n Number of bytes to skip
+		 * @return Pointer to the first skipped byte
+		 * @throw Ghulbus::gbException GB_FAILED indicates a read beyond the end of the buffer
+		 */
+		unsigned char const* Skip(size_t n);
+		/** Set the read position
+		 * @param[in] pos New read position in bytes from the start of the buffer
+		 * @throw Ghulbus::gbException GB_FAILED indicates a position beyond the end of the buffer
+		 */
+		void Seek(size_t pos);
+		/** Get the current read position
+		 * @return Read position in bytes from the start of the buffer
+		 */
+		size_t GetPosition() const;
+		/** Get the number of bytes left to read
+		 * @return Number of bytes between the read position and the end of the buffer
+		 */
+		size_t GetRemaining() const;
+	};
+};
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file include/gbStats.hpp
+ *
+ * ghulbusUtil - A collection of useful stuff
+ *
+ * @brief gbUtil Counters and stage timers for instrumentation
+ *
+ * @version 1.1
+ * @author Andreas Weis
+ *
+ */
+
+#ifndef _GHULBUSUTIL_STATS_HPP_INCLUDE_GUARD_
+#define _GHULBUSUTIL_STATS_HPP_INCLUDE_GUARD_
+
+#include <iosfwd>
+
+namespace GhulbusUtil {
+	/** Process wide named counters and stage timers
+	 * Recording is disabled by default; while disabled, the GB_STATS_COUNT() and
+	 * GB_STATS_TIMER() hooks only test a flag. All functions may be called concurrently
+	 * from multiple threads; timers of stages running in parallel add up.
+	 * @note Define GB_NO_STATS to compile all hooks out.
+	 */
+	class gbStats {
+	private:
+		static bool m_enabled;					///< Recording flag
+	public:
+		/** Start or stop recording
+		 * @param[in] enable true to record counters and timers
+		 */
+		static void Enable(bool enable);
+		/** Check whether recording is enabled
+		 * @return true if counters and timers are recorded
+		 */
+		static bool IsEnabled() { return m_enabled; }
+		/** Add to a counter
+		 * @param[in] name Name of the counter; must be a string literal or otherwise outlive the process
+		 * @param[in] value Value added to the counter
+		 * @throw std::bad_alloc
+		 */
+		static void AddCounter(char const* name, unsigned long long value);
+		/** Add a measurement to a stage timer
+		 * @param[in] stage Name of the stage; must be a string literal or otherwise outlive the process
+		 * @param[in] seconds Duration of the measurement in seconds
+		 * @throw std::bad_alloc
+		 */
+		static void AddTime(char const* stage, double seconds);
+		/** Get the value of a counter
+		 * @param[in] name Name of the counter
+		 * @return The value or 0 if the counter was never added to
+		 */
+		static unsigned long long GetCounter(char const* name);
+		/** Reset all counters and timers
+		 */
+		static void Reset();
+		/** Write all counters and timers as text, one per line
+		 * @param[out] os Destination stream
+		 */
+		static void WriteText(std::ostream& os);
+		/** Write all counters and timers as a JSON object
+		 * @param[out] os Destination stream
+		 */
+		static void WriteJSON(std::ostream& os);
+		/** Get a monotonic time stamp
+		 * @return Time in seconds from an arbitrary starting point
+		 */
+		static double GetTime();
+	};
+
+	/** Measures the lifetime of a scope and adds it to a stage timer
+	 */
+	class gbStatsTimer {
+	private:
+		char const* m_stage;			///< Name of the stage; NULL if recording was disabled
+		double m_start;					///< Time stamp of construction
+	public:
+		/** Constructor
+		 * @param[in] stage Name of the stage; must be a string literal or otherwise outlive the process
+		 */
+		explicit gbStatsTimer(char const* stage)
+			:m_stage(gbStats::IsEnabled() ? stage : 0), m_start(m_stage ? gbStats::GetTime() : 0.0)
+		{
+		}
+		/** Destructor
+		 */
+		~gbStatsTimer() {
+			if(m_stage) { gbStats::AddTime(m_stage, gbStats::GetTime() - m_start); }
+		}
+	private:
+		gbStatsTimer(gbStatsTimer const&);				///< private copy constructor (not implemented!)
+		gbStatsTimer& operator=(gbStatsTimer const&);	///< private copy assignment (not implemented!)
+	};
+};
+
+#define GB_STATS_CONCAT_IMPL(a, b) a ## b
+#define GB_STATS_CONCAT(a, b) GB_STATS_CONCAT_IMPL(a, b)
+
+#ifdef GB_NO_STATS
+#	define GB_STATS_COUNT(name, value) ((void)0)
+#	define GB_STATS_TIMER(stage) ((void)0)
+#else
+	/** Add value to the counter name if recording is enabled
+	 */
+#	define GB_STATS_COUNT(name, value) \
+		do { if(GhulbusUtil::gbStats::IsEnabled()) { GhulbusUtil::gbStats::AddCounter((name), (value)); } } while(0)
+	/** Measure the rest of the enclosing scope as stage
+	 */
+#	define GB_STATS_TIMER(stage) \
+		GhulbusUtil::gbStatsTimer GB_STATS_CONCAT(gb_stats_timer_, __LINE__)(stage)
+#endif
+
+#endif
@@ -0,0 +1,166 @@
+/**
+ * @file include/gbThreadPool.hpp
+ *
+ * ghulbusUtil - A collection of useful stuff
+ *
+ * @brief gbUtil Worker threads and synchronization primitives
+ *
+ * @version 1.1
+ * @author Andreas Weis
+ *
+ */
+
+#ifndef _GHULBUSUTIL_THREADPOOL_HPP_INCLUDE_GUARD_
+#define _GHULBUSUTIL_THREADPOOL_HPP_INCLUDE_GUARD_
+
+#include "gbException.hpp"
+
+namespace GhulbusUtil {
+	/** A non-recursive mutex
+	 */
+	class gbMutex {
+		friend class gbCondition;
+	private:
+		void* m_mutex;					///< Platform specific mutex object
+	public:
+		/** Constructor
+		 * @throw std::bad_alloc
+		 */
+		gbMutex();
+		/** Destructor
+		 */
+		~gbMutex();
+		/** Acquire the mutex; blocks until it is available
+		 */
+		void Lock();
+		/** Release the mutex
+		 */
+		void Unlock();
+	private:
+		gbMutex(gbMutex const&);				///< private copy constructor (not implemented!)
+		gbMutex& operator=(gbMutex const&);		///< private copy assignment (not implemented!)
+	};
+
+	/** Holds a gbMutex for the duration of a scope
+	 */
+	class gbLock {
+	private:
+		gbMutex& m_mutex;				///< The locked mutex
+	public:
+		/** Constructor
+		 * @param[in,out] mutex The mutex to acquire
+		 */
+		explicit gbLock(gbMutex& mutex);
+		/** Destructor
+		 */
+		~gbLock();
+	private:
+		gbLock(gbLock const&);					///< private copy constructor (not implemented!)
+		gbLock& operator=(gbLock const&);		///< private copy assignment (not implemented!)
+	};
+
+	/** A condition variable for use with gbMutex
+	 */
+	class gbCondition {
+	private:
+		void* m_cond;					///< Platform specific condition variable
+	public:
+		/** Constructor
+		 * @throw std::bad_alloc
+		 */
+		gbCondition();
+		/** Destructor
+		 */
+		~gbCondition();
+		/** Release a mutex and block until the condition is signaled; the mutex is reacquired before returning
+		 * @param[in,out] mutex A mutex locked by the calling thread
+		 * @note Wakeups may be spurious; always check the awaited state in a loop.
+		 */
+		void Wait(gbMutex& mutex);
+		/** Wake up one waiting thread
+		 */
+		void Signal();
+		/** Wake up all waiting threads
+		 */
+		void Broadcast();
+	private:
+		gbCondition(gbCondition const&);			///< private copy constructor (not implemented!)
+		gbCondition& operator=(gbCondition const&);	///< private copy assignment (not implemented!)
+	};
+
+	/** A single thread running a user function
+	 */
+	class gbThread {
+	public:
+		/** Function run by the thread
+		 * @param[in,out] user User supplied pointer passed to Start()
+		 * @note Exceptions must not leave this function.
+		 */
+		typedef void (*ThreadFunc)(void* user);
+	private:
+		void* m_thread;					///< Platform specific thread handle (or NULL)
+	public:
+		/** Constructor
+		 * @note No thread is started until Start() is called
+		 */
+		gbThread();
+		/** Destructor
+		 * @note Waits for a running thread to finish
+		 */
+		~gbThread();
+		/** Start the thread
+		 * @param[in] func Function run by the thread
+		 * @param[in,out] user User supplied pointer that is passed to func
+		 * @throw Ghulbus::gbException GB_FAILED indicates that the thread could not be created
+		 *                             or that a thread was already started
+		 * @throw std::bad_alloc
+		 */
+		void Start(ThreadFunc func, void* user);
+		/** Wait for the thread to finish; returns immediately if no thread was started
+		 */
+		void Join();
+	private:
+		gbThread(gbThread const&);					///< private copy constructor (not implemented!)
+		gbThread& operator=(gbThread const&);		///< private copy assignment (not implemented!)
+	};
+
+	/** Get the number of processors available to the process
+	 * @return Number of processors; at least 1
+	 */
+	int GetNumberOfProcessors();
+
+	/** A fixed number of worker threads processing a range of work items
+	 */
+	class gbThreadPool {
+	public:
+		/** Function called for every work item
+		 * @param[in] item Index of the work item (0..n_items-1)
+		 * @param[in] worker Index of the calling worker (0..GetNThreads()-1);
+		 *                   no two calls with the same worker index run concurrently
+		 * @param[in,out] user User supplied pointer passed to Run()
+		 */
+		typedef void (*WorkFunc)(int item, int worker, void* user);
+	private:
+		int m_nThreads;					///< Number of worker threads
+	public:
+		/** Constructor
+		 * @param[in] n_threads Number of worker threads; values < 1 select GetNumberOfProcessors()
+		 */
+		explicit gbThreadPool(int n_threads);
+		/** Get the number of worker threads
+		 * @return Number of worker threads used by Run()
+		 */
+		int GetNThreads() const;
+		/** Process work items in parallel
+		 * Items are handed out to the workers in increasing order. The function returns
+		 * after all items have been processed.
+		 * @param[in] n_items Number of work items
+		 * @param[in] func Function that is called once for every item
+		 * @param[in,out] user User supplied pointer that is passed to func
+		 * @throw Ghulbus::gbException GB_FAILED indicates that func threw an exception
+		 */
+		void Run(int n_items, WorkFunc func, void* user);
+	};
+};
+
+#endif
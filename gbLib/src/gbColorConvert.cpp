@@ -0,0 +1,281 @@
+/**
+ * @file src/gbColorConvert.cpp
+ *
+ * ghulbusUtil - A collection of useful stuff
+ *
+ * @brief gbUtil Block conversion of pixel data to 32 bit color implementation
+ *
+ * @version 1.1
+ * @author Andreas Weis
+ *
+ */
+#include "../include/gbColorConvert.hpp"
+#include <cstring>
+
+#if (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))) || \
+    (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#	define GB_COLORCONVERT_X86
+#	include <immintrin.h>
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#		define GB_TARGET(isa)
+#	else
+#		define GB_TARGET(isa) __attribute__((target(isa)))
+#	endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#	define GB_COLORCONVERT_NEON
+#	include <arm_neon.h>
+#endif
+
+/* Every kernel converts as many pixels as it can without reading or writing past the
+ * end of the fields and returns their number; the remaining pixels are converted by the
+ * scalar code of the public functions. The scalar code defines the results; all kernels
+ * produce identical output.
+ */
+
+namespace GhulbusUtil {
+	/** Helper function: determine the best instruction set supported by build and processor
+	 */
+	static gbColorConvertISA_T DetectISA() {
+#if defined(GB_COLORCONVERT_X86)
+#	ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		int const max_leaf = info[0];
+		__cpuid(info, 1);
+		bool const sse2  = (info[3] & (1 << 26)) != 0;
+		bool const ssse3 = (info[2] & (1 << 9)) != 0;
+		//AVX2 also requires the operating system to save the ymm registers:
+		bool avx2 = false;
+		if((max_leaf >= 7) && ((info[2] & (1 << 27)) != 0) && ((_xgetbv(0) & 0x6) == 0x6)) {
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+#	else
+		__builtin_cpu_init();
+		bool const sse2  = __builtin_cpu_supports("sse2") != 0;
+		bool const ssse3 = __builtin_cpu_supports("ssse3") != 0;
+		bool const avx2  = __builtin_cpu_supports("avx2") != 0;
+#	endif
+		if(avx2)  { return GB_ISA_AVX2; }
+		if(ssse3) { return GB_ISA_SSSE3; }
+		if(sse2)  { return GB_ISA_SSE2; }
+		return GB_ISA_SCALAR;
+#elif defined(GB_COLORCONVERT_NEON)
+		return GB_ISA_NEON;
+#else
+		return GB_ISA_SCALAR;
+#endif
+	}
+
+	static gbColorConvertISA_T const g_detected_isa = DetectISA();		///< best supported instruction set
+	/** Instruction set in use
+	 * @note Before static initialization completes this is 0 (GB_ISA_SCALAR), so early callers are safe.
+	 */
+	static gbColorConvertISA_T g_isa = g_detected_isa;
+
+#if defined(GB_COLORCONVERT_X86)
+	GB_TARGET("ssse3")
+	static size_t BGR24ToARGB32_SSSE3(unsigned char const* src, GhulbusGraphics::GBCOLOR* dst, size_t n) {
+		__m128i const mask  = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		__m128i const alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+		size_t i = 0;
+		//16 pixels from 3 loads; the shifts line up the pixels for the shuffle:
+		for(; i + 16 <= n; i += 16) {
+			__m128i const a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i*3));
+			__m128i const b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i*3 + 16));
+			__m128i const c = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i*3 + 32));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+			                 _mm_or_si128(_mm_shuffle_epi8(a, mask), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4),
+			                 _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), mask), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8),
+			                 _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), mask), alpha));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 12),
+			                 _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), mask), alpha));
+		}
+		return i;
+	}
+
+	GB_TARGET("avx2")
+	static size_t BGR24ToARGB32_AVX2(unsigned char const* src, GhulbusGraphics::GBCOLOR* dst, size_t n) {
+		__m256i const mask  = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+		                                       0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		__m256i const alpha = _mm256_set1_epi32(static_cast<int>(0xff000000));
+		size_t i = 0;
+		//each 128 bit lane takes 4 pixels from a 16 byte load; the last load reads 4 bytes ahead:
+		for(; (i + 8)*3 + 4 <= n*3; i += 8) {
+			__m128i const lo = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i*3));
+			__m128i const hi = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i*3 + 12));
+			__m256i const v  = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+			                    _mm256_or_si256(_mm256_shuffle_epi8(v, mask), alpha));
+		}
+		return i;
+	}
+
+	GB_TARGET("sse2")
+	static size_t RGB555ToARGB32_SSE2(unsigned char const* src, GhulbusGraphics::GBCOLOR* dst, size_t n) {
+		__m128i const zero   = _mm_setzero_si128();
+		__m128i const alpha  = _mm_set1_epi32(static_cast<int>(0xff000000));
+		__m128i const mask_r = _mm_set1_epi32(0x7c00);
+		__m128i const mask_g = _mm_set1_epi32(0x03e0);
+		__m128i const mask_b = _mm_set1_epi32(0x001f);
+		size_t i = 0;
+		for(; i + 8 <= n; i += 8) {
+			__m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i*2));
+			__m128i const p[2] = { _mm_unpacklo_epi16(v, zero), _mm_unpackhi_epi16(v, zero) };
+			for(int j=0; j<2; j++) {
+				__m128i const c = _mm_or_si128( _mm_or_si128(alpha, _mm_slli_epi32(_mm_and_si128(p[j], mask_r), 9)),
+				                                _mm_or_si128( _mm_slli_epi32(_mm_and_si128(p[j], mask_g), 6),
+				                                              _mm_slli_epi32(_mm_and_si128(p[j], mask_b), 3) ) );
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + j*4), c);
+			}
+		}
+		return i;
+	}
+
+	GB_TARGET("avx2")
+	static size_t RGB555ToARGB32_AVX2(unsigned char const* src, GhulbusGraphics::GBCOLOR* dst, size_t n) {
+		__m256i const alpha  = _mm256_set1_epi32(static_cast<int>(0xff000000));
+		__m256i const mask_r = _mm256_set1_epi32(0x7c00);
+		__m256i const mask_g = _mm256_set1_epi32(0x03e0);
+		__m256i const mask_b = _mm256_set1_epi32(0x001f);
+		size_t i = 0;
+		for(; i + 8 <= n; i += 8) {
+			__m256i const p = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i*2)));
+			__m256i const c = _mm256_or_si256( _mm256_or_si256(alpha, _mm256_slli_epi32(_mm256_and_si256(p, mask_r), 9)),
+			                                   _mm256_or_si256( _mm256_slli_epi32(_mm256_and_si256(p, mask_g), 6),
+			                                                    _mm256_slli_epi32(_mm256_and_si256(p, mask_b), 3) ) );
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), c);
+		}
+		return i;
+	}
+
+	GB_TARGET("avx2")
+	static size_t PaletteToARGB32_AVX2(unsigned char const* src, GhulbusGraphics::GBCOLOR const* palette,
+	                                   GhulbusGraphics::GBCOLOR* dst, size_t n) {
+		int const* table = reinterpret_cast<int const*>(palette);
+		size_t i = 0;
+		for(; i + 8 <= n; i += 8) {
+			__m256i const index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(src + i)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_i32gather_epi32(table, index, 4));
+		}
+		return i;
+	}
+#elif defined(GB_COLORCONVERT_NEON)
+	static size_t BGR24ToARGB32_NEON(unsigned char const* src, GhulbusGraphics::GBCOLOR* dst, size_t n) {
+		size_t i = 0;
+		for(; i + 16 <= n; i += 16) {
+			uint8x16x3_t const bgr = vld3q_u8(src + i*3);
+			uint8x16x4_t bgra;
+			bgra.val[0] = bgr.val[0];
+			bgra.val[1] = bgr.val[1];
+			bgra.val[2] = bgr.val[2];
+			bgra.val[3] = vdupq_n_u8(0xff);
+			vst4q_u8(reinterpret_cast<unsigned char*>(dst + i), bgra);
+		}
+		return i;
+	}
+
+	static size_t RGB555ToARGB32_NEON(unsigned char const* src, GhulbusGraphics::GBCOLOR* dst, size_t n) {
+		uint32x4_t const alpha  = vdupq_n_u32(0xff000000);
+		uint32x4_t const mask_r = vdupq_n_u32(0x7c00);
+		uint32x4_t const mask_g = vdupq_n_u32(0x03e0);
+		uint32x4_t const mask_b = vdupq_n_u32(0x001f);
+		size_t i = 0;
+		for(; i + 8 <= n; i += 8) {
+			uint16x8_t const v = vreinterpretq_u16_u8(vld1q_u8(src + i*2));
+			uint32x4_t const p[2] = { vmovl_u16(vget_low_u16(v)), vmovl_u16(vget_high_u16(v)) };
+			for(int j=0; j<2; j++) {
+				uint32x4_t const c = vorrq_u32( vorrq_u32(alpha, vshlq_n_u32(vandq_u32(p[j], mask_r), 9)),
+				                                vorrq_u32( vshlq_n_u32(vandq_u32(p[j], mask_g), 6),
+				                                           vshlq_n_u32(vandq_u32(p[j], mask_b), 3) ) );
+				vst1q_u32(dst + i + j*4, c);
+			}
+		}
+		return i;
+	}
+#endif
+
+	gbColorConvertISA_T GetColorConvertISA() {
+		return g_isa;
+	}
+
+	void SetColorConvertISA(gbColorConvertISA_T isa) {
+		bool supported;
+		if(isa == GB_ISA_SCALAR) {
+			supported = true;
+		} else if(g_detected_isa == GB_ISA_NEON) {
+			supported = (isa == GB_ISA_NEON);
+		} else {
+			//the x86 instruction sets are ordered by capability:
+			supported = (isa != GB_ISA_NEON) && (isa <= g_detected_isa);
+		}
+		g_isa = (supported) ? isa : g_detected_isa;
+	}
+
+	void ConvertBGR24ToARGB32(unsigned char const* src, GhulbusGraphics::GBCOLOR* dst, size_t n) {
+		size_t i = 0;
+#if defined(GB_COLORCONVERT_X86)
+		if(g_isa == GB_ISA_AVX2) {
+			i = BGR24ToARGB32_AVX2(src, dst, n);
+		} else if(g_isa == GB_ISA_SSSE3) {
+			i = BGR24ToARGB32_SSSE3(src, dst, n);
+		}
+#elif defined(GB_COLORCONVERT_NEON)
+		if(g_isa == GB_ISA_NEON) {
+			i = BGR24ToARGB32_NEON(src, dst, n);
+		}
+#endif
+		for(; i<n; i++) {
+			dst[i] = GhulbusGraphics::GBCOLOR32::XRGB(src[i*3+2], src[i*3+1], src[i*3]);
+		}
+	}
+
+	void ConvertBGRA32ToARGB32(unsigned char const* src, GhulbusGraphics::GBCOLOR* dst, size_t n) {
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+		for(size_t i=0; i<n; i++) {
+			dst[i] = GhulbusGraphics::GBCOLOR32::ARGB(src[i*4+3], src[i*4+2], src[i*4+1], src[i*4]);
+		}
+#else
+		//on little endian hosts the byte order B,G,R,A already is the memory layout of GBCOLOR:
+		memcpy(dst, src, n * 4);
+#endif
+	}
+
+	void ConvertRGB555ToARGB32(unsigned char const* src, GhulbusGraphics::GBCOLOR* dst, size_t n) {
+		size_t i = 0;
+#if defined(GB_COLORCONVERT_X86)
+		if(g_isa == GB_ISA_AVX2) {
+			i = RGB555ToARGB32_AVX2(src, dst, n);
+		} else if(g_isa != GB_ISA_SCALAR) {
+			i = RGB555ToARGB32_SSE2(src, dst, n);
+		}
+#elif defined(GB_COLORCONVERT_NEON)
+		if(g_isa == GB_ISA_NEON) {
+			i = RGB555ToARGB32_NEON(src, dst, n);
+		}
+#endif
+		for(; i<n; i++) {
+			unsigned int const r =  (src[i*2+1] & 0x7C) >> 2;
+			unsigned int const g = ((src[i*2]   & 0xE0) >> 5) | ((src[i*2+1] & 0x03) << 3);
+			unsigned int const b =  (src[i*2]   & 0x1F);
+			///@todo alpha channel
+			dst[i] = GhulbusGraphics::GBCOLOR32::XRGB(static_cast<int>(r*8), static_cast<int>(g*8), static_cast<int>(b*8));
+		}
+	}
+
+	void ConvertPaletteToARGB32(unsigned char const* src, GhulbusGraphics::GBCOLOR const* palette,
+	                            GhulbusGraphics::GBCOLOR* dst, size_t n) {
+		size_t i = 0;
+#if defined(GB_COLORCONVERT_X86)
+		if(g_isa == GB_ISA_AVX2) {
+			i = PaletteToARGB32_AVX2(src, palette, dst, n);
+		}
+#endif
+		for(; i<n; i++) {
+			dst[i] = palette[src[i]];
+		}
+	}
+};
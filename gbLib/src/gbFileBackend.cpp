@@ -0,0 +1,309 @@
+/**
+ * @file src/gbFileBackend.cpp
+ *
+ * ghulbusUtil - A collection of useful stuff
+ *
+ * @brief gbUtil Pluggable file access implementation
+ *
+ * @version 1.1
+ * @author Andreas Weis
+ *
+ */
+#include "../include/gbFileBackend.hpp"
+#include "../include/gbStats.hpp"
+#include <cstring>
+#include <fstream>
+
+namespace GhulbusUtil {
+	/** Helper function: writes a file in one go
+	 * @return false if the file could not be written completely
+	 */
+	static bool WriteWholeFile(char const* fname, void const* data, size_t size)
+	{
+		std::ofstream fout(fname, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		if(fout.fail()) { return false; }
+		if(size > 0) { fout.write(static_cast<char const*>(data), size); }
+		fout.close();
+		return !fout.fail();
+	}
+
+	gbFileBackend::~gbFileBackend()
+	{
+		;
+	}
+
+	void gbFileBackend::Prefetch(char const*)
+	{
+		;
+	}
+
+	void gbFileBackend::Flush()
+	{
+		;
+	}
+
+	void gbDirectFileBackend::OpenFile(char const* fname, gbMappedFile& file)
+	{
+		file.OpenDirect(fname);
+	}
+
+	void gbDirectFileBackend::WriteFile(char const* fname, void const* data, size_t size)
+	{
+		if(!WriteWholeFile(fname, data, size)) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "File could not be written" ) );
+		}
+	}
+
+	gbPrefetchFileBackend::gbPrefetchFileBackend(int n_ahead, int n_threads)
+		:m_nAhead(n_ahead), m_nextRead(0), m_nextEvict(0), m_openedEnd(0), m_shutdown(false)
+	{
+		if((n_ahead < 1) || (n_threads < 1)) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
+		}
+		//if some threads can not be created, the others do all the work:
+		try {
+			m_threads.reserve(n_threads);
+			for(int i=0; i<n_threads; i++) {
+				gbThread* thread = new gbThread;
+				try {
+					thread->Start(IOThread, this);
+				} catch(Ghulbus::gbException&) {
+					delete thread;
+					break;
+				}
+				m_threads.push_back(thread);
+			}
+		} catch(...) {
+			StopThreads();
+			throw;
+		}
+		if(m_threads.empty()) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "I/O thread could not be created" ) );
+		}
+	}
+
+	gbPrefetchFileBackend::~gbPrefetchFileBackend()
+	{
+		StopThreads();
+	}
+
+	void gbPrefetchFileBackend::StopThreads()
+	{
+		{
+			gbLock lock(m_mutex);
+			m_shutdown = true;
+			m_work.Broadcast();
+		}
+		for(size_t i=0; i<m_threads.size(); i++) {
+			m_threads[i]->Join();
+			delete m_threads[i];
+		}
+		m_threads.clear();
+	}
+
+	void gbPrefetchFileBackend::OpenFile(char const* fname, gbMappedFile& file)
+	{
+		{
+			std::string const name(fname);
+			gbLock lock(m_mutex);
+			while(IsWritePending(name)) { m_done.Wait(m_mutex); }
+			std::map<std::string, size_t>::iterator it = m_readIndex.find(name);
+			if(it != m_readIndex.end()) {
+				size_t const index = it->second;
+				ReadEntry& entry = m_reads[index];
+				if(index >= m_openedEnd) {
+					//the window moves on:
+					m_openedEnd = index + 1;
+					Evict();
+					m_work.Broadcast();
+				}
+				if(entry.state == ReadEntry::QUEUED) {
+					//not started yet; reading it here is quicker than waiting for it:
+					entry.state = ReadEntry::INVALID;
+					m_readIndex.erase(it);
+				}
+				while(entry.state == ReadEntry::READING) { m_done.Wait(m_mutex); }
+				if(entry.state == ReadEntry::DONE) {
+					//the entry is kept for further opens until it leaves the window:
+					size_t const size = entry.data.size();
+					unsigned char* buffer = (size > 0) ? (new unsigned char[size]) : NULL;
+					if(size > 0) { memcpy(buffer, &entry.data[0], size); }
+					file.Assign(buffer, size);
+					GB_STATS_COUNT("io.prefetch_hits", 1);
+					return;
+				}
+			}
+		}
+		file.OpenDirect(fname);
+	}
+
+	void gbPrefetchFileBackend::WriteFile(char const* fname, void const* data, size_t size)
+	{
+		std::string const name(fname);
+		std::vector<unsigned char> buffer(static_cast<unsigned char const*>(data),
+		                                  static_cast<unsigned char const*>(data) + size);
+		gbLock lock(m_mutex);
+		//contents read ahead of time are outdated now:
+		std::map<std::string, size_t>::iterator it = m_readIndex.find(name);
+		if(it != m_readIndex.end()) {
+			ReadEntry& entry = m_reads[it->second];
+			entry.state = ReadEntry::INVALID;
+			std::vector<unsigned char>().swap(entry.data);
+			m_readIndex.erase(it);
+		}
+		while(m_writes.size() >= static_cast<size_t>(m_nAhead)) { m_done.Wait(m_mutex); }
+		m_writes.push_back(WriteEntry());
+		m_writes.back().name    = name;
+		m_writes.back().writing = false;
+		m_writes.back().data.swap(buffer);
+		GB_STATS_COUNT("io.write_behind_bytes", size);
+		m_work.Signal();
+	}
+
+	void gbPrefetchFileBackend::Prefetch(char const* fname)
+	{
+		std::string const name(fname);
+		gbLock lock(m_mutex);
+		if(m_readIndex.find(name) != m_readIndex.end()) { return; }
+		m_reads.push_back(ReadEntry());
+		m_reads.back().name  = name;
+		m_reads.back().state = ReadEntry::QUEUED;
+		m_readIndex[name] = m_reads.size() - 1;
+		m_work.Signal();
+	}
+
+	void gbPrefetchFileBackend::Flush()
+	{
+		gbLock lock(m_mutex);
+		while(!m_writes.empty()) { m_done.Wait(m_mutex); }
+		if(!m_failedWrites.empty()) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "File could not be written" ) );
+		}
+	}
+
+	void gbPrefetchFileBackend::GetFailedWrites(std::vector<std::string>& files)
+	{
+		gbLock lock(m_mutex);
+		files.clear();
+		files.swap(m_failedWrites);
+	}
+
+	void gbPrefetchFileBackend::IOThread(void* user)
+	{
+		static_cast<gbPrefetchFileBackend*>(user)->ProcessIO();
+	}
+
+	void gbPrefetchFileBackend::ProcessIO()
+	{
+		gbLock lock(m_mutex);
+		for(;;) {
+			//writes come first, as callers may be waiting for them; writes to the same file keep their order:
+			std::list<WriteEntry>::iterator write = m_writes.end();
+			for(std::list<WriteEntry>::iterator i = m_writes.begin(); (write == m_writes.end()) && (i != m_writes.end()); ++i) {
+				if(i->writing) { continue; }
+				bool blocked = false;
+				for(std::list<WriteEntry>::iterator j = m_writes.begin(); (!blocked) && (j != i); ++j) {
+					blocked = (j->name == i->name);
+				}
+				if(!blocked) { write = i; }
+			}
+			if(write != m_writes.end()) {
+				write->writing = true;
+				m_mutex.Unlock();
+				bool success = false;
+				try {
+					success = WriteWholeFile(write->name.c_str(), (write->data.empty()) ? NULL : (&write->data[0]),
+					                         write->data.size());
+				} catch(...) {
+					success = false;
+				}
+				m_mutex.Lock();
+				if(!success) {
+					try { m_failedWrites.push_back(write->name); } catch(...) { ; }
+				}
+				m_writes.erase(write);
+				m_done.Broadcast();
+				m_work.Broadcast();
+				continue;
+			}
+			if(m_shutdown) {
+				if(m_writes.empty()) { return; }
+				m_work.Wait(m_mutex);
+				continue;
+			}
+
+			//next read inside the window:
+			while((m_nextRead < m_reads.size()) && (m_reads[m_nextRead].state != ReadEntry::QUEUED)) { m_nextRead++; }
+			if((m_nextRead < m_reads.size()) && (m_nextRead < m_openedEnd + m_nAhead)) {
+				//deque elements stay in place when more are appended:
+				ReadEntry& entry = m_reads[m_nextRead++];
+				entry.state = ReadEntry::READING;
+				bool success = false;
+				std::vector<unsigned char> data;
+				std::string name;
+				try {
+					name = entry.name;
+				} catch(...) {
+					entry.state = ReadEntry::INVALID;
+					continue;
+				}
+				m_mutex.Unlock();
+				try {
+					//copying the contents makes sure they are actually transferred on this thread:
+					gbMappedFile file;
+					file.OpenDirect(name.c_str());
+					data.assign(file.GetData(), file.GetData() + file.GetSize());
+					success = true;
+				} catch(...) {
+					success = false;
+				}
+				m_mutex.Lock();
+				//the entry may have been invalidated in the meantime:
+				if(entry.state == ReadEntry::READING) {
+					entry.state = (success) ? ReadEntry::DONE : ReadEntry::INVALID;
+					entry.data.swap(data);
+					if(success) { GB_STATS_COUNT("io.prefetch_bytes", entry.data.size()); }
+				}
+				m_done.Broadcast();
+				continue;
+			}
+			m_work.Wait(m_mutex);
+		}
+	}
+
+	void gbPrefetchFileBackend::Evict()
+	{
+		while(m_nextEvict + m_nAhead < m_openedEnd) {
+			ReadEntry& entry = m_reads[m_nextEvict];
+			std::map<std::string, size_t>::iterator it = m_readIndex.find(entry.name);
+			if((it != m_readIndex.end()) && (it->second == m_nextEvict)) {
+				m_readIndex.erase(it);
+			}
+			//a read in progress discards its result:
+			entry.state = ReadEntry::INVALID;
+			std::vector<unsigned char>().swap(entry.data);
+			m_nextEvict++;
+		}
+	}
+
+	bool gbPrefetchFileBackend::IsWritePending(std::string const& name) const
+	{
+		for(std::list<WriteEntry>::const_iterator i = m_writes.begin(); i != m_writes.end(); ++i) {
+			if(i->name == name) { return true; }
+		}
+		return false;
+	}
+
+	static gbDirectFileBackend direct_backend;			///< backend used if none is set
+	static gbFileBackend* file_backend = NULL;			///< backend set with SetFileBackend()
+
+	gbFileBackend& GetFileBackend()
+	{
+		return (file_backend) ? (*file_backend) : static_cast<gbFileBackend&>(direct_backend);
+	}
+
+	void SetFileBackend(gbFileBackend* backend)
+	{
+		file_backend = backend;
+	}
+};
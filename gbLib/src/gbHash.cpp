@@ -0,0 +1,163 @@
+/**
+ * @file src/gbHash.cpp
+ *
+ * ghulbusUtil - A collection of useful stuff
+ *
+ * @brief gbUtil Fast non-cryptographic hashing implementation
+ *
+ * @version 1.1
+ * @author Andreas Weis
+ *
+ */
+#include "../include/gbHash.hpp"
+#include <cstring>
+
+namespace GhulbusUtil {
+	static unsigned long long const PRIME64_1 = 0x9E3779B185EBCA87ULL;
+	static unsigned long long const PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+	static unsigned long long const PRIME64_3 = 0x165667B19E3779F9ULL;
+	static unsigned long long const PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+	static unsigned long long const PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+	/** Helper function: reads a little endian 64 bit value
+	 */
+	static inline unsigned long long ReadLE64(unsigned char const* p)
+	{
+		unsigned long long ret = 0;
+		for(int i=7; i>=0; i--) { ret = (ret << 8) | p[i]; }
+		return ret;
+	}
+
+	/** Helper function: reads a little endian 32 bit value
+	 */
+	static inline unsigned long long ReadLE32(unsigned char const* p)
+	{
+		return static_cast<unsigned long long>(p[0])         | (static_cast<unsigned long long>(p[1]) << 8) |
+		       (static_cast<unsigned long long>(p[2]) << 16) | (static_cast<unsigned long long>(p[3]) << 24);
+	}
+
+	/** Helper function: rotates left by r bits
+	 */
+	static inline unsigned long long RotL64(unsigned long long x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	/** Helper function: mixes 8 bytes of input into an accumulator
+	 */
+	static inline unsigned long long Round(unsigned long long acc, unsigned long long input)
+	{
+		acc += input * PRIME64_2;
+		acc = RotL64(acc, 31);
+		return acc * PRIME64_1;
+	}
+
+	/** Helper function: merges an accumulator into the final hash
+	 */
+	static inline unsigned long long MergeRound(unsigned long long acc, unsigned long long val)
+	{
+		acc ^= Round(0, val);
+		return acc * PRIME64_1 + PRIME64_4;
+	}
+
+	/** Helper function: processes complete 32 byte stripes
+	 * @return Pointer to the first byte not processed
+	 */
+	static unsigned char const* ProcessStripes(unsigned long long* acc, unsigned char const* p,
+	                                           unsigned char const* end)
+	{
+		unsigned long long v1 = acc[0], v2 = acc[1], v3 = acc[2], v4 = acc[3];
+		while(end - p >= 32) {
+			v1 = Round(v1, ReadLE64(p));
+			v2 = Round(v2, ReadLE64(p + 8));
+			v3 = Round(v3, ReadLE64(p + 16));
+			v4 = Round(v4, ReadLE64(p + 24));
+			p += 32;
+		}
+		acc[0] = v1; acc[1] = v2; acc[2] = v3; acc[3] = v4;
+		return p;
+	}
+
+	gbHash64::gbHash64(unsigned long long seed)
+	{
+		Reset(seed);
+	}
+
+	void gbHash64::Reset(unsigned long long seed)
+	{
+		m_seed = seed;
+		m_acc[0] = seed + PRIME64_1 + PRIME64_2;
+		m_acc[1] = seed + PRIME64_2;
+		m_acc[2] = seed;
+		m_acc[3] = seed - PRIME64_1;
+		m_totalSize = 0;
+		m_bufferSize = 0;
+	}
+
+	void gbHash64::Update(void const* data, size_t size)
+	{
+		unsigned char const* p = static_cast<unsigned char const*>(data);
+		unsigned char const* const end = p + size;
+		m_totalSize += size;
+		if(m_bufferSize + size < 32) {
+			if(size > 0) { memcpy(m_buffer + m_bufferSize, p, size); }
+			m_bufferSize += size;
+			return;
+		}
+		if(m_bufferSize > 0) {
+			size_t const n = 32 - m_bufferSize;
+			memcpy(m_buffer + m_bufferSize, p, n);
+			ProcessStripes(m_acc, m_buffer, m_buffer + 32);
+			p += n;
+			m_bufferSize = 0;
+		}
+		p = ProcessStripes(m_acc, p, end);
+		m_bufferSize = static_cast<size_t>(end - p);
+		if(m_bufferSize > 0) { memcpy(m_buffer, p, m_bufferSize); }
+	}
+
+	unsigned long long gbHash64::GetDigest() const
+	{
+		unsigned long long h;
+		if(m_totalSize >= 32) {
+			h = RotL64(m_acc[0], 1) + RotL64(m_acc[1], 7) + RotL64(m_acc[2], 12) + RotL64(m_acc[3], 18);
+			h = MergeRound(h, m_acc[0]);
+			h = MergeRound(h, m_acc[1]);
+			h = MergeRound(h, m_acc[2]);
+			h = MergeRound(h, m_acc[3]);
+		} else {
+			h = m_seed + PRIME64_5;
+		}
+		h += m_totalSize;
+		//remaining bytes of the last incomplete stripe:
+		unsigned char const* p = m_buffer;
+		unsigned char const* const end = m_buffer + m_bufferSize;
+		for(; end - p >= 8; p += 8) {
+			h ^= Round(0, ReadLE64(p));
+			h = RotL64(h, 27) * PRIME64_1 + PRIME64_4;
+		}
+		if(end - p >= 4) {
+			h ^= ReadLE32(p) * PRIME64_1;
+			h = RotL64(h, 23) * PRIME64_2 + PRIME64_3;
+			p += 4;
+		}
+		for(; p < end; p++) {
+			h ^= (*p) * PRIME64_5;
+			h = RotL64(h, 11) * PRIME64_1;
+		}
+		//avalanche:
+		h ^= h >> 33;
+		h *= PRIME64_2;
+		h ^= h >> 29;
+		h *= PRIME64_3;
+		h ^= h >> 32;
+		return h;
+	}
+
+	unsigned long long gbHashXXH64(void const* data, size_t size, unsigned long long seed)
+	{
+		gbHash64 hash(seed);
+		hash.Update(data, size);
+		return hash.GetDigest();
+	}
+};
@@ -10,29 +10,193 @@
  *
  */
 #include "../include/gbImageLoader.hpp"
+#include "../include/gbColorConvert.hpp"
+#include "../include/gbStats.hpp"
+#include "../include/gbFileBackend.hpp"
 #include <cstring>
 #include <climits>
+#include <vector>
+#include <istream>
+#include <streambuf>
 
 namespace GhulbusUtil {
-	gbImageLoader::gbImageLoader(char const* fname, gbImageType* img_type)
+	gbImageView::gbImageView()
+		:data(NULL), pitch(0), width(0), height(0), format(GB_PIXEL_BGRA32), palette(NULL)
+	{
+		;
+	}
+
+	/** Helper function: Converts pixels of a gbImageView to GBCOLORs
+	 */
+	static void ConvertPixels32(gbImageView const& view, unsigned char const* src,
+	                            GhulbusGraphics::GBCOLOR* dst, size_t n_pixels)
+	{
+		switch(view.format) {
+			case GB_PIXEL_BGRA32:
+				//32 bit image: one byte per color-channel, one byte alpha:
+				ConvertBGRA32ToARGB32(src, dst, n_pixels);
+				break;
+			case GB_PIXEL_BGRX32:
+				//32 bit image: one byte per color-channel, one unused byte
+				ConvertBGRA32ToARGB32(src, dst, n_pixels);
+				for(size_t i=0; i<n_pixels; i++) { dst[i] &= 0x00ffffff; }
+				break;
+			case GB_PIXEL_BGR24:
+				//24 bit image: one byte per color-channel, no alpha channel
+				ConvertBGR24ToARGB32(src, dst, n_pixels);
+				break;
+			case GB_PIXEL_RGB555:
+				//16 bit image: 5 bit per color channel, 1 bit alpha channel (unsupported)
+				///@todo dithering(?)
+				ConvertRGB555ToARGB32(src, dst, n_pixels);
+				break;
+			case GB_PIXEL_INDEX8:
+				//one byte palette index per pixel
+				ConvertPaletteToARGB32(src, view.palette, dst, n_pixels);
+				///@todo dithering(?)
+				break;
+		}
+	}
+
+	/** Helper function: Size of a pixel in a gbImageView
+	 */
+	static size_t GetPixelSize(gbPixelFormat_T format) {
+		switch(format) {
+			case GB_PIXEL_INDEX8:  return 1;
+			case GB_PIXEL_RGB555:  return 2;
+			case GB_PIXEL_BGR24:   return 3;
+			case GB_PIXEL_BGRX32:
+			case GB_PIXEL_BGRA32:
+			default:               return 4;
+		}
+	}
+
+	void GetRowData32(gbImageView const& view, int row, GhulbusGraphics::GBCOLOR* pData) {
+		if((row < 0) || (row >= view.height)) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
+		}
+		ConvertPixels32(view, view.GetRow(row), pData, view.width);
+	}
+
+	gbImageLoader::gbImageLoader()
 		:m_data(NULL), m_palette(NULL), m_width(0), m_height(0), m_bpp(0)
 	{
-		std::ifstream file( fname, std::ios_base::binary| std::ios_base::in );
-		if( file.fail() ) {
+		;
+	}
+
+	gbImageLoader::gbImageLoader(char const* fname, gbImageType* img_type, RowOrder_T order)
+		:m_data(NULL), m_palette(NULL), m_width(0), m_height(0), m_bpp(0)
+	{
+		Load(fname, img_type, order);
+	}
+
+	/** Helper class: a read-only stream buffer over a block of memory
+	 */
+	class gbMemoryStreamBuf: public std::streambuf {
+	public:
+		gbMemoryStreamBuf(void const* data, size_t size) {
+			char* p = const_cast<char*>(static_cast<char const*>(data));
+			setg(p, p, p + size);
+		}
+	protected:
+		pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+			off_type const size = egptr() - eback();
+			off_type pos = off;
+			if(dir == std::ios_base::cur) {
+				pos += gptr() - eback();
+			} else if(dir == std::ios_base::end) {
+				pos += size;
+			}
+			if( !(which & std::ios_base::in) || (pos < 0) || (pos > size) ) {
+				return pos_type(off_type(-1));
+			}
+			setg(eback(), eback() + pos, egptr());
+			return pos_type(pos);
+		}
+		pos_type seekpos(pos_type pos, std::ios_base::openmode which) {
+			return seekoff(off_type(pos), std::ios_base::beg, which);
+		}
+	};
+
+	void gbImageLoader::Load(char const* fname, gbImageType* img_type, RowOrder_T order) {
+		gbMappedFile file;
+		try {
+			file.Open(fname);
+		} catch(Ghulbus::gbException&) {
+			Clear();
 			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
 				                         "Image file could not be opened" ) );
-		}		
+		}
+		Load(file.GetData(), file.GetSize(), img_type, order);
+	}
+
+	void gbImageLoader::Load(void const* data, size_t size, gbImageType* img_type, RowOrder_T order) {
+		GB_STATS_TIMER("image.load");
+		Clear();
+		gbMemoryStreamBuf buffer(data, size);
+		std::istream file(&buffer);
+		ReadStream(file, img_type, order);
+		GB_STATS_COUNT("image.bytes_read", size);
+	}
+
+	void gbImageLoader::ReadStream(std::istream& file, gbImageType* img_type, RowOrder_T order) {
 		if( !img_type->CheckFile(file) ) {
 			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
 				                         "Image file seems to be corrupted" ) );
 		}
 
-		img_type->ReadFile(file, &m_width, &m_height, &m_bpp, &m_data, &m_palette);
+		img_type->ReadFile(file, &m_width, &m_height, &m_bpp, &m_data, &m_palette, (order == ROWS_BOTTOM_UP));
+
+		//decoded images are stored without padding, less than 8 bits per pixel as one byte per pixel:
+		switch(m_bpp) {
+			case 32:                m_view.format = GB_PIXEL_BGRA32; break;
+			case 24:                m_view.format = GB_PIXEL_BGR24;  break;
+			case 16:                m_view.format = GB_PIXEL_RGB555; break;
+			case 8: case 4: case 1: m_view.format = GB_PIXEL_INDEX8; break;
+			default:
+				Clear();
+				throw( Ghulbus::gbException( Ghulbus::gbException::GB_NOTIMPLEMENTED ) );
+		}
+		m_view.data    = m_data;
+		m_view.pitch   = static_cast<ptrdiff_t>(GetPixelSize(m_view.format) * m_width);
+		m_view.width   = m_width;
+		m_view.height  = m_height;
+		m_view.palette = m_palette;
+		GB_STATS_COUNT("image.pixels_decoded", static_cast<unsigned long long>(m_width) * m_height);
+		GB_STATS_COUNT("alloc.count", 1);
+		GB_STATS_COUNT("alloc.bytes", static_cast<unsigned long long>(m_view.pitch) * m_height);
+	}
+
+	void gbImageLoader::Map(char const* fname, gbImageType* img_type, RowOrder_T order) {
+		GB_STATS_TIMER("image.map");
+		Clear();
+		try {
+			m_file.Open(fname);
+		} catch( Ghulbus::gbException& ) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
+				                         "Image file could not be opened" ) );
+		}
+		if( img_type->MapFile(m_file.GetData(), m_file.GetSize(), (order == ROWS_BOTTOM_UP), &m_view, &m_bpp) ) {
+			m_width  = m_view.width;
+			m_height = m_view.height;
+			GB_STATS_COUNT("image.bytes_mapped", m_file.GetSize());
+			GB_STATS_COUNT("image.pixels_mapped", static_cast<unsigned long long>(m_width) * m_height);
+		} else {
+			m_file.Close();
+			Load(fname, img_type, order);
+		}
 	}
 
 	gbImageLoader::~gbImageLoader() {
+		Clear();
+	}
+
+	void gbImageLoader::Clear() {
 		if(m_palette) { delete[] m_palette;  m_palette = NULL; }
 		if(m_data)    { delete[] m_data;     m_data    = NULL; }
+		m_file.Close();
+		m_view = gbImageView();
+		m_width = m_height = m_bpp = 0;
 	}
 
 	int gbImageLoader::GetWidth() const {
@@ -47,8 +211,17 @@ namespace GhulbusUtil {
 	bool gbImageLoader::HasPalette() const {
 		return (m_palette != NULL);
 	}
+	bool gbImageLoader::IsMapped() const {
+		return (m_file.GetData() != NULL);
+	}
+	gbImageView const& gbImageLoader::GetView() const {
+		return m_view;
+	}
 	void gbImageLoader::GetImageData(unsigned char* pData) const {
-		memcpy(pData, m_data, (m_width*m_height*m_bpp));
+		size_t const row_size = GetPixelSize(m_view.format) * m_width;
+		for(int row=0; row<m_height; row++) {
+			memcpy(pData + row * row_size, m_view.GetRow(row), row_size);
+		}
 	}
 	void gbImageLoader::GetPaletteData(unsigned int* pPal) const {
 		switch(m_bpp) {
@@ -67,50 +240,33 @@ namespace GhulbusUtil {
 				break;
 		}
 	}
+
 	void gbImageLoader::GetImageData32(GhulbusGraphics::GBCOLOR* pData) const {
-		switch(m_bpp) {
-			case 32:
-				//32 bit image: one byte per color-channel, one byte alpha:
-				for(int i=0; i<(m_width*m_height); i++) {
-					pData[i] = GhulbusGraphics::GBCOLOR32::ARGB(m_data[i*4+3], m_data[i*4+2], m_data[i*4+1], m_data[i*4]);
-				}
-				break;
-			case 24:
-				//24 bit image: one byte per color-channel, no alpha channel
-				for(int i=0; i<(m_width*m_height); i++) {
-					pData[i] = GhulbusGraphics::GBCOLOR32::XRGB(m_data[i*3+2], m_data[i*3+1], m_data[i*3]);
-				}
-				break;
-			case 16:
-				//16 bit image: 5 bit per color channel, 1 bit alpha channel (unsupported)
-				for(int i=0; i<(m_width*m_height); i++) {
-					GhulbusGraphics::GBCOLOR_COMPONENT r,g,b,a;
-					r =  (m_data[i*2+1] & 0x7C) >> 2;
-					g = ((m_data[i*2]   & 0xE0) >> 5) | ((m_data[i*2+1] & 0x03) << 3);
-					b =  (m_data[i*2]   & 0x1F);
-					a =  (m_data[i*2+1] & 0x80) >> 7;
-					a = 1;
-					///@todo alpha channel
-					///@todo dithering(?)
-					pData[i] = GhulbusGraphics::GBCOLOR32::ARGB(a*255,r*8,g*8,b*8);
-				}
-				break;
-			case 8: case 4: case 1:
-				//one byte palette index per pixel
-				for(int i=0; i<(m_width*m_height); i++) {
-					GhulbusGraphics::GBCOLOR_COMPONENT r,g,b,a;
-					r = static_cast<GhulbusGraphics::GBCOLOR_COMPONENT>((m_palette[m_data[i]] >> 16) & 0xff);
-					g = static_cast<GhulbusGraphics::GBCOLOR_COMPONENT>((m_palette[m_data[i]] >>  8) & 0xff);
-					b = static_cast<GhulbusGraphics::GBCOLOR_COMPONENT>((m_palette[m_data[i]])       & 0xff);
-					a = static_cast<GhulbusGraphics::GBCOLOR_COMPONENT>((m_palette[m_data[i]] >> 24) & 0xff);
-					pData[i] = GhulbusGraphics::GBCOLOR32::ARGB(a, r, g, b);
-				}
-				///@todo dithering(?)
-				break;
-			default:
-				throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
-					                         "Unable to acquire 32bit image data" ) );
-				break;
+		if((m_width <= 0) || (m_height <= 0)) { return; }
+		size_t const row_size = GetPixelSize(m_view.format) * m_width;
+		if(m_view.pitch == static_cast<ptrdiff_t>(row_size)) {
+			//rows are contiguous:
+			ConvertPixels32(m_view, m_view.data, pData, static_cast<size_t>(m_width) * m_height);
+		} else {
+			for(int row=0; row<m_height; row++) {
+				ConvertPixels32(m_view, m_view.GetRow(row), pData + static_cast<size_t>(row) * m_width, m_width);
+			}
+		}
+	}
+
+	void gbImageLoader::GetRowData32(int row, GhulbusGraphics::GBCOLOR* pData) const {
+		GhulbusUtil::GetRowData32(m_view, row, pData);
+	}
+
+	void FlipRows(unsigned char* data, int pitch, int height) {
+		if((pitch <= 0) || (height < 2)) { return; }
+		std::vector<unsigned char> tmp(pitch);
+		for(int row=0; row<(height/2); row++) {
+			unsigned char* top    = data + static_cast<size_t>(row) * pitch;
+			unsigned char* bottom = data + static_cast<size_t>((height-1) - row) * pitch;
+			memcpy(&tmp[0], top, pitch);
+			memcpy(top, bottom, pitch);
+			memcpy(bottom, &tmp[0], pitch);
 		}
 	}
 
@@ -118,12 +274,54 @@ namespace GhulbusUtil {
 		;
 	}
 
-	void WriteImage(char const* fname, GhulbusGraphics::GBCOLOR const* data, int width, int height)
+	/** Helper function: Appends a row of pixels in the byte order of 32 bit TGA files
+	 */
+	static unsigned char* StoreTGAPixels(unsigned char* dst, GhulbusGraphics::GBCOLOR const* src, int n)
+	{
+		for(int i=0; i<n; ++i) {
+			dst[0] = GhulbusGraphics::GBCOLOR32::GetB(src[i]);
+			dst[1] = GhulbusGraphics::GBCOLOR32::GetG(src[i]);
+			dst[2] = GhulbusGraphics::GBCOLOR32::GetR(src[i]);
+			dst[3] = GhulbusGraphics::GBCOLOR32::GetA(src[i]);
+			dst += 4;
+		}
+		return dst;
+	}
+
+	/** Helper function: Appends a row of pixels as TGA RLE packets
+	 * @note Packets never cross rows, as recommended by the TGA specification.
+	 */
+	static unsigned char* StoreTGAPixelsRLE(unsigned char* dst, GhulbusGraphics::GBCOLOR const* src, int n)
+	{
+		int i = 0;
+		while(i < n) {
+			//length of the repetition starting at i:
+			int run = 1;
+			while((i + run < n) && (run < 128) && (src[i + run] == src[i])) { ++run; }
+			if(run > 1) {
+				*dst++ = static_cast<unsigned char>(0x80 | (run - 1));
+				dst = StoreTGAPixels(dst, src + i, 1);
+				i += run;
+				continue;
+			}
+			//literal packet up to the next repetition:
+			int count = 1;
+			while((i + count < n) && (count < 128) &&
+			      ((i + count + 1 >= n) || (src[i + count] != src[i + count + 1]))) { ++count; }
+			*dst++ = static_cast<unsigned char>(count - 1);
+			dst = StoreTGAPixels(dst, src + i, count);
+			i += count;
+		}
+		return dst;
+	}
+
+	void WriteImage(std::vector<unsigned char>& out, GhulbusGraphics::GBCOLOR const* data, int width, int height,
+	                bool bottom_up, bool rle)
 	{
 		struct {
 			unsigned char  nCharIDField;		// Number of Chars in ID Field (1 Byte)
 			unsigned char  ColorMapType;		// is 1 if color map specified; must be 0 for us
-			unsigned char  ImageTypeCode;		// Data Type; must be 2 for us
+			unsigned char  ImageTypeCode;		// Data Type; 2 (unmapped) or 10 (unmapped, RLE)
 			unsigned char  ColorMapSpec[5];		// should be 0
 			unsigned short XOrigin;				// expected to be 0
 			unsigned short YOrigin;				// expected to be 0
@@ -134,8 +332,8 @@ namespace GhulbusUtil {
 		} header;
 
 		memset(&header, 0, sizeof(header));
-		header.ImageTypeCode = 2;
-		if((width > USHRT_MAX) || (height > USHRT_MAX)) { 
+		header.ImageTypeCode = (rle) ? 10 : 2;
+		if((width < 0) || (height < 0) || (width > USHRT_MAX) || (height > USHRT_MAX)) { 
 			throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
 		}
 		header.Width  = static_cast<unsigned short>(width);
@@ -143,42 +341,48 @@ namespace GhulbusUtil {
 		header.ImagePixelSize = 32;
 		header.ImageDescByte = 0x28;		//magic number: 8 bits per channel, origin upper left, no padding
 
-		std::ofstream  fout( fname, std::ios_base::out | std::ios_base::binary );
-		if(fout.fail()) {
-			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Output file could not be opened" ) );
-		}
-		fout.write( reinterpret_cast<char*>(&header), sizeof(header) );
-		
-		for(int i=0; i<width*height; ++i) {
-			unsigned char a = GhulbusGraphics::GBCOLOR32::GetA(data[i]);
-			unsigned char r = GhulbusGraphics::GBCOLOR32::GetR(data[i]);
-			unsigned char g = GhulbusGraphics::GBCOLOR32::GetG(data[i]);
-			unsigned char b = GhulbusGraphics::GBCOLOR32::GetB(data[i]);
-			fout << b << g << r << a;
+		//worst case for RLE is one packet header per pixel:
+		size_t const pitch = static_cast<size_t>(width) * ((rle) ? 5 : 4);
+		out.resize(sizeof(header) + pitch * height);
+		memcpy(&out[0], &header, sizeof(header));
+		unsigned char* dst = &out[0] + sizeof(header);
+
+		//the file stores the top row first:
+		for(int row=0; row<height; ++row) {
+			GhulbusGraphics::GBCOLOR const* line = data + static_cast<size_t>((bottom_up) ? (height-1-row) : row) * width;
+			dst = (rle) ? StoreTGAPixelsRLE(dst, line, width) : StoreTGAPixels(dst, line, width);
 		}
-		if(fout.fail()) {
+		out.resize(dst - &out[0]);
+	}
+
+	void WriteImage(char const* fname, GhulbusGraphics::GBCOLOR const* data, int width, int height, bool bottom_up, bool rle)
+	{
+		GB_STATS_TIMER("image.write_file");
+		std::vector<unsigned char> buffer;
+		WriteImage(buffer, data, width, height, bottom_up, rle);
+
+		try {
+			GetFileBackend().WriteFile(fname, &buffer[0], buffer.size());
+		} catch(Ghulbus::gbException&) {
 			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Error while writing to output file" ) );
 		}
+		GB_STATS_COUNT("image.bytes_written", buffer.size());
 	}
 
 	void gbImageLoader::FlipV() {
-		int pitch;		//fields per row
-		switch(m_bpp) {
-			case 32: case 24: case 16: case 8: 
-				pitch = (m_bpp / 8) * m_width;
-				break;
-			case 4: case 1:
-				pitch = m_width;
-				break;
-			default:
-				throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED ) );
-				break;
-		}
-		for(int row=0; row<(m_height/2); row++) {
-			for(int i=0; i<pitch; i++) {
-				m_data[row * pitch + i] ^= m_data[((m_height-1) - row) * pitch + i]
-					^= m_data[row * pitch + i] ^= m_data[((m_height-1) - row) * pitch + i];
-			}
+		if((m_width <= 0) || (m_height <= 0)) { return; }
+		if(IsMapped()) {
+			//the file must not be modified; reverse the view instead:
+			m_view.data  = m_view.GetRow(m_height - 1);
+			m_view.pitch = -m_view.pitch;
+			return;
 		}
+		FlipRows(m_data, static_cast<int>(m_view.pitch), m_height);
+	}
+
+	bool gbImageLoader::gbImageType::MapFile(unsigned char const* file_data, size_t file_size, bool bottom_up,
+	                                         gbImageView* view, int* bpp)
+	{
+		return false;
 	}
 };
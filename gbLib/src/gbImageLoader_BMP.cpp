@@ -10,6 +10,8 @@
  *
  */
 #include "../include/gbImageLoader.hpp"
+#include <cstring>
+#include <vector>
 
 namespace GhulbusUtil {
 	gbImageLoader::gbImageType* gbImageType_BMP() {
@@ -55,19 +57,48 @@ namespace GhulbusUtil {
         unsigned int   biClrImportant;
 	};
 
-	/** Helper function: Flips the image in Y
+	/** Helper function: Number of rows of the image
 	 */
-	static void FlipImageVertical(BITMAPINFOHEADER const& iheader, unsigned char* data) {
-		//Flip image in Y:
-		int p = (iheader.biBitCount >= 8)?(iheader.biBitCount >> 3):1;
-		for(int y=0; y<iheader.biHeight/2; y++) {
-			for(int x=0; x<iheader.biWidth; x++) {
-				for(int q=0; q<p; q++) {			//loop over different color channels
-					data[(y*iheader.biWidth + x) * p + q] 
-						^= data[((((iheader.biHeight-1)-y)*iheader.biWidth) + x) * p + q]
-						^= data[(y*iheader.biWidth + x) * p + q] 
-						^= data[((((iheader.biHeight-1)-y)*iheader.biWidth) + x) * p + q];
+	static int GetImageHeight(BITMAPINFOHEADER const& iheader) {
+		//a negative height indicates an image stored top row first:
+		return (iheader.biHeight < 0) ? -iheader.biHeight : iheader.biHeight;
+	}
+
+	/** Helper function: Reads the pixel rows, unpacking 1 and 4 bit pixels to one byte each
+	 * @param[in] bottom_up Requested row order of data (see gbImageLoader::gbImageType::ReadFile())
+	 */
+	static void ReadPixelRows(std::istream& file, BITMAPINFOHEADER const& iheader, BITMAPFILEHEADER const& fheader,
+	                          unsigned char* data, unsigned int file_offset, bool bottom_up)
+	{
+		int const width  = iheader.biWidth;
+		int const height = GetImageHeight(iheader);
+		//rows in the file are padded to a multiple of 4 bytes:
+		size_t const file_pitch = ((static_cast<size_t>(width) * iheader.biBitCount + 31) / 32) * 4;
+		size_t const pitch      = static_cast<size_t>(width) * ((iheader.biBitCount >= 8) ? (iheader.biBitCount >> 3) : 1);
+		bool const same_order   = ((iheader.biHeight > 0) == bottom_up);
+		file.seekg( file_offset+fheader.bfOffBits, ::std::ios::beg );
+		if((file_pitch == pitch) && same_order) {
+			file.read( reinterpret_cast<char*>(data), pitch * height );
+			return;
+		}
+		std::vector<unsigned char> row(file_pitch);
+		for(int i=0; (i<height) && file.good(); i++) {
+			file.read( reinterpret_cast<char*>(&row[0]), file_pitch );
+			unsigned char* dst = data + pitch * ((same_order) ? i : ((height-1) - i));
+			switch(iheader.biBitCount) {
+			case 1:					//eight pixels per byte, first pixel in the highest bit
+				for(int x=0; x<width; x++) {
+					dst[x] = (row[x >> 3] >> (7 - (x & 7))) & 0x1;
+				}
+				break;
+			case 4:					//two pixels per byte, first pixel in the upper half-byte
+				for(int x=0; x<width; x++) {
+					dst[x] = (x & 1) ? (row[x >> 1] & 0xF) : ((row[x >> 1] & 0xF0) >> 4);
 				}
+				break;
+			default:
+				memcpy(dst, &row[0], pitch);
+				break;
 			}
 		}
 	}
@@ -78,27 +109,15 @@ namespace GhulbusUtil {
 #endif
 	/** Helper function: Reads image data from 1bpp BMP file
 	 */
-	static void ReadData1Bit(std::ifstream& file, BITMAPINFOHEADER const& iheader, BITMAPFILEHEADER const& fheader, 
-		                     unsigned char* data, unsigned int** palette, unsigned int file_offset)
+	static void ReadData1Bit(std::istream& file, BITMAPINFOHEADER const& iheader, BITMAPFILEHEADER const& fheader, 
+		                     unsigned char* data, unsigned int** palette, unsigned int file_offset, bool bottom_up)
 	{
 		switch(iheader.biCompression)
 			{
 			case 0:					//uncompressed rgb (1 bit, palettized)
 				(*palette) = new unsigned int[2];
 				file.read( reinterpret_cast<char*>(*palette), 8 );
-				file.seekg( file_offset+fheader.bfOffBits, ::std::ios::beg );
-				file.read( reinterpret_cast<char*>(data), (iheader.biWidth*iheader.biHeight)>>3 );
-				//unpack data (currently each byte describes eight consecutive pixels):
-				for(int i=(iheader.biWidth*iheader.biHeight)-1; i>=7; i-=8) {
-					data[i]   = (data[(i>>3)] & 0x1);
-					data[i-1] = (data[(i>>3)] & 0x2)  >> 1;
-					data[i-2] = (data[(i>>3)] & 0x4)  >> 2;
-					data[i-3] = (data[(i>>3)] & 0x8)  >> 3;
-					data[i-4] = (data[(i>>3)] & 0x10) >> 4;
-					data[i-5] = (data[(i>>3)] & 0x20) >> 5;
-					data[i-6] = (data[(i>>3)] & 0x40) >> 6;
-					data[i-7] = (data[(i>>3)] & 0x80) >> 7;
-				}
+				ReadPixelRows(file, iheader, fheader, data, file_offset, bottom_up);
 				break;
 			default:
 				throw( Ghulbus::gbException( Ghulbus::gbException::GB_NOTIMPLEMENTED ) );
@@ -107,21 +126,15 @@ namespace GhulbusUtil {
 
 	/** Helper function: Reads image data from 4bpp BMP file
 	 */
-	static void ReadData4Bit(std::ifstream& file, BITMAPINFOHEADER const& iheader, BITMAPFILEHEADER const& fheader, 
-		                     unsigned char* data, unsigned int** palette, unsigned int file_offset)
+	static void ReadData4Bit(std::istream& file, BITMAPINFOHEADER const& iheader, BITMAPFILEHEADER const& fheader, 
+		                     unsigned char* data, unsigned int** palette, unsigned int file_offset, bool bottom_up)
 	{
 		switch(iheader.biCompression)
 		{
 		case 0:						//uncompressed rgb (4 bits, palettized)
 			(*palette) = new unsigned int[16];
 			file.read( reinterpret_cast<char*>(*palette), 64 );
-			file.seekg( file_offset+fheader.bfOffBits, ::std::ios::beg );
-			file.read( reinterpret_cast<char*>(data), (iheader.biWidth*iheader.biHeight)>>1 );
-			//unpack data (currently each byte describes two consecutive pixels):
-			for(int i=(iheader.biWidth*iheader.biHeight)-1; i>0; i-=2) {
-				data[i]   = (data[i>>1] & 0xF);			//Lower half-byte
-				data[i-1] = (data[i>>1] & 0xF0) >> 4;	//Upper half-byte
-			}
+			ReadPixelRows(file, iheader, fheader, data, file_offset, bottom_up);
 			break;
 		default:
 			throw( Ghulbus::gbException( Ghulbus::gbException::GB_NOTIMPLEMENTED ) );
@@ -130,16 +143,15 @@ namespace GhulbusUtil {
 
 	/** Helper function: Reads image data from 8bpp BMP file
 	 */
-	static void ReadData8Bit(std::ifstream& file, BITMAPINFOHEADER const& iheader, BITMAPFILEHEADER const& fheader, 
-		                     unsigned char* data, unsigned int** palette, unsigned int file_offset)
+	static void ReadData8Bit(std::istream& file, BITMAPINFOHEADER const& iheader, BITMAPFILEHEADER const& fheader, 
+		                     unsigned char* data, unsigned int** palette, unsigned int file_offset, bool bottom_up)
 	{
 		switch(iheader.biCompression)
 		{
 		case 0:						//uncompressed rgb (8 bit, palettized)
 			(*palette) = new unsigned int[256];
 			file.read( reinterpret_cast<char*>(*palette), 1024 );
-			file.seekg( file_offset+fheader.bfOffBits, ::std::ios::beg );
-			file.read( reinterpret_cast<char*>(data), iheader.biWidth*iheader.biHeight );
+			ReadPixelRows(file, iheader, fheader, data, file_offset, bottom_up);
 			break;
 		default:
 			throw( Ghulbus::gbException( Ghulbus::gbException::GB_NOTIMPLEMENTED ) );
@@ -148,23 +160,22 @@ namespace GhulbusUtil {
 
 	/** Helper function: Reads image data from 16bpp BMP file
 	 */
-	static void ReadData16Bit(std::ifstream& file, BITMAPINFOHEADER const& iheader, BITMAPFILEHEADER const& fheader, 
-		                     unsigned char* data, unsigned int** palette, unsigned int file_offset)
+	static void ReadData16Bit(std::istream& file, BITMAPINFOHEADER const& iheader, BITMAPFILEHEADER const& fheader, 
+		                     unsigned char* data, unsigned int** palette, unsigned int file_offset, bool bottom_up)
 	{
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_NOTIMPLEMENTED ) );
 	}
 
 	/** Helper function: Reads image data from 24bpp BMP file
 	 */
-	static void ReadData24Bit(std::ifstream& file, BITMAPINFOHEADER const& iheader, BITMAPFILEHEADER const& fheader, 
-		                     unsigned char* data, unsigned int** palette, unsigned int file_offset)
+	static void ReadData24Bit(std::istream& file, BITMAPINFOHEADER const& iheader, BITMAPFILEHEADER const& fheader, 
+		                     unsigned char* data, unsigned int** palette, unsigned int file_offset, bool bottom_up)
 	{
 		switch(iheader.biCompression)
 		{
 		case 0:						//uncompressed rgb (24 bits)
 			//read image data:
-			file.seekg( file_offset+fheader.bfOffBits, ::std::ios::beg );
-			file.read( reinterpret_cast<char*>(data), iheader.biWidth*iheader.biHeight*4 );
+			ReadPixelRows(file, iheader, fheader, data, file_offset, bottom_up);
 			break;
 		default:
 			throw( Ghulbus::gbException( Ghulbus::gbException::GB_NOTIMPLEMENTED ) );
@@ -173,8 +184,8 @@ namespace GhulbusUtil {
 
 	/** Helper function: Reads image data from 32bpp BMP file
 	 */
-	static void ReadData32Bit(std::ifstream& file, BITMAPINFOHEADER const& iheader, BITMAPFILEHEADER const& fheader, 
-		                     unsigned char* data, unsigned int** palette, unsigned int file_offset)
+	static void ReadData32Bit(std::istream& file, BITMAPINFOHEADER const& iheader, BITMAPFILEHEADER const& fheader, 
+		                     unsigned char* data, unsigned int** palette, unsigned int file_offset, bool bottom_up)
 	{
 		switch(iheader.biCompression)
 		{
@@ -190,10 +201,9 @@ namespace GhulbusUtil {
 				file.read( reinterpret_cast<char*>(colormasks), 12 );
 			}
 			//read image data:
-			file.seekg( file_offset+fheader.bfOffBits, ::std::ios::beg );
-			file.read( reinterpret_cast<char*>(data), iheader.biWidth*iheader.biHeight*4 );
+			ReadPixelRows(file, iheader, fheader, data, file_offset, bottom_up);
 			unsigned int tmp, *ptmp;
-			for(int i=0; i<iheader.biWidth*iheader.biHeight; i++) {		//apply color masks
+			for(int i=0; i<iheader.biWidth*GetImageHeight(iheader); i++) {		//apply color masks
 				ptmp = (unsigned int*)(&data[i*4]);
 				tmp = *ptmp;
 				*ptmp = ( ((((tmp & colormasks[0]) / ((colormasks[0]>>8)+1)) & 0xff) << 16) |
@@ -218,62 +228,100 @@ namespace GhulbusUtil {
 	{
 		;
 	}
-	bool gbImageType_BMP_T::CheckFile(std::ifstream const& file) 
+	bool gbImageType_BMP_T::CheckFile(std::istream const& file) 
 	{
 		///@todo
 		return true;
 	}
-	void gbImageType_BMP_T::ReadFile(std::ifstream& file, int* width, int* height, int* bpp, 
-		                           unsigned char** pp_data, unsigned int** pp_palette) 
+	bool gbImageType_BMP_T::MapFile(unsigned char const* file_data, size_t file_size, bool bottom_up,
+	                                gbImageView* view, int* bpp)
+	{
+		BITMAPFILEHEADER fheader;
+		BITMAPINFOHEADER iheader;
+		if(file_size < m_file_offset + sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)) { return false; }
+		memcpy(&fheader, file_data + m_file_offset, sizeof(BITMAPFILEHEADER));
+		memcpy(&iheader, file_data + m_file_offset + sizeof(BITMAPFILEHEADER), sizeof(BITMAPINFOHEADER));
+		//only uncompressed 24 and 32 bit images can be used as they are:
+		if( (iheader.biCompression != 0) || (iheader.biClrUsed != 0) ||
+		    ((iheader.biBitCount != 24) && (iheader.biBitCount != 32)) ||
+		    (iheader.biWidth <= 0) || (iheader.biHeight == 0) ) {
+			return false;
+		}
+		int const height = GetImageHeight(iheader);
+		size_t const file_pitch = ((static_cast<size_t>(iheader.biWidth) * iheader.biBitCount + 31) / 32) * 4;
+		size_t const offset = m_file_offset + fheader.bfOffBits;
+		if((offset > file_size) || ((file_size - offset) / file_pitch < static_cast<size_t>(height))) {
+			return false;
+		}
+		bool const same_order = ((iheader.biHeight > 0) == bottom_up);
+		view->data    = file_data + offset + ((same_order) ? 0 : ((height-1) * file_pitch));
+		view->pitch   = (same_order) ? static_cast<ptrdiff_t>(file_pitch) : -static_cast<ptrdiff_t>(file_pitch);
+		view->width   = iheader.biWidth;
+		view->height  = height;
+		//ReadFile() clears the unused byte of 32 bit pixels:
+		view->format  = (iheader.biBitCount == 24) ? GB_PIXEL_BGR24 : GB_PIXEL_BGRX32;
+		view->palette = NULL;
+		*bpp = iheader.biBitCount;
+		return true;
+	}
+
+	void gbImageType_BMP_T::ReadFile(std::istream& file, int* width, int* height, int* bpp, 
+		                           unsigned char** pp_data, unsigned int** pp_palette, bool bottom_up) 
 	{
 		BITMAPFILEHEADER fheader;
 		BITMAPINFOHEADER iheader;
 		file.seekg(m_file_offset, ::std::ios::beg);
 		file.read( reinterpret_cast<char*>(&fheader), sizeof(BITMAPFILEHEADER) );
 		file.read( reinterpret_cast<char*>(&iheader), sizeof(BITMAPINFOHEADER));
+		if(file.fail() || (iheader.biWidth < 0)) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
+			                             "Error while reading BMP image file" ) );
+		}
 
-		if(iheader.biClrUsed || (iheader.biHeight < 0)) { 
+		if(iheader.biClrUsed) { 
 			throw( Ghulbus::gbException( Ghulbus::gbException::GB_NOTIMPLEMENTED ) );
 		}
 
 		unsigned int* palette = NULL;
-		unsigned char* data = new unsigned char[iheader.biWidth*iheader.biHeight*((iheader.biBitCount >= 8)?(iheader.biBitCount>>3):1)];
+		unsigned char* data = new unsigned char[iheader.biWidth*GetImageHeight(iheader)*((iheader.biBitCount >= 8)?(iheader.biBitCount>>3):1)];
 
 		try {
 			switch(iheader.biBitCount)
 			{
 			case 1:
-				ReadData1Bit(file, iheader, fheader, data, &palette, m_file_offset);
+				ReadData1Bit(file, iheader, fheader, data, &palette, m_file_offset, bottom_up);
 				break;
 			case 4:
-				ReadData4Bit(file, iheader, fheader, data, &palette, m_file_offset);
+				ReadData4Bit(file, iheader, fheader, data, &palette, m_file_offset, bottom_up);
 				break;
 			case 8:
-				ReadData8Bit(file, iheader, fheader, data, &palette, m_file_offset);
+				ReadData8Bit(file, iheader, fheader, data, &palette, m_file_offset, bottom_up);
 				break;
 			case 16:
-				ReadData16Bit(file, iheader, fheader, data, &palette, m_file_offset);
+				ReadData16Bit(file, iheader, fheader, data, &palette, m_file_offset, bottom_up);
 				break;
 			case 24:
-				ReadData24Bit(file, iheader, fheader, data, &palette, m_file_offset);
+				ReadData24Bit(file, iheader, fheader, data, &palette, m_file_offset, bottom_up);
 				break;
 			case 32:
-				ReadData32Bit(file, iheader, fheader, data, &palette, m_file_offset);
+				ReadData32Bit(file, iheader, fheader, data, &palette, m_file_offset, bottom_up);
 				break;
 			default:
 				throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
 											 "Illegal bit depth in BMP image file") );
 			}
+			if(file.fail()) {
+				throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
+				                             "Error while reading BMP image file" ) );
+			}
 		} catch(Ghulbus::gbException) {
 			if(data)    { delete[] data; }
 			if(palette) { delete[] palette; }
 			throw;
 		}
 
-		FlipImageVertical(iheader, data);
-
 		*width      = iheader.biWidth;
-		*height     = iheader.biHeight;
+		*height     = GetImageHeight(iheader);
 		*bpp        = iheader.biBitCount;
 		*pp_data    = data;
 		*pp_palette = palette;
@@ -10,6 +10,9 @@
  *
  */
 #include "../include/gbImageLoader.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 namespace GhulbusUtil {
 	gbImageLoader::gbImageType* gbImageType_TGA() {
@@ -20,7 +23,7 @@ namespace GhulbusUtil {
 	//  TGA  //
 	///////////
 	/*
-	 * currently supported: unmapped rgb 16, 24, 32 bit
+	 * currently supported: unmapped rgb 16, 24, 32 bit; uncompressed or RLE
 	 */
 	struct TGAHEADER {
 		unsigned char  nCharIDField;		///< Number of Chars in ID Field (1 Byte)
@@ -35,31 +38,87 @@ namespace GhulbusUtil {
 		unsigned char  ImageDescByte;		///< Image Descriptor Byte
 	};
 
-	/** Helper function: Flips image data in Y
+	/** Helper function: Reads image data from unmapped rgb file
+	 * @param[in] bottom_up Requested row order of data (see gbImageLoader::gbImageType::ReadFile())
 	 */
-	static void FlipImageVertical(TGAHEADER const& header, unsigned char* data) {
-		//Flip image in Y:
-		int p = header.ImagePixelSize >> 3;
-		for(int y=0; y<header.Height/2; y++) {
-			for(int x=0; x<header.Width; x++) {
-				for(int q=0; q<p; q++) {			//loop over different color channels
-					data[(y*header.Width + x) * p + q] 
-						^= data[((((header.Height-1)-y)*header.Width) + x) * p + q]
-						^= data[(y*header.Width + x) * p + q] 
-						^= data[((((header.Height-1)-y)*header.Width) + x) * p + q];
-				}
+	static void ReadUnmappedRBG(std::istream& file, TGAHEADER const& header, unsigned char* data, unsigned int file_offset,
+	                            bool bottom_up)
+	{
+		//Adjust file pointer to beginning of img-data:
+		file.seekg(file_offset+sizeof(TGAHEADER)+header.nCharIDField, ::std::ios::beg);
+		size_t const pitch = static_cast<size_t>(header.Width) * (header.ImagePixelSize / 8);
+		//bit 5 of the descriptor is set for images stored top row first:
+		bool const file_bottom_up = ((header.ImageDescByte & 0x20) == 0);
+		if(file_bottom_up == bottom_up) {
+			//Read image data:
+			file.read(reinterpret_cast<char*>(data), pitch * header.Height);
+		} else {
+			//Read rows in reverse order:
+			for(int row=header.Height-1; (row >= 0) && file.good(); row--) {
+				file.read(reinterpret_cast<char*>(data + row * pitch), pitch);
 			}
 		}
 	}
 
-	/** Helper function: Reads image data from unmapped rgb file
+	/** Helper function: Reads image data from run length encoded unmapped rgb file
+	 * @param[in] bottom_up Requested row order of data (see gbImageLoader::gbImageType::ReadFile())
+	 * @throw Ghulbus::gbException GB_FAILED indicates corrupted data
 	 */
-	static void ReadUnmappedRBG(std::ifstream& file, TGAHEADER const& header, unsigned char* data, unsigned int file_offset)
+	static void ReadUnmappedRBG_RLE(std::istream& file, TGAHEADER const& header, unsigned char* data, unsigned int file_offset,
+	                                bool bottom_up)
 	{
-		//Adjust file pointer to beginning of img-data:
-		file.seekg(file_offset+sizeof(TGAHEADER)+header.nCharIDField, ::std::ios::beg);
-		//Read image data:
-		file.read(reinterpret_cast<char*>(data), (header.Width*header.Height*header.ImagePixelSize) / 8);
+		size_t const data_start = file_offset + sizeof(TGAHEADER) + header.nCharIDField;
+		size_t const pixel_size = header.ImagePixelSize / 8;
+		size_t const pitch = static_cast<size_t>(header.Width) * pixel_size;
+		//read the compressed stream at once; it is never larger than a packet header per pixel:
+		file.seekg(0, ::std::ios::end);
+		size_t const file_end = static_cast<size_t>(file.tellg());
+		if(file_end < data_start) { file.setstate(std::ios::failbit); return; }
+		size_t const size = std::min(file_end - data_start, static_cast<size_t>(header.Width) * header.Height * (pixel_size + 1));
+		std::vector<unsigned char> buffer(size + 1);
+		file.seekg(data_start, ::std::ios::beg);
+		file.read(reinterpret_cast<char*>(&buffer[0]), size);
+		if(file.fail()) { return; }
+
+		//rows are written in the requested order; packets may span rows:
+		bool const flip = (((header.ImageDescByte & 0x20) == 0) != bottom_up);
+		unsigned char const* src = &buffer[0];
+		unsigned char const* const src_end = src + size;
+		size_t count = 0;			//pixels left in the current packet
+		bool repeat = false;		//current packet is a repetition of the pixel at src
+		for(int row=0; row<header.Height; row++) {
+			unsigned char* dst = data + ((flip) ? (header.Height-1-row) : row) * pitch;
+			unsigned char* const dst_end = dst + pitch;
+			while(dst != dst_end) {
+				if(count == 0) {
+					//next packet header:
+					if(src == src_end) {
+						throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
+						                             "TGA image data is corrupted" ) );
+					}
+					repeat = ((*src & 0x80) != 0);
+					count = (*src & 0x7f) + 1;
+					++src;
+					if(static_cast<size_t>(src_end - src) < ((repeat) ? 1 : count) * pixel_size) {
+						throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
+						                             "TGA image data is corrupted" ) );
+					}
+				}
+				size_t const n = std::min(count, static_cast<size_t>(dst_end - dst) / pixel_size);
+				if(repeat) {
+					for(size_t i=0; i<n; i++) {
+						memcpy(dst, src, pixel_size);
+						dst += pixel_size;
+					}
+				} else {
+					memcpy(dst, src, n * pixel_size);
+					dst += n * pixel_size;
+					src += n * pixel_size;
+				}
+				count -= n;
+				if(repeat && (count == 0)) { src += pixel_size; }
+			}
+		}
 	}
 
 	gbImageType_TGA_T::gbImageType_TGA_T()
@@ -73,27 +132,72 @@ namespace GhulbusUtil {
 		;
 	}
 
-	bool gbImageType_TGA_T::CheckFile(std::ifstream const& file) {
+	bool gbImageType_TGA_T::CheckFile(std::istream const& file) {
 		///@todo
 		return true;
 	}
 
-	void gbImageType_TGA_T::ReadFile(std::ifstream& file, int* width, int* height, int* bpp, 
-			                       unsigned char** pp_data, unsigned int** pp_palette)
+	bool gbImageType_TGA_T::MapFile(unsigned char const* file_data, size_t file_size, bool bottom_up,
+	                                gbImageView* view, int* bpp)
+	{
+		TGAHEADER header;
+		if(file_size < m_file_offset + sizeof(TGAHEADER)) { return false; }
+		memcpy(&header, file_data + m_file_offset, sizeof(TGAHEADER));
+		//only uncompressed unmapped images stored left to right can be used as they are:
+		if( (header.ImageTypeCode != 2) || (header.ColorMapType != 0) || ((header.ImageDescByte & 0xd0) != 0) ||
+		    ((header.ImagePixelSize != 16) && (header.ImagePixelSize != 24) && (header.ImagePixelSize != 32)) ||
+		    (header.Width == 0) || (header.Height == 0) ) {
+			return false;
+		}
+		size_t const pitch = static_cast<size_t>(header.Width) * (header.ImagePixelSize / 8);
+		size_t const offset = m_file_offset + sizeof(TGAHEADER) + header.nCharIDField;
+		if((offset > file_size) || ((file_size - offset) / pitch < header.Height)) {
+			return false;
+		}
+		//bit 5 of the descriptor is set for images stored top row first:
+		bool const same_order = (((header.ImageDescByte & 0x20) == 0) == bottom_up);
+		view->data    = file_data + offset + ((same_order) ? 0 : ((header.Height-1) * pitch));
+		view->pitch   = (same_order) ? static_cast<ptrdiff_t>(pitch) : -static_cast<ptrdiff_t>(pitch);
+		view->width   = header.Width;
+		view->height  = header.Height;
+		switch(header.ImagePixelSize) {
+			case 16: view->format = GB_PIXEL_RGB555; break;
+			case 24: view->format = GB_PIXEL_BGR24;  break;
+			default: view->format = GB_PIXEL_BGRA32; break;
+		}
+		view->palette = NULL;
+		*bpp = header.ImagePixelSize;
+		return true;
+	}
+
+	void gbImageType_TGA_T::ReadFile(std::istream& file, int* width, int* height, int* bpp, 
+			                       unsigned char** pp_data, unsigned int** pp_palette, bool bottom_up)
 	{
 		TGAHEADER header;
 		file.seekg(m_file_offset, ::std::ios::beg);
 		file.read( reinterpret_cast<char*>(&header), sizeof(TGAHEADER));
-		unsigned char* data = new unsigned char[header.Width*header.Height*header.ImagePixelSize];
+		if(file.fail()) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
+			                             "Error while reading TGA image file" ) );
+		}
+		if((header.ImagePixelSize != 16) && (header.ImagePixelSize != 24) && (header.ImagePixelSize != 32)) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_NOTIMPLEMENTED ) );
+		}
+		unsigned char* data = new unsigned char[header.Width*header.Height*(header.ImagePixelSize / 8)];
 
 		switch(header.ImageTypeCode) {
 			case 2:	//Unmapped RBG
-				ReadUnmappedRBG(file, header, data, m_file_offset);
-				if((header.ImageDescByte & 0x20) == 0) {		//Truvision?
-					FlipImageVertical(header, data);
+				ReadUnmappedRBG(file, header, data, m_file_offset, bottom_up);
+				break;
+			case 10: //Unmapped RBG, run length encoded
+				try {
+					ReadUnmappedRBG_RLE(file, header, data, m_file_offset, bottom_up);
+				} catch(...) {
+					delete[] data;
+					throw;
 				}
 				break;
-			case 1:	case 3:	case 9:	case 10: case 11: case 32: case 33:
+			case 1:	case 3:	case 9:	case 11: case 32: case 33:
 			default:
 				delete[] data;
 				throw( Ghulbus::gbException( Ghulbus::gbException::GB_NOTIMPLEMENTED ) );
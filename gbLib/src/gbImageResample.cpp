@@ -0,0 +1,283 @@
+/**
+ * @file src/gbImageResample.cpp
+ *
+ * ghulbusUtil - A collection of useful stuff
+ *
+ * @brief gbUtil Image resampling implementation
+ *
+ * @version 1.1
+ * @author Andreas Weis
+ *
+ */
+#include "../include/gbImageResample.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#	define GB_RESAMPLE_SSE2
+#	include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#	define GB_RESAMPLE_NEON
+#	include <arm_neon.h>
+#endif
+
+namespace GhulbusUtil {
+	/*
+	 * The image is filtered separably: every source row is converted to floating point
+	 * and filtered horizontally as soon as it is fetched; the filtered rows are kept in
+	 * a ring buffer holding just as many rows as the vertical filter needs.
+	 * Pixels are processed as 4 floats (b, g, r, a), one SIMD register each.
+	 */
+
+	/** Helper: Filter weights for resampling along one axis
+	 */
+	struct ResampleWeights {
+		int taps;						///< maximum number of source pixels contributing to a destination pixel
+		std::vector<int> first;			///< first contributing source pixel per destination pixel
+		std::vector<int> count;			///< number of contributing source pixels per destination pixel
+		std::vector<float> weights;		///< taps weights per destination pixel; normalized to a sum of 1
+	};
+
+	static float const PI = 3.14159265358979f;
+
+	/** Helper function: Evaluates a filter kernel
+	 * @param[in] x Distance from the filter center (in units of the widened filter)
+	 */
+	static float FilterKernel(gbResampleFilter_T filter, float x)
+	{
+		x = std::fabs(x);
+		switch(filter) {
+			case GB_RESAMPLE_BILINEAR:
+				return (x < 1.0f) ? (1.0f - x) : 0.0f;
+			case GB_RESAMPLE_LANCZOS3:
+				if(x < 1e-6f) { return 1.0f; }
+				if(x >= 3.0f) { return 0.0f; }
+				return (3.0f * std::sin(PI * x) * std::sin(PI * x / 3.0f)) / (PI * PI * x * x);
+			case GB_RESAMPLE_BOX:
+			default:
+				return (x <= 0.5f) ? 1.0f : 0.0f;
+		}
+	}
+
+	/** Helper function: Computes the filter weights for one axis
+	 */
+	static void ComputeWeights(ResampleWeights& w, int src_size, int dst_size, gbResampleFilter_T filter)
+	{
+		float const scale = static_cast<float>(src_size) / static_cast<float>(dst_size);
+		float const stretch = std::max(scale, 1.0f);		//widen the filter when reducing
+		float radius;
+		switch(filter) {
+			case GB_RESAMPLE_BILINEAR: radius = 1.0f; break;
+			case GB_RESAMPLE_LANCZOS3: radius = 3.0f; break;
+			case GB_RESAMPLE_BOX: default: radius = 0.5f; break;
+		}
+		float const support = radius * stretch;
+		w.taps = static_cast<int>(std::ceil(2.0f * support)) + 2;
+		w.first.resize(dst_size);
+		w.count.resize(dst_size);
+		w.weights.assign(static_cast<size_t>(dst_size) * w.taps, 0.0f);
+		for(int i=0; i<dst_size; i++) {
+			float const center = (i + 0.5f) * scale;
+			int const lo = std::max(static_cast<int>(std::floor(center - support)), 0);
+			int const hi = std::min(static_cast<int>(std::ceil(center + support)), src_size);
+			float* const dst = &w.weights[static_cast<size_t>(i) * w.taps];
+			float sum = 0.0f;
+			int n = 0;
+			for(int j=lo; (j<hi) && (n<w.taps); j++, n++) {
+				float weight;
+				if(filter == GB_RESAMPLE_BOX) {
+					//exact coverage of source pixel j by the destination pixel:
+					float const a = std::max(center - support, static_cast<float>(j));
+					float const b = std::min(center + support, static_cast<float>(j + 1));
+					weight = std::max(b - a, 0.0f);
+				} else {
+					weight = FilterKernel(filter, (j + 0.5f - center) / stretch);
+				}
+				dst[n] = weight;
+				sum += weight;
+			}
+			//drop leading pixels without weight:
+			int skip = 0;
+			while((skip < n-1) && (dst[skip] == 0.0f)) { skip++; }
+			if(skip > 0) {
+				std::copy(dst + skip, dst + n, dst);
+				std::fill(dst + n - skip, dst + n, 0.0f);
+			}
+			w.first[i] = lo + skip;
+			w.count[i] = n - skip;
+			if(sum != 0.0f) {
+				for(int j=0; j<w.count[i]; j++) { dst[j] /= sum; }
+			} else {
+				//pixel center outside of all contributions (can only happen at the border):
+				dst[0] = 1.0f;
+			}
+		}
+	}
+
+	/** Helper function: Converts an sRGB encoded channel to linear light
+	 */
+	static float ToLinear(float c)
+	{
+		return (c <= 0.04045f) ? (c / 12.92f) : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	/** Helper function: Converts a linear light channel to sRGB
+	 */
+	static float ToSRGB(float c)
+	{
+		return (c <= 0.0031308f) ? (c * 12.92f) : (1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f);
+	}
+
+	/** Helper function: Filters a row of float pixels horizontally
+	 */
+	static void FilterRow(float const* src, float* dst, ResampleWeights const& w, int dst_width)
+	{
+		for(int x=0; x<dst_width; x++) {
+			float const* s    = src + 4 * w.first[x];
+			float const* coef = &w.weights[static_cast<size_t>(x) * w.taps];
+			int const n = w.count[x];
+#if defined(GB_RESAMPLE_SSE2)
+			__m128 acc = _mm_setzero_ps();
+			for(int t=0; t<n; t++) {
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(coef[t]), _mm_loadu_ps(s + 4*t)));
+			}
+			_mm_storeu_ps(dst + 4*x, acc);
+#elif defined(GB_RESAMPLE_NEON)
+			float32x4_t acc = vdupq_n_f32(0.0f);
+			for(int t=0; t<n; t++) {
+				acc = vmlaq_n_f32(acc, vld1q_f32(s + 4*t), coef[t]);
+			}
+			vst1q_f32(dst + 4*x, acc);
+#else
+			float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for(int t=0; t<n; t++) {
+				for(int c=0; c<4; c++) { acc[c] += coef[t] * s[4*t + c]; }
+			}
+			for(int c=0; c<4; c++) { dst[4*x + c] = acc[c]; }
+#endif
+		}
+	}
+
+	/** Helper function: Adds a weighted row to an accumulator row
+	 * @param[in] n Number of floats in the rows
+	 */
+	static void AccumulateRow(float const* src, float weight, float* acc, size_t n)
+	{
+		size_t i = 0;
+#if defined(GB_RESAMPLE_SSE2)
+		__m128 const w = _mm_set1_ps(weight);
+		for(; i+4 <= n; i += 4) {
+			_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(w, _mm_loadu_ps(src + i))));
+		}
+#elif defined(GB_RESAMPLE_NEON)
+		for(; i+4 <= n; i += 4) {
+			vst1q_f32(acc + i, vmlaq_n_f32(vld1q_f32(acc + i), vld1q_f32(src + i), weight));
+		}
+#endif
+		for(; i<n; i++) { acc[i] += weight * src[i]; }
+	}
+
+	/** Helper: Reads rows from a gbImageView
+	 */
+	struct ViewRowSource {
+		gbImageView const& view;
+		explicit ViewRowSource(gbImageView const& v): view(v) {}
+		void GetRow(int row, GhulbusGraphics::GBCOLOR* dst) const { GetRowData32(view, row, dst); }
+	};
+
+	/** Helper: Reads rows from an image in memory
+	 */
+	struct MemoryRowSource {
+		GhulbusGraphics::GBCOLOR const* data;
+		int width;
+		MemoryRowSource(GhulbusGraphics::GBCOLOR const* d, int w): data(d), width(w) {}
+		void GetRow(int row, GhulbusGraphics::GBCOLOR* dst) const {
+			std::copy(data + static_cast<size_t>(row) * width, data + static_cast<size_t>(row + 1) * width, dst);
+		}
+	};
+
+	/** Helper function: Resamples an image fetched row by row from src
+	 */
+	template<class RowSource_T>
+	static void Resample(RowSource_T const& src, int src_width, int src_height,
+	                     GhulbusGraphics::GBCOLOR* dst, int dst_width, int dst_height,
+	                     gbResampleFilter_T filter, bool gamma_correct)
+	{
+		if((src_width <= 0) || (src_height <= 0) || (dst_width <= 0) || (dst_height <= 0)) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
+		}
+		ResampleWeights wx, wy;
+		ComputeWeights(wx, src_width, dst_width, filter);
+		ComputeWeights(wy, src_height, dst_height, filter);
+
+		//conversion of 8 bit channels to float:
+		float to_float[256];
+		for(int i=0; i<256; i++) {
+			to_float[i] = (gamma_correct) ? ToLinear(i / 255.0f) : (i / 255.0f);
+		}
+
+		size_t const dst_pitch = static_cast<size_t>(dst_width) * 4;
+		int const ring_size = std::min(wy.taps, src_height);
+		std::vector<GhulbusGraphics::GBCOLOR> src_row(src_width);
+		std::vector<float> src_row_f(static_cast<size_t>(src_width) * 4);
+		std::vector<float> ring(dst_pitch * ring_size);
+		std::vector<float> acc(dst_pitch);
+
+		int next_row = 0;		//next source row to fetch
+		for(int y=0; y<dst_height; y++) {
+			int const first = wy.first[y];
+			int const last = first + wy.count[y];
+			for(; next_row < last; next_row++) {
+				src.GetRow(next_row, &src_row[0]);
+				for(int x=0; x<src_width; x++) {
+					GhulbusGraphics::GBCOLOR const c = src_row[x];
+					float* const f = &src_row_f[4*x];
+					f[0] = to_float[GhulbusGraphics::GBCOLOR32::GetB(c)];
+					f[1] = to_float[GhulbusGraphics::GBCOLOR32::GetG(c)];
+					f[2] = to_float[GhulbusGraphics::GBCOLOR32::GetR(c)];
+					f[3] = GhulbusGraphics::GBCOLOR32::GetA(c) / 255.0f;
+				}
+				FilterRow(&src_row_f[0], &ring[(next_row % ring_size) * dst_pitch], wx, dst_width);
+			}
+
+			std::fill(acc.begin(), acc.end(), 0.0f);
+			float const* coef = &wy.weights[static_cast<size_t>(y) * wy.taps];
+			for(int t=0; t<wy.count[y]; t++) {
+				AccumulateRow(&ring[((first + t) % ring_size) * dst_pitch], coef[t], &acc[0], dst_pitch);
+			}
+
+			GhulbusGraphics::GBCOLOR* const line = dst + static_cast<size_t>(y) * dst_width;
+			for(int x=0; x<dst_width; x++) {
+				int ch[4];
+				for(int c=0; c<4; c++) {
+					float v = std::min(std::max(acc[4*x + c], 0.0f), 1.0f);
+					if(gamma_correct && (c < 3)) { v = ToSRGB(v); }
+					ch[c] = static_cast<int>(v * 255.0f + 0.5f);
+				}
+				line[x] = GhulbusGraphics::GBCOLOR32::ARGB(ch[3], ch[2], ch[1], ch[0]);
+			}
+		}
+	}
+
+	void ResampleImage(gbImageLoader const& src, GhulbusGraphics::GBCOLOR* dst, int dst_width, int dst_height,
+	                   gbResampleFilter_T filter, bool gamma_correct)
+	{
+		ResampleImage(src.GetView(), dst, dst_width, dst_height, filter, gamma_correct);
+	}
+
+	void ResampleImage(gbImageView const& src, GhulbusGraphics::GBCOLOR* dst, int dst_width, int dst_height,
+	                   gbResampleFilter_T filter, bool gamma_correct)
+	{
+		Resample(ViewRowSource(src), src.width, src.height, dst, dst_width, dst_height,
+		         filter, gamma_correct);
+	}
+
+	void ResampleImage(GhulbusGraphics::GBCOLOR const* src, int src_width, int src_height,
+	                   GhulbusGraphics::GBCOLOR* dst, int dst_width, int dst_height,
+	                   gbResampleFilter_T filter, bool gamma_correct)
+	{
+		Resample(MemoryRowSource(src, src_width), src_width, src_height, dst, dst_width, dst_height,
+		         filter, gamma_correct);
+	}
+};
@@ -0,0 +1,179 @@
+/**
+ * @file src/gbMappedFile.cpp
+ *
+ * ghulbusUtil - A collection of useful stuff
+ *
+ * @brief gbUtil Memory mapped files implementation
+ *
+ * @version 1.1
+ * @author Andreas Weis
+ *
+ */
+#include "../include/gbMappedFile.hpp"
+#include "../include/gbFileBackend.hpp"
+#include <cstring>
+#include <fstream>
+
+#ifdef WIN32
+#	include <windows.h>
+#else
+#	include <sys/types.h>
+#	include <sys/stat.h>
+#	include <sys/mman.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+namespace GhulbusUtil {
+	gbMappedFile::gbMappedFile()
+		:m_data(NULL), m_size(0), m_buffer(NULL), m_mapping(NULL)
+#ifdef WIN32
+		,m_hFile(INVALID_HANDLE_VALUE), m_hMapping(NULL)
+#endif
+	{
+		;
+	}
+
+	gbMappedFile::gbMappedFile(char const* fname)
+		:m_data(NULL), m_size(0), m_buffer(NULL), m_mapping(NULL)
+#ifdef WIN32
+		,m_hFile(INVALID_HANDLE_VALUE), m_hMapping(NULL)
+#endif
+	{
+		Open(fname);
+	}
+
+	gbMappedFile::~gbMappedFile()
+	{
+		Close();
+	}
+
+	void gbMappedFile::Open(char const* fname)
+	{
+		Close();
+		GetFileBackend().OpenFile(fname, *this);
+	}
+
+	void gbMappedFile::OpenDirect(char const* fname)
+	{
+		Close();
+#ifdef WIN32
+		m_hFile = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		                      FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if(m_hFile == INVALID_HANDLE_VALUE) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "File could not be opened" ) );
+		}
+		LARGE_INTEGER fsize;
+		if(!GetFileSizeEx(m_hFile, &fsize) || (static_cast<ULONGLONG>(fsize.QuadPart) > static_cast<size_t>(-1))) {
+			Close();
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Unable to determine file size" ) );
+		}
+		m_size = static_cast<size_t>(fsize.QuadPart);
+		if(m_size == 0) { return; }
+		m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if(m_hMapping) {
+			m_mapping = MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+		}
+		if(m_mapping) {
+			m_data = static_cast<unsigned char const*>(m_mapping);
+			return;
+		}
+#else
+		int fd = open(fname, O_RDONLY);
+		if(fd < 0) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "File could not be opened" ) );
+		}
+		struct stat st;
+		if((fstat(fd, &st) != 0) || (!S_ISREG(st.st_mode))) {
+			close(fd);
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Unable to determine file size" ) );
+		}
+		m_size = static_cast<size_t>(st.st_size);
+		if(m_size == 0) {
+			close(fd);
+			return;
+		}
+		void* p = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if(p != MAP_FAILED) {
+			m_mapping = p;
+			m_data = static_cast<unsigned char const*>(m_mapping);
+			return;
+		}
+#endif
+		//mapping failed; fall back to reading the whole file in one go:
+		size_t size = m_size;
+		Close();
+		std::ifstream fin(fname, std::ios_base::in | std::ios_base::binary);
+		if(fin.fail()) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "File could not be opened" ) );
+		}
+		m_buffer = new unsigned char[size];
+		fin.read( reinterpret_cast<char*>(m_buffer), size );
+		if(fin.fail()) {
+			Close();
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "File read error" ) );
+		}
+		m_data = m_buffer;
+		m_size = size;
+	}
+
+	void gbMappedFile::Close()
+	{
+#ifdef WIN32
+		if(m_mapping)                        { UnmapViewOfFile(m_mapping);  m_mapping = NULL; }
+		if(m_hMapping)                       { CloseHandle(m_hMapping);     m_hMapping = NULL; }
+		if(m_hFile != INVALID_HANDLE_VALUE)  { CloseHandle(m_hFile);        m_hFile = INVALID_HANDLE_VALUE; }
+#else
+		if(m_mapping)                        { munmap(m_mapping, m_size);   m_mapping = NULL; }
+#endif
+		if(m_buffer) { delete[] m_buffer;  m_buffer = NULL; }
+		m_data = NULL;
+		m_size = 0;
+	}
+
+	void gbMappedFile::Assign(unsigned char* buffer, size_t size)
+	{
+		Close();
+		m_buffer = buffer;
+		m_data   = (size > 0) ? buffer : NULL;
+		m_size   = size;
+	}
+
+	unsigned char const* gbMappedFile::GetData() const {
+		return m_data;
+	}
+	size_t gbMappedFile::GetSize() const {
+		return m_size;
+	}
+
+	gbMemoryReader::gbMemoryReader(void const* data, size_t size)
+		:m_data(static_cast<unsigned char const*>(data)), m_size(size), m_pos(0)
+	{
+		;
+	}
+	void gbMemoryReader::Read(void* dst, size_t n) {
+		unsigned char const* src = Skip(n);
+		if(n > 0) { memcpy(dst, src, n); }
+	}
+	unsigned char const* gbMemoryReader::Skip(size_t n) {
+		if(n > (m_size - m_pos)) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Unexpected end of data" ) );
+		}
+		unsigned char const* ret = m_data + m_pos;
+		m_pos += n;
+		return ret;
+	}
+	void gbMemoryReader::Seek(size_t pos) {
+		if(pos > m_size) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Unexpected end of data" ) );
+		}
+		m_pos = pos;
+	}
+	size_t gbMemoryReader::GetPosition() const {
+		return m_pos;
+	}
+	size_t gbMemoryReader::GetRemaining() const {
+		return m_size - m_pos;
+	}
+};
@@ -0,0 +1,132 @@
+/**
+ * @file src/gbStats.cpp
+ *
+ * ghulbusUtil - A collection of useful stuff
+ *
+ * @brief gbUtil Counters and stage timers implementation
+ *
+ * @version 1.1
+ * @author Andreas Weis
+ *
+ */
+#include "../include/gbStats.hpp"
+#include "../include/gbThreadPool.hpp"
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <ostream>
+
+#ifdef WIN32
+#	include <windows.h>
+#else
+#	include <time.h>
+#endif
+
+namespace GhulbusUtil {
+	/** Orders counter and stage names alphabetically
+	 */
+	struct NameLess {
+		bool operator()(char const* a, char const* b) const { return (strcmp(a, b) < 0); }
+	};
+
+	/** Accumulated measurements of a stage
+	 */
+	struct StageTime {
+		unsigned long long calls;		///< Number of measurements
+		double total;					///< Sum of all measurements in seconds
+		double max;						///< Longest measurement in seconds
+		StageTime(): calls(0), total(0.0), max(0.0) {}
+	};
+
+	typedef std::map<char const*, unsigned long long, NameLess> CounterMap;
+	typedef std::map<char const*, StageTime, NameLess> StageMap;
+
+	static gbMutex stats_mutex;			///< Guards stats_counters and stats_stages
+	static CounterMap stats_counters;	///< All counters
+	static StageMap stats_stages;		///< All stage timers
+
+	bool gbStats::m_enabled = false;
+
+	void gbStats::Enable(bool enable)
+	{
+		m_enabled = enable;
+	}
+
+	void gbStats::AddCounter(char const* name, unsigned long long value)
+	{
+		gbLock lock(stats_mutex);
+		stats_counters[name] += value;
+	}
+
+	void gbStats::AddTime(char const* stage, double seconds)
+	{
+		gbLock lock(stats_mutex);
+		StageTime& t = stats_stages[stage];
+		t.calls++;
+		t.total += seconds;
+		if(seconds > t.max) { t.max = seconds; }
+	}
+
+	unsigned long long gbStats::GetCounter(char const* name)
+	{
+		gbLock lock(stats_mutex);
+		CounterMap::const_iterator it = stats_counters.find(name);
+		return (it != stats_counters.end()) ? it->second : 0;
+	}
+
+	void gbStats::Reset()
+	{
+		gbLock lock(stats_mutex);
+		stats_counters.clear();
+		stats_stages.clear();
+	}
+
+	void gbStats::WriteText(std::ostream& os)
+	{
+		gbLock lock(stats_mutex);
+		char line[256];
+		for(CounterMap::const_iterator it = stats_counters.begin(); it != stats_counters.end(); ++it) {
+			sprintf(line, "%-28s %20llu\n", it->first, it->second);
+			os << line;
+		}
+		for(StageMap::const_iterator it = stats_stages.begin(); it != stats_stages.end(); ++it) {
+			sprintf(line, "%-28s %8llu calls %12.3f ms total %10.3f ms max\n", it->first,
+			        it->second.calls, it->second.total * 1000.0, it->second.max * 1000.0);
+			os << line;
+		}
+	}
+
+	void gbStats::WriteJSON(std::ostream& os)
+	{
+		gbLock lock(stats_mutex);
+		char line[256];
+		//names are identifiers chosen by the code, so they need no escaping:
+		os << "{\n  \"counters\": {";
+		for(CounterMap::const_iterator it = stats_counters.begin(); it != stats_counters.end(); ++it) {
+			sprintf(line, "%s\n    \"%s\": %llu", (it == stats_counters.begin()) ? "" : ",", it->first, it->second);
+			os << line;
+		}
+		os << "\n  },\n  \"timers\": {";
+		for(StageMap::const_iterator it = stats_stages.begin(); it != stats_stages.end(); ++it) {
+			sprintf(line, "%s\n    \"%s\": {\"calls\": %llu, \"total_ms\": %.3f, \"max_ms\": %.3f}",
+			        (it == stats_stages.begin()) ? "" : ",", it->first,
+			        it->second.calls, it->second.total * 1000.0, it->second.max * 1000.0);
+			os << line;
+		}
+		os << "\n  }\n}\n";
+	}
+
+	double gbStats::GetTime()
+	{
+#ifdef WIN32
+		LARGE_INTEGER freq, count;
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&count);
+		return static_cast<double>(count.QuadPart) / static_cast<double>(freq.QuadPart);
+#else
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+	}
+};
@@ -0,0 +1,329 @@
+/**
+ * @file src/gbThreadPool.cpp
+ *
+ * ghulbusUtil - A collection of useful stuff
+ *
+ * @brief gbUtil Worker threads and synchronization primitives implementation
+ *
+ * @version 1.1
+ * @author Andreas Weis
+ *
+ */
+#include "../include/gbThreadPool.hpp"
+#include <vector>
+
+#ifdef WIN32
+	//condition variables require Windows Vista:
+#	ifndef _WIN32_WINNT
+#		define _WIN32_WINNT 0x0600
+#	endif
+#	include <windows.h>
+#else
+#	include <pthread.h>
+#	include <unistd.h>
+#endif
+
+namespace GhulbusUtil {
+	gbMutex::gbMutex()
+	{
+#ifdef WIN32
+		CRITICAL_SECTION* cs = new CRITICAL_SECTION;
+		InitializeCriticalSection(cs);
+		m_mutex = cs;
+#else
+		pthread_mutex_t* mutex = new pthread_mutex_t;
+		pthread_mutex_init(mutex, NULL);
+		m_mutex = mutex;
+#endif
+	}
+
+	gbMutex::~gbMutex()
+	{
+#ifdef WIN32
+		DeleteCriticalSection(static_cast<CRITICAL_SECTION*>(m_mutex));
+		delete static_cast<CRITICAL_SECTION*>(m_mutex);
+#else
+		pthread_mutex_destroy(static_cast<pthread_mutex_t*>(m_mutex));
+		delete static_cast<pthread_mutex_t*>(m_mutex);
+#endif
+	}
+
+	void gbMutex::Lock()
+	{
+#ifdef WIN32
+		EnterCriticalSection(static_cast<CRITICAL_SECTION*>(m_mutex));
+#else
+		pthread_mutex_lock(static_cast<pthread_mutex_t*>(m_mutex));
+#endif
+	}
+
+	void gbMutex::Unlock()
+	{
+#ifdef WIN32
+		LeaveCriticalSection(static_cast<CRITICAL_SECTION*>(m_mutex));
+#else
+		pthread_mutex_unlock(static_cast<pthread_mutex_t*>(m_mutex));
+#endif
+	}
+
+	gbLock::gbLock(gbMutex& mutex)
+		:m_mutex(mutex)
+	{
+		m_mutex.Lock();
+	}
+
+	gbLock::~gbLock()
+	{
+		m_mutex.Unlock();
+	}
+
+	gbCondition::gbCondition()
+	{
+#ifdef WIN32
+		CONDITION_VARIABLE* cond = new CONDITION_VARIABLE;
+		InitializeConditionVariable(cond);
+		m_cond = cond;
+#else
+		pthread_cond_t* cond = new pthread_cond_t;
+		pthread_cond_init(cond, NULL);
+		m_cond = cond;
+#endif
+	}
+
+	gbCondition::~gbCondition()
+	{
+#ifdef WIN32
+		delete static_cast<CONDITION_VARIABLE*>(m_cond);
+#else
+		pthread_cond_destroy(static_cast<pthread_cond_t*>(m_cond));
+		delete static_cast<pthread_cond_t*>(m_cond);
+#endif
+	}
+
+	void gbCondition::Wait(gbMutex& mutex)
+	{
+#ifdef WIN32
+		SleepConditionVariableCS(static_cast<CONDITION_VARIABLE*>(m_cond),
+		                         static_cast<CRITICAL_SECTION*>(mutex.m_mutex), INFINITE);
+#else
+		pthread_cond_wait(static_cast<pthread_cond_t*>(m_cond), static_cast<pthread_mutex_t*>(mutex.m_mutex));
+#endif
+	}
+
+	void gbCondition::Signal()
+	{
+#ifdef WIN32
+		WakeConditionVariable(static_cast<CONDITION_VARIABLE*>(m_cond));
+#else
+		pthread_cond_signal(static_cast<pthread_cond_t*>(m_cond));
+#endif
+	}
+
+	void gbCondition::Broadcast()
+	{
+#ifdef WIN32
+		WakeAllConditionVariable(static_cast<CONDITION_VARIABLE*>(m_cond));
+#else
+		pthread_cond_broadcast(static_cast<pthread_cond_t*>(m_cond));
+#endif
+	}
+
+	/** Function and user pointer of a gbThread, passed to the thread entry point
+	 */
+	struct gbThreadStart {
+		gbThread::ThreadFunc func;		///< The user function
+		void* user;						///< User pointer for func
+	};
+
+#ifdef WIN32
+	static DWORD WINAPI gbThreadEntry(LPVOID p)
+	{
+		gbThreadStart start = *static_cast<gbThreadStart*>(p);
+		delete static_cast<gbThreadStart*>(p);
+		start.func(start.user);
+		return 0;
+	}
+#else
+	static void* gbThreadEntry(void* p)
+	{
+		gbThreadStart start = *static_cast<gbThreadStart*>(p);
+		delete static_cast<gbThreadStart*>(p);
+		start.func(start.user);
+		return NULL;
+	}
+#endif
+
+	gbThread::gbThread()
+		:m_thread(NULL)
+	{
+		;
+	}
+
+	gbThread::~gbThread()
+	{
+		Join();
+	}
+
+	void gbThread::Start(ThreadFunc func, void* user)
+	{
+		if(m_thread) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Thread is already running" ) );
+		}
+		gbThreadStart* start = new gbThreadStart;
+		start->func = func;
+		start->user = user;
+#ifdef WIN32
+		HANDLE h = CreateThread(NULL, 0, gbThreadEntry, start, 0, NULL);
+		if(!h) {
+			delete start;
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Thread could not be created" ) );
+		}
+		m_thread = h;
+#else
+		pthread_t* t = new pthread_t;
+		if(pthread_create(t, NULL, gbThreadEntry, start) != 0) {
+			delete t;
+			delete start;
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Thread could not be created" ) );
+		}
+		m_thread = t;
+#endif
+	}
+
+	void gbThread::Join()
+	{
+		if(!m_thread) { return; }
+#ifdef WIN32
+		WaitForSingleObject(static_cast<HANDLE>(m_thread), INFINITE);
+		CloseHandle(static_cast<HANDLE>(m_thread));
+#else
+		pthread_join(*static_cast<pthread_t*>(m_thread), NULL);
+		delete static_cast<pthread_t*>(m_thread);
+#endif
+		m_thread = NULL;
+	}
+
+	int GetNumberOfProcessors()
+	{
+#ifdef WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		int n = static_cast<int>(info.dwNumberOfProcessors);
+#else
+		int n = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+		return (n > 0) ? n : 1;
+	}
+
+	/** State shared by all workers of a single gbThreadPool::Run()
+	 */
+	struct gbThreadPoolJob {
+		gbThreadPool::WorkFunc func;	///< The user function
+		void* user;						///< User pointer for func
+		int n_items;					///< Number of work items
+		int next_item;					///< Next item to be handed out
+		bool failed;					///< Set if func threw an exception
+		gbMutex mutex;					///< Protects next_item and failed
+	};
+
+	/** Per-worker data passed to the thread entry point
+	 */
+	struct gbThreadPoolWorker {
+		gbThreadPoolJob* job;			///< The shared job
+		int index;						///< Index of this worker
+	};
+
+	/** Worker loop: fetches items until the job is exhausted
+	 */
+	static void gbThreadPoolWork(gbThreadPoolWorker* worker)
+	{
+		gbThreadPoolJob& job = *worker->job;
+		for(;;) {
+			int item;
+			{
+				gbLock lock(job.mutex);
+				if(job.next_item >= job.n_items) { return; }
+				item = job.next_item++;
+			}
+			try {
+				job.func(item, worker->index, job.user);
+			} catch(...) {
+				gbLock lock(job.mutex);
+				job.failed = true;
+			}
+		}
+	}
+
+#ifdef WIN32
+	static DWORD WINAPI gbThreadPoolEntry(LPVOID p)
+	{
+		gbThreadPoolWork(static_cast<gbThreadPoolWorker*>(p));
+		return 0;
+	}
+#else
+	static void* gbThreadPoolEntry(void* p)
+	{
+		gbThreadPoolWork(static_cast<gbThreadPoolWorker*>(p));
+		return NULL;
+	}
+#endif
+
+	gbThreadPool::gbThreadPool(int n_threads)
+		:m_nThreads((n_threads > 0) ? n_threads : GetNumberOfProcessors())
+	{
+		;
+	}
+
+	int gbThreadPool::GetNThreads() const
+	{
+		return m_nThreads;
+	}
+
+	void gbThreadPool::Run(int n_items, WorkFunc func, void* user)
+	{
+		gbThreadPoolJob job;
+		job.func      = func;
+		job.user      = user;
+		job.n_items   = n_items;
+		job.next_item = 0;
+		job.failed    = false;
+
+		int const n_threads = (m_nThreads < n_items) ? m_nThreads : n_items;
+		if(n_threads <= 0) { return; }
+		std::vector<gbThreadPoolWorker> workers(n_threads);
+		for(int i=0; i<n_threads; i++) {
+			workers[i].job   = &job;
+			workers[i].index = i;
+		}
+
+		//the calling thread acts as worker #0; if a thread can not be created,
+		// its share of the items is picked up by the remaining workers:
+#ifdef WIN32
+		std::vector<HANDLE> threads;
+		for(int i=1; i<n_threads; i++) {
+			HANDLE h = CreateThread(NULL, 0, gbThreadPoolEntry, &workers[i], 0, NULL);
+			if(!h) { break; }
+			threads.push_back(h);
+		}
+		gbThreadPoolWork(&workers[0]);
+		for(size_t i=0; i<threads.size(); i++) {
+			WaitForSingleObject(threads[i], INFINITE);
+			CloseHandle(threads[i]);
+		}
+#else
+		std::vector<pthread_t> threads;
+		for(int i=1; i<n_threads; i++) {
+			pthread_t t;
+			if(pthread_create(&t, NULL, gbThreadPoolEntry, &workers[i]) != 0) { break; }
+			threads.push_back(t);
+		}
+		gbThreadPoolWork(&workers[0]);
+		for(size_t i=0; i<threads.size(); i++) {
+			pthread_join(threads[i], NULL);
+		}
+#endif
+		if(job.failed) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Exception in worker thread" ) );
+		}
+	}
+};
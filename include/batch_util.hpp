@@ -0,0 +1,159 @@
+/**
+ * @file include/batch_util.hpp
+ *
+ * @brief Helpers for converting many files in a single runbuild_header/
+ */
+#ifndef __BATCH_UTIL_HPP_INCLUDE_GUARD__
+#define __BATCH_UTIL_HPP_INCLUDE_GUARD__
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../gbLib/include/gbException.hpp"
+
+/** A single entry of a batch conversion
+ */
+struct BatchItem {
+	std::string input;			///< path to the input file
+	std::string output;			///< path to the output file (empty means derive from input)
+	std::string texture;		///< path to the texture file (empty means tool default)
+};
+
+/** Read a batch manifest
+ * Each non-empty line of the manifest describes one item as up to three
+ * tab-separated fields: input, output and texture. Lines starting with '#' are ignored.
+ * @param[in] fname Full path to the manifest file
+ * @param[out] items Receives one BatchItem per line
+ * @throw Ghulbus::gbException GB_FAILED indicates a file access error
+ * @throw std::bad_alloc
+ */
+void ReadBatchManifest(char const* fname, std::vector<BatchItem>& items);
+
+/** Get all files in a directory that have a specific extension
+ * @param[in] dir Path to the directory
+ * @param[in] extension File extension including the dot (e.g. ".obj"); compared case insensitive
+ * @param[out] files Receives the full paths of all matching files in alphabetical order
+ * @param[in] recursive If true, subdirectories are searched as well
+ * @throw Ghulbus::gbException GB_FAILED indicates that the directory could not be read
+ * @throw std::bad_alloc
+ */
+void ListDirectory(char const* dir, char const* extension, std::vector<std::string>& files,
+                   bool recursive = false);
+
+/** Append a filename to a directory path
+ * @param[in] dir Path to a directory (may be empty)
+ * @param[in] fname Name of a file in dir
+ * @return The combined path
+ */
+std::string JoinPath(std::string const& dir, std::string const& fname);
+
+/** Get the filename part of a path
+ * @param[in] path A path to a file
+ * @return Everything after the last path separator
+ */
+std::string GetFileName(std::string const& path);
+
+/** Replace the extension of a path
+ * @param[in] path A path to a file
+ * @param[in] extension New extension including the dot (e.g. ".icn")
+ * @return path with its extension replaced; if path has no extension, the new one is appended
+ */
+std::string ReplaceExtension(std::string const& path, char const* extension);
+
+/** Collects the outcome of each item of a batch conversion
+ */
+class BatchReport {
+public:
+	/** The outcome of a single item
+	 */
+	struct Entry {
+		std::string input;		///< path to the input file
+		std::string output;		///< path to the output file
+		bool success;			///< true if the conversion succeeded
+		std::string message;	///< error description if the conversion failed
+	};
+private:
+	std::vector<Entry> m_entries;	///< list of all items added so far
+	int m_nFailed;					///< number of failed items
+public:
+	/** Constructor
+	 */
+	BatchReport();
+	/** Record a successful conversion
+	 * @param[in] item The converted item
+	 * @throw std::bad_alloc
+	 */
+	void AddSuccess(BatchItem const& item);
+	/** Record a failed conversion
+	 * @param[in] item The item that failed
+	 * @param[in] message Description of the error
+	 * @throw std::bad_alloc
+	 */
+	void AddFailure(BatchItem const& item, char const* message);
+	/** Get the number of items recorded
+	 * @return The number of items
+	 */
+	int GetNItems() const;
+	/** Get the number of failed items
+	 * @return The number of failed items
+	 */
+	int GetNFailed() const;
+	/** Print a per-file status summary
+	 * @param[in] os Destination stream
+	 */
+	void Print(std::ostream& os) const;
+};
+
+/** Interface for the per-item work of a batch conversion
+ */
+class BatchConverter {
+public:
+	/** Prepare for a batch run; called once before the first call to Convert()
+	 * @param[in] n_workers Number of workers that will call Convert()
+	 * @throw std::bad_alloc
+	 */
+	virtual void Prepare(int n_workers)=0;
+	/** Convert a single item
+	 * @param[in] item The item to convert
+	 * @param[in] worker Index of the calling worker (0..n_threads-1); calls with
+	 *                   different worker indices may run concurrently
+	 * @param[out] log Receives all messages concerning this item
+	 * @throw Ghulbus::gbException indicates that the conversion failed; the error string
+	 *                             is recorded in the BatchReport
+	 * @throw std::bad_alloc
+	 */
+	virtual void Convert(BatchItem const& item, int worker, std::ostream& log)=0;
+	/** Destructor
+	 */
+	virtual ~BatchConverter();
+};
+
+/** Convert all items of a batch on a pool of worker threads
+ * The log of every item is written to os in the order of items, regardless of the
+ * order in which the items complete. A failed item does not affect the others.
+ * With prefetch > 0, a GhulbusUtil::gbPrefetchFileBackend is installed for the run: the input and
+ * texture files of the items are read ahead while the workers convert, and all files are written
+ * behind. This hides the latency of slow storage such as network shares. Outputs that can not be
+ * written are detected only at the end of the run and reported as failures as well.
+ * @param[in] items The items to convert
+ * @param[in,out] converter Strategy performing the actual conversion
+ * @param[in] n_threads Number of worker threads; values < 1 select the number of processors
+ * @param[in,out] os Destination stream for the item logs
+ * @param[out] report Receives the outcome of every item, in the order of items
+ * @param[in] prefetch Number of files read ahead (should be at least n_threads); 0 accesses files directly
+ * @throw Ghulbus::gbException GB_FAILED indicates that the I/O threads could not be created
+ * @throw std::bad_alloc
+ */
+void RunBatch(std::vector<BatchItem> const& items, BatchConverter& converter, int n_threads,
+              std::ostream& os, BatchReport& report, int prefetch = 0);
+
+/** Handle the --stats command line option of the tools
+ * "--stats" (or "--stats=text") and "--stats=json" enable gbStats and register a handler
+ * that writes all counters and stage timers to stderr when the program exits.
+ * Stages running on several worker threads add up, so their total may exceed "total".
+ * @param[in] arg A command line argument
+ * @return true if arg was a --stats option
+ */
+bool EnableStatsOption(char const* arg);
+
+#endif
@@ -0,0 +1,96 @@
+/**
+ * @file include/conversion_cache.hpp
+ *
+ * @brief An on-disk cache for the outputs of conversionsbuild_header/
+ */
+#ifndef __CONVERSION_CACHE_HPP_INCLUDE_GUARD__
+#define __CONVERSION_CACHE_HPP_INCLUDE_GUARD__
+
+#include <string>
+#include <vector>
+#include "../gbLib/include/gbException.hpp"
+#include "../gbLib/include/gbHash.hpp"
+
+/** A content-addressed store for the output files of conversions
+ * Each entry holds the contents of all output files of one conversion and is found by a
+ * key that the caller computes from everything the outputs depend on: input file contents,
+ * settings and a version tag of the converter. Entries carry a checksum; damaged or
+ * incomplete entries are treated as misses.
+ * @note All member functions may be called concurrently, also from several processes
+ *       sharing the same directory.
+ */
+class ConversionCache {
+public:
+	typedef unsigned long long Key_T;				///< key of a cache entry
+private:
+	std::string m_dir;								///< directory holding the entries
+public:
+	/** Constructor
+	 * @note Constructs a closed cache; use Open() to select the cache directory
+	 */
+	ConversionCache();
+	/** Constructor
+	 * @param[in] dir Path to the cache directory; it is created if it does not exist
+	 * @throw Ghulbus::gbException GB_FAILED indicates that the directory could not be created
+	 * @throw std::bad_alloc
+	 */
+	explicit ConversionCache(char const* dir);
+	/** Select the cache directory
+	 * @param[in] dir Path to the cache directory; it is created if it does not exist
+	 * @throw Ghulbus::gbException GB_FAILED indicates that the directory could not be created
+	 * @throw std::bad_alloc
+	 */
+	void Open(char const* dir);
+	/** Add a block of memory to a key
+	 * @param[in,out] hash Hash of the key under construction
+	 * @param[in] data A field of size bytes
+	 * @param[in] size Size of the field data in bytes; it is included so consecutive blocks can not be confused
+	 */
+	static void AddData(GhulbusUtil::gbHash64& hash, void const* data, size_t size);
+	/** Add a string to a key
+	 * @param[in,out] hash Hash of the key under construction
+	 * @param[in] str The string
+	 */
+	static void AddString(GhulbusUtil::gbHash64& hash, std::string const& str);
+	/** Add the contents of a file to a key
+	 * @param[in,out] hash Hash of the key under construction
+	 * @param[in] fname Path to the file
+	 * @throw Ghulbus::gbException GB_FAILED indicates that the file could not be read
+	 */
+	static void AddFile(GhulbusUtil::gbHash64& hash, char const* fname);
+	/** Write the output files of a cached conversion
+	 * @param[in] key Key of the conversion
+	 * @param[in] outputs Paths the output files are written to, in the order passed to Store()
+	 * @return true if the entry was found and all outputs were written
+	 * @throw std::bad_alloc
+	 */
+	bool Fetch(Key_T key, std::vector<std::string> const& outputs) const;
+	/** Store the output files of a conversion
+	 * @param[in] key Key of the conversion
+	 * @param[in] outputs Paths to the output files just written by the conversion
+	 * @throw Ghulbus::gbException GB_FAILED indicates that an output could not be read or
+	 *                             the entry could not be written
+	 * @throw std::bad_alloc
+	 */
+	void Store(Key_T key, std::vector<std::string> const& outputs) const;
+private:
+	/** Internal helper function: get the path of an entry
+	 * @param[in] key Key of the entry
+	 * @return Path to the entry file
+	 */
+	std::string GetEntryPath(Key_T key) const;
+};
+
+//EXTENSIVE DOCUMENTATION:
+/**
+ * @class ConversionCache
+ * Every entry is a single file named after the hexadecimal key, holding a magic string,
+ * the number of outputs, an XXH64 checksum of the rest of the entry and the size and
+ * contents of each output, all in little endian order. On a hit the outputs are copied
+ * straight from the mapped entry without looking at the inputs again.
+ *
+ * New entries are written to a temporary file that is renamed once it is complete, so
+ * readers never see a partially written entry. The cache is never pruned; delete the
+ * directory to clear it.
+ */
+#endif
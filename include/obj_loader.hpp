@@ -12,12 +12,150 @@
 #include "../gbLib/include/gbException.hpp"
 #include <cstring>
 
+/** A list of 3-component vertex attributes held in a selectable precision
+ * Data is passed in as a stream of triples and read back per element. Only the first
+ * GetNComponents() components of each triple are stored; the others read back as 0.
+ */
+class OBJ_AttributeArray {
+public:
+	typedef enum {
+		STORAGE_DOUBLE=0,					///< 64 bit floating point
+		STORAGE_FLOAT,						///< 32 bit floating point
+		STORAGE_FIXED16						///< 16 bit 4.12 fixed point as used by PS2 icons (range [-8..8))
+	} STORAGE;
+private:
+	STORAGE m_storage;						///< precision of the stored data
+	int m_nComponents;						///< number of components stored per element (1..3)
+	size_t m_nInput;						///< number of values passed in so far (including discarded ones)
+	std::vector<double> m_double;			///< data for STORAGE_DOUBLE
+	std::vector<float>  m_float;			///< data for STORAGE_FLOAT
+	std::vector<short>  m_fixed;			///< data for STORAGE_FIXED16
+public:
+	/** Constructor
+	 * @param[in] storage Precision of the stored data
+	 * @param[in] n_components Number of components stored per element (1..3)
+	 */
+	OBJ_AttributeArray(STORAGE storage, int n_components);
+	/** Get the precision of the stored data
+	 * @return The storage type
+	 */
+	STORAGE GetStorage() const;
+	/** Get the number of components stored per element
+	 * @return The number of components (1..3)
+	 */
+	int GetNComponents() const;
+	/** Get the number of elements
+	 * @return The number of complete triples passed in
+	 */
+	int GetNElements() const;
+	/** Delete all data
+	 */
+	void Clear();
+	/** Reserve storage for data that is about to be added
+	 * @param[in] n_elements Number of elements
+	 * @throw std::bad_alloc
+	 */
+	void Reserve(int n_elements);
+	/** Replace the current data
+	 * @param[in] data Field holding the new data as triples
+	 * @param[in] n_data Size of field data
+	 * @throw std::bad_alloc
+	 */
+	template<typename T>
+	void Assign(T const* data, int n_data);
+	/** Append data
+	 * @param[in] data Field holding new data as triples
+	 * @param[in] n_data Size of field data
+	 * @throw std::bad_alloc
+	 */
+	template<typename T>
+	void Append(T const* data, int n_data);
+	/** Get a single component
+	 * @param[in] index Element index (0..GetNElements()-1)
+	 * @param[in] component Component index (0..2)
+	 * @return The component's value
+	 */
+	double Get(int index, int component) const;
+	/** Get a single element
+	 * @param[in] index Element index (0..GetNElements()-1)
+	 * @param[out] dst Field of size 3 receiving the element
+	 * @param[in] scale A scale factor applied to each component
+	 */
+	template<typename T>
+	void GetElement(int index, T* dst, T scale) const;
+	/** Get the stored data
+	 * @return A field of GetNElements()*GetNComponents() values, or NULL if the data is
+	 *         held in another precision or the list is empty
+	 */
+	double const* GetDoubleData() const;
+	float const* GetFloatData() const;		///< @copydoc GetDoubleData()
+	short const* GetFixed16Data() const;	///< @copydoc GetDoubleData()
+};
+
+/** Output for OBJ_Mesh::ExtractUnindexed() that discards a channel
+ * Extraction of the channel is removed at compile time.
+ */
+class OBJ_NoOutput {
+public:
+	typedef float value_type;				///< type of the scale when the positions are discarded
+};
+
+/** Output for OBJ_Mesh::ExtractUnindexed() writing N components of type T per vertex
+ * Components are computed in type T, exactly as by OBJ_Mesh::GetMeshGeometryUnindexed().
+ * The default stride of N gives a planar field; a larger stride interleaves the channel
+ * with other data.
+ */
+template<typename T, int N>
+class OBJ_ArrayOutput {
+public:
+	typedef T value_type;					///< type components are computed in
+private:
+	T* m_dst;								///< first component of the first vertex
+	size_t m_stride;						///< distance between the first components of two vertices
+public:
+	/** Constructor
+	 * @param[out] dst A field of at least size ((n_vertices-1)*stride + N)
+	 * @param[in] stride Distance between two vertices in elements of T (at least N)
+	 */
+	explicit OBJ_ArrayOutput(T* dst, size_t stride = N);
+	/** Write a vertex
+	 * @param[in] vertex Index of the vertex
+	 * @param[in] v The 3 components of the vertex; only the first N are written
+	 */
+	void Write(size_t vertex, T const* v) const;
+};
+
+/** Output for OBJ_Mesh::ExtractUnindexed() writing N components per vertex in 4.12 fixed point
+ * Components are computed in float and converted like the PS2Icon conversion,
+ * rounding towards zero and saturating to the 16 bit range.
+ */
+template<int N>
+class OBJ_Fixed16Output {
+public:
+	typedef float value_type;				///< type components are computed in
+private:
+	short* m_dst;							///< first component of the first vertex
+	size_t m_stride;						///< distance between the first components of two vertices
+public:
+	/** Constructor
+	 * @param[out] dst A field of at least size ((n_vertices-1)*stride + N)
+	 * @param[in] stride Distance between two vertices in elements of short (at least N)
+	 */
+	explicit OBJ_Fixed16Output(short* dst, size_t stride = N);
+	/** Write a vertex
+	 * @param[in] vertex Index of the vertex
+	 * @param[in] v The 3 components of the vertex; only the first N are written
+	 */
+	void Write(size_t vertex, float const* v) const;
+};
+
 /** The mesh files generated by OBJ_FileLoader
- * @todo sophisticated parsing of face entries (e.g. vert//normal)
  * @note Note that the datasets for geometry, normals and texture coordinates
  *       are expected to have a size divisible by 3! Keep this in mind and
  *       ensure that you're only writing triples when using the respective
  *       Set*() and Add*() functions!
+ * @note With STORAGE_FLOAT and STORAGE_FIXED16 only the U and V components of
+ *       texture coordinates are stored.
  */
 class OBJ_Mesh {
 public:
@@ -27,20 +165,23 @@ public:
 		int vert1, vert2, vert3;			///< indices into the vertex coordinate list m_geometry
 		int normal1, normal2, normal3;		///< indices into the normal coordinate list m_normals
 		int texture1, texture2, texture3;	///< indices into the texture coordinate list m_texcoords
+		                                    ///  (normal and texture indices are -1 if not specified)
 		int smoothing_group;				///< an id specifying the face's smoothing group (-1 means undefined)
 	};
+	typedef OBJ_AttributeArray::STORAGE STORAGE;
 private:
-	std::vector<double> m_geometry;			///< a list of size (n_vertices*3) storing geometry data
-	std::vector<double> m_normals;			///< a list of size (n_vertices*3) storing normal data
-	std::vector<double> m_texcoords;		///< a list of size (???) storing texture coordinates
+	OBJ_AttributeArray m_geometry;			///< a list of n_vertices elements storing geometry data
+	OBJ_AttributeArray m_normals;			///< a list of n_normals elements storing normal data
+	OBJ_AttributeArray m_texcoords;			///< a list of n_texture elements storing texture coordinates
 	std::vector<Face>   m_faces;			///< a list of size (n_triangles) storing all face data
 	char*		        m_name;				///< the name of the mesh
 public:
 	/** Constructor
 	 * @param[in] name Name of the mesh as null-terminated C-string (can be changed later invoking SetName() )
+	 * @param[in] storage Precision used for geometry, normals and texture coordinates
 	 * @throw std::bad_alloc
 	 */
-	OBJ_Mesh(char const* name);
+	OBJ_Mesh(char const* name, STORAGE storage = OBJ_AttributeArray::STORAGE_DOUBLE);
 	/** Destructor
 	 */
 	~OBJ_Mesh();
@@ -115,6 +256,14 @@ public:
 	 * @param[in] n_data Size of field data
 	 */
 	void AddFaceData(Face const* data, int n_data);
+	/** Reserve storage for data that is about to be added
+	 * @param[in] n_vertices Number of vertices
+	 * @param[in] n_normals Number of normals
+	 * @param[in] n_texture Number of texture coordinates
+	 * @param[in] n_faces Number of faces
+	 * @throw std::bad_alloc
+	 */
+	void Reserve(int n_vertices, int n_normals, int n_texture, int n_faces);
 	/** Delete all geometry data
 	 */
 	void ClearGeometry();
@@ -127,6 +276,10 @@ public:
 	/** Delete all face data
 	 */
 	void ClearFaceData();
+	/** Get the precision used for geometry, normals and texture coordinates
+	 * @return The storage type
+	 */
+	STORAGE GetStorage() const;
 	/** Get the mesh name
 	 * @return The name as null terminated C-string
 	 */
@@ -147,7 +300,24 @@ public:
 	 * @return The number of texture coordinates of the mesh
 	 */
 	int GetNTexture() const;
+	/** Get the geometry data
+	 * @return A list of n_vertices elements holding all vertex coordinates
+	 */
+	OBJ_AttributeArray const& GetGeometry() const;
+	/** Get the normal data
+	 * @return A list of n_normals elements holding all normal vectors
+	 */
+	OBJ_AttributeArray const& GetNormals() const;
+	/** Get the texture data
+	 * @return A list of n_texture elements holding all texture coordinates
+	 */
+	OBJ_AttributeArray const& GetTextureData() const;
+	/** Get the face data
+	 * @return A list of size (n_faces) holding all faces
+	 */
+	std::vector<Face> const& GetFaceData() const;
 	/** Get an immediate (unindexed) representation of the mesh
+	 * Components of unspecified or out of range indices are set to 0.
 	 * @param[out] mesh_geometry Pointer to a field of at least size (n_triangles*9) or NULL
 	 * @param[out] mesh_normals Pointer to a field of at least size (n_triangles*9) or NULL
 	 * @param[out] mesh_texture Pointer to a field of at least size (n_triangles*9) or NULL
@@ -155,6 +325,19 @@ public:
 	 */
 	template<typename T>
 	void GetMeshGeometryUnindexed(T* mesh_geometry, T* mesh_normals, T* mesh_texture, T scale) const;
+	/** Get an immediate (unindexed) representation of the mesh in a layout chosen at compile time
+	 * Each output is one of OBJ_NoOutput, OBJ_ArrayOutput or OBJ_Fixed16Output and receives
+	 * three vertices per face. Components of unspecified or out of range indices are set to 0.
+	 * The channels are extracted one after the other, each by a loop specialized for the
+	 * output and the storage of the mesh.
+	 * @param[out] positions Output for the vertex coordinates
+	 * @param[out] normals Output for the normals
+	 * @param[out] texcoords Output for the texture coordinates
+	 * @param[in] scale A scale factor applied to each vertex coordinate
+	 */
+	template<typename PositionOutput, typename NormalOutput, typename TexcoordOutput>
+	void ExtractUnindexed(PositionOutput const& positions, NormalOutput const& normals,
+	                      TexcoordOutput const& texcoords, typename PositionOutput::value_type scale) const;
 	/** Get a raw (indexed) representation of the mesh
 	 * @param[out] mesh_geometry Pointer to a field of at least size (n_vertices*3)
 	 * @param[out] mesh_normals Pointer to a field of at least size (n_normals*3)
@@ -168,47 +351,47 @@ public:
 	 * @param index Vertex index (0..n_vertices-1)
 	 * @return The X coordinate of the vertex
 	 */
-	double const* GetVertexX(int index) const;
+	double GetVertexX(int index) const;
 	/** Get the Y-coordinate of a vertex
 	 * @param index Vertex index (0..n_vertices-1)
 	 * @return The Y coordinate of the vertex
 	 */
-	double const* GetVertexY(int index) const;
+	double GetVertexY(int index) const;
 	/** Get the Z-coordinate of a vertex
 	 * @param index Vertex index (0..n_vertices-1)
 	 * @return The Y coordinate of the vertex
 	 */
-	double const* GetVertexZ(int index) const;
+	double GetVertexZ(int index) const;
 	/** Get the X-coordinate of a normal vector
 	 * @param index Normal vector index (0..n_normals-1)
 	 * @return The X coordinate of the normal vector
 	 */
-	double const* GetNormalX(int index) const;
+	double GetNormalX(int index) const;
 	/** Get the Y-coordinate of a normal vector
 	 * @param index Normal vector index (0..n_normals-1)
 	 * @return The Y coordinate of the normal vector
 	 */
-	double const* GetNormalY(int index) const;
+	double GetNormalY(int index) const;
 	/** Get the Z-coordinate of a normal vector
 	 * @param index Normal vector index (0..n_normals-1)
 	 * @return The Z coordinate of the normal vector
 	 */
-	double const* GetNormalZ(int index) const;
+	double GetNormalZ(int index) const;
 	/** Get the X-coordinate (U) of a texture coordinate
 	 * @param index Texture index (0..n_texture-1)
 	 * @return The X texture coordinate (U)
 	 */
-	double const* GetTextureX(int index) const;
+	double GetTextureX(int index) const;
 	/** Get the X-coordinate (V) of a texture coordinate
 	 * @param index Texture index (0..n_texture-1)
 	 * @return The Y texture coordinate (V)
 	 */
-	double const* GetTextureY(int index) const;
+	double GetTextureY(int index) const;
 	/** Get the Z-coordinate (W) of a texture coordinate
 	 * @param index Texture index (0..n_texture-1)
 	 * @return The Z texture coordinate (W)
 	 */
-	double const* GetTextureZ(int index) const;
+	double GetTextureZ(int index) const;
 	/** Get the face indices for a specific face
 	 * @param index Face index (0..n_faces-1)
 	 * @return A Face structure containing all index information
@@ -237,6 +420,23 @@ public:
 	/** Destructor
 	 */
 	~OBJ_FileLoader();
+	/** Replace the current meshlist with the meshes found in a file
+	 * @param[in] fname Full path to the file that shall be loaded
+	 * @param[in] storage Precision used for the meshes' vertex data
+	 * @throw Ghulbus::gbException GB_FAILED indicates a file access error
+	 * @throw std::bad_alloc
+	 */
+	void Load(char const* fname, OBJ_Mesh::STORAGE storage = OBJ_AttributeArray::STORAGE_DOUBLE);
+	/** Replace the current meshlist with the meshes found in a memory buffer
+	 * @param[in] data Pointer to the contents of an obj file
+	 * @param[in] size Size of data in bytes
+	 * @param[in] storage Precision used for the meshes' vertex data
+	 * @throw std::bad_alloc
+	 */
+	void Load(void const* data, size_t size, OBJ_Mesh::STORAGE storage = OBJ_AttributeArray::STORAGE_DOUBLE);
+	/** Delete all meshes from the meshlist
+	 */
+	void Clear();
 	/** Get the number of meshes found in the file
 	 * @return The number of meshes found in the file
 	 */
@@ -256,13 +456,22 @@ public:
 	 * @throw Ghulbus::gbException GB_FAILED indicates a file access error
 	 */
 	void WriteFile(char const* fname) const;
+	/** Write data to a stream, in the same format as WriteFile()
+	 * @param[out] os Destination stream; should be opened in binary mode
+	 * @throw Ghulbus::gbException GB_FAILED indicates a stream error
+	 * @throw std::bad_alloc
+	 */
+	void Write(std::ostream& os) const;
 private:
 	/** Private helper function that does the actual parsing
+	 * @param[in] data Pointer to the contents of an obj file
+	 * @param[in] size Size of data in bytes
+	 * @param[in] storage Precision used for the meshes' vertex data
 	 * @throw Ghulbus::gbException GB_INVALIDCONTEXT indicates that the function was called while there
 	 *                             where already objects in the meshlist
 	 * @throw std::bad_alloc
 	 */
-	void ReadFile(std::ifstream& f);
+	void ReadData(char const* data, size_t size, OBJ_Mesh::STORAGE storage);
 };
 
 #endif
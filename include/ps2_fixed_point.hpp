@@ -0,0 +1,49 @@
+/**
+ * @file include/ps2_fixed_point.hpp
+ *
+ * @brief Block conversion between PS2 icon 4.12 fixed point coordinates and floatbuild_header/
+ */
+#ifndef __PS2_FIXED_POINT_HPP_INCLUDE_GUARD__
+#define __PS2_FIXED_POINT_HPP_INCLUDE_GUARD__
+
+#include <cstddef>
+
+/** Convert a single float to 4.12 fixed point
+ * @param[in] f The value to convert
+ * @return f * 4096, rounded towards zero and saturated to the range of short;
+ *         NaN is converted to the minimum value
+ */
+inline short PS2_FloatToFixed16(float f) {
+	float const s = f * 4096.0f;
+	if(s >= 32767.0f)     { return 32767; }
+	if(!(s > -32768.0f))  { return -32768; }
+	return static_cast<short>(s);
+}
+
+/** Convert a single 4.12 fixed point value to float
+ * @param[in] i The value to convert
+ * @return i / 4096
+ */
+inline float PS2_Fixed16ToFloat(short i) {
+	return static_cast<float>(i) / 4096.0f;
+}
+
+/** Convert a block of coordinate sets from 4.12 fixed point to float
+ * @param[in] src A field of size (n_coords*4) holding x, y, z and an unused fourth
+ *                component per set, as in PS2Icon::Vertex_Coord
+ * @param[out] dst A field of at least size (n_coords*3) receiving x, y and z per set
+ * @param[in] n_coords Number of coordinate sets
+ * @note Uses SSE2 or NEON if available; results are identical to PS2_Fixed16ToFloat()
+ */
+void PS2_UnpackFixed16Coords(short const* src, float* dst, size_t n_coords);
+
+/** Convert a block of coordinate sets from float to 4.12 fixed point
+ * @param[in] src A field of size (n_coords*3) holding x, y and z per set
+ * @param[out] dst A field of at least size (n_coords*4) receiving x, y, z and 0 per set,
+ *                 as in PS2Icon::Vertex_Coord
+ * @param[in] n_coords Number of coordinate sets
+ * @note Uses SSE2 or NEON if available; results are identical to PS2_FloatToFixed16()
+ */
+void PS2_PackFixed16Coords(float const* src, short* dst, size_t n_coords);
+
+#endif
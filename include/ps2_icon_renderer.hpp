@@ -0,0 +1,156 @@
+/**
+ * @file include/ps2_icon_renderer.hpp
+ *
+ * @brief A software renderer for icon previewsbuild_header/
+ */
+#ifndef __PS2_ICON_RENDERER_HPP_INCLUDE_GUARD__
+#define __PS2_ICON_RENDERER_HPP_INCLUDE_GUARD__
+
+#include <cstddef>
+#include <vector>
+#include "../gbLib/include/gbException.hpp"
+#include "../gbLib/include/gbColor.hpp"
+#include "ps2_ps2icon.hpp"
+#include "ps2_iconsys.hpp"
+
+/** Renders preview images of PS2Icon objects
+ * The icon is drawn textured and lit by the three directional lights and the ambient color
+ * of an icon.sys file. All buffers are kept between calls to Render(), so a single renderer
+ * should be reused for many icons.
+ * @note A renderer may not be used from multiple threads at once; use one per thread.
+ */
+class PS2IconRenderer {
+public:
+	/** Size of the square tiles the image is rendered in
+	 */
+	enum { TILE_SIZE = 16 };
+	/** Maximum width and height of the image
+	 */
+	enum { MAX_SIZE = 1024 };
+private:
+	/** A triangle prepared for rasterization
+	 */
+	struct Triangle {
+		int edge_a[3];								///< change of the edge functions per pixel in x
+		int edge_b[3];								///< change of the edge functions per pixel in y
+		int edge_c[3];								///< edge functions at the center of pixel (0,0)
+		float attr[6][3];							///< planes (value at pixel (0,0), change in x, change in y) of z, u, v, r, g, b
+		int min_x, min_y, max_x, max_y;				///< bounding box in pixels (inclusive)
+	};
+	int m_width;									///< width of the image in pixels
+	int m_height;									///< height of the image in pixels
+	float m_lightDir[3][3];							///< normalized directions of the three lights
+	float m_lightColor[3][3];						///< rgb colors of the three lights
+	float m_ambient[3];								///< rgb ambient color
+	unsigned int m_background;						///< color of pixels not covered by the icon
+	std::vector<GhulbusGraphics::GBCOLOR> m_image;	///< the rendered image (m_width*m_height); top row first
+	std::vector<float> m_positions;					///< vertex positions of the drawn shape
+	std::vector<float> m_allShapes;					///< vertex positions of all shapes, used for framing
+	std::vector<float> m_normals;					///< vertex normals
+	std::vector<float> m_texcoords;					///< vertex texture coordinates
+	std::vector<unsigned int> m_colors;				///< vertex colors
+	std::vector<unsigned int> m_texture;			///< icon texture (128*128)
+	std::vector<Triangle> m_triangles;				///< prepared triangles
+	std::vector< std::vector<int> > m_bins;			///< indices of the triangles touching each tile
+public:
+	/** Constructor
+	 * @note The image size is 128x128 pixels; lights and background are the defaults of a new icon.sys file
+	 * @throw std::bad_alloc
+	 */
+	PS2IconRenderer();
+	/** Set the size of the rendered image
+	 * @param[in] width Width of the image in pixels [1..MAX_SIZE]
+	 * @param[in] height Height of the image in pixels [1..MAX_SIZE]
+	 * @throw Ghulbus::gbException GB_ILLEGALPARAMETER
+	 * @throw std::bad_alloc
+	 */
+	void SetSize(int width, int height);
+	/** Get the width of the rendered image
+	 * @return The image width in pixels
+	 */
+	int GetWidth() const;
+	/** Get the height of the rendered image
+	 * @return The image height in pixels
+	 */
+	int GetHeight() const;
+	/** Take the lights from an icon.sys file
+	 * @param[in] icon_sys The icon.sys file of the icon
+	 */
+	void SetLights(IconSys const& icon_sys);
+	/** Set one of the directional lights
+	 * @param[in] index Number of the light [0..2]
+	 * @param[in] dir Direction pointing towards the light, in icon coordinates
+	 * @param[in] color Color of the light
+	 * @throw Ghulbus::gbException GB_ILLEGALPARAMETER
+	 */
+	void SetLight(int index, IconSys::IconSys_LightVec const& dir, IconSys::IconSys_LightColor const& color);
+	/** Set the ambient light
+	 * @param[in] color Color of the ambient light
+	 */
+	void SetAmbient(IconSys::IconSys_LightColor const& color);
+	/** Set the background color
+	 * @param[in] color Color of the pixels not covered by the icon (32 bit ARGB); default is 0 (transparent)
+	 */
+	void SetBackground(unsigned int color);
+	/** Render an icon
+	 * The icon is viewed orthographically along its z axis with y pointing down, as on the PS2,
+	 * and scaled to fill the image. The scale is chosen to fit all shapes, so that all frames of
+	 * an animation are framed alike.
+	 * @param[in] icon The icon
+	 * @param[in] frame Number of the animation frame whose shape is drawn [0..(GetNFrames()-1)];
+	 *                  a negative number draws the first shape
+	 * @throw Ghulbus::gbException GB_ILLEGALPARAMETER indicates an invalid frame;
+	 *                             GB_FAILED indicates a corrupted icon
+	 * @throw std::bad_alloc
+	 */
+	void Render(PS2Icon const& icon, int frame = -1);
+	/** Get the rendered image
+	 * @return A field of GetWidth()*GetHeight() 32 bit ARGB pixels, top row first
+	 */
+	GhulbusGraphics::GBCOLOR const* GetImage() const;
+	/** Write the rendered image to a TGA image in memory
+	 * @param[out] out Receives the complete TGA file; its capacity is reused
+	 * @param[in] rle If true, the image is written run length encoded
+	 * @throw std::bad_alloc
+	 */
+	void WriteImage(std::vector<unsigned char>& out, bool rle = false) const;
+	/** Write the rendered image to a TGA image file
+	 * @param[in] fname Full path to the output file
+	 * @param[in] rle If true, the image is written run length encoded
+	 * @throw Ghulbus::gbException GB_FAILED indicates a file access error;
+	 * @throw std::bad_alloc
+	 */
+	void WriteFile(char const* fname, bool rle = false) const;
+private:
+	/** Internal helper function: transforms, lights and bins the triangles of the drawn shape
+	 * @param[in] n_vertices Number of vertices
+	 * @param[in] n_shapes Number of shapes in m_allShapes
+	 * @throw std::bad_alloc
+	 */
+	void SetupTriangles(int n_vertices, int n_shapes);
+	/** Internal helper function: rasterizes all triangles touching a tile
+	 * @param[in] tile_x X coordinate of the tile's upper left pixel
+	 * @param[in] tile_y Y coordinate of the tile's upper left pixel
+	 * @param[in] bin Triangles touching the tile
+	 */
+	void RenderTile(int tile_x, int tile_y, std::vector<int> const& bin);
+};
+
+//EXTENSIVE DOCUMENTATION:
+/**
+ * @class PS2IconRenderer
+ * This class draws previews of icons without a graphics API, for catalogues and thumbnails.
+ *
+ * @section ps2render_pipeline The pipeline
+ * Lighting is computed per vertex from the icon normals: the ambient color plus the color of
+ * every light weighted by the cosine between normal and light direction. The result is
+ * multiplied with the vertex color and interpolated across the triangle, where it modulates
+ * the texture (nearest texel). Channels saturate at full intensity.
+ *
+ * Triangles are binned into tiles of TILE_SIZE x TILE_SIZE pixels, which are then rasterized
+ * one by one with their own depth buffer, small enough to stay in the processor cache.
+ * Coverage is decided by edge functions in fixed point with 4 bits of subpixel precision and
+ * a top-left fill rule, so triangles sharing an edge never overlap or leave gaps. Tiles that
+ * lie completely inside a triangle skip the edge tests.
+ */
+#endif
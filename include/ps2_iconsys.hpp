@@ -7,6 +7,7 @@
 #define __PS2_ICON_SYS_HPP_INCLUDE_GUARD__
 
 #include <fstream>
+#include <cstddef>
 #include "../gbLib/include/gbException.hpp"
 
 /** A loader for the PS2 icon.sys files
@@ -138,7 +139,7 @@ private:
 		unsigned char icon_delete_file[64];			///< filename of delete opertation icon (null terminated ASCII)
 		unsigned char reserve3[512];				///< reserved, should be: 0
 	} File;
-	char decoded_title[34];							///< title string in ASCII
+	char decoded_title[35];							///< title string in ASCII
 	char title_str[35];								///< decoded_title with proper linebreak
 	char title_str_single_line[35];					///< decoded_title with whitespace instead of linebreak
 public:
@@ -150,6 +151,25 @@ public:
 	 * @throw Ghulbus::gbException GB_FAILED indicates either a file read error or corrupt file;
 	 */
 	IconSys(const char* fname);
+	/** Constructor
+	 * @param[in] data Pointer to the contents of a valid icon.sys file
+	 * @param[in] size Size of the field data in bytes; at least GetHeaderSize().
+	 *                 The reserved block after the header is treated as zero if data ends before it.
+	 * @throw Ghulbus::gbException GB_FAILED indicates truncated data;
+	 */
+	IconSys(void const* data, size_t size);
+	/** Get the size of an icon.sys file
+	 * @return The number of bytes written by WriteFile()
+	 */
+	static size_t GetFileSize();
+	/** Get the size of the part of an icon.sys file holding data
+	 * @return The number of bytes before the reserved block at the end of the file
+	 */
+	static size_t GetHeaderSize();
+	/** Get the file image
+	 * @return Pointer to GetFileSize() bytes holding the file as written by WriteFile()
+	 */
+	void const* GetFileData() const;
 	/** Destructor
 	 */
 	~IconSys();
@@ -298,17 +318,13 @@ private:
 	 * Checks the PS2D string and the reserved fields for consistency
 	 */
 	static bool CheckValidity(File_t const&);
-	/** Decodes S-JIS to ASCII
-	 * @note Not all S-JIS characters are supported!
-	 */
-	static void DecodeTitle(unsigned char const * str_in, char* str_out);
-	/** Encode S-JIS from ASCII
-	 * @note Not all S-JIS characters are supported!
-	 */
-	static void EncodeTitle(char const* str_in, unsigned char* str_out);
 	/** Augments the ASCII title string with a proper line break
 	 */
 	static void GetTitleString(char const * str_in, unsigned int pos_linebreak, char * str_out);
+	/** Internal helper function
+	 * Builds the ASCII title strings from the loaded File structure
+	 */
+	void DecodeStrings();
 	IconSys(IconSys const&);						///< private copy constructor (not implemented!)
 	IconSys& operator=(IconSys const&);				///< private copy assignment (not implemented!)
 };
@@ -323,10 +339,9 @@ typedef IconSys *LPICONSYS;
  * a File_t and written by directly writing from a File_t, which makes the implementation
  * pretty straightforward.
  *
- * The implementation of the S-JIS/ASCII converter is not very good and far from 
- * complete. While it supports all of alphanumeric characters and a few special 
- * chars it will certainly fail when encountering some more exotic chars. Feel free
- * to augment/replace the DecodeTitle() function at your needs.
+ * The title is converted between S-JIS and ASCII by PS2TitleCodec. All printable
+ * ASCII characters are supported; S-JIS characters without an ASCII counterpart are
+ * shown as '?' by GetTitle(), but are kept in the file unless the title is replaced.
  *
  */
 #endif
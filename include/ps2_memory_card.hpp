@@ -0,0 +1,195 @@
+/**
+ * @file include/ps2_memory_card.hpp
+ *
+ * @brief A reader for PS2 memory card imagesbuild_header/
+ */
+#ifndef __PS2_MEMORY_CARD_HPP_INCLUDE_GUARD__
+#define __PS2_MEMORY_CARD_HPP_INCLUDE_GUARD__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "../gbLib/include/gbException.hpp"
+#include "../gbLib/include/gbMappedFile.hpp"
+
+/** A reader for PS2 memory card images
+ * Opening an image reads the file allocation table and the directory entries of all
+ * save directories; file contents are only accessed through GetFileData().
+ * After opening, all const member functions may be called concurrently from multiple threads.
+ */
+class PS2MemoryCard {
+public:
+	/** Flags of the mode field of a directory entry
+	 */
+	enum Mode_T {
+		MODE_READ      = 0x0001,					///< readable
+		MODE_WRITE     = 0x0002,					///< writable
+		MODE_EXECUTE   = 0x0004,					///< executable
+		MODE_PROTECTED = 0x0008,					///< copy protected
+		MODE_FILE      = 0x0010,					///< entry is a file
+		MODE_DIRECTORY = 0x0020,					///< entry is a directory
+		MODE_EXISTS    = 0x8000						///< entry is in use; cleared for deleted entries
+	};
+	/** A directory entry
+	 */
+	struct Entry {
+		std::string name;							///< name of the file or directory
+		unsigned int mode;							///< combination of Mode_T flags
+		unsigned int length;						///< size in bytes for files; number of entries for directories
+		unsigned int cluster;						///< first cluster, relative to the start of the allocatable area
+	};
+	/** A save directory in the root directory of the card
+	 */
+	struct SaveDirectory {
+		Entry entry;								///< entry of the directory in the root directory
+		std::vector<Entry> files;					///< the files in the directory
+	};
+private:
+	GhulbusUtil::gbMappedFile m_file;				///< mapped card image, if opened from a file
+	unsigned char const* m_data;					///< card image
+	size_t m_size;									///< size of m_data in bytes
+	size_t m_pageSize;								///< size of the data part of a page in bytes
+	size_t m_rawPageSize;							///< size of a page in the image, including spare data
+	size_t m_pagesPerCluster;						///< number of pages per cluster
+	size_t m_clusterSize;							///< size of the data part of a cluster in bytes
+	size_t m_allocOffset;							///< first cluster of the allocatable area
+	size_t m_allocEnd;								///< number of clusters in the allocatable area
+	std::vector<unsigned int> m_fat;				///< allocation table entry for every allocatable cluster
+	std::vector<SaveDirectory> m_saves;				///< all save directories of the card
+public:
+	/** Constructor
+	 * @note Constructs an empty card; use Open() or Load() to read an image
+	 */
+	PS2MemoryCard();
+	/** Constructor
+	 * @param[in] fname Complete path to a memory card image
+	 * @throw Ghulbus::gbException GB_FAILED indicates a file access error or a corrupted image;
+	 * @throw std::bad_alloc
+	 */
+	explicit PS2MemoryCard(char const* fname);
+	/** Constructor
+	 * @param[in] data Pointer to the complete card image; must stay valid for the lifetime of the object
+	 * @param[in] size Size of the field data in bytes
+	 * @throw Ghulbus::gbException GB_FAILED indicates a corrupted image;
+	 * @throw std::bad_alloc
+	 */
+	PS2MemoryCard(void const* data, size_t size);
+	/** Destructor
+	 */
+	~PS2MemoryCard();
+	/** Replace the current card with a memory card image file
+	 * The image is mapped and kept open until the object is destroyed or another card is read.
+	 * Images with and without the spare (ECC) area of each page are supported.
+	 * @param[in] fname Complete path to a memory card image
+	 * @note On failure the object is left empty.
+	 * @throw Ghulbus::gbException GB_FAILED indicates a file access error or a corrupted image;
+	 * @throw std::bad_alloc
+	 */
+	void Open(char const* fname);
+	/** Replace the current card with a memory card image in memory
+	 * @param[in] data Pointer to the complete card image; must stay valid as long as the card is used
+	 * @param[in] size Size of the field data in bytes
+	 * @note On failure the object is left empty.
+	 * @throw Ghulbus::gbException GB_FAILED indicates a corrupted image;
+	 * @throw std::bad_alloc
+	 */
+	void Load(void const* data, size_t size);
+	/** Close the card image
+	 */
+	void Close();
+	/** Check whether the image holds the spare area of each page
+	 * @return true if the image holds the spare (ECC) data of each page
+	 */
+	bool HasSpareData() const;
+	/** Get the number of save directories
+	 * @return The number of save directories in the root directory of the card
+	 */
+	int GetNSaves() const;
+	/** Get a save directory
+	 * @param[in] index Number of the save directory [0..(GetNSaves()-1)]
+	 * @return The save directory
+	 * @throw Ghulbus::gbException GB_ILLEGALPARAMETER;
+	 */
+	SaveDirectory const& GetSave(int index) const;
+	/** Find a save directory by name
+	 * @param[in] name Name of the directory (case sensitive)
+	 * @return The save directory or NULL if there is none of that name
+	 */
+	SaveDirectory const* FindSave(char const* name) const;
+	/** Find a file in a save directory
+	 * @param[in] save The save directory
+	 * @param[in] name Name of the file (case sensitive)
+	 * @return The file entry or NULL if there is none of that name
+	 */
+	Entry const* FindFile(SaveDirectory const& save, char const* name) const;
+	/** Get the contents of a file
+	 * If the clusters of the file are stored contiguously in the image, a pointer into
+	 * the image is returned and no data is copied. Otherwise the file is assembled in buffer.
+	 * @param[in] file A file entry of this card
+	 * @param[in,out] buffer Receives the file contents if they are not contiguous; its capacity is reused
+	 * @return Pointer to the file.length bytes of the file (NULL for empty files)
+	 * @throw Ghulbus::gbException GB_FAILED indicates a corrupted cluster chain;
+	 * @throw std::bad_alloc
+	 */
+	unsigned char const* GetFileData(Entry const& file, std::vector<unsigned char>& buffer) const;
+private:
+	/** Internal helper function: reads the superblock and the file allocation table
+	 * @throw Ghulbus::gbException GB_FAILED indicates a corrupted image;
+	 */
+	void ReadAllocationTable();
+	/** Internal helper function: reads the root directory and all save directories
+	 * @throw Ghulbus::gbException GB_FAILED indicates a corrupted image;
+	 */
+	void ReadDirectories();
+	/** Internal helper function: reads the entries of a directory
+	 * @param[in] cluster First cluster of the directory, relative to the allocatable area
+	 * @param[in] n_entries Number of entries in the directory, including "." and ".."
+	 * @param[out] entries Receives all existing entries except "." and ".."
+	 * @throw Ghulbus::gbException GB_FAILED indicates a corrupted image;
+	 */
+	void ReadDirectory(unsigned int cluster, size_t n_entries, std::vector<Entry>& entries) const;
+	/** Internal helper function: follows a cluster chain
+	 * @param[in] cluster First cluster of the chain, relative to the allocatable area
+	 * @param[in] n_clusters Number of clusters to collect
+	 * @param[out] chain Receives the absolute cluster numbers
+	 * @throw Ghulbus::gbException GB_FAILED indicates a corrupted cluster chain;
+	 */
+	void GetClusterChain(unsigned int cluster, size_t n_clusters, std::vector<size_t>& chain) const;
+	/** Internal helper function: get a page of the image
+	 * @param[in] cluster Absolute cluster number
+	 * @param[in] page Page in the cluster [0..(m_pagesPerCluster-1)]
+	 * @return Pointer to the data part of the page
+	 * @throw Ghulbus::gbException GB_FAILED indicates that the page is outside the image;
+	 */
+	unsigned char const* GetPage(size_t cluster, size_t page) const;
+	PS2MemoryCard(PS2MemoryCard const&);			///< private copy constructor (not implemented!)
+	PS2MemoryCard& operator=(PS2MemoryCard const&);	///< private copy assignment (not implemented!)
+};
+
+//EXTENSIVE DOCUMENTATION:
+/**
+ * @class PS2MemoryCard
+ * This class reads the file system of 8 MB memory card images, as written by card
+ * dumping tools (usually with the extension .ps2, including the spare area of each
+ * page) and by emulators (usually .mcd, without the spare area).
+ *
+ * @section ps2card_layout The card layout
+ * The card is divided into pages of 512 bytes, two of which make up a cluster. In images
+ * with spare data, every page is followed by 16 bytes of ECC data. The first page holds
+ * the superblock: a magic string "Sony PS2 Memory Card Format ", the page and cluster
+ * sizes, the first cluster and the size of the allocatable area, the cluster of the root
+ * directory and a list of indirect allocation table clusters.
+ *
+ * @section ps2card_fat The file allocation table
+ * The allocation table holds one 32 bit entry for every cluster of the allocatable area.
+ * Bit 31 marks allocated clusters; the lower 31 bits hold the next cluster of a chain,
+ * 0x7FFFFFFF marking the end. The table clusters themselves are found through the
+ * indirect table clusters listed in the superblock.
+ *
+ * @section ps2card_dir Directories
+ * A directory is a cluster chain of 512 byte entries. The first entry ("."), as well as
+ * the entry of the directory in its parent, holds the number of entries. Save directories
+ * are subdirectories of the root directory; each usually contains an icon.sys file and the
+ * icons it references.
+ */
+#endif
@@ -0,0 +1,85 @@
+/**
+ * @file include/ps2_mesh_optimizer.hpp
+ *
+ * @brief Simplification and reordering of icon geometrybuild_header/
+ */
+#ifndef __PS2_MESH_OPTIMIZER_HPP_INCLUDE_GUARD__
+#define __PS2_MESH_OPTIMIZER_HPP_INCLUDE_GUARD__
+
+#include <cstddef>
+#include <vector>
+#include "../gbLib/include/gbException.hpp"
+#include "obj_loader.hpp"
+
+/** Optimizes geometry before it is stored in a PS2Icon
+ * The geometry is held as in icon files: an unindexed list of triangles, each made of three
+ * consecutive vertices with position, normal and 2D texture coordinates. Use the Get*()
+ * functions to pass the result on to PS2Icon::SetGeometry().
+ * @note Vertex colors and animation shapes are not handled; the result is a single shape.
+ */
+class PS2MeshOptimizer {
+private:
+	std::vector<float> m_positions;			///< 3 floats per vertex
+	std::vector<float> m_normals;			///< 3 floats per vertex
+	std::vector<float> m_texcoords;			///< 2 floats per vertex
+public:
+	/** Constructor
+	 * @note Constructs an empty mesh; use SetGeometry() to set the geometry
+	 */
+	PS2MeshOptimizer();
+	/** Replace the current geometry with the faces of an OBJ mesh
+	 * @param[in] mesh The mesh
+	 * @param[in] scale_factor A scale factor applied to each vertex
+	 * @throw std::bad_alloc
+	 */
+	void SetGeometry(OBJ_Mesh const& mesh, float scale_factor);
+	/** Get the number of vertices
+	 * @return The number of vertices; three times the number of triangles
+	 */
+	int GetNVertices() const;
+	/** Get the vertex positions
+	 * @return A field of size (n_vertices*3) or NULL if the mesh is empty
+	 */
+	float const* GetPositions() const;
+	/** Get the vertex normals
+	 * @return A field of size (n_vertices*3) or NULL if the mesh is empty
+	 */
+	float const* GetNormals() const;
+	/** Get the texture coordinates
+	 * @return A field of size (n_vertices*2) or NULL if the mesh is empty
+	 */
+	float const* GetTextureCoords() const;
+	/** Remove triangles without area
+	 * A triangle is removed if its corners are collinear once converted to the 4.12 fixed point
+	 * format of icon files. This includes triangles that only collapse by the conversion.
+	 * @return The number of triangles removed
+	 */
+	int RemoveDegenerateTriangles();
+	/** Reduce the number of vertices by quadric error edge collapse
+	 * Vertices with identical positions are joined first; edges are then collapsed into one of
+	 * their end points in order of increasing geometric error until the budget is met.
+	 * Collapses that would flip a triangle are skipped, and open borders are kept in place
+	 * as far as possible. Normals and texture coordinates of the remaining corners are kept.
+	 * @param[in] max_vertices Maximum number of vertices (three per triangle); at least one
+	 *                         triangle is kept even for values below 3
+	 * @return The number of triangles removed; the budget may not be met if no valid
+	 *         collapses are left
+	 * @throw std::bad_alloc
+	 */
+	int Decimate(int max_vertices);
+	/** Reorder the triangles for the texture cache
+	 * Triangles are sorted along a Z-order curve over the texture coordinates of their centers,
+	 * so consecutive triangles mostly sample the same texture area.
+	 * @note This changes the drawing order, which is visible with translucent textures.
+	 * @throw std::bad_alloc
+	 */
+	void ReorderTriangles();
+private:
+	/** Internal helper function: keeps only the listed triangles
+	 * @param[in] triangles Indices of the triangles to keep, in their new order
+	 * @throw std::bad_alloc
+	 */
+	void SelectTriangles(std::vector<int> const& triangles);
+};
+
+#endif
@@ -7,8 +7,58 @@
 #define __PS2_ICON_LOADER_HPP_INCLUDE_GUARD__
 
 #include <fstream>
+#include <cstddef>
+#include <vector>
 #include "../gbLib/include/gbException.hpp"
+#include "../gbLib/include/gbMappedFile.hpp"
+#include "../gbLib/include/gbThreadPool.hpp"
 #include "obj_loader.hpp"
+#include "ps2_texture_codec.hpp"
+
+/** A pool of storage blocks for PS2Icon objects
+ * Icons created with a pool take their storage block from it and hand it back on
+ * destruction, so that converting many files does not allocate a block per file.
+ * All member functions may be called concurrently from multiple threads.
+ * @note The pool must outlive all icons using it.
+ */
+class PS2IconPool {
+private:
+	/** A free storage block
+	 */
+	struct Block {
+		unsigned char* data;						///< start of the block
+		size_t size;								///< size of the block in bytes
+	};
+	std::vector<Block> m_free;						///< blocks available for reuse
+	size_t m_maxBlocks;								///< maximum number of blocks kept in m_free
+	GhulbusUtil::gbMutex m_mutex;					///< protects m_free
+public:
+	/** Constructor
+	 * @param[in] max_blocks Maximum number of free blocks kept for reuse
+	 * @throw std::bad_alloc
+	 */
+	explicit PS2IconPool(size_t max_blocks = 64);
+	/** Destructor
+	 * @note Frees all blocks currently held by the pool
+	 */
+	~PS2IconPool();
+	/** Get a storage block
+	 * @param[in] size Minimum size of the block in bytes
+	 * @param[out] capacity Receives the actual size of the block
+	 * @return The smallest free block of at least size bytes or a newly allocated one
+	 * @throw std::bad_alloc
+	 */
+	unsigned char* Acquire(size_t size, size_t* capacity);
+	/** Return a storage block to the pool
+	 * @param[in] data A block obtained from Acquire()
+	 * @param[in] capacity The capacity reported by Acquire()
+	 * @note If the pool is full, the smallest block is freed.
+	 */
+	void Release(unsigned char* data, size_t capacity);
+private:
+	PS2IconPool(PS2IconPool const&);				///< private copy constructor (not implemented!)
+	PS2IconPool& operator=(PS2IconPool const&);		///< private copy assignment (not implemented!)
+};
 
 /** A loader for PS2 icon files
  * @note Currently all structs defined in this class are assumed to be unpadded!
@@ -63,6 +113,15 @@ public:
 		float time;									///< ???
 		float value;								///< ???
 	} Frame_Key;
+	/** Ways of storing the texture when writing a file
+	 */
+	enum TextureEncoding_T {
+		TEXTURE_AS_HEADER,							///< as given by the texture type of the header; greedy RLE
+		TEXTURE_UNCOMPRESSED,						///< uncompressed (texture type 0x07)
+		TEXTURE_RLE,								///< RLE compressed (texture type 0x0f); greedy choice of runs
+		TEXTURE_RLE_OPTIMAL,						///< RLE compressed (texture type 0x0f); runs of minimal size
+		TEXTURE_AUTO								///< the smaller one of TEXTURE_UNCOMPRESSED and TEXTURE_RLE_OPTIMAL
+	};
 private:
 	Icon_Header header;								///< icon file header
 	Vertex_Coord* vertices;							///< icon vertex data
@@ -72,23 +131,104 @@ private:
 	float* fnormals;								///< converted normal data
 	Animation_Header anim_header;					///< animation segment header
 	Frame_Data* animation;							///< animation data
-	Frame_Key** anim_keys;							///< frame key data
-	unsigned int texture[16384];					///< texture image data (128*128 pixels) in ARGB format (8 bits per channel)
+	Frame_Key** anim_keys;							///< frame key data (pointers into frame_keys)
+	Frame_Key* frame_keys;							///< frame keys of all frames
+	unsigned int* texture;							///< texture image data (128*128 pixels) in ARGB format (8 bits per channel)
+	unsigned char* m_arena;							///< single storage block holding all of the above fields
+	size_t m_arenaSize;								///< size of m_arena in bytes
+	PS2IconPool* m_pool;							///< pool providing m_arena (or NULL to use new[])
+	/** Sections that are decoded on demand
+	 */
+	enum Pending_T {
+		PENDING_GEOMETRY  = 0x01,					///< vertex, normal and texture coordinate data
+		PENDING_ANIMATION = 0x02,					///< animation header and frame data
+		PENDING_TEXTURE   = 0x04					///< texture image data
+	};
+	GhulbusUtil::gbMappedFile m_sourceFile;			///< mapped icon file while sections are pending
+	unsigned char const* m_source;					///< icon file data while sections are pending
+	size_t m_sourceSize;							///< size of m_source in bytes
+	unsigned int m_pending;							///< combination of Pending_T flags for sections not yet decoded
+	size_t m_animOffset;							///< offset of the animation header in m_source
+	size_t m_textureOffset;							///< offset of the texture segment in m_source
+	size_t m_nSourceFrames;							///< number of animation frames in m_source
+	size_t m_nSourceKeys;							///< total number of frame keys in m_source
+	mutable std::vector<unsigned char> m_encodedTexture;	///< rle encoding of texture, see EncodeTexture()
+	mutable bool m_encodedTextureValid;				///< true if m_encodedTexture matches texture
+	TextureEncoding_T m_textureEncoding;			///< encoding used when writing the texture
 public:
 	/** Constructor
+	 * @param[in] pool Pool providing the storage block (NULL to allocate it with new[])
 	 * @note This just fills the fields with default values. 
 	 *       To obtain a valid file you must at least call SetGeometry() before writing.
+	 * @throw std::bad_alloc
 	 */
-	PS2Icon();
+	explicit PS2Icon(PS2IconPool* pool = NULL);
 	/** Constructor
 	 * @param[in] fname Complete path to a valid icon file
+	 * @param[in] pool Pool providing the storage block (NULL to allocate it with new[])
 	 * @throw Ghulbus::gbException GB_FAILED indicates a file access error; 
 	 * @throw std::bad_alloc
 	 */
-	PS2Icon(char const * fname);
+	PS2Icon(char const * fname, PS2IconPool* pool = NULL);
+	/** Constructor
+	 * @param[in] data Pointer to the complete contents of a valid icon file
+	 * @param[in] size Size of the field data in bytes
+	 * @param[in] pool Pool providing the storage block (NULL to allocate it with new[])
+	 * @note The data is decoded immediately; the field may be released after construction.
+	 * @throw Ghulbus::gbException GB_FAILED indicates corrupted or truncated icon data;
+	 * @throw std::bad_alloc
+	 */
+	PS2Icon(void const* data, size_t size, PS2IconPool* pool = NULL);
 	/** Destructor
 	 */
 	~PS2Icon();
+	/** Replace the current data with the contents of an icon file
+	 * @param[in] fname Complete path to a valid icon file
+	 * @note On failure the object is left in the default constructed state.
+	 * @throw Ghulbus::gbException GB_FAILED indicates a file access error; 
+	 * @throw std::bad_alloc
+	 */
+	void Load(char const* fname);
+	/** Replace the current data with the contents of an icon file
+	 * @param[in] fname Complete path to a valid icon file
+	 * @param[in] lazy If true, only the header is read; geometry, animation and texture
+	 *                 are decoded on the first call to a function that needs them and
+	 *                 the file is kept mapped until then
+	 * @note On failure the object is left in the default constructed state.
+	 * @note Decoding a pending section from a const function modifies the object;
+	 *       a lazily loaded object must not be shared between threads before all
+	 *       sections are decoded.
+	 * @note WriteFile(), GetSerializedSize() and Serialize() cache the encoded texture,
+	 *       so they must not be called on the same object from several threads at once.
+	 * @throw Ghulbus::gbException GB_FAILED indicates a file access error; 
+	 * @throw std::bad_alloc
+	 */
+	void Load(char const* fname, bool lazy);
+	/** Replace the current data with icon data from memory
+	 * @param[in] data Pointer to the complete contents of a valid icon file
+	 * @param[in] size Size of the field data in bytes
+	 * @note On failure the object is left in the default constructed state.
+	 * @throw Ghulbus::gbException GB_FAILED indicates corrupted or truncated icon data;
+	 * @throw std::bad_alloc
+	 */
+	void Load(void const* data, size_t size);
+	/** Replace the current data with icon data from memory
+	 * @param[in] data Pointer to the complete contents of a valid icon file
+	 * @param[in] size Size of the field data in bytes
+	 * @param[in] lazy If true, only the header is read; the other sections are decoded
+	 *                 on demand (see Load(char const*, bool)) and data must stay valid
+	 *                 until they are
+	 * @note On failure the object is left in the default constructed state.
+	 * @throw Ghulbus::gbException GB_FAILED indicates corrupted or truncated icon data;
+	 * @throw std::bad_alloc
+	 */
+	void Load(void const* data, size_t size, bool lazy);
+	/** Reset the object to the default constructed state
+	 * @note The storage block is kept for reuse by the next Load() or SetGeometry();
+	 *       it is only released on destruction.
+	 * @throw std::bad_alloc
+	 */
+	void Clear();
 	/** Get the number of vertices of the icon
 	 * @return The number of vertices of the icon
 	 * @throw Ghulbus::gbException GB_FAILED uint overflow;
@@ -133,10 +273,15 @@ public:
 	 */
 	float GetFrameKeyValue(int frame, int key) const;
 	/** Get the texture type
-	 * @return The texture type id (>=0x07: uncompressed; <=0x07: rle encoded)
+	 * @return The texture type id (<=0x07: uncompressed; >0x07: rle encoded)
+	 * @note With TEXTURE_AUTO encoding this is the type that will be written.
 	 * @throw Ghulbus::gbException GB_FAILED uint overflow;
 	 */
 	int GetTextureType() const;
+	/** Get the encoding used when writing the texture
+	 * @return The texture encoding
+	 */
+	TextureEncoding_T GetTextureEncoding() const;
 	/** Get the vertex data used in a specific shape
 	 * @param[out] data A field of at least size (n_vertices * 3), resp. (n_vertices * n_shapes * 3)
 	 * @param[in] shape A positive integer specifies the shape; A negative integer causes all shapes to be copied to data sequentially
@@ -174,9 +319,26 @@ public:
 	unsigned int GetTextureData(int x, int y) const;
 	/** Save the current data to a new icon file
 	 * @param[in] fname The full path of the destination file
+	 * @note The texture is stored as selected by SetTextureEncoding().
 	 * @throw Ghulbus::gbException GB_FAILED file access error;
 	 */
 	void WriteFile(char const * fname) const;
+	/** Get the size of the icon file image
+	 * @return The number of bytes written by Serialize()
+	 */
+	size_t GetSerializedSize() const;
+	/** Build the complete icon file image in memory
+	 * @param[out] buffer Receives the icon file image; its capacity is reused between calls
+	 * @throw std::bad_alloc
+	 */
+	void Serialize(std::vector<unsigned char>& buffer) const;
+	/** Build the complete icon file image in memory
+	 * @param[out] dst A field of at least size cap
+	 * @param[in] cap Size of the field dst in bytes
+	 * @return The number of bytes written to dst
+	 * @throw Ghulbus::gbException GB_FAILED cap is smaller than GetSerializedSize();
+	 */
+	size_t Serialize(void* dst, size_t cap) const;
 	/** Set the geometry data of the icon
 	 * @param[in] mesh A valid OBJ_Mesh object holding new geometry data
 	 * @throw std::bad_alloc
@@ -195,24 +357,110 @@ public:
 	 * @param[in] n_vertices Number of vertices
 	 */
 	void SetGeometry(float const* pverts, float const* pnormals, float const* ptexture, int n_vertices);
+	/** Set the geometry data of the icon from a sequence of animation shapes
+	 * Each mesh becomes one shape and one frame of a looping animation, in which every
+	 * shape is blended linearly into the next one over frame_time time units.
+	 * @param[in] shapes A field of n_shapes valid OBJ_Mesh objects; all meshes must have the
+	 *                   same faces referencing the same vertex indices
+	 * @param[in] n_shapes Number of shapes
+	 * @param[in] scale_factor A factor that is multiplied onto each vertex for scaling
+	 * @param[in] frame_time Time between two consecutive shapes
+	 * @note Normals and texture coordinates are taken from the first shape.
+	 * @throw Ghulbus::gbException GB_ILLEGALPARAMETER indicates that n_shapes or frame_time is
+	 *                             less than 1 or that the topology of the meshes differs;
+	 * @throw std::bad_alloc
+	 */
+	void SetAnimation(OBJ_Mesh const* const* shapes, int n_shapes, float scale_factor, int frame_time);
 	/** Set the texture data of the icon
 	 * @param[in] data A field of at least size 16384 containing 32 bit image data
 	 */
 	void SetTextureData(unsigned int const* data);
+	/** Set the encoding used when writing the texture
+	 * @param[in] encoding The texture encoding
+	 * @note Except for TEXTURE_AS_HEADER and TEXTURE_AUTO this also sets the texture type.
+	 *       Loading a file or calling Clear() resets the encoding to TEXTURE_AS_HEADER.
+	 */
+	void SetTextureEncoding(TextureEncoding_T encoding);
 	/** Build a mesh from current data
 	 * @param[in,out] mesh A mesh object that will be filled with the icon geometry
+	 * @param[in] weld If true, vertices with identical position, normal and texture coordinates
+	 *                 are merged into a single indexed vertex; otherwise every triangle gets
+	 *                 three vertices of its own, as stored in the icon.
+	 * @note Vertices are compared in the 16 bit fixed point format of the file.
+	 *       Only the first animation shape is used.
+	 * @throw std::bad_alloc
 	 */
-	void BuildMesh(OBJ_Mesh* mesh);
+	void BuildMesh(OBJ_Mesh* mesh, bool weld = false);
 private:
-	/** Internal helper function: resets and allocates memory for geometry
+	/** Internal helper function: finds vertices that can be shared between triangles
+	 * @param[out] remap Receives the index of the welded vertex for each icon vertex
+	 * @param[out] unique Receives the icon vertex used for each welded vertex
 	 * @throw std::bad_alloc
 	 */
-	void AllocateVertexMemory();
-	/** Internal helper function: reads icon data from a (binary) filestream
-	 * @throw Ghulbus::gbException GB_FAILED indicates either file access error or uint overflow;
+	void WeldVertices(std::vector<unsigned int>& remap, std::vector<unsigned int>& unique) const;
+	/** Internal helper function: lays out the storage block for the given sizes
+	 * The block only grows; the texture data is preserved.
+	 * @param[in] n_vertices Number of vertices
+	 * @param[in] n_shapes Number of animation shapes
+	 * @param[in] n_frames Number of animation frames
+	 * @param[in] n_keys Total number of frame keys
 	 * @throw std::bad_alloc
 	 */
-	void ReadFile(std::ifstream & fin);
+	void SetupStorage(size_t n_vertices, size_t n_shapes, size_t n_frames, size_t n_keys);
+	/** Internal helper function: gives the storage block back to the pool or frees it
+	 */
+	void ReleaseStorage();
+	/** Internal helper function: frees all memory held by the object
+	 */
+	void ReleaseMemory();
+	/** Internal helper function: closes the icon file data of a lazy load
+	 */
+	void ReleaseSource();
+	/** Internal helper function: starts decoding icon data from a memory buffer
+	 * @param[in] data Pointer to the complete contents of an icon file
+	 * @param[in] size Size of the field data in bytes
+	 * @param[in] lazy If false, all sections are decoded immediately
+	 * @note On failure the object is left in the default constructed state.
+	 * @throw Ghulbus::gbException GB_FAILED indicates either truncated data or uint overflow;
+	 * @throw std::bad_alloc
+	 */
+	void LoadFromSource(unsigned char const* data, size_t size, bool lazy);
+	/** Internal helper function: reads the header and records the section offsets and sizes
+	 * @throw Ghulbus::gbException GB_FAILED indicates a corrupted header or truncated vertex or animation data;
+	 */
+	void ReadHeader();
+	/** Internal helper function: decodes the vertex segment
+	 */
+	void DecodeGeometry();
+	/** Internal helper function: decodes the animation segment
+	 */
+	void DecodeAnimation();
+	/** Internal helper function: decodes the texture segment
+	 * @throw Ghulbus::gbException GB_FAILED indicates either truncated or corrupted data;
+	 */
+	void DecodeTexture();
+	/** Internal helper function: marks sections as decoded; releases the source once nothing is pending
+	 * @param[in] section Combination of Pending_T flags
+	 */
+	void SectionDecoded(unsigned int section);
+	/** Internal helper functions: decode a pending section before it is accessed
+	 * @throw Ghulbus::gbException GB_FAILED indicates either truncated or corrupted data;
+	 * @throw std::bad_alloc
+	 */
+	void EnsureGeometry() const;
+	void EnsureAnimation() const;	///< @copydoc EnsureGeometry()
+	void EnsureTexture() const;		///< @copydoc EnsureGeometry()
+	/** Internal helper function: rle encodes the texture
+	 * @return The encoded texture, excluding the size field
+	 * @note The encoding is cached until the texture changes, so that GetSerializedSize()
+	 *       and Serialize() encode the texture only once.
+	 * @throw std::bad_alloc
+	 */
+	std::vector<unsigned char> const& EncodeTexture() const;
+	/** Internal helper function: get the texture type written to file
+	 * @return The texture type of the header, or the type chosen for TEXTURE_AUTO
+	 */
+	unsigned int GetSerializedTextureType() const;
 	/** Internal helper function: checks the validity of a file header
 	 */
 	static bool CheckValidity(Icon_Header const&);
@@ -226,7 +474,11 @@ typedef PS2Icon *LPPS2ICON;
  * @note This class keeps two representations of most of its data. Aside from the
  *       representation also used in the file, there is also a representation 
  *       that fits the standards of modern graphic APIs for visualization.
- * @todo SetAnimation
+ * @note When loaded lazily (see Load(char const*, bool)), an icon only reads its header;
+ *       the geometry, animation and texture segments are decoded on first access. The
+ *       accessors of a pending segment may then throw the same exceptions as Load().
+ * @note The const functions that write the icon modify its texture cache; calls on
+ *       the same object from several threads must be serialized by the caller.
  *
  * @section ps2icon_file The file format
  * The file is made up of the following segments:
@@ -0,0 +1,89 @@
+/**
+ * @file include/ps2_texture_codec.hpp
+ *
+ * @brief Conversion and RLE coding of PS2 icon texturesbuild_header/
+ */
+#ifndef __PS2_TEXTURE_CODEC_HPP_INCLUDE_GUARD__
+#define __PS2_TEXTURE_CODEC_HPP_INCLUDE_GUARD__
+
+#include <cstddef>
+#include <vector>
+#include "../gbLib/include/gbException.hpp"
+
+/** Encoder and decoder for the texture segment of PS2 icon files
+ * Textures are handled as 128*128 pixels in 32 bit ARGB format (8 bits per channel),
+ * as used by PS2Icon. In the file each pixel is stored as a 16 bit texel @c ABBBBBGGGGGRRRRR.
+ * The RLE stream is a sequence of 16 bit control words, each followed by texel data:
+ *  - a value below 0xFF00 is a repeat count for the single texel that follows
+ *  - any other value v is followed by (0xFFFF ^ v) + 1 texels that are copied verbatim
+ * @note Texels are stored unaligned in little endian order (the byte order of the host).
+ *       All functions use SSE2 or NEON if available; the results are identical to the
+ *       scalar versions.
+ */
+class PS2TextureCodec {
+public:
+	enum Texture_Size_T {
+		TEXTURE_WIDTH  = 128,						///< width of the texture in pixels
+		TEXTURE_HEIGHT = 128,						///< height of the texture in pixels
+		N_TEXELS       = 128*128					///< number of pixels in a texture
+	};
+	/** Strategies for choosing the runs of the RLE stream
+	 */
+	enum RLE_Mode_T {
+		RLE_GREEDY,									///< take every repetition, literal runs of up to 255 pixels
+		RLE_OPTIMAL									///< choose runs that minimize the encoded size
+	};
+public:
+	/** Convert 32 bit ARGB pixels to 16 bit texels
+	 * @param[in] src A field of size n holding ARGB pixels
+	 * @param[out] dst A field of at least (n*2) bytes receiving the texels
+	 * @param[in] n Number of pixels
+	 * @note The alpha channel is dropped; the alpha bit of the texels is always 0.
+	 */
+	static void PackTexels(unsigned int const* src, void* dst, size_t n);
+	/** Convert 16 bit texels to 32 bit ARGB pixels
+	 * @param[in] src A field of (n*2) bytes holding texels
+	 * @param[out] dst A field of at least size n receiving the ARGB pixels
+	 * @param[in] n Number of pixels
+	 * @note The alpha bit of the texels is ignored; alpha is always 0xff.
+	 */
+	static void UnpackTexels(void const* src, unsigned int* dst, size_t n);
+	/** RLE encode a texture
+	 * @param[in] src A field of size N_TEXELS holding the ARGB texture
+	 * @param[out] out Receives the encoded stream (excluding the 32 bit size field
+	 *                 preceding it in icon files); previous contents are replaced.
+	 * @param[in] mode Strategy for choosing the runs
+	 * @note Pixels are compared after conversion to texels, so pixels differing only in
+	 *       bits lost by the conversion form a single run.
+	 * @note RLE_OPTIMAL is never larger than RLE_GREEDY; it splits the texture by dynamic
+	 *       programming over all pixels and is considerably slower.
+	 * @throw std::bad_alloc
+	 */
+	static void Encode(unsigned int const* src, std::vector<unsigned char>& out, RLE_Mode_T mode = RLE_GREEDY);
+	/** Decode an RLE encoded texture
+	 * @param[in] src The encoded stream (excluding the 32 bit size field)
+	 * @param[in] size Size of the field src in bytes
+	 * @param[out] dst A field of size N_TEXELS receiving the ARGB texture;
+	 *                 pixels not covered by the stream are set to 0.
+	 * @throw Ghulbus::gbException GB_FAILED indicates corrupted or truncated data;
+	 */
+	static void Decode(void const* src, size_t size, unsigned int* dst);
+};
+
+/** Convert a single 16 bit texel to 32 bit ARGB
+ * @param[in] c The texel to convert
+ * @return The ARGB pixel; alpha is always 0xff
+ */
+inline unsigned int PS2_TexelToARGB32(unsigned short c) {
+	return( 0xff000000 | ((c & 0x001f) << 19) | ((c & 0x03e0) << 6) | ((c & 0x7c00) >> 7) );
+}
+
+/** Convert a single 32 bit ARGB pixel to a 16 bit texel
+ * @param[in] c The pixel to convert
+ * @return The texel; the alpha bit is always 0
+ */
+inline unsigned short PS2_ARGB32ToTexel(unsigned int c) {
+	return static_cast<unsigned short>( ((c >> 19) & 0x001f) | ((c >> 6) & 0x03e0) | ((c << 7) & 0x7c00) );
+}
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * @file include/ps2_title_codec.hpp
+ *
+ * @brief Conversion of icon.sys titles between ASCII and S-JISbuild_header/
+ */
+#ifndef __PS2_TITLE_CODEC_HPP_INCLUDE_GUARD__
+#define __PS2_TITLE_CODEC_HPP_INCLUDE_GUARD__
+
+#include <cstddef>
+
+/** Encoder and decoder for the S-JIS title strings of icon.sys files
+ * Each printable ASCII character is stored as its full-width S-JIS counterpart, two bytes
+ * per character. Both directions are single lookups in precomputed tables.
+ * @note Only the full-width counterparts of printable ASCII are supported. Kana, kanji and
+ *       other non-ASCII characters decode to '?', so titles containing them do not round-trip;
+ *       unsupported ASCII characters encode to a full-width '?'.
+ */
+class PS2TitleCodec {
+public:
+	enum Title_Size_T {
+		TITLE_BYTES = 68,							///< size of the S-JIS title field in bytes
+		TITLE_CHARS = 34							///< maximum number of decoded characters
+	};
+public:
+	/** Get the S-JIS encoding of a character
+	 * @param[in] c An ASCII character
+	 * @return The two byte S-JIS character (lead byte in the high byte); 0 for '\\0'
+	 */
+	static unsigned short EncodeChar(unsigned char c);
+	/** Get the ASCII character for an S-JIS character
+	 * @param[in] lead First byte of the S-JIS character
+	 * @param[in] trail Second byte of the S-JIS character
+	 * @return The ASCII character; '\\0' for the terminator and '?' for unsupported characters
+	 */
+	static char DecodeChar(unsigned char lead, unsigned char trail);
+	/** Encode an ASCII title
+	 * @param[in] str_in A null terminated C-string; characters beyond (TITLE_CHARS-1) are dropped
+	 * @param[out] str_out A field of size TITLE_BYTES receiving the null padded S-JIS title
+	 * @return The number of characters encoded
+	 */
+	static int Encode(char const* str_in, unsigned char* str_out);
+	/** Decode an S-JIS title
+	 * @param[in] str_in A field of size TITLE_BYTES holding the S-JIS title
+	 * @param[out] str_out A field of size (TITLE_CHARS+1) receiving the null terminated ASCII title
+	 * @return The number of characters decoded
+	 */
+	static int Decode(unsigned char const* str_in, char* str_out);
+};
+
+//EXTENSIVE DOCUMENTATION:
+/**
+ * @class PS2TitleCodec
+ * The encoder maps the printable ASCII range (0x20-0x7E) to the full-width characters of
+ * rows 0x81 and 0x82 of S-JIS, which the PS2 browser displays. The space is written as
+ * 0x82 0x3F and ;<=>?@ as 0x82 0x5A-0x5F, as by earlier versions of this library, so
+ * existing titles keep their bytes.
+ *
+ * The decoder accepts every character written by the encoder, as well as the ideographic
+ * space 0x81 0x40, the typographic quotes 0x81 0x65 and 0x81 0x67 and the codes earlier
+ * versions wrote for ;<=>?@[{. Thus decoding an encoded title always yields the original
+ * string, apart from characters beyond the limit.
+ */
+#endif
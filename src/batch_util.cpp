@@ -0,0 +1,405 @@
+/**
+ * @file src/batch_util.cpp
+ *
+ * @brief Implementation of the batch conversion helpersbuild_header/
+ */
+#include "../include/batch_util.hpp"
+#include "../gbLib/include/gbThreadPool.hpp"
+#include "../gbLib/include/gbFileBackend.hpp"
+#include "../gbLib/include/gbStats.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <set>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+
+#ifdef WIN32
+#	include <windows.h>
+#else
+#	include <dirent.h>
+#	include <sys/stat.h>
+#endif
+
+/** Helper function: removes trailing whitespace (including CR from DOS line endings)
+ */
+static void StripTrailingWhitespace(std::string& str)
+{
+	std::string::size_type end = str.find_last_not_of(" \t\r\n");
+	if(end == std::string::npos) {
+		str.clear();
+	} else {
+		str.erase(end + 1);
+	}
+}
+
+void ReadBatchManifest(char const* fname, std::vector<BatchItem>& items)
+{
+	std::ifstream fin(fname, std::ios_base::in);
+	if(fin.fail()) { throw( Ghulbus::gbException(Ghulbus::gbException::GB_FAILED,
+	                                             "Could not open batch manifest for read") ); }
+	std::string line;
+	while(std::getline(fin, line)) {
+		StripTrailingWhitespace(line);
+		if(line.empty() || (line[0] == '#')) { continue; }
+		//split into up to 3 tab-separated fields:
+		std::string fields[3];
+		std::string::size_type pos = 0;
+		for(int i=0; (i<3) && (pos != std::string::npos); i++) {
+			std::string::size_type next = line.find('\t', pos);
+			fields[i] = line.substr(pos, (next == std::string::npos) ? std::string::npos : (next - pos));
+			pos = (next == std::string::npos) ? next : (next + 1);
+		}
+		if(fields[0].empty()) { continue; }
+		BatchItem item;
+		item.input   = fields[0];
+		item.output  = fields[1];
+		item.texture = fields[2];
+		items.push_back(item);
+	}
+	if(fin.bad()) { throw( Ghulbus::gbException(Ghulbus::gbException::GB_FAILED,
+	                                            "Error while reading batch manifest") ); }
+}
+
+/** Helper function: case insensitive check for a file extension
+ */
+static bool HasExtension(char const* fname, char const* extension)
+{
+	size_t len = strlen(fname), ext_len = strlen(extension);
+	if(len <= ext_len) { return false; }
+	for(size_t i=0; i<ext_len; i++) {
+		if(tolower(static_cast<unsigned char>(fname[len - ext_len + i])) !=
+		   tolower(static_cast<unsigned char>(extension[i]))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/** Helper function: is name one of the "." and ".." directory entries?
+ */
+static bool IsDotEntry(char const* name)
+{
+	return (strcmp(name, ".") == 0) || (strcmp(name, "..") == 0);
+}
+
+/** Helper function for ListDirectory(): collects matching files without sorting
+ */
+static void CollectFiles(std::string const& dir, char const* extension, bool recursive,
+                         std::vector<std::string>& found)
+{
+#ifdef WIN32
+	WIN32_FIND_DATAA find_data;
+	HANDLE hFind = FindFirstFileA(JoinPath(dir, "*").c_str(), &find_data);
+	if(hFind == INVALID_HANDLE_VALUE) {
+		throw( Ghulbus::gbException(Ghulbus::gbException::GB_FAILED, "Could not read input directory") );
+	}
+	do {
+		if(find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			//junctions are not followed, so that links can not form cycles:
+			if( recursive && !IsDotEntry(find_data.cFileName) &&
+			    ((find_data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0) ) {
+				try {
+					CollectFiles(JoinPath(dir, find_data.cFileName), extension, recursive, found);
+				} catch(...) {
+					FindClose(hFind);
+					throw;
+				}
+			}
+		} else if(HasExtension(find_data.cFileName, extension)) {
+			found.push_back(JoinPath(dir, find_data.cFileName));
+		}
+	} while(FindNextFileA(hFind, &find_data));
+	FindClose(hFind);
+#else
+	DIR* d = opendir(dir.c_str());
+	if(!d) {
+		throw( Ghulbus::gbException(Ghulbus::gbException::GB_FAILED, "Could not read input directory") );
+	}
+	struct dirent* entry;
+	while((entry = readdir(d)) != NULL) {
+		bool const match = HasExtension(entry->d_name, extension);
+		if(!match && (!recursive || IsDotEntry(entry->d_name))) { continue; }
+		std::string path = JoinPath(dir, entry->d_name);
+		struct stat st;
+		if(match && (stat(path.c_str(), &st) == 0) && S_ISREG(st.st_mode)) {
+			found.push_back(path);
+		} else if( recursive && !IsDotEntry(entry->d_name) &&
+		           (lstat(path.c_str(), &st) == 0) && S_ISDIR(st.st_mode) ) {
+			//symbolic links are not followed, so that they can not form cycles:
+			try {
+				CollectFiles(path, extension, recursive, found);
+			} catch(...) {
+				closedir(d);
+				throw;
+			}
+		}
+	}
+	closedir(d);
+#endif
+}
+
+void ListDirectory(char const* dir, char const* extension, std::vector<std::string>& files, bool recursive)
+{
+	std::vector<std::string> found;
+	CollectFiles(dir, extension, recursive, found);
+	std::sort(found.begin(), found.end());
+	files.insert(files.end(), found.begin(), found.end());
+}
+
+/** Helper function: is c a path separator?
+ */
+static bool IsPathSeparator(char c)
+{
+#ifdef WIN32
+	return (c == '/') || (c == '\\');
+#else
+	return (c == '/');
+#endif
+}
+
+std::string JoinPath(std::string const& dir, std::string const& fname)
+{
+	if(dir.empty()) { return fname; }
+	if(IsPathSeparator(dir[dir.size() - 1])) { return dir + fname; }
+	return dir + "/" + fname;
+}
+
+std::string GetFileName(std::string const& path)
+{
+	for(std::string::size_type i=path.size(); i>0; i--) {
+		if(IsPathSeparator(path[i-1])) { return path.substr(i); }
+	}
+	return path;
+}
+
+std::string ReplaceExtension(std::string const& path, char const* extension)
+{
+	std::string::size_type name_start = path.size() - GetFileName(path).size();
+	std::string::size_type dot = path.rfind('.');
+	if((dot == std::string::npos) || (dot <= name_start)) {
+		return path + extension;
+	}
+	return path.substr(0, dot) + extension;
+}
+
+BatchReport::BatchReport()
+	:m_nFailed(0)
+{
+	;
+}
+
+void BatchReport::AddSuccess(BatchItem const& item)
+{
+	Entry entry;
+	entry.input   = item.input;
+	entry.output  = item.output;
+	entry.success = true;
+	m_entries.push_back(entry);
+}
+
+void BatchReport::AddFailure(BatchItem const& item, char const* message)
+{
+	Entry entry;
+	entry.input   = item.input;
+	entry.output  = item.output;
+	entry.success = false;
+	entry.message = (message) ? message : "Unknown error";
+	m_entries.push_back(entry);
+	m_nFailed++;
+}
+
+int BatchReport::GetNItems() const
+{
+	return static_cast<int>(m_entries.size());
+}
+
+int BatchReport::GetNFailed() const
+{
+	return m_nFailed;
+}
+
+void BatchReport::Print(std::ostream& os) const
+{
+	os << " * Batch summary:\n";
+	for(std::vector<Entry>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+		if(it->success) {
+			os << " **  [ OK ] \"" << it->input << "\" -> \"" << it->output << "\"\n";
+		} else {
+			os << " **  [FAIL] \"" << it->input << "\": " << it->message << "\n";
+		}
+	}
+	os << " *  " << (GetNItems() - m_nFailed) << " of " << GetNItems() << " files converted, "
+	   << m_nFailed << " failed." << std::endl;
+}
+
+BatchConverter::~BatchConverter()
+{
+	;
+}
+
+/** State shared by the workers of RunBatch()
+ */
+struct BatchState {
+	std::vector<BatchItem> const* items;		///< the items to convert
+	BatchConverter* converter;					///< conversion strategy
+	std::ostream* os;							///< destination for the item logs
+	std::vector<std::string> logs;				///< log of every item that is not yet printed
+	std::vector<std::string> messages;			///< error string of every failed item
+	std::vector<char> state;					///< 0: pending, 1: succeeded, 2: failed
+	size_t next_print;							///< first item whose log was not yet printed
+	GhulbusUtil::gbMutex mutex;					///< protects logs, state, next_print and os
+};
+
+/** Worker function for RunBatch()
+ */
+static void BatchWork(int item, int worker, void* user)
+{
+	BatchState& batch = *static_cast<BatchState*>(user);
+	BatchItem const& batch_item = (*batch.items)[item];
+	std::ostringstream log;
+	log << " * [" << (item+1) << "/" << batch.items->size() << "] \"" << batch_item.input << "\"\n";
+	char result = 1;
+	std::string message;
+	try {
+		GB_STATS_TIMER("batch.item");
+		batch.converter->Convert(batch_item, worker, log);
+	} catch(Ghulbus::gbException& e) {
+		result  = 2;
+		message = (e.GetErrorString()[0] != '\0') ? e.GetErrorString() : e.what();
+	} catch(std::bad_alloc&) {
+		result  = 2;
+		message = "Out of memory";
+	} catch(std::exception& e) {
+		result  = 2;
+		message = e.what();
+	}
+
+	GhulbusUtil::gbLock lock(batch.mutex);
+	batch.logs[item] = log.str();
+	if(result == 2) { batch.messages[item] = message; }
+	batch.state[item] = result;
+	//print all logs that are complete in sequence:
+	bool printed = false;
+	while((batch.next_print < batch.state.size()) && (batch.state[batch.next_print] != 0)) {
+		*batch.os << batch.logs[batch.next_print];
+		batch.logs[batch.next_print].clear();
+		batch.next_print++;
+		printed = true;
+	}
+	if(printed) { batch.os->flush(); }
+}
+
+static int const MAX_IO_THREADS = 16;		///< upper limit for the I/O threads of RunBatch()
+
+/** Helper class for RunBatch(): installs a file backend for the lifetime of the object
+ */
+class FileBackendScope {
+private:
+	GhulbusUtil::gbFileBackend& m_previous;		///< backend that was installed before
+public:
+	explicit FileBackendScope(GhulbusUtil::gbFileBackend& backend)
+		:m_previous(GhulbusUtil::GetFileBackend())
+	{
+		GhulbusUtil::SetFileBackend(&backend);
+	}
+	~FileBackendScope() {
+		GhulbusUtil::SetFileBackend(&m_previous);
+	}
+};
+
+void RunBatch(std::vector<BatchItem> const& items, BatchConverter& converter, int n_threads,
+              std::ostream& os, BatchReport& report, int prefetch)
+{
+	BatchState batch;
+	batch.items      = &items;
+	batch.converter  = &converter;
+	batch.os         = &os;
+	batch.logs.resize(items.size());
+	batch.messages.resize(items.size());
+	batch.state.resize(items.size(), 0);
+	batch.next_print = 0;
+
+	GhulbusUtil::gbThreadPool pool(n_threads);
+	converter.Prepare(pool.GetNThreads());
+	std::vector<std::string> failed_writes;
+	if(prefetch > 0) {
+		//inputs are announced in the order the workers take the items:
+		GhulbusUtil::gbPrefetchFileBackend backend(prefetch, (prefetch < MAX_IO_THREADS) ? prefetch : MAX_IO_THREADS);
+		FileBackendScope scope(backend);
+		for(size_t i=0; i<items.size(); i++) {
+			backend.Prefetch(items[i].input.c_str());
+			if( (!items[i].texture.empty()) && ((i == 0) || (items[i].texture != items[i-1].texture)) ) {
+				backend.Prefetch(items[i].texture.c_str());
+			}
+		}
+		pool.Run(static_cast<int>(items.size()), BatchWork, &batch);
+		try {
+			backend.Flush();
+		} catch(Ghulbus::gbException&) {
+			backend.GetFailedWrites(failed_writes);
+		}
+	} else {
+		pool.Run(static_cast<int>(items.size()), BatchWork, &batch);
+	}
+
+	//outputs written behind may fail only now:
+	std::set<std::string> unassigned(failed_writes.begin(), failed_writes.end());
+	for(size_t i=0; i<items.size(); i++) {
+		if((batch.state[i] == 1) && (unassigned.erase(items[i].output) > 0)) {
+			batch.state[i]    = 2;
+			batch.messages[i] = "Output file could not be written";
+		}
+	}
+	for(size_t i=0; i<items.size(); i++) {
+		if(batch.state[i] == 1) {
+			report.AddSuccess(items[i]);
+		} else {
+			report.AddFailure(items[i], batch.messages[i].c_str());
+		}
+	}
+	for(std::set<std::string>::const_iterator it = unassigned.begin(); it != unassigned.end(); ++it) {
+		BatchItem item;
+		item.input = *it;
+		report.AddFailure(item, "Output file could not be written");
+	}
+	GB_STATS_COUNT("batch.items", items.size());
+	GB_STATS_COUNT("batch.failed", report.GetNFailed());
+	GB_STATS_COUNT("batch.threads", pool.GetNThreads());
+}
+
+static bool stats_json = false;			///< write the statistics as JSON instead of text
+static double stats_start = 0.0;		///< time stamp of EnableStatsOption()
+
+/** Helper function: writes the statistics to stderr; registered with atexit()
+ */
+static void WriteStatsAtExit()
+{
+	GhulbusUtil::gbStats::AddTime("total", GhulbusUtil::gbStats::GetTime() - stats_start);
+	if(stats_json) {
+		GhulbusUtil::gbStats::WriteJSON(std::cerr);
+	} else {
+		std::cerr << "\nStatistics:\n";
+		GhulbusUtil::gbStats::WriteText(std::cerr);
+	}
+	std::cerr.flush();
+}
+
+bool EnableStatsOption(char const* arg)
+{
+	if( (strcmp(arg, "--stats") == 0) || (strcmp(arg, "--stats=text") == 0) ) {
+		stats_json = false;
+	} else if( strcmp(arg, "--stats=json") == 0 ) {
+		stats_json = true;
+	} else {
+		return false;
+	}
+	if(!GhulbusUtil::gbStats::IsEnabled()) {
+		GhulbusUtil::gbStats::Enable(true);
+		stats_start = GhulbusUtil::gbStats::GetTime();
+		atexit(WriteStatsAtExit);
+	}
+	return true;
+}
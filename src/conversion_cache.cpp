@@ -0,0 +1,206 @@
+/**
+ * @file src/conversion_cache.cpp
+ *
+ * @brief Implementation of the ConversionCache classbuild_header/
+ */
+#include "../include/conversion_cache.hpp"
+#include "../include/batch_util.hpp"
+#include "../gbLib/include/gbMappedFile.hpp"
+#include "../gbLib/include/gbStats.hpp"
+#include "../gbLib/include/gbThreadPool.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#ifdef WIN32
+#	include <windows.h>
+#else
+#	include <sys/stat.h>
+#	include <sys/types.h>
+#	include <unistd.h>
+#endif
+
+static char const ENTRY_MAGIC[8] = { 'P', 'S', '2', 'I', 'C', 'C', '0', '1' };	///< first bytes of every entry
+static size_t const ENTRY_HEADER_SIZE = 20;		///< magic, number of outputs and checksum
+
+static GhulbusUtil::gbMutex temp_file_mutex;	///< protects temp_file_counter
+static unsigned int temp_file_counter = 0;		///< number of temporary files created by this process
+
+/** Helper function: appends a little endian value of n bytes
+ */
+static void AppendLE(std::vector<unsigned char>& buffer, unsigned long long v, int n)
+{
+	for(int i=0; i<n; i++) {
+		buffer.push_back(static_cast<unsigned char>(v & 0xFF));
+		v >>= 8;
+	}
+}
+
+/** Helper function: reads a little endian value of n bytes
+ */
+static unsigned long long ReadLE(unsigned char const* p, int n)
+{
+	unsigned long long ret = 0;
+	for(int i=n-1; i>=0; i--) { ret = (ret << 8) | p[i]; }
+	return ret;
+}
+
+/** Helper function: writes a file in one go
+ * @return false if the file could not be written completely
+ */
+static bool WriteWholeFile(char const* fname, unsigned char const* data, size_t size)
+{
+	std::ofstream fout(fname, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+	if(fout.fail()) { return false; }
+	if(size > 0) { fout.write(reinterpret_cast<char const*>(data), size); }
+	fout.close();
+	return !fout.fail();
+}
+
+ConversionCache::ConversionCache()
+{
+}
+
+ConversionCache::ConversionCache(char const* dir)
+{
+	Open(dir);
+}
+
+void ConversionCache::Open(char const* dir)
+{
+	m_dir.clear();
+#ifdef WIN32
+	if(!CreateDirectoryA(dir, NULL) && (GetLastError() != ERROR_ALREADY_EXISTS)) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Cache directory could not be created" ) );
+	}
+#else
+	struct stat st;
+	if(mkdir(dir, 0777) != 0) {
+		if( (stat(dir, &st) != 0) || !S_ISDIR(st.st_mode) ) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Cache directory could not be created" ) );
+		}
+	}
+#endif
+	m_dir = dir;
+}
+
+void ConversionCache::AddData(GhulbusUtil::gbHash64& hash, void const* data, size_t size)
+{
+	std::vector<unsigned char> size_field;
+	AppendLE(size_field, size, 8);
+	hash.Update(&size_field[0], size_field.size());
+	hash.Update(data, size);
+}
+
+void ConversionCache::AddString(GhulbusUtil::gbHash64& hash, std::string const& str)
+{
+	AddData(hash, str.data(), str.size());
+}
+
+void ConversionCache::AddFile(GhulbusUtil::gbHash64& hash, char const* fname)
+{
+	try {
+		GhulbusUtil::gbMappedFile file(fname);
+		AddData(hash, file.GetData(), file.GetSize());
+	} catch(Ghulbus::gbException&) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Input file could not be read" ) );
+	}
+}
+
+std::string ConversionCache::GetEntryPath(Key_T key) const
+{
+	char name[32];
+	sprintf(name, "%08lx%08lx.cache", static_cast<unsigned long>(key >> 32),
+	                                  static_cast<unsigned long>(key & 0xFFFFFFFFUL));
+	return JoinPath(m_dir, name);
+}
+
+bool ConversionCache::Fetch(Key_T key, std::vector<std::string> const& outputs) const
+{
+	GB_STATS_TIMER("cache.fetch");
+	GhulbusUtil::gbMappedFile entry;
+	try {
+		entry.Open(GetEntryPath(key).c_str());
+	} catch(Ghulbus::gbException&) {
+		GB_STATS_COUNT("cache.misses", 1);
+		return false;
+	}
+	unsigned char const* data = entry.GetData();
+	size_t const size = entry.GetSize();
+	if( (size < ENTRY_HEADER_SIZE) || (memcmp(data, ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) != 0) ||
+		(ReadLE(data + 8, 4) != outputs.size()) ||
+		(ReadLE(data + 12, 8) != GhulbusUtil::gbHashXXH64(data + ENTRY_HEADER_SIZE, size - ENTRY_HEADER_SIZE)) ) {
+		GB_STATS_COUNT("cache.corrupted", 1);
+		return false;
+	}
+	//check all sizes before writing anything:
+	std::vector<size_t> offsets, sizes;
+	size_t offset = ENTRY_HEADER_SIZE;
+	for(size_t i=0; i<outputs.size(); i++) {
+		if(size - offset < 8) { return false; }
+		unsigned long long const file_size = ReadLE(data + offset, 8);
+		offset += 8;
+		if(file_size > size - offset) { return false; }
+		offsets.push_back(offset);
+		sizes.push_back(static_cast<size_t>(file_size));
+		offset += sizes.back();
+	}
+	if(offset != size) { return false; }
+	for(size_t i=0; i<outputs.size(); i++) {
+		if(!WriteWholeFile(outputs[i].c_str(), data + offsets[i], sizes[i])) { return false; }
+	}
+	GB_STATS_COUNT("cache.hits", 1);
+	GB_STATS_COUNT("cache.bytes_read", size);
+	return true;
+}
+
+void ConversionCache::Store(Key_T key, std::vector<std::string> const& outputs) const
+{
+	GB_STATS_TIMER("cache.store");
+	std::vector<unsigned char> buffer(sizeof(ENTRY_MAGIC) + 4 + 8);
+	for(size_t i=0; i<outputs.size(); i++) {
+		GhulbusUtil::gbMappedFile file;
+		try {
+			file.Open(outputs[i].c_str());
+		} catch(Ghulbus::gbException&) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Output file could not be read" ) );
+		}
+		AppendLE(buffer, file.GetSize(), 8);
+		buffer.insert(buffer.end(), file.GetData(), file.GetData() + file.GetSize());
+	}
+	memcpy(&buffer[0], ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+	std::vector<unsigned char> header;
+	AppendLE(header, outputs.size(), 4);
+	AppendLE(header, GhulbusUtil::gbHashXXH64(&buffer[ENTRY_HEADER_SIZE], buffer.size() - ENTRY_HEADER_SIZE), 8);
+	memcpy(&buffer[sizeof(ENTRY_MAGIC)], &header[0], header.size());
+
+	//write to a name unique to this process and call, then move into place:
+	unsigned int id;
+	{
+		GhulbusUtil::gbLock lock(temp_file_mutex);
+		id = temp_file_counter++;
+	}
+	std::string const path = GetEntryPath(key);
+	std::ostringstream tmp_path;
+#ifdef WIN32
+	tmp_path << path << "." << GetCurrentProcessId() << "." << id << ".tmp";
+#else
+	tmp_path << path << "." << getpid() << "." << id << ".tmp";
+#endif
+	if(!WriteWholeFile(tmp_path.str().c_str(), &buffer[0], buffer.size())) {
+		remove(tmp_path.str().c_str());
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Cache entry could not be written" ) );
+	}
+#ifdef WIN32
+	//an existing entry for the same key holds the same outputs and can be kept:
+	if(!MoveFileExA(tmp_path.str().c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		remove(tmp_path.str().c_str());
+	}
+#else
+	if(rename(tmp_path.str().c_str(), path.c_str()) != 0) {
+		remove(tmp_path.str().c_str());
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Cache entry could not be written" ) );
+	}
+#endif
+}
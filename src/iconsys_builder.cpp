@@ -5,8 +5,16 @@
  */
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include "../include/ps2_iconsys.hpp"
+#include "../include/batch_util.hpp"
+#include "../gbLib/include/gbMappedFile.hpp"
+#include "../gbLib/include/gbThreadPool.hpp"
+#include <algorithm>
 #include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
 
 char const* input_file   = NULL;	///< name of the input file
 char const* output_file  = NULL;	///< name of the output file
@@ -14,10 +22,12 @@ bool list_file           = false;	///< flag for file listing before writing
 bool verbose_output      = false;	///< flag for verbose output
 char* title_string       = NULL;	///< new title string
 int title_linebreak      = 32;		///< index of title linebreak
+bool title_linebreak_set = false;	///< flag for an explicitly given title linebreak
 char* icon_string        = NULL;	///< icon filename
 char* icon_copy_string   = NULL;	///< copy icon filename
 char* icon_delete_string = NULL;	///< delete icon filename
 int bg_opacity           = 0;		///< background opacity
+bool bg_opacity_set      = false;	///< flag for an explicitly given background opacity
 float* light1_dir        = NULL;	///< direction vector light #1
 float* light2_dir        = NULL;	///< direction vector light #2
 float* light3_dir        = NULL;	///< direction vector light #3
@@ -29,6 +39,11 @@ int* bg_color_ul         = NULL;	///< color vector upper left
 int* bg_color_ur         = NULL;	///< color vector upper right
 int* bg_color_ll         = NULL;	///< color vector lower left
 int* bg_color_lr         = NULL;	///< color vector lower right
+char const* batch_manifest  = NULL;	///< path to the batch manifest file
+char const* batch_input_dir = NULL;	///< path to the batch input directory (searched recursively)
+int batch_jobs              = 0;	///< number of worker threads for batch editing (0: one per processor)
+int batch_prefetch          = 0;	///< number of files read ahead in batch mode (0: direct file access)
+char const* csv_output_file = NULL;	///< path to the csv listing
 
 /** Print a help text on screen
  * @param[in] self Name of the executable (e.g. obtained from argv[0])
@@ -70,12 +85,27 @@ void PrintHelp(char* self)
 			  << "                      Takes four parameters for each r, g, b and x"       << "\n"
 			  << "   --set-opacity      Set the background opacity"                         << "\n"
 			  << "\n"
+			  << "  -b, --batch          Edit all files listed in a manifest"            << "\n"
+			  << "  -d, --input-dir      Edit all .sys files in a directory and its"     << "\n"
+			  << "                       subdirectories"                                << "\n"
+			  << "  -j, --jobs           Number of files edited in parallel (batch mode)" << "\n"
+			  << "      --prefetch       Read this many files ahead and write the edited"  << "\n"
+			  << "                       files in the background (batch mode); speeds up"  << "\n"
+			  << "                       editing on network storage"                      << "\n"
+			  << "      --dump-csv       Write title and icon filenames of the files"    << "\n"
+			  << "                       given with -f, -b or -d to a csv file; no files" << "\n"
+			  << "                       are edited"                                    << "\n"
+			  << "\n"
 			  << " Notes:"                                                                << "\n"
 			  << " * If no output file is specified, all output will be written"          << "\n"
 			  << "   to a file icon.sys"                                                  << "\n"
 			  << " * If no input file is specified, default values will be used"          << "\n"
 			  << "   for all values not explicitly specified as parameters"               << "\n"
 			  << " * All color and opacity values have to be in a range [0..255]"         << "\n"
+			  << " * In batch mode, only the values given as parameters are changed and"  << "\n"
+			  << "   files are edited in place, unless the manifest lists an output as"   << "\n"
+			  << "   second tab-separated field; files that would not change are not"     << "\n"
+			  << "   written"                                                             << "\n"
 			  << "\n"
 			  << " Examples:"                                                             << "\n"
 			  << "  " << self << " --set-title \"Test Icon\""                             << "\n"
@@ -93,6 +123,9 @@ void PrintHelp(char* self)
 			  << "  " << self << " -f myicon -l"                                          << "\n"
 			  << "Prints a listing of the data in the existing file myicon and saves a"   << "\n"
 			  << "copy to icon.sys."                                                      << "\n"
+			  << "\n"
+			  << "  " << self << " -d saves --set-title \"Test Icon\""                    << "\n"
+			  << "Sets the title of every .sys file below directory saves."               << "\n"
 			  << std::endl;
 }
 
@@ -111,6 +144,7 @@ bool ParseCommandLine_1Arg(int i, char* argv[])
 		i++;
 	} else if(strcmp( argv[i], "--title-linebreak" ) == 0) {
 		title_linebreak = atoi(argv[++i]);
+		title_linebreak_set = true;
 	} else if(strcmp( argv[i], "--set-icon" ) == 0) {
 		icon_string = new char[strlen(argv[i+1]) + 1];
 		strcpy(icon_string, argv[i+1]);
@@ -125,6 +159,17 @@ bool ParseCommandLine_1Arg(int i, char* argv[])
 		i++;
 	} else if(strcmp( argv[i], "--set-opacity" ) == 0) {
 		bg_opacity = atoi(argv[++i]);
+		bg_opacity_set = true;
+	} else if( (strcmp( argv[i], "-b" ) == 0) || (strcmp( argv[i], "--batch" ) == 0) ) {
+		batch_manifest = argv[++i];
+	} else if( (strcmp( argv[i], "-d" ) == 0) || (strcmp( argv[i], "--input-dir" ) == 0) ) {
+		batch_input_dir = argv[++i];
+	} else if( (strcmp( argv[i], "-j" ) == 0) || (strcmp( argv[i], "--jobs" ) == 0) ) {
+		batch_jobs = atoi(argv[++i]);
+	} else if(strcmp( argv[i], "--prefetch" ) == 0) {
+		batch_prefetch = atoi(argv[++i]);
+	} else if(strcmp( argv[i], "--dump-csv" ) == 0) {
+		csv_output_file = argv[++i];
 	} else {
 		return false;
 	}
@@ -260,15 +305,21 @@ void CheckParameters()
 }
 
 /** Adjust icon_sys according to the parameters
+ * @param[in,out] icon_sys The file to adjust
+ * @param[in] set_defaults If true, title linebreak and background opacity are set even if
+ *                         they were not given as parameters
+ * @param[out] log Destination for messages
  */
-void ProcessParameters(IconSys* icon_sys)
+void ProcessParameters(IconSys* icon_sys, bool set_defaults, std::ostream& log)
 {
 	if(verbose_output) 
-		std::cout << " * Adjusting parameters...";
+		log << " * Adjusting parameters...";
 	if(title_string) {
 		icon_sys->SetTitle(title_string);
 	}
-	icon_sys->SetLinebreak(title_linebreak);
+	if(set_defaults || title_linebreak_set || title_string) {
+		icon_sys->SetLinebreak(title_linebreak);
+	}
 	if(icon_string) {
 		try {
 			icon_sys->SetIconFilename(icon_string);
@@ -295,7 +346,9 @@ void ProcessParameters(IconSys* icon_sys)
 			exit(1);
 		}
 	}
-	icon_sys->SetBackgroundOpacity(bg_opacity);
+	if(set_defaults || bg_opacity_set) {
+		icon_sys->SetBackgroundOpacity(bg_opacity);
+	}
 	if(light1_dir) { icon_sys->SetLight1Dir( IconSys::IconSys_LightVec(light1_dir) ); }
 	if(light2_dir) { icon_sys->SetLight2Dir( IconSys::IconSys_LightVec(light2_dir) ); }
 	if(light3_dir) { icon_sys->SetLight3Dir( IconSys::IconSys_LightVec(light3_dir) ); }
@@ -324,7 +377,7 @@ void ProcessParameters(IconSys* icon_sys)
 	if(bg_color_ll) { icon_sys->SetBackgroundColor_LL( IconSys::IconSys_Color( bg_color_ll ) ); }
 	if(bg_color_lr) { icon_sys->SetBackgroundColor_LR( IconSys::IconSys_Color( bg_color_lr ) ); }
 	if(verbose_output) 
-		std::cout << "done." << std::endl;
+		log << "done." << std::endl;
 }
 
 /** Helper function for ListFile()
@@ -410,6 +463,154 @@ void WriteOutput(IconSys* icon_sys)
 		std::cout << "done." << std::endl;
 }
 
+/** Applies the parameters to the items of a batch
+ */
+class IconSysEditor: public BatchConverter {
+private:
+	int m_nUnchanged;							///< number of files that were not written
+	GhulbusUtil::gbMutex m_mutex;				///< protects m_nUnchanged
+public:
+	IconSysEditor(): m_nUnchanged(0) {}
+	/** Get the number of files that were left alone because they would not change
+	 */
+	int GetNUnchanged() const { return m_nUnchanged; }
+	void Prepare(int) {}
+	void Convert(BatchItem const& item, int, std::ostream& log) {
+		GhulbusUtil::gbMappedFile file;
+		try {
+			file.Open(item.input.c_str());
+		} catch(Ghulbus::gbException&) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "File read error" ) );
+		}
+		IconSys icon_sys(file.GetData(), file.GetSize());
+		ProcessParameters(&icon_sys, false, log);
+		//compare with the current contents of the destination:
+		if(item.output != item.input) {
+			try {
+				file.Open(item.output.c_str());
+			} catch(Ghulbus::gbException&) {
+				file.Close();
+			}
+		}
+		if( (file.GetSize() == IconSys::GetFileSize()) &&
+			(memcmp(file.GetData(), icon_sys.GetFileData(), file.GetSize()) == 0) ) {
+			if(verbose_output)
+				log << " * \"" << item.output << "\" is unchanged" << std::endl;
+			GhulbusUtil::gbLock lock(m_mutex);
+			m_nUnchanged++;
+			return;
+		}
+		if(verbose_output)
+			log << " * Writing output file to \"" << item.output << "\"...";
+		try {
+			icon_sys.WriteFile(item.output.c_str());
+		} catch(Ghulbus::gbException&) {
+			log << "\nFile write error: \"" << item.output << "\"" << std::endl;
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "File write error" ) );
+		}
+		if(verbose_output)
+			log << "done." << std::endl;
+	}
+};
+
+/** Collect the files of a batch from manifest and input directory
+ * @param[out] items Receives the items to edit; the output defaults to the input
+ */
+void CollectBatchItems(std::vector<BatchItem>& items)
+{
+	try {
+		if(batch_manifest) {
+			ReadBatchManifest(batch_manifest, items);
+		}
+		if(batch_input_dir) {
+			std::vector<std::string> files;
+			ListDirectory(batch_input_dir, ".sys", files, true);
+			for(std::vector<std::string>::const_iterator it = files.begin(); it != files.end(); ++it) {
+				BatchItem item;
+				item.input = *it;
+				items.push_back(item);
+			}
+		}
+	} catch(Ghulbus::gbException& e) {
+		std::cout << e.GetErrorString() << ": \"" << (batch_manifest ? batch_manifest : batch_input_dir) << "\"" << std::endl;
+		exit(1);
+	}
+	for(std::vector<BatchItem>::iterator it = items.begin(); it != items.end(); ++it) {
+		if(it->output.empty()) { it->output = it->input; }
+	}
+}
+
+/** Helper function: appends a quoted csv field
+ */
+void AppendCSVField(std::string& line, char const* str, size_t max_len)
+{
+	line += '"';
+	for(size_t i=0; (i<max_len) && (str[i] != '\0'); i++) {
+		if(str[i] == '"') { line += '"'; }
+		line += str[i];
+	}
+	line += '"';
+}
+
+/** Lines of the csv listing written by DumpCSV()
+ */
+struct CSVJob {
+	std::vector<BatchItem> const* items;		///< the files to list
+	std::vector<std::string> lines;				///< csv line for each file
+};
+
+/** Worker function for DumpCSV()
+ */
+void DumpCSVLine(int item, int, void* user)
+{
+	CSVJob& job = *static_cast<CSVJob*>(user);
+	char const* fname = (*job.items)[item].input.c_str();
+	std::string& line = job.lines[item];
+	AppendCSVField(line, fname, std::string::npos);
+	//only the header part is needed; the reserved block at the end of the file is not read:
+	GhulbusUtil::gbMappedFile file;
+	try {
+		file.Open(fname);
+	} catch(Ghulbus::gbException&) {
+		file.Close();
+	}
+	if(file.GetSize() >= IconSys::GetHeaderSize()) {
+		IconSys icon_sys(file.GetData(), IconSys::GetHeaderSize());
+		line += ",";
+		AppendCSVField(line, icon_sys.GetTitleSingleLine(), 34);
+		line += ",";
+		AppendCSVField(line, icon_sys.GetIconFilename(), 64);
+		line += ",";
+		AppendCSVField(line, icon_sys.GetIconCopyFilename(), 64);
+		line += ",";
+		AppendCSVField(line, icon_sys.GetIconDeleteFilename(), 64);
+		line += ",\"\"\n";
+		return;
+	}
+	line += ",\"\",\"\",\"\",\"\",\"File read error\"\n";
+}
+
+/** Write a csv listing of title and icon filenames of many files
+ * @param[in] items The files to list
+ * @return false if the listing could not be written
+ */
+bool DumpCSV(std::vector<BatchItem> const& items)
+{
+	CSVJob job;
+	job.items = &items;
+	job.lines.resize(items.size());
+	GhulbusUtil::gbThreadPool pool(batch_jobs);
+	pool.Run(static_cast<int>(items.size()), DumpCSVLine, &job);
+
+	std::ofstream fout(csv_output_file, std::ios_base::out | std::ios_base::binary);
+	fout << "\"file\",\"title\",\"icon\",\"copy_icon\",\"delete_icon\",\"error\"\n";
+	for(size_t i=0; i<job.lines.size(); i++) {
+		fout << job.lines[i];
+	}
+	fout.close();
+	return !fout.fail();
+}
+
 void Cleanup()
 {
 	if(title_string)       { delete[] title_string;              title_string = NULL; }
@@ -443,6 +644,53 @@ int main(int argc, char* argv[])
 
 	std::cout << "PS2 Icon.Sys Builder  V-1.0\n by Ghulbus Inc.  (http://www.ghulbus-inc.de/)\n" << std::endl;
 
+	bool const batch_mode = (batch_manifest || batch_input_dir);
+	if(batch_mode && (input_file || output_file || list_file)) {
+		std::cout << "Batch mode can not be combined with -f, -o or -l." << std::endl << std::endl;
+		PrintHelp(argv[0]);
+		exit(1);
+	}
+	if(csv_output_file) {
+		std::vector<BatchItem> items;
+		if(batch_mode) {
+			CollectBatchItems(items);
+		} else if(input_file) {
+			BatchItem item;
+			item.input = input_file;
+			items.push_back(item);
+		}
+		if(!DumpCSV(items)) {
+			std::cout << "File write error: \"" << csv_output_file << "\"" << std::endl;
+			exit(1);
+		}
+		std::cout << " * Listed " << items.size() << " files in \"" << csv_output_file << "\"" << std::endl;
+		Cleanup();
+		return 0;
+	}
+	if(batch_mode) {
+		//check the parameters once, so that they can not fail for single files:
+		{
+			IconSys check;
+			std::ostringstream discard;
+			ProcessParameters(&check, false, discard);
+		}
+		std::vector<BatchItem> items;
+		CollectBatchItems(items);
+		IconSysEditor editor;
+		BatchReport report;
+		try {
+			RunBatch(items, editor, batch_jobs, std::cout, report, batch_prefetch);
+		} catch(Ghulbus::gbException& e) {
+			std::cout << e.GetErrorString() << std::endl;
+			Cleanup();
+			return 1;
+		}
+		report.Print(std::cout);
+		std::cout << " *  " << editor.GetNUnchanged() << " files were unchanged and not written." << std::endl;
+		Cleanup();
+		return (report.GetNFailed() > 0) ? 1 : 0;
+	}
+
 	if(!output_file) {
 		output_file = "icon.sys";
 	}
@@ -463,7 +711,7 @@ int main(int argc, char* argv[])
 		icon_sys = new IconSys();
 	}
 
-	ProcessParameters(icon_sys);
+	ProcessParameters(icon_sys, true, std::cout);
 
 	WriteOutput(icon_sys);
 
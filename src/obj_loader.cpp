@@ -4,9 +4,14 @@
  * @brief Implementation of OBJ_FileLoader and OBJ_Meshbuild_header/
  */
 #include "../include/obj_loader.hpp"
+#include "../gbLib/include/gbMappedFile.hpp"
+#include "../gbLib/include/gbFileBackend.hpp"
+#include "../gbLib/include/gbStats.hpp"
 #include <cstdio>
 #include <cstring>
+#include <cmath>
 #include <string>
+#include <sstream>
 
 OBJ_FileLoader::OBJ_FileLoader()
 {
@@ -15,13 +20,46 @@ OBJ_FileLoader::OBJ_FileLoader()
 
 OBJ_FileLoader::OBJ_FileLoader(const char* fname)
 {
-	std::ifstream fin(fname, std::ios_base::in);
-	if(fin.fail()) { throw( Ghulbus::gbException(Ghulbus::gbException::GB_FAILED,
-	                                             "Could not open obj file for read") ); }
-	ReadFile(fin);
+	Load(fname);
 }
 OBJ_FileLoader::~OBJ_FileLoader()
 {
+	Clear();
+}
+
+void OBJ_FileLoader::Load(char const* fname, OBJ_Mesh::STORAGE storage) {
+	Clear();
+	GhulbusUtil::gbMappedFile file;
+	try {
+		file.Open(fname);
+	} catch(Ghulbus::gbException&) {
+		throw( Ghulbus::gbException(Ghulbus::gbException::GB_FAILED,
+		                            "Could not open obj file for read") );
+	}
+	Load(file.GetData(), file.GetSize(), storage);
+}
+
+void OBJ_FileLoader::Load(void const* data, size_t size, OBJ_Mesh::STORAGE storage) {
+	GB_STATS_TIMER("obj.parse");
+	Clear();
+	try {
+		ReadData(static_cast<char const*>(data), size, storage);
+	} catch(...) {
+		Clear();
+		throw;
+	}
+	GB_STATS_COUNT("obj.bytes_read", size);
+#ifndef GB_NO_STATS
+	if(GhulbusUtil::gbStats::IsEnabled()) {
+		for(int i=0; i<GetNMeshes(); i++) {
+			GB_STATS_COUNT("obj.vertices_read", GetMesh(i)->GetNVertices());
+			GB_STATS_COUNT("obj.faces_read", GetMesh(i)->GetNFaces());
+		}
+	}
+#endif
+}
+
+void OBJ_FileLoader::Clear() {
 	for(std::vector<OBJ_Mesh*>::iterator i = m_MeshList.begin(); i != m_MeshList.end(); ++i) {
 		delete *i;
 	}
@@ -40,197 +78,628 @@ void OBJ_FileLoader::AddMesh(OBJ_Mesh const& mesh) {
 	m_MeshList.push_back(newmesh);
 }
 
+/** Output buffer used by OBJ_FileLoader::WriteFile()
+ * Text is formatted directly into a fixed size buffer which is only written to
+ * the stream when it runs full, avoiding both per-line flushes and iostream formatting.
+ */
+class OBJ_WriteBuffer {
+public:
+	enum Constants_T {
+		BUFFER_SIZE    = 1 << 16,			///< size of the output buffer
+		MAX_ITEM_SIZE  = 400				///< upper bound for the size of a single formatted item
+	};
+private:
+	std::ostream& m_os;						///< destination stream
+	std::vector<char> m_buffer;				///< output buffer
+	size_t m_pos;							///< number of bytes used in m_buffer
+	size_t m_written;						///< number of bytes written to the stream so far
+public:
+	/** Constructor
+	 * @param[in] os Destination stream
+	 * @throw std::bad_alloc
+	 */
+	explicit OBJ_WriteBuffer(std::ostream& os)
+		:m_os(os), m_buffer(BUFFER_SIZE), m_pos(0), m_written(0)
+	{
+	}
+	/** Get the number of bytes written to the stream so far
+	 */
+	size_t GetBytesWritten() const {
+		return m_written;
+	}
+	/** Write all buffered data to the stream
+	 * @throw Ghulbus::gbException GB_FAILED indicates a file access error
+	 */
+	void Flush() {
+		if(m_pos > 0) {
+			m_os.write(&m_buffer[0], static_cast<std::streamsize>(m_pos));
+			m_written += m_pos;
+			m_pos = 0;
+		}
+		if(m_os.fail()) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
+			                             "Error while writing OBJ file" ) );
+		}
+	}
+	/** Append a string
+	 */
+	void Put(char const* str) {
+		for(; *str; ++str) {
+			if(m_pos == m_buffer.size()) { Flush(); }
+			m_buffer[m_pos++] = *str;
+		}
+	}
+	/** Append a decimal integer
+	 */
+	void PutInt(int n) {
+		char tmp[16];
+		char* p = tmp + sizeof(tmp);
+		unsigned int u = (n < 0) ? (0U - static_cast<unsigned int>(n)) : static_cast<unsigned int>(n);
+		do { *(--p) = static_cast<char>('0' + (u % 10)); u /= 10; } while(u);
+		if(n < 0) { *(--p) = '-'; }
+		Append(p, tmp + sizeof(tmp) - p);
+	}
+	/** Append a floating point number formatted as printf("%.6f")
+	 */
+	void PutFixed6(double d) {
+		Reserve(MAX_ITEM_SIZE);
+		m_pos += FormatFixed6(d, &m_buffer[m_pos]);
+	}
+private:
+	/** Make room for n bytes
+	 */
+	void Reserve(size_t n) {
+		if(m_pos + n > m_buffer.size()) { Flush(); }
+	}
+	/** Append n bytes
+	 */
+	void Append(char const* data, size_t n) {
+		Reserve(n);
+		memcpy(&m_buffer[m_pos], data, n);
+		m_pos += n;
+	}
+	/** Format a number as printf("%.6f") would in the C locale
+	 * The fractional part f is scaled with an exact two-product (Dekker), so the decision
+	 * between the two possible 6-digit results is taken on the exact binary value,
+	 * including round-half-to-even on exact ties. Values that are not finite or
+	 * have an integer part of 2^53 or more are handed to sprintf.
+	 * @param[in] d The number to format
+	 * @param[out] dst Buffer of at least MAX_ITEM_SIZE bytes
+	 * @return Number of characters written (no terminating null is written)
+	 */
+	static size_t FormatFixed6(double d, char* dst) {
+		double const two53 = 9007199254740992.0;
+		if(!(d > -two53 && d < two53)) {
+			char tmp[MAX_ITEM_SIZE];
+			int n = sprintf(tmp, "%.6f", d);
+			memcpy(dst, tmp, n);
+			return static_cast<size_t>(n);
+		}
+		bool const negative = (d < 0.0) || ((d == 0.0) && (1.0/d < 0.0));
+		double const a = (negative) ? -d : d;
+		double const int_part = std::floor(a);
+		double const frac = a - int_part;				//exact
+		//exact product frac * 1e6 = p + e:
+		double const scale = 1000000.0;					//20 significant bits: exact in both halves of the split
+		double const p = frac * scale;
+		double const split = frac * 134217729.0;		//2^27+1
+		double const frac_hi = split - (split - frac);
+		double const frac_lo = frac - frac_hi;
+		double const e = ((frac_hi * scale - p) + frac_lo * scale);
+		double digits = std::floor(p);
+		double const rest = p - digits;					//exact
+		if((rest > 0.5) || ((rest == 0.5) && ((e > 0.0) || ((e == 0.0) && (std::fmod(digits, 2.0) != 0.0))))) {
+			digits += 1.0;
+		}
+		unsigned long long ipart = static_cast<unsigned long long>(int_part);
+		unsigned long fpart = static_cast<unsigned long>(digits);
+		if(fpart >= 1000000UL) { fpart -= 1000000UL; ipart++; }
+		char tmp[32];
+		char* q = tmp + sizeof(tmp);
+		for(int i=0; i<6; i++) { *(--q) = static_cast<char>('0' + (fpart % 10)); fpart /= 10; }
+		*(--q) = '.';
+		do { *(--q) = static_cast<char>('0' + (ipart % 10)); ipart /= 10; } while(ipart);
+		if(negative) { *(--q) = '-'; }
+		size_t const n = tmp + sizeof(tmp) - q;
+		memcpy(dst, q, n);
+		return n;
+	}
+};
+
+/** Helper function: writes a list of triples as obj element lines
+ * @param[in] prefix Line prefix (e.g. "v  ")
+ */
+static void WriteTriples(OBJ_WriteBuffer& out, char const* prefix, OBJ_AttributeArray const& data) {
+	double tmp[3];
+	for(int j=0; j<data.GetNElements(); j++) {
+		data.GetElement(j, tmp, 1.0);
+		out.Put(prefix);
+		out.PutFixed6(tmp[0]);
+		out.Put(" ");
+		out.PutFixed6(tmp[1]);
+		out.Put(" ");
+		out.PutFixed6(tmp[2]);
+		out.Put("\n");
+	}
+}
+
+/** Helper function: writes a single face corner in v, v/t, v//n or v/t/n notation
+ * @param[in] vert 0-based global vertex index
+ * @param[in] texture 0-based mesh texture index or -1
+ * @param[in] texture_base Number of texture coordinates written before the current mesh
+ * @param[in] normal 0-based mesh normal index or -1
+ * @param[in] normal_base Number of normals written before the current mesh
+ */
+static void WriteFaceCorner(OBJ_WriteBuffer& out, int vert, int texture, int texture_base, int normal, int normal_base) {
+	out.PutInt(vert + 1);
+	if((texture < 0) && (normal < 0)) { return; }
+	out.Put("/");
+	if(texture >= 0) { out.PutInt(texture + texture_base + 1); }
+	if(normal >= 0) { out.Put("/"); out.PutInt(normal + normal_base + 1); }
+}
+
 void OBJ_FileLoader::WriteFile(char const* fname) const {
-	std::ofstream fout(fname, std::ios_base::out);
-	if( fout.fail() ) {
+	GB_STATS_TIMER("obj.write_file");
+	//the file is built in memory and handed to the file backend in one piece:
+	std::ostringstream out;
+	Write(out);
+	std::string const data = out.str();
+	try {
+		GhulbusUtil::GetFileBackend().WriteFile(fname, data.data(), data.size());
+	} catch(Ghulbus::gbException&) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
-			                         "Output OBJ file could not be opened" ) );
+			                         "Output OBJ file could not be written" ) );
 	}
+}
+
+void OBJ_FileLoader::Write(std::ostream& os) const {
+	OBJ_WriteBuffer out(os);
 	//again we need counters since obj doesn't reset indices between meshes:
-	int vert_counter=0, normal_counter=0, texture_counter=0;
 	int vert_base=0, normal_base=0, texture_base=0;
 	int current_smooth_group = 0;
 	
-	fout.precision(6);
-	fout << std::fixed;
 	//file header:
-	fout << "# OBJ File created by PS2IconSys Viewer" << std::endl
-		 << "#  http://www.ghulbus-inc.de/" << std::endl
-		 << "#" << std::endl;
+	out.Put("# OBJ File created by PS2IconSys Viewer\n"
+	        "#  http://www.ghulbus-inc.de/\n"
+	        "#\n");
 
 	for(int i=0; i<GetNMeshes(); i++) {
 		OBJ_Mesh const* mesh = GetMesh(i);
 		//object header:
-		fout << "# object " << mesh->GetName() << " to come" << std::endl
-			 << "#" << std::endl;
+		out.Put("# object "); out.Put(mesh->GetName()); out.Put(" to come\n#\n");
 		
 		//vertex data:
-		for(int j=0; j<mesh->GetNVertices(); j++) {
-			vert_counter++;
-			fout << "v  " << *(mesh->GetVertexX(j)) << " " << *(mesh->GetVertexY(j)) << " "
-				<< *(mesh->GetVertexZ(j)) << std::endl;
-		}
-		fout << "# " << mesh->GetNVertices() << " vertices" << std::endl << std::endl;
+		WriteTriples(out, "v  ", mesh->GetGeometry());
+		out.Put("# "); out.PutInt(mesh->GetNVertices()); out.Put(" vertices\n\n");
 		//texture vertex data:
-		for(int j=0; j<mesh->GetNTexture(); j++) {
-			texture_counter++;
-			fout << "vt  " << *(mesh->GetTextureX(j)) << " " << *(mesh->GetTextureY(j)) << " "
-				<< *(mesh->GetTextureZ(j)) << std::endl;
-		}
-		fout << "# " << mesh->GetNTexture() << " texture vertices" << std::endl << std::endl;
+		WriteTriples(out, "vt  ", mesh->GetTextureData());
+		out.Put("# "); out.PutInt(mesh->GetNTexture()); out.Put(" texture vertices\n\n");
 		//vertex normal data:
-		for(int j=0; j<mesh->GetNNormals(); j++) {
-			normal_counter++;
-			fout << "vn  " << *(mesh->GetNormalX(j)) << " " << *(mesh->GetNormalY(j)) << " "
-				<< *(mesh->GetNormalZ(j)) << std::endl;
-		}
-		fout << "# " << mesh->GetNNormals() << " vertex normals" << std::endl << std::endl;
+		WriteTriples(out, "vn  ", mesh->GetNormals());
+		out.Put("# "); out.PutInt(mesh->GetNNormals()); out.Put(" vertex normals\n\n");
 
 		//face list:
-		fout << "g " << mesh->GetName() << std::endl;
+		out.Put("g "); out.Put(mesh->GetName()); out.Put("\n");
 		current_smooth_group = mesh->GetFace(0)->smoothing_group;
-		fout << "s " << current_smooth_group << std::endl;
-		for(int j=0; j<mesh->GetNFaces(); j++) {
-			OBJ_Mesh::Face const* current_face = mesh->GetFace(j);
-			if(current_face->smoothing_group != current_smooth_group) {
-				current_smooth_group = current_face->smoothing_group;
-				fout << "s " << current_smooth_group << std::endl;
+		out.Put("s "); out.PutInt(current_smooth_group); out.Put("\n");
+		std::vector<OBJ_Mesh::Face> const& faces = mesh->GetFaceData();
+		for(std::vector<OBJ_Mesh::Face>::const_iterator it = faces.begin(); it != faces.end(); ++it) {
+			if(it->smoothing_group != current_smooth_group) {
+				current_smooth_group = it->smoothing_group;
+				out.Put("s "); out.PutInt(current_smooth_group); out.Put("\n");
 			}
-			fout << "f " << (current_face->vert1 + vert_base + 1) << "/" 
-				<< (current_face->texture1 + texture_base + 1) << "/" 
-				<< (current_face->normal1 + normal_base + 1)   << " " 
-				<< (current_face->vert2 + vert_base + 1)       << "/" 
-				<< (current_face->texture2 + texture_base + 1) << "/" 
-				<< (current_face->normal2 + normal_base + 1)   << " " 
-				<< (current_face->vert3 + vert_base + 1)       << "/" 
-				<< (current_face->texture3 + texture_base + 1) << "/" 
-				<< (current_face->normal3 + normal_base + 1)   << std::endl;
+			out.Put("f ");
+			WriteFaceCorner(out, it->vert1 + vert_base, it->texture1, texture_base, it->normal1, normal_base);
+			out.Put(" ");
+			WriteFaceCorner(out, it->vert2 + vert_base, it->texture2, texture_base, it->normal2, normal_base);
+			out.Put(" ");
+			WriteFaceCorner(out, it->vert3 + vert_base, it->texture3, texture_base, it->normal3, normal_base);
+			out.Put("\n");
 		}
-		fout << "# " << mesh->GetNFaces() << " faces" << std::endl << std::endl;
+		out.Put("# "); out.PutInt(mesh->GetNFaces()); out.Put(" faces\n\n");
 
 		//adjust base counters:
-		vert_base = vert_counter;
-		normal_base = normal_counter;
-		texture_base = texture_counter;
-		fout << "g" << std::endl;
+		vert_base    += mesh->GetNVertices();
+		normal_base  += mesh->GetNNormals();
+		texture_base += mesh->GetNTexture();
+		out.Put("g\n");
+		GB_STATS_COUNT("obj.vertices_written", mesh->GetNVertices());
+		GB_STATS_COUNT("obj.faces_written", mesh->GetNFaces());
+	}
+	out.Flush();
+	GB_STATS_COUNT("obj.bytes_written", out.GetBytesWritten());
+}
+
+/** Helper function: is c a blank within a line?
+ */
+inline bool IsBlank(char c) {
+	return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+/** Helper function: skips blanks
+ */
+inline char const* SkipBlanks(char const* p, char const* end) {
+	while((p < end) && IsBlank(*p)) { ++p; }
+	return p;
+}
+
+/** Helper function: skips a token
+ */
+inline char const* SkipToken(char const* p, char const* end) {
+	while((p < end) && !IsBlank(*p)) { ++p; }
+	return p;
+}
+
+/** Helper function: get the end of the current line
+ * @return Pointer to the terminating '\n' or end
+ */
+inline char const* FindLineEnd(char const* p, char const* end) {
+	char const* ret = static_cast<char const*>(memchr(p, '\n', end - p));
+	return (ret) ? ret : end;
+}
+
+/** Helper function: parses a decimal integer
+ * @param[in,out] p Start of the number; advanced past the number on success
+ * @param[in] end End of the buffer
+ * @param[out] value Receives the number
+ * @return true if a number was found
+ */
+static bool ParseInt(char const*& p, char const* end, int* value) {
+	char const* s = p;
+	bool negative = false;
+	if((s < end) && ((*s == '-') || (*s == '+'))) { negative = (*s == '-'); ++s; }
+	if((s >= end) || (*s < '0') || (*s > '9')) { return false; }
+	int ret = 0;
+	for(; (s < end) && (*s >= '0') && (*s <= '9'); ++s) {
+		if(ret < 100000000) { ret = ret*10 + (*s - '0'); }
+	}
+	*value = (negative) ? -ret : ret;
+	p = s;
+	return true;
+}
+
+/** Helper function: parses a floating point number in C locale notation
+ * @param[in,out] p Start of the number; advanced past the number on success
+ * @param[in] end End of the buffer
+ * @param[out] value Receives the number
+ * @return true if a number was found
+ * @note Numbers with up to 15 significant digits and a decimal exponent within +/-22
+ *       are converted exactly (correctly rounded); that covers everything written by
+ *       common exporters. Other numbers may be off by a few ulp.
+ */
+static bool ParseDouble(char const*& p, char const* end, double* value) {
+	static double const pow10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+	                                1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+	                                1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	char const* s = p;
+	bool negative = false;
+	if((s < end) && ((*s == '-') || (*s == '+'))) { negative = (*s == '-'); ++s; }
+	unsigned long long mantissa = 0;
+	int n_digits = 0;			//significant digits stored in mantissa
+	int exponent = 0;			//decimal exponent applied to mantissa
+	bool found_digits = false;
+	for(; (s < end) && (*s >= '0') && (*s <= '9'); ++s) {
+		found_digits = true;
+		if(n_digits < 19) {
+			mantissa = mantissa*10 + (*s - '0');
+			if(mantissa) { n_digits++; }
+		} else {
+			exponent++;
+		}
+	}
+	if((s < end) && (*s == '.')) {
+		for(++s; (s < end) && (*s >= '0') && (*s <= '9'); ++s) {
+			found_digits = true;
+			if(n_digits < 19) {
+				mantissa = mantissa*10 + (*s - '0');
+				if(mantissa) { n_digits++; }
+				exponent--;
+			}
+		}
+	}
+	if(!found_digits) { return false; }
+	if((s < end) && ((*s == 'e') || (*s == 'E'))) {
+		char const* e = s + 1;
+		int exp_value;
+		if(ParseInt(e, end, &exp_value)) {
+			exponent += exp_value;
+			s = e;
+		}
+	}
+	double ret;
+	if(mantissa == 0) {
+		ret = 0.0;
+	} else if((mantissa < (1ULL << 53)) && (exponent >= -22) && (exponent <= 22)) {
+		//both operands are exact, so the result is correctly rounded:
+		ret = (exponent >= 0) ? (static_cast<double>(mantissa) * pow10[exponent]) :
+		                        (static_cast<double>(mantissa) / pow10[-exponent]);
+	} else {
+		ret = static_cast<double>( static_cast<long double>(mantissa) * std::pow(10.0L, exponent) );
+	}
+	*value = (negative) ? -ret : ret;
+	p = s;
+	return true;
+}
+
+/** Helper function: parses up to 3 floating point numbers; missing numbers are set to 0
+ */
+static void ParseVector3(char const* p, char const* end, double* v) {
+	for(int i=0; i<3; i++) {
+		p = SkipBlanks(p, end);
+		if(!ParseDouble(p, end, &v[i])) {
+			for(; i<3; i++) { v[i] = 0.0; }
+			return;
+		}
+	}
+}
+
+/** Helper function: converts an obj index to an index into the current mesh
+ * @param[in] index The 1-based (or negative, relative) index as found in the obj file
+ * @param[in] counter Number of elements read so far
+ * @param[in] base Number of elements read before the current mesh started
+ * @return 0-based index into the current mesh or -1 if no index was given
+ */
+inline int ResolveIndex(int index, int counter, int base) {
+	if(index > 0) { return index - 1 - base; }
+	if(index < 0) { return counter + index - base; }
+	return -1;
+}
+
+/** Per-mesh element counts from the pre-scan, used to reserve storage
+ */
+struct OBJ_MeshCounts {
+	int n_vertices, n_normals, n_texture, n_faces;
+};
+
+/** Helper function: classifies an obj line
+ * @return The line's keyword: 'v', 't' (vt), 'n' (vn), 'f', 'g', 's' or 0 for anything else
+ */
+inline char ClassifyLine(char const* p, char const* line_end) {
+	if(p >= line_end) { return 0; }
+	char const c0 = p[0];
+	char const c1 = (p + 1 < line_end) ? p[1] : ' ';
+	switch(c0) {
+		case 'v':
+			if(IsBlank(c1))  { return 'v'; }
+			if(c1 == 't')    { return 't'; }
+			if(c1 == 'n')    { return 'n'; }
+			return 'p';		//parameter space vertex (or unknown): still starts a new mesh
+		case 'f': return (IsBlank(c1)) ? 'f' : 0;
+		case 'g': return 'g';
+		case 's': return (IsBlank(c1)) ? 's' : 0;
+		default:  return 0;
 	}
 }
 
-void OBJ_FileLoader::ReadFile(std::ifstream& f) 
+/** Helper function: counts the elements of each mesh in an obj buffer
+ * @note Mesh boundaries are determined the same way as in OBJ_FileLoader::ReadData()
+ */
+static void PrescanOBJData(char const* p, char const* end, std::vector<OBJ_MeshCounts>& counts) {
+	OBJ_MeshCounts current = { 0, 0, 0, 0 };
+	bool new_group_was_opened = false;
+	while(p < end) {
+		char const* line_end = FindLineEnd(p, end);
+		char const* s = SkipBlanks(p, line_end);
+		char const type = ClassifyLine(s, line_end);
+		switch(type) {
+			case 'v': case 't': case 'n': case 'p':
+				if(new_group_was_opened) {
+					counts.push_back(current);
+					current.n_vertices = current.n_normals = current.n_texture = current.n_faces = 0;
+					new_group_was_opened = false;
+				}
+				if(type == 'v') { current.n_vertices++; }
+				if(type == 't') { current.n_texture++; }
+				if(type == 'n') { current.n_normals++; }
+				break;
+			case 'f': {
+				int n_corners = 0;
+				for(s = SkipBlanks(s + 1, line_end); s < line_end; s = SkipBlanks(SkipToken(s, line_end), line_end)) {
+					n_corners++;
+				}
+				if(n_corners > 2) { current.n_faces += n_corners - 2; }
+				} break;
+			case 'g':
+				if(SkipBlanks(s + 1, line_end) < line_end) { new_group_was_opened = true; }
+				break;
+			default:
+				break;
+		}
+		p = line_end + 1;
+	}
+	counts.push_back(current);
+}
+
+/** Helper function: reserves storage in a mesh from the pre-scan counts
+ */
+inline void ReserveMesh(OBJ_Mesh* mesh, std::vector<OBJ_MeshCounts> const& counts, size_t index) {
+	if(index < counts.size()) {
+		mesh->Reserve(counts[index].n_vertices, counts[index].n_normals, counts[index].n_texture, counts[index].n_faces);
+	}
+}
+
+void OBJ_FileLoader::ReadData(char const* data, size_t size, OBJ_Mesh::STORAGE storage) 
 {
-	///@todo: only triangular polys supported; all vertices are assumed to have vertex, texture and normal data present;
-	std::string buffer;
 	if(m_MeshList.size() > 0) { 
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_INVALIDCONTEXT,
 			                         "The mesh list is not empty" ) );
 	}
-	char group_name[256];								///< buffer holding the current group name
+	char const* p = data;
+	char const* const end = data + size;
+	std::vector<OBJ_MeshCounts> counts;
+	PrescanOBJData(p, end, counts);
+
+	std::string group_name;								///< the current group name
 	bool new_group_was_opened = false;					///< flag for mesh object maintenance
-	OBJ_Mesh* mesh = new OBJ_Mesh("");					///< buffer mesh object
+	size_t mesh_index = 0;								///< index of the current mesh into counts
+	OBJ_Mesh* mesh = new OBJ_Mesh("", storage);					///< buffer mesh object
+	ReserveMesh(mesh, counts, mesh_index);
 	double tmp[3];
 	OBJ_Mesh::Face tmp_face;
 	tmp_face.smoothing_group = -1;
 	int vert_counter=0, normal_counter=0, texture_counter=0;
 	int vert_base=0, normal_base=0, texture_base=0;
+	/// corner indices of the current face (vertex, texture, normal); polygons are triangulated as fans
+	std::vector<int> corners;
 	
-	while( std::getline(f, buffer) ) {
-		//for each line of the file do:
-		//first character determines what kind of data to expect:
-		switch(buffer[0]) {
-			case '#':
-				//commentary
-				// do nothing
-				break;
-			case 'v':
+	try {
+	while(p < end) {
+		//for each line of the buffer do:
+		char const* line_end = FindLineEnd(p, end);
+		char const* s = SkipBlanks(p, line_end);
+		//first token determines what kind of data to expect:
+		char const type = ClassifyLine(s, line_end);
+		switch(type) {
+			case 'v': case 't': case 'n': case 'p':
 				//vertex data
 				if(new_group_was_opened) {
 					//if new group was opened since last vertex was read
 					//the following data belongs to a new mesh
-					OBJ_Mesh* newmesh = new OBJ_Mesh("");
-					mesh->SetName(group_name);
+					OBJ_Mesh* newmesh = new OBJ_Mesh("", storage);
+					mesh->SetName(group_name.c_str());
 					m_MeshList.push_back(mesh);
 					mesh = newmesh;
+					ReserveMesh(mesh, counts, ++mesh_index);
 					vert_base = vert_counter;			//save current indices
 					normal_base = normal_counter;
 					texture_base = texture_counter;
 					new_group_was_opened = false;
 				}
 				//read and store vertex data:
-				switch(buffer[1]) {
-					case ' ':
+				switch(type) {
+					case 'v':
 						//geometry vertex
-						sscanf(buffer.c_str(), "v %lf %lf %lf", &(tmp[0]), &(tmp[1]), &(tmp[2]));
+						ParseVector3(s + 1, line_end, tmp);
 						mesh->AddGeometry(tmp, 3);
 						vert_counter++;
 						break;
 					case 't':
 						//texture vertex
-						sscanf(buffer.c_str(), "vt %lf %lf %lf", &(tmp[0]), &(tmp[1]), &(tmp[2]));
+						ParseVector3(s + 2, line_end, tmp);
 						mesh->AddTextureData(tmp, 3);
 						texture_counter++;
 						break;
 					case 'n':
 						//normal vertex
-						sscanf(buffer.c_str(), "vn %lf %lf %lf", &(tmp[0]), &(tmp[1]), &(tmp[2]));
+						ParseVector3(s + 2, line_end, tmp);
 						mesh->AddNormals(tmp, 3);
 						normal_counter++;
 						break;
-					case 'p':
+					default:
 						//parameter space vertex
 						/// @todo
 						break;
-					default:
-						break;
 				}
 				break;
 			case 'f':
 				//face
-				//read and store face data:
-				sscanf(buffer.c_str(), "f %d/%d/%d %d/%d/%d %d/%d/%d",
-					    &(tmp_face.vert1), &(tmp_face.texture1), &(tmp_face.normal1),
-						&(tmp_face.vert2), &(tmp_face.texture2), &(tmp_face.normal2),
-						&(tmp_face.vert3), &(tmp_face.texture3), &(tmp_face.normal3) );
-				//since obj's index counters are not reset between groups, we need to adjust indices manually:
-				tmp_face.vert1 -= vert_base; tmp_face.vert2 -= vert_base; tmp_face.vert3 -= vert_base;
-				tmp_face.normal1 -= normal_base; tmp_face.normal2 -= normal_base; tmp_face.normal3 -= normal_base; 
-				tmp_face.texture1 -= texture_base; tmp_face.texture2 -= texture_base; tmp_face.texture3 -= texture_base;
-				//beware! object file indices are 1-based; readjust:
-				tmp_face.vert1--;    tmp_face.vert2--;    tmp_face.vert3--;
-				tmp_face.texture1--; tmp_face.texture2--; tmp_face.texture3--;
-				tmp_face.normal1--;  tmp_face.normal2--;  tmp_face.normal3--;
-				mesh->AddFaceData(&tmp_face, 1);
+				//read all corners; each is one of v, v/t, v//n or v/t/n:
+				corners.clear();
+				for(s = SkipBlanks(s + 1, line_end); s < line_end; s = SkipBlanks(SkipToken(s, line_end), line_end)) {
+					int v = 0, t = 0, n = 0;
+					if(!ParseInt(s, line_end, &v)) { continue; }
+					if((s < line_end) && (*s == '/')) {
+						++s;
+						ParseInt(s, line_end, &t);
+						if((s < line_end) && (*s == '/')) {
+							++s;
+							ParseInt(s, line_end, &n);
+						}
+					}
+					//since obj's index counters are not reset between groups, we need to adjust indices manually;
+					//beware! object file indices are 1-based:
+					corners.push_back(ResolveIndex(v, vert_counter, vert_base));
+					corners.push_back(ResolveIndex(t, texture_counter, texture_base));
+					corners.push_back(ResolveIndex(n, normal_counter, normal_base));
+				}
+				for(size_t i=6; i+2<corners.size(); i+=3) {
+					tmp_face.vert1    = corners[0];   tmp_face.texture1 = corners[1];   tmp_face.normal1 = corners[2];
+					tmp_face.vert2    = corners[i-3]; tmp_face.texture2 = corners[i-2]; tmp_face.normal2 = corners[i-1];
+					tmp_face.vert3    = corners[i];   tmp_face.texture3 = corners[i+1]; tmp_face.normal3 = corners[i+2];
+					mesh->AddFaceData(&tmp_face, 1);
+				}
 				break;
 			case 'g':
 				//group
-				if(sscanf(buffer.c_str(), "g %s", group_name) > 0) {
+				s = SkipBlanks(s + 1, line_end);
+				if(s < line_end) {
 					//a new (named) group was opened;
 					//in 3dsmax obj files this should only happen before a new faces block
+					group_name.assign(s, SkipToken(s, line_end));
 					new_group_was_opened = true;
 				}
 				break;
 			case 's':
-				switch(buffer[1]) {
-					case ' ':
-						//smoothing group
-						sscanf(buffer.c_str(), "s %d", &(tmp_face.smoothing_group));
-						break;
-					default:
-						break;
-				}
+				//smoothing group
+				s = SkipBlanks(s + 1, line_end);
+				ParseInt(s, line_end, &(tmp_face.smoothing_group));
+				break;
 			default:
 				break;
 		}
+		p = line_end + 1;
+	}
+	} catch(...) {
+		delete mesh;
+		throw;
 	}
 	if(mesh->GetNFaces() > 0) {
-		mesh->SetName(group_name);
+		mesh->SetName(group_name.c_str());
 		m_MeshList.push_back(mesh);
 	} else {
 		delete mesh;
 	}
 }
 
-OBJ_Mesh::OBJ_Mesh(char const* name)
-	:m_name(NULL)
+OBJ_AttributeArray::OBJ_AttributeArray(STORAGE storage, int n_components)
+	:m_storage(storage), m_nComponents(n_components), m_nInput(0)
+{
+}
+OBJ_AttributeArray::STORAGE OBJ_AttributeArray::GetStorage() const {
+	return m_storage;
+}
+int OBJ_AttributeArray::GetNComponents() const {
+	return m_nComponents;
+}
+int OBJ_AttributeArray::GetNElements() const {
+	return static_cast<int>(m_nInput / 3);
+}
+void OBJ_AttributeArray::Clear() {
+	m_double.clear();
+	m_float.clear();
+	m_fixed.clear();
+	m_nInput = 0;
+}
+void OBJ_AttributeArray::Reserve(int n_elements) {
+	size_t const n = static_cast<size_t>(n_elements) * m_nComponents;
+	switch(m_storage) {
+		case STORAGE_DOUBLE:  m_double.reserve(n); break;
+		case STORAGE_FLOAT:   m_float.reserve(n);  break;
+		case STORAGE_FIXED16: m_fixed.reserve(n);  break;
+	}
+}
+double const* OBJ_AttributeArray::GetDoubleData() const {
+	return ((m_storage == STORAGE_DOUBLE) && (!m_double.empty())) ? (&m_double[0]) : NULL;
+}
+float const* OBJ_AttributeArray::GetFloatData() const {
+	return ((m_storage == STORAGE_FLOAT) && (!m_float.empty())) ? (&m_float[0]) : NULL;
+}
+short const* OBJ_AttributeArray::GetFixed16Data() const {
+	return ((m_storage == STORAGE_FIXED16) && (!m_fixed.empty())) ? (&m_fixed[0]) : NULL;
+}
+double OBJ_AttributeArray::Get(int index, int component) const {
+	if(component >= m_nComponents) { return 0.0; }
+	size_t const i = static_cast<size_t>(index) * m_nComponents + component;
+	switch(m_storage) {
+		case STORAGE_FLOAT:   return m_float[i];
+		case STORAGE_FIXED16: return static_cast<double>( static_cast<float>(m_fixed[i]) / 4096.0f );
+		default:              return m_double[i];
+	}
+}
+
+OBJ_Mesh::OBJ_Mesh(char const* name, STORAGE storage)
+	:m_geometry(storage, 3), m_normals(storage, 3),
+	 m_texcoords(storage, (storage == OBJ_AttributeArray::STORAGE_DOUBLE) ? 3 : 2), m_name(NULL)
 {
 	SetName(name);
 }
@@ -238,14 +707,11 @@ OBJ_Mesh::~OBJ_Mesh() {
 	if(m_name) { delete[] m_name;  m_name = NULL; }
 }
 OBJ_Mesh::OBJ_Mesh(OBJ_Mesh const& rhs)
-	:m_name(NULL)
+	:m_geometry(rhs.m_geometry), m_normals(rhs.m_normals), m_texcoords(rhs.m_texcoords),
+	 m_faces(rhs.m_faces), m_name(NULL)
 {
 	//copy construct:
 	this->SetName(rhs.m_name);
-	this->SetGeometry(rhs.m_geometry);
-	this->SetNormals(rhs.m_normals);
-	this->SetTextureData(rhs.m_texcoords);
-	this->SetFaceData(rhs.m_faces);
 }
 
 void OBJ_Mesh::SetName(char const* name) {
@@ -255,27 +721,20 @@ void OBJ_Mesh::SetName(char const* name) {
 	strcpy(m_name, name);
 }
 
-/** Helper function for the Set*vector methods
- */
-template<typename T>
-inline void CopyVector(std::vector<T>* dest, std::vector<T> const* src) {
-	dest->clear();
-	for(typename std::vector<T>::const_iterator i = src->begin(); i != src->end(); ++i) {
-		dest->push_back(*i);
-	}
-}
-
 void OBJ_Mesh::SetGeometry(std::vector<double> const& data) {
-	CopyVector(&m_geometry, &data);
+	m_geometry.Clear();
+	if(!data.empty()) { m_geometry.Append(&data[0], static_cast<int>(data.size())); }
 }
 void OBJ_Mesh::SetNormals(std::vector<double> const& data) {
-	CopyVector(&m_normals, &data);
+	m_normals.Clear();
+	if(!data.empty()) { m_normals.Append(&data[0], static_cast<int>(data.size())); }
 }
 void OBJ_Mesh::SetTextureData(std::vector<double> const& data) {
-	CopyVector(&m_texcoords, &data);
+	m_texcoords.Clear();
+	if(!data.empty()) { m_texcoords.Append(&data[0], static_cast<int>(data.size())); }
 }
 void OBJ_Mesh::SetFaceData(std::vector<Face> const& data) {
-	CopyVector(&m_faces, &data);
+	m_faces = data;
 }
 void OBJ_Mesh::SetFaceData(Face const* data, int n_data) {
 	FillVector(&m_faces, data, n_data);
@@ -283,86 +742,107 @@ void OBJ_Mesh::SetFaceData(Face const* data, int n_data) {
 void OBJ_Mesh::AddFaceData(Face const* data, int n_data) {
 	AppendToVector(&m_faces, data, n_data);
 }
+void OBJ_Mesh::Reserve(int n_vertices, int n_normals, int n_texture, int n_faces) {
+	m_geometry.Reserve(n_vertices);
+	m_normals.Reserve(n_normals);
+	m_texcoords.Reserve(n_texture);
+	m_faces.reserve(n_faces);
+}
 void OBJ_Mesh::ClearGeometry() {
-	m_geometry.clear();
+	m_geometry.Clear();
 }
 void OBJ_Mesh::ClearNormals() {
-	m_normals.clear();
+	m_normals.Clear();
 }
 void OBJ_Mesh::ClearTextureData() {
-	m_texcoords.clear();
+	m_texcoords.Clear();
 }
 void OBJ_Mesh::ClearFaceData() {
 	m_faces.clear();
 }
+OBJ_Mesh::STORAGE OBJ_Mesh::GetStorage() const {
+	return m_geometry.GetStorage();
+}
 char const* OBJ_Mesh::GetName() const {
 	return (m_name?m_name:"");
 }
 int OBJ_Mesh::GetNVertices() const {
-	return static_cast<int>(m_geometry.size() / 3);
+	return m_geometry.GetNElements();
 }
 int OBJ_Mesh::GetNFaces() const {
 	return static_cast<int>(m_faces.size());
 }
 int OBJ_Mesh::GetNNormals() const {
-	return static_cast<int>(m_normals.size() / 3);
+	return m_normals.GetNElements();
 }
 int OBJ_Mesh::GetNTexture() const {
-	return static_cast<int>(m_texcoords.size() / 3);
+	return m_texcoords.GetNElements();
+}
+OBJ_AttributeArray const& OBJ_Mesh::GetGeometry() const {
+	return m_geometry;
+}
+OBJ_AttributeArray const& OBJ_Mesh::GetNormals() const {
+	return m_normals;
+}
+OBJ_AttributeArray const& OBJ_Mesh::GetTextureData() const {
+	return m_texcoords;
+}
+std::vector<OBJ_Mesh::Face> const& OBJ_Mesh::GetFaceData() const {
+	return m_faces;
 }
-double const* OBJ_Mesh::GetVertexX(int index) const {
-	if(index >= static_cast<int>(m_geometry.size() / 3)) {
+double OBJ_Mesh::GetVertexX(int index) const {
+	if(index >= m_geometry.GetNElements()) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
 	}
-	return &(m_geometry[index*3]);
+	return m_geometry.Get(index, 0);
 }
-double const* OBJ_Mesh::GetVertexY(int index) const {
-	if(index >= static_cast<int>(m_geometry.size() / 3)) {
+double OBJ_Mesh::GetVertexY(int index) const {
+	if(index >= m_geometry.GetNElements()) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
 	}
-	return &(m_geometry[index*3 + 1]);
+	return m_geometry.Get(index, 1);
 }
-double const* OBJ_Mesh::GetVertexZ(int index) const {
-	if(index >= static_cast<int>(m_geometry.size() / 3)) {
+double OBJ_Mesh::GetVertexZ(int index) const {
+	if(index >= m_geometry.GetNElements()) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
 	}
-	return &(m_geometry[index*3 + 2]);
+	return m_geometry.Get(index, 2);
 }
-double const* OBJ_Mesh::GetNormalX(int index) const {
-	if(index >= static_cast<int>(m_normals.size() / 3)) {
+double OBJ_Mesh::GetNormalX(int index) const {
+	if(index >= m_normals.GetNElements()) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
 	}
-	return &(m_normals[index*3]);
+	return m_normals.Get(index, 0);
 }
-double const* OBJ_Mesh::GetNormalY(int index) const {
-	if(index >= static_cast<int>(m_normals.size() / 3)) {
+double OBJ_Mesh::GetNormalY(int index) const {
+	if(index >= m_normals.GetNElements()) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
 	}
-	return &(m_normals[index*3 + 1]);
+	return m_normals.Get(index, 1);
 }
-double const* OBJ_Mesh::GetNormalZ(int index) const {
-	if(index >= static_cast<int>(m_normals.size() / 3)) {
+double OBJ_Mesh::GetNormalZ(int index) const {
+	if(index >= m_normals.GetNElements()) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
 	}
-	return &(m_normals[index*3 + 2]);
+	return m_normals.Get(index, 2);
 }
-double const* OBJ_Mesh::GetTextureX(int index) const {
-	if(index >= static_cast<int>(m_texcoords.size() / 3)) {
+double OBJ_Mesh::GetTextureX(int index) const {
+	if(index >= m_texcoords.GetNElements()) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
 	}
-	return &(m_texcoords[index*3]);
+	return m_texcoords.Get(index, 0);
 }
-double const* OBJ_Mesh::GetTextureY(int index) const {
-	if(index >= static_cast<int>(m_texcoords.size() / 3)) {
+double OBJ_Mesh::GetTextureY(int index) const {
+	if(index >= m_texcoords.GetNElements()) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
 	}
-	return &(m_texcoords[index*3 + 1]);
+	return m_texcoords.Get(index, 1);
 }
-double const* OBJ_Mesh::GetTextureZ(int index) const {
-	if(index >= static_cast<int>(m_texcoords.size() / 3)) {
+double OBJ_Mesh::GetTextureZ(int index) const {
+	if(index >= m_texcoords.GetNElements()) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
 	}
-	return &(m_texcoords[index*3 + 2]);
+	return m_texcoords.Get(index, 2);
 }
 OBJ_Mesh::Face const* OBJ_Mesh::GetFace(int index) const {
 	if(index >= static_cast<int>(m_faces.size()) ) {
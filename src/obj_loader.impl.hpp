@@ -3,77 +3,227 @@
  *
  * @brief Template members of OBJ_FileLoader and OBJ_Meshbuild_header/
  */
+/** Helper function: converts a value to 4.12 fixed point
+ * @note Rounds towards zero like the PS2Icon conversion and saturates to the 16 bit range;
+ *       NaN is converted to the minimum value
+ */
 template<typename T>
-void OBJ_Mesh::GetMeshGeometryUnindexed(T* mesh_geometry, T* mesh_normals, T* mesh_texture, T scale) const {
-	int index = 0;		//index of the current triangle
-	for(std::vector<Face>::const_iterator iter = m_faces.begin(); iter != m_faces.end(); ++iter, ++index) {
-		if(mesh_geometry) {
-			mesh_geometry[(index*9)]     = static_cast<T>( m_geometry[ (*iter).vert1 * 3 ])    * scale;
-			mesh_geometry[(index*9) + 1] = static_cast<T>( m_geometry[ (*iter).vert1 * 3 + 1]) * scale;
-			mesh_geometry[(index*9) + 2] = static_cast<T>( m_geometry[ (*iter).vert1 * 3 + 2]) * scale;
-			mesh_geometry[(index*9) + 3] = static_cast<T>( m_geometry[ (*iter).vert2 * 3 ])    * scale;
-			mesh_geometry[(index*9) + 4] = static_cast<T>( m_geometry[ (*iter).vert2 * 3 + 1]) * scale;
-			mesh_geometry[(index*9) + 5] = static_cast<T>( m_geometry[ (*iter).vert2 * 3 + 2]) * scale;
-			mesh_geometry[(index*9) + 6] = static_cast<T>( m_geometry[ (*iter).vert3 * 3 ])    * scale;
-			mesh_geometry[(index*9) + 7] = static_cast<T>( m_geometry[ (*iter).vert3 * 3 + 1]) * scale;
-			mesh_geometry[(index*9) + 8] = static_cast<T>( m_geometry[ (*iter).vert3 * 3 + 2]) * scale;
+inline short OBJ_ConvertToFixed16(T const& v) {
+	float f = static_cast<float>(v) * 4096.0f;
+	if(f >= 32767.0f)   { return 32767; }
+	if(!(f > -32768.0f)) { return -32768; }
+	return static_cast<short>(f);
+}
+
+template<typename T>
+void OBJ_AttributeArray::Assign(T const* data, int n_data) {
+	Clear();
+	Append(data, n_data);
+}
+
+template<typename T>
+void OBJ_AttributeArray::Append(T const* data, int n_data) {
+	for(int i=0; i<n_data; i++, m_nInput++) {
+		if(static_cast<int>(m_nInput % 3) >= m_nComponents) { continue; }
+		switch(m_storage) {
+			case STORAGE_DOUBLE:  m_double.push_back( static_cast<double>(data[i]) ); break;
+			case STORAGE_FLOAT:   m_float.push_back( static_cast<float>(data[i]) );   break;
+			case STORAGE_FIXED16: m_fixed.push_back( OBJ_ConvertToFixed16(data[i]) ); break;
 		}
-		if(mesh_normals) {
-			mesh_normals[(index*9)]      = static_cast<T>( m_normals[ (*iter).normal1 * 3 ] );
-			mesh_normals[(index*9) + 1]  = static_cast<T>( m_normals[ (*iter).normal1 * 3 + 1] );
-			mesh_normals[(index*9) + 2]  = static_cast<T>( m_normals[ (*iter).normal1 * 3 + 2] );
-			mesh_normals[(index*9) + 3]  = static_cast<T>( m_normals[ (*iter).normal2 * 3] );
-			mesh_normals[(index*9) + 4]  = static_cast<T>( m_normals[ (*iter).normal2 * 3 + 1] );
-			mesh_normals[(index*9) + 5]  = static_cast<T>( m_normals[ (*iter).normal2 * 3 + 2] );
-			mesh_normals[(index*9) + 6]  = static_cast<T>( m_normals[ (*iter).normal3 * 3] );
-			mesh_normals[(index*9) + 7]  = static_cast<T>( m_normals[ (*iter).normal3 * 3 + 1] );
-			mesh_normals[(index*9) + 8]  = static_cast<T>( m_normals[ (*iter).normal3 * 3 + 2] );
+	}
+}
+
+template<typename T>
+void OBJ_AttributeArray::GetElement(int index, T* dst, T scale) const {
+	size_t const offset = static_cast<size_t>(index) * m_nComponents;
+	for(int i=0; i<3; i++) {
+		if(i >= m_nComponents) {
+			dst[i] = static_cast<T>(0);
+			continue;
 		}
-		if(mesh_texture) {
-			mesh_texture[(index*9)]      = static_cast<T>( m_texcoords[ (*iter).texture1 * 3 ] );
-			mesh_texture[(index*9) + 1]  = static_cast<T>( m_texcoords[ (*iter).texture1 * 3 + 1] );
-			mesh_texture[(index*9) + 2]  = static_cast<T>( m_texcoords[ (*iter).texture1 * 3 + 2] );
-			mesh_texture[(index*9) + 3]  = static_cast<T>( m_texcoords[ (*iter).texture2 * 3] );
-			mesh_texture[(index*9) + 4]  = static_cast<T>( m_texcoords[ (*iter).texture2 * 3 + 1] );
-			mesh_texture[(index*9) + 5]  = static_cast<T>( m_texcoords[ (*iter).texture2 * 3 + 2] );
-			mesh_texture[(index*9) + 6]  = static_cast<T>( m_texcoords[ (*iter).texture3 * 3] );
-			mesh_texture[(index*9) + 7]  = static_cast<T>( m_texcoords[ (*iter).texture3 * 3 + 1] );
-			mesh_texture[(index*9) + 8]  = static_cast<T>( m_texcoords[ (*iter).texture3 * 3 + 2] );
+		switch(m_storage) {
+			case STORAGE_DOUBLE:  dst[i] = static_cast<T>( m_double[offset + i] ) * scale; break;
+			case STORAGE_FLOAT:   dst[i] = static_cast<T>( m_float[offset + i] ) * scale;  break;
+			case STORAGE_FIXED16: dst[i] = static_cast<T>( static_cast<float>(m_fixed[offset + i]) / 4096.0f ) * scale; break;
+		}
+	}
+}
+
+template<typename T, int N>
+OBJ_ArrayOutput<T, N>::OBJ_ArrayOutput(T* dst, size_t stride)
+	:m_dst(dst), m_stride(stride)
+{
+}
+
+template<typename T, int N>
+inline void OBJ_ArrayOutput<T, N>::Write(size_t vertex, T const* v) const {
+	T* dst = m_dst + vertex * m_stride;
+	for(int i=0; i<N; i++) {
+		dst[i] = v[i];
+	}
+}
+
+template<int N>
+OBJ_Fixed16Output<N>::OBJ_Fixed16Output(short* dst, size_t stride)
+	:m_dst(dst), m_stride(stride)
+{
+}
+
+template<int N>
+inline void OBJ_Fixed16Output<N>::Write(size_t vertex, float const* v) const {
+	short* dst = m_dst + vertex * m_stride;
+	for(int i=0; i<N; i++) {
+		dst[i] = OBJ_ConvertToFixed16(v[i]);
+	}
+}
+
+/** Helper classes for the extraction functions of OBJ_Mesh: read a stored component as type T
+ * The conversions are the same as in OBJ_AttributeArray::GetElement().
+ */
+template<typename T>
+struct OBJ_ReadDouble {
+	double const* m_data;					///< the stored components
+	explicit OBJ_ReadDouble(double const* data): m_data(data) {}
+	T operator()(size_t i) const { return static_cast<T>(m_data[i]); }
+};
+template<typename T>
+struct OBJ_ReadFloat {
+	float const* m_data;					///< the stored components
+	explicit OBJ_ReadFloat(float const* data): m_data(data) {}
+	T operator()(size_t i) const { return static_cast<T>(m_data[i]); }
+};
+template<typename T>
+struct OBJ_ReadFixed16 {
+	short const* m_data;					///< the stored components
+	explicit OBJ_ReadFixed16(short const* data): m_data(data) {}
+	T operator()(size_t i) const { return static_cast<T>( static_cast<float>(m_data[i]) / 4096.0f ); }
+};
+
+/** Helper function for the extraction functions of OBJ_Mesh: writes a single indexed element
+ * @note Unspecified (negative) or out of range indices yield a null vector
+ */
+template<int N_COMPONENTS, typename Reader, typename Output>
+inline void OBJ_GatherElement(Reader const& read, int n_elements, int index, Output const& out, size_t vertex,
+                              typename Output::value_type scale)
+{
+	typedef typename Output::value_type T;
+	T v[3] = { static_cast<T>(0), static_cast<T>(0), static_cast<T>(0) };
+	if((index >= 0) && (index < n_elements)) {
+		size_t const offset = static_cast<size_t>(index) * N_COMPONENTS;
+		for(int i=0; i<N_COMPONENTS; i++) {
+			v[i] = read(offset + i) * scale;
 		}
 	}
+	out.Write(vertex, v);
+}
+
+/** Helper function for the extraction functions of OBJ_Mesh: writes the elements of all face corners
+ * The face members I1, I2 and I3 select the indices of the channel.
+ */
+template<int OBJ_Mesh::Face::* I1, int OBJ_Mesh::Face::* I2, int OBJ_Mesh::Face::* I3,
+         int N_COMPONENTS, typename Reader, typename Output>
+inline void OBJ_GatherFaces(Reader const& read, int n_elements, std::vector<OBJ_Mesh::Face> const& faces,
+                            Output const& out, typename Output::value_type scale)
+{
+	size_t vertex = 0;
+	for(std::vector<OBJ_Mesh::Face>::const_iterator iter = faces.begin(); iter != faces.end(); ++iter, vertex += 3) {
+		OBJ_GatherElement<N_COMPONENTS>(read, n_elements, (*iter).*I1, out, vertex,     scale);
+		OBJ_GatherElement<N_COMPONENTS>(read, n_elements, (*iter).*I2, out, vertex + 1, scale);
+		OBJ_GatherElement<N_COMPONENTS>(read, n_elements, (*iter).*I3, out, vertex + 2, scale);
+	}
+}
+
+/** Helper function for the extraction functions of OBJ_Mesh: selects the loop for the number of stored components
+ */
+template<int OBJ_Mesh::Face::* I1, int OBJ_Mesh::Face::* I2, int OBJ_Mesh::Face::* I3,
+         typename Reader, typename Output>
+inline void OBJ_GatherComponents(Reader const& read, OBJ_AttributeArray const& src, std::vector<OBJ_Mesh::Face> const& faces,
+                                 Output const& out, typename Output::value_type scale)
+{
+	switch(src.GetNComponents()) {
+		case 1:  OBJ_GatherFaces<I1, I2, I3, 1>(read, src.GetNElements(), faces, out, scale); break;
+		case 2:  OBJ_GatherFaces<I1, I2, I3, 2>(read, src.GetNElements(), faces, out, scale); break;
+		default: OBJ_GatherFaces<I1, I2, I3, 3>(read, src.GetNElements(), faces, out, scale); break;
+	}
+}
+
+/** Helper function for the extraction functions of OBJ_Mesh: selects the loop for the storage of a channel
+ */
+template<int OBJ_Mesh::Face::* I1, int OBJ_Mesh::Face::* I2, int OBJ_Mesh::Face::* I3, typename Output>
+inline void OBJ_GatherChannel(OBJ_AttributeArray const& src, std::vector<OBJ_Mesh::Face> const& faces,
+                              Output const& out, typename Output::value_type scale)
+{
+	typedef typename Output::value_type T;
+	switch(src.GetStorage()) {
+		case OBJ_AttributeArray::STORAGE_DOUBLE:
+			OBJ_GatherComponents<I1, I2, I3>(OBJ_ReadDouble<T>(src.GetDoubleData()), src, faces, out, scale);
+			break;
+		case OBJ_AttributeArray::STORAGE_FLOAT:
+			OBJ_GatherComponents<I1, I2, I3>(OBJ_ReadFloat<T>(src.GetFloatData()), src, faces, out, scale);
+			break;
+		case OBJ_AttributeArray::STORAGE_FIXED16:
+			OBJ_GatherComponents<I1, I2, I3>(OBJ_ReadFixed16<T>(src.GetFixed16Data()), src, faces, out, scale);
+			break;
+	}
+}
+
+/** Helper function for the extraction functions of OBJ_Mesh: discarded channels are not extracted
+ */
+template<int OBJ_Mesh::Face::* I1, int OBJ_Mesh::Face::* I2, int OBJ_Mesh::Face::* I3>
+inline void OBJ_GatherChannel(OBJ_AttributeArray const&, std::vector<OBJ_Mesh::Face> const&,
+                              OBJ_NoOutput const&, float)
+{
+}
+
+template<typename PositionOutput, typename NormalOutput, typename TexcoordOutput>
+void OBJ_Mesh::ExtractUnindexed(PositionOutput const& positions, NormalOutput const& normals,
+                                TexcoordOutput const& texcoords, typename PositionOutput::value_type scale) const
+{
+	OBJ_GatherChannel<&OBJ_Mesh::Face::vert1, &OBJ_Mesh::Face::vert2, &OBJ_Mesh::Face::vert3>(
+		m_geometry, m_faces, positions, scale);
+	OBJ_GatherChannel<&OBJ_Mesh::Face::normal1, &OBJ_Mesh::Face::normal2, &OBJ_Mesh::Face::normal3>(
+		m_normals, m_faces, normals, static_cast<typename NormalOutput::value_type>(1));
+	OBJ_GatherChannel<&OBJ_Mesh::Face::texture1, &OBJ_Mesh::Face::texture2, &OBJ_Mesh::Face::texture3>(
+		m_texcoords, m_faces, texcoords, static_cast<typename TexcoordOutput::value_type>(1));
+}
+
+template<typename T>
+void OBJ_Mesh::GetMeshGeometryUnindexed(T* mesh_geometry, T* mesh_normals, T* mesh_texture, T scale) const {
+	//the channel checks are made once, outside the loops:
+	if(mesh_geometry) {
+		OBJ_GatherChannel<&OBJ_Mesh::Face::vert1, &OBJ_Mesh::Face::vert2, &OBJ_Mesh::Face::vert3>(
+			m_geometry, m_faces, OBJ_ArrayOutput<T, 3>(mesh_geometry), scale);
+	}
+	if(mesh_normals) {
+		OBJ_GatherChannel<&OBJ_Mesh::Face::normal1, &OBJ_Mesh::Face::normal2, &OBJ_Mesh::Face::normal3>(
+			m_normals, m_faces, OBJ_ArrayOutput<T, 3>(mesh_normals), static_cast<T>(1));
+	}
+	if(mesh_texture) {
+		OBJ_GatherChannel<&OBJ_Mesh::Face::texture1, &OBJ_Mesh::Face::texture2, &OBJ_Mesh::Face::texture3>(
+			m_texcoords, m_faces, OBJ_ArrayOutput<T, 3>(mesh_texture), static_cast<T>(1));
+	}
 }
 
 template<typename T>
 void OBJ_Mesh::GetMeshGeometry(T* mesh_geometry, T* mesh_normals, T* mesh_texture, OBJ_Mesh::Face* mesh_faces, T scale) const {
-	int i = 0;
+	//every field starts at its first element:
 	if(mesh_geometry) {
-		for(std::vector<double>::const_iterator iter = m_geometry.begin(); iter != m_geometry.end(); ++iter, ++i) {
-			mesh_geometry[i] = static_cast<T>( (*iter) * scale );
+		for(int j=0; j<m_geometry.GetNElements(); j++) {
+			m_geometry.GetElement(j, mesh_geometry + j*3, scale);
 		}
 	}
 	if(mesh_normals) {
-		for(std::vector<double>::const_iterator iter = m_normals.begin(); iter != m_normals.end(); ++iter, ++i) {
-			mesh_normals[i] = static_cast<T>( *iter );
+		for(int j=0; j<m_normals.GetNElements(); j++) {
+			m_normals.GetElement(j, mesh_normals + j*3, static_cast<T>(1));
 		}
 	}
 	if(mesh_texture) {
-		for(std::vector<double>::const_iterator iter = m_texcoords.begin(); iter != m_texcoords.end(); ++iter, ++i) {
-			mesh_texture[i] = static_cast<T>( *iter );
+		for(int j=0; j<m_texcoords.GetNElements(); j++) {
+			m_texcoords.GetElement(j, mesh_texture + j*3, static_cast<T>(1));
 		}
 	}
-	if(mesh_faces) {
-		for(std::vector<Face>::const_iterator iter = m_faces.begin(); iter != m_faces.end(); ++iter, ++i) {
-			mesh_faces[i].vert1           = (*iter).vert1;
-			mesh_faces[i].vert2           = (*iter).vert2;
-			mesh_faces[i].vert3           = (*iter).vert3;
-			mesh_faces[i].normal1         = (*iter).normal1;
-			mesh_faces[i].normal2         = (*iter).normal2;
-			mesh_faces[i].normal3         = (*iter).normal3;
-			mesh_faces[i].texture1        = (*iter).texture1;
-			mesh_faces[i].texture2        = (*iter).texture2;
-			mesh_faces[i].texture3        = (*iter).texture3;
-			mesh_faces[i].smoothing_group = (*iter).smoothing_group;
-		}
+	if(mesh_faces && (!m_faces.empty())) {
+		std::copy(m_faces.begin(), m_faces.end(), mesh_faces);
 	}
 }
 /** Helper function for the Set*field methods
@@ -96,25 +246,25 @@ inline void AppendToVector(std::vector<T_1>* dest, T_2 const* data, int n_data)
 
 template<typename T>
 void OBJ_Mesh::SetGeometry(T const* data, int n_data) {
-	FillVector(&m_geometry, data, n_data);
+	m_geometry.Assign(data, n_data);
 }
 template<typename T>
 void OBJ_Mesh::AddGeometry(T const* data, int n_data) {
-	AppendToVector(&m_geometry, data, n_data);
+	m_geometry.Append(data, n_data);
 }
 template<typename T>
 void OBJ_Mesh::SetNormals(T const* data, int n_data) {
-	FillVector(&m_normals, data, n_data);
+	m_normals.Assign(data, n_data);
 }
 template<typename T>
 void OBJ_Mesh::AddNormals(T const* data, int n_data) {
-	AppendToVector(&m_normals, data, n_data);
+	m_normals.Append(data, n_data);
 }
 template<typename T>
 void OBJ_Mesh::SetTextureData(T const* data, int n_data) {
-	FillVector(&m_texcoords, data, n_data);
+	m_texcoords.Assign(data, n_data);
 }
 template<typename T>
 void OBJ_Mesh::AddTextureData(T const* data, int n_data) {
-	AppendToVector(&m_texcoords, data, n_data);
+	m_texcoords.Append(data, n_data);
 }
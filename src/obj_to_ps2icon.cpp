@@ -6,16 +6,70 @@
 #include <iostream>
 #include "../include/ps2_ps2icon.hpp"
 #include "../include/obj_loader.hpp"
+#include "../include/ps2_mesh_optimizer.hpp"
+#include "../include/batch_util.hpp"
+#include "../include/conversion_cache.hpp"
 #include "../gbLib/include/gbException.hpp"
 #include "../gbLib/include/gbImageLoader.hpp"
+#include "../gbLib/include/gbImageResample.hpp"
+#include "../gbLib/include/gbThreadPool.hpp"
+#include "../gbLib/include/gbStats.hpp"
+#include <vector>
+#include <string>
+
+/** Settings that apply to every conversion
+ */
+struct ConversionOptions {
+	int mesh_index;							///< 0-based index of the mesh to use
+	float scale_factor;						///< geometric scale factor for conversion
+	bool verbose;							///< flag for verbose output
+	bool list_obj_file;						///< flag for obj content listing
+	PS2Icon::TextureEncoding_T texture_encoding;	///< how the texture is stored in the icon
+	GhulbusUtil::gbResampleFilter_T texture_filter;	///< filter for resizing textures to 128x128
+	bool gamma_correct;						///< resize textures in linear light
+	bool optimize;							///< remove degenerate triangles and reorder for the texture cache
+	int max_vertices;						///< vertex budget for decimation (0: no limit)
+	std::vector<std::string> anim_frames;	///< OBJ files holding the animation shapes after the first
+	int frame_time;							///< animation time between two consecutive shapes
+	int jobs;								///< number of worker threads (0: one per processor)
+	ConversionCache const* cache;			///< cache for the output files (or NULL)
+	/** Constructor
+	 */
+	ConversionOptions(): mesh_index(0), scale_factor(0.0f), verbose(false), list_obj_file(false),
+	                     texture_encoding(PS2Icon::TEXTURE_AS_HEADER),
+	                     texture_filter(GhulbusUtil::GB_RESAMPLE_BOX), gamma_correct(false),
+	                     optimize(false), max_vertices(0), frame_time(10), jobs(0), cache(NULL) {}
+};
 
 char const* obj_input_file     = NULL;		///< path to the input file
-int obj_mesh_index             = 0;			///< 0-based index of the mesh to use
 char const* ps2_output_file    = NULL;		///< path to the output file
 char const* texture_input_file = NULL;		///< path to the texture file (tga or bmp)
-bool verbose_output            = false;		///< flag for verbose output
-bool list_obj_file             = false;		///< flag for obj content listing
-float obj_scale_factor         = 0.0f;		///< geometric scale factor for conversion
+char const* batch_manifest     = NULL;		///< path to the batch manifest file
+char const* batch_input_dir    = NULL;		///< path to the batch input directory
+char const* batch_output_dir   = NULL;		///< path to the batch output directory
+char const* cache_dir          = NULL;		///< path to the cache directory
+int batch_prefetch             = 0;			///< number of files read ahead in batch mode (0: direct file access)
+ConversionOptions options;					///< settings from the command line
+
+/** Objects that are reused between the items of a batch conversion
+ * @note Every worker thread owns a separate context.
+ */
+struct ConversionContext {
+	OBJ_FileLoader obj_file;					///< loader for the obj input
+	GhulbusUtil::gbImageLoader img_loader;		///< loader for the texture input
+	GhulbusUtil::gbImageType_BMP_T bmp_type;	///< loading strategy for BMP textures
+	GhulbusUtil::gbImageType_TGA_T tga_type;	///< loading strategy for TGA textures
+	PS2Icon ps2_icon;							///< the icon under construction
+	PS2MeshOptimizer mesh_optimizer;			///< geometry optimization stage
+	std::vector<unsigned int> texture_data;		///< converted texture, ready for PS2Icon::SetTextureData()
+	std::string texture_file;					///< path of the texture currently held in texture_data
+	std::vector<OBJ_FileLoader*> anim_files;	///< loaders for the animation shapes after the first
+	/** Destructor
+	 */
+	~ConversionContext() {
+		for(size_t i=0; i<anim_files.size(); i++) { delete anim_files[i]; }
+	}
+};
 
 /** Print a help text on screen
  * @param[in] self Name of the executable (e.g. obtained from argv[0])
@@ -37,7 +91,31 @@ void PrintHelp(char* self)
 			  << "  -m, --mesh-index     Index of the OBJ mesh to use (0-based)"          << "\n"
 			  << "  -s, --scale-factor   Scale factor that is applied to geometry"        << "\n"
 			  << "  -v, --verbose        activate verbose output"                         << "\n"
+			  << "      --stats          Print timings and counters of all stages to stderr" << "\n"
+			  << "                       when done; --stats=json prints them as JSON"       << "\n"
 			  << "  -l, --list-obj-file  list the meshes contained in input"              << "\n"
+			  << "  -b, --batch          Convert all files listed in a manifest"          << "\n"
+			  << "  -d, --input-dir      Convert all OBJ files in a directory"            << "\n"
+			  << "      --output-dir     Destination directory for batch conversion"      << "\n"
+			  << "  -j, --jobs           Number of files converted in parallel (batch mode)" << "\n"
+			  << "                       or animation frames read in parallel"             << "\n"
+			  << "      --prefetch       Read this many input files ahead and write the"    << "\n"
+			  << "                       outputs in the background (batch mode); speeds up" << "\n"
+			  << "                       conversions on network storage"                   << "\n"
+			  << "      --rle-optimal    Store the texture RLE compressed with minimal size" << "\n"
+			  << "      --texture-auto   Store the texture uncompressed or RLE compressed,"  << "\n"
+			  << "                       whichever is smaller"                              << "\n"
+			  << "      --filter         Filter for resizing textures that are not 128x128:" << "\n"
+			  << "                       box (default), bilinear or lanczos"                << "\n"
+			  << "      --gamma-correct  Resize textures in linear light"                   << "\n"
+			  << "  -O, --optimize       Remove degenerate triangles and sort triangles by"  << "\n"
+			  << "                       texture position (changes the drawing order)"      << "\n"
+			  << "      --max-vertices   Simplify the mesh to at most this many vertices"   << "\n"
+			  << "  -a, --anim-frame     OBJ file holding the next animation shape; the mesh" << "\n"
+			  << "                       must have the same faces as the input file"         << "\n"
+			  << "      --frame-time     Animation time between two shapes (default 10)"     << "\n"
+			  << "      --cache-dir      Reuse the output of earlier runs with the same input" << "\n"
+			  << "                       files and options from this directory"              << "\n"
 			  << "\n"
 			  << " Examples:"                                                              << "\n"
 			  << "  " << self << " -f foo.obj"                                            << "\n"
@@ -51,6 +129,16 @@ void PrintHelp(char* self)
 			  << "\n"
 			  << "  " << self << " -f foo.obj -l"                                         << "\n"
 			  << "Prints a list of all meshes in foo.obj. No files are written."          << "\n"
+			  << "\n"
+			  << "  " << self << " -d models --output-dir icons -t bar.tga"              << "\n"
+			  << "Converts every OBJ file in directory models to an icon file of the"    << "\n"
+			  << "same name in directory icons, using the image from bar.tga."            << "\n"
+			  << "A manifest given with -b lists one conversion per line as"              << "\n"
+			  << "tab-separated input, output and texture paths; only input is required." << "\n"
+			  << "\n"
+			  << "  " << self << " -f walk0.obj -a walk1.obj -a walk2.obj -o walk.icn"    << "\n"
+			  << "Builds an icon that loops through the three shapes walk0, walk1 and"   << "\n"
+			  << "walk2, blending each shape into the next one."                         << "\n"
 			  << std::endl;
 }
 
@@ -66,9 +154,19 @@ void ParseCommandLine(int argc, char* argv[])
 			PrintHelp(argv[0]);
 			exit(0);
 		} else if( (strcmp( argv[i], "-l" ) == 0) || (strcmp( argv[i], "--list-obj-file" ) == 0) ) {
-			list_obj_file = true;
+			options.list_obj_file = true;
 		} else if( (strcmp( argv[i], "-v" ) == 0) || (strcmp( argv[i], "--verbose" ) == 0) ) {
-			verbose_output = true;
+			options.verbose = true;
+		} else if( EnableStatsOption(argv[i]) ) {
+			//statistics are written when the program exits
+		} else if( strcmp( argv[i], "--rle-optimal" ) == 0 ) {
+			options.texture_encoding = PS2Icon::TEXTURE_RLE_OPTIMAL;
+		} else if( strcmp( argv[i], "--texture-auto" ) == 0 ) {
+			options.texture_encoding = PS2Icon::TEXTURE_AUTO;
+		} else if( strcmp( argv[i], "--gamma-correct" ) == 0 ) {
+			options.gamma_correct = true;
+		} else if( (strcmp( argv[i], "-O" ) == 0) || (strcmp( argv[i], "--optimize" ) == 0) ) {
+			options.optimize = true;
 		} else if(i < argc-1) {
 		//Parameters with 1 argument
 			if( (strcmp( argv[i], "-f" ) == 0) || (strcmp( argv[i], "--input-file" ) == 0) ) {
@@ -78,9 +176,45 @@ void ParseCommandLine(int argc, char* argv[])
 			} else if( (strcmp( argv[i], "-o" ) == 0) || (strcmp( argv[i], "--output-file" ) == 0) ) {
 				ps2_output_file = argv[++i];
 			} else if( (strcmp( argv[i], "-m" ) == 0) || (strcmp( argv[i], "--mesh-index" ) == 0) ) {
-				obj_mesh_index = atoi(argv[++i]);
+				options.mesh_index = atoi(argv[++i]);
 			} else if( (strcmp( argv[i], "-s" ) == 0) || (strcmp( argv[i], "--scale-factor" ) == 0) ) {
-				obj_scale_factor = static_cast<float>(atof(argv[++i]));
+				options.scale_factor = static_cast<float>(atof(argv[++i]));
+			} else if( (strcmp( argv[i], "-b" ) == 0) || (strcmp( argv[i], "--batch" ) == 0) ) {
+				batch_manifest = argv[++i];
+			} else if( (strcmp( argv[i], "-d" ) == 0) || (strcmp( argv[i], "--input-dir" ) == 0) ) {
+				batch_input_dir = argv[++i];
+			} else if( strcmp( argv[i], "--output-dir" ) == 0 ) {
+				batch_output_dir = argv[++i];
+			} else if( (strcmp( argv[i], "-j" ) == 0) || (strcmp( argv[i], "--jobs" ) == 0) ) {
+				options.jobs = atoi(argv[++i]);
+			} else if( strcmp( argv[i], "--prefetch" ) == 0 ) {
+				batch_prefetch = atoi(argv[++i]);
+			} else if( (strcmp( argv[i], "-a" ) == 0) || (strcmp( argv[i], "--anim-frame" ) == 0) ) {
+				options.anim_frames.push_back(argv[++i]);
+			} else if( strcmp( argv[i], "--frame-time" ) == 0 ) {
+				options.frame_time = atoi(argv[++i]);
+			} else if( strcmp( argv[i], "--cache-dir" ) == 0 ) {
+				cache_dir = argv[++i];
+			} else if( strcmp( argv[i], "--max-vertices" ) == 0 ) {
+				options.max_vertices = atoi(argv[++i]);
+				if(options.max_vertices < 3) {
+					std::cout << "Invalid vertex count \"" << argv[i] << "\" (must be at least 3)." << std::endl << std::endl;
+					PrintHelp(argv[0]);
+					exit(1);
+				}
+			} else if( strcmp( argv[i], "--filter" ) == 0 ) {
+				++i;
+				if( strcmp( argv[i], "box" ) == 0 ) {
+					options.texture_filter = GhulbusUtil::GB_RESAMPLE_BOX;
+				} else if( strcmp( argv[i], "bilinear" ) == 0 ) {
+					options.texture_filter = GhulbusUtil::GB_RESAMPLE_BILINEAR;
+				} else if( strcmp( argv[i], "lanczos" ) == 0 ) {
+					options.texture_filter = GhulbusUtil::GB_RESAMPLE_LANCZOS3;
+				} else {
+					std::cout << "Invalid filter \"" << argv[i] << "\"." << std::endl << std::endl;
+					PrintHelp(argv[0]);
+					exit(1);
+				}
 			} else {
 				std::cout << "Invalid argument." << std::endl << std::endl;
 				PrintHelp(argv[0]);
@@ -95,162 +229,496 @@ void ParseCommandLine(int argc, char* argv[])
 }
 
 /** Load the obj file
+ * @param[in,out] obj_file Loader that receives the file contents
+ * @param[in] fname Path to the obj file
+ * @param[in] opt Conversion settings
+ * @param[out] log Destination for messages
+ * @throw Ghulbus::gbException GB_FAILED indicates that the file could not be used
  */
-OBJ_FileLoader* LoadOBJFile()
+void LoadOBJFile(OBJ_FileLoader& obj_file, char const* fname, ConversionOptions const& opt, std::ostream& log)
 {
-	OBJ_FileLoader* ret = NULL;
-	if(verbose_output)
-		std::cout << " * Reading OBJ file \"" << obj_input_file << "\"...";
+	if(opt.verbose)
+		log << " * Reading OBJ file \"" << fname << "\"...";
+	//without scaling, vertex data can be stored in the icon's own 4.12 fixed point format:
+	OBJ_Mesh::STORAGE const storage = (opt.scale_factor != 0.0f) ? OBJ_AttributeArray::STORAGE_FLOAT :
+	                                                               OBJ_AttributeArray::STORAGE_FIXED16;
 	try {
-		ret = new OBJ_FileLoader(obj_input_file);
-	} catch(Ghulbus::gbException e) {
-		std::cout << "\nFile read error: \"" << obj_input_file << "\"" << std::endl;
-		exit(1);
+		obj_file.Load(fname, storage);
+	} catch(Ghulbus::gbException&) {
+		log << "\nFile read error: \"" << fname << "\"" << std::endl;
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "File read error" ) );
 	}
-	if(verbose_output)
-		std::cout << "done." << std::endl;
+	if(opt.verbose)
+		log << "done." << std::endl;
 
-	if(obj_mesh_index >= ret->GetNMeshes()) {
-		std::cout << "Invalid mesh index. Index given: " << obj_mesh_index << "; Maximum allowed for \"" 
-			<< obj_input_file << "\": " << (ret->GetNMeshes() - 1) << std::endl;
-		exit(1);
+	if(opt.mesh_index >= obj_file.GetNMeshes()) {
+		log << "Invalid mesh index. Index given: " << opt.mesh_index << "; Maximum allowed for \"" 
+			<< fname << "\": " << (obj_file.GetNMeshes() - 1) << std::endl;
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Invalid mesh index" ) );
+	}
+}
+
+/** Animation frames read by LoadAnimationFrames()
+ */
+struct AnimationFrameJob {
+	std::vector<std::string> const* files;		///< paths to the obj files
+	std::vector<OBJ_FileLoader*>* loaders;		///< one loader per file
+	ConversionOptions const* options;			///< conversion settings
+	std::vector<std::string> errors;			///< error message per file; empty on success
+};
+
+/** Worker function for LoadAnimationFrames()
+ */
+void LoadAnimationFrame(int item, int, void* user)
+{
+	AnimationFrameJob& job = *static_cast<AnimationFrameJob*>(user);
+	char const* fname = (*job.files)[item].c_str();
+	OBJ_FileLoader& obj_file = *(*job.loaders)[item];
+	OBJ_Mesh::STORAGE const storage = (job.options->scale_factor != 0.0f) ? OBJ_AttributeArray::STORAGE_FLOAT :
+	                                                                        OBJ_AttributeArray::STORAGE_FIXED16;
+	try {
+		obj_file.Load(fname, storage);
+	} catch(Ghulbus::gbException&) {
+		job.errors[item] = std::string("File read error: \"") + fname + "\"";
+		return;
+	} catch(std::bad_alloc&) {
+		job.errors[item] = std::string("Out of memory while reading \"") + fname + "\"";
+		return;
+	}
+	if(job.options->mesh_index >= obj_file.GetNMeshes()) {
+		job.errors[item] = std::string("Invalid mesh index for \"") + fname + "\"";
 	}
-	return ret;
+}
+
+/** Load the obj files of the animation shapes after the first, in parallel
+ * @param[in,out] ctx Conversion context; receives the files in ctx.anim_files
+ * @param[in] opt Conversion settings
+ * @param[out] log Destination for messages
+ * @throw Ghulbus::gbException GB_FAILED indicates that a file could not be used
+ * @throw std::bad_alloc
+ */
+void LoadAnimationFrames(ConversionContext& ctx, ConversionOptions const& opt, std::ostream& log)
+{
+	if(opt.verbose)
+		log << " * Reading " << opt.anim_frames.size() << " animation frames...";
+	while(ctx.anim_files.size() < opt.anim_frames.size()) {
+		ctx.anim_files.push_back(new OBJ_FileLoader);
+	}
+	AnimationFrameJob job;
+	job.files   = &opt.anim_frames;
+	job.loaders = &ctx.anim_files;
+	job.options = &opt;
+	job.errors.resize(opt.anim_frames.size());
+	GhulbusUtil::gbThreadPool pool(opt.jobs);
+	pool.Run(static_cast<int>(opt.anim_frames.size()), LoadAnimationFrame, &job);
+	bool failed = false;
+	for(size_t i=0; i<job.errors.size(); i++) {
+		if(!job.errors[i].empty()) {
+			log << ((failed || !opt.verbose) ? "" : "\n") << job.errors[i] << std::endl;
+			failed = true;
+		}
+	}
+	if(failed) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Animation frame could not be read" ) );
+	}
+	if(opt.verbose)
+		log << "done." << std::endl;
 }
 
 /** Print a list of all meshes contained in an obj file
  * @param[in] obj_file Working loader to the file to list
+ * @param[in] fname Path to the obj file
+ * @param[out] log Destination for messages
  */
-void ListOBJFile(OBJ_FileLoader const* obj_file)
+void ListOBJFile(OBJ_FileLoader const& obj_file, char const* fname, std::ostream& log)
 {
-	std::cout << " * Parsing OBJ file \"" << obj_input_file << "\" contents...\n";
-	std::cout << " **  Found " << obj_file->GetNMeshes() << " meshes: " << std::endl;
-	for(int i=0; i<obj_file->GetNMeshes(); ++i) {
-		OBJ_Mesh const* tmp = obj_file->GetMesh(i);
-		std::cout << " **   #" << i << ": " << tmp->GetName() << " - " 
+	log << " * Parsing OBJ file \"" << fname << "\" contents...\n";
+	log << " **  Found " << obj_file.GetNMeshes() << " meshes: " << std::endl;
+	for(int i=0; i<obj_file.GetNMeshes(); ++i) {
+		OBJ_Mesh const* tmp = obj_file.GetMesh(i);
+		log << " **   #" << i << ": " << tmp->GetName() << " - " 
 			<< tmp->GetNFaces() << " Triangles, " << tmp->GetNVertices() << " Vertices\n";
 	}
-	std::cout << " *  done." << std::endl;
+	log << " *  done." << std::endl;
 }
 
 /** Helper function: Is f a path to a BMP file?
  */
 bool IsBMP(char const* f)
 {
-	//check for .bmp ending:
+	//check for .bmp ending; the file itself is read through the file backend by the loader:
 	int len = static_cast<int>(strlen(f));
-	if( (f[len-3] == 'B' || f[len-3] == 'b') && 
+	return (len >= 3) &&
+		(f[len-3] == 'B' || f[len-3] == 'b') && 
 		(f[len-2] == 'M' || f[len-2] == 'm') && 
-		(f[len-1] == 'P' || f[len-1] == 'p') ) {
-			GhulbusUtil::gbImageType_BMP_T checker;
-			std::ifstream tmp(f, std::ios_base::in | std::ios_base::binary);
-			return checker.CheckFile(tmp);
-	}
-	return false;
+		(f[len-1] == 'P' || f[len-1] == 'p');
 }
 
-/** Load a texture file
+/** Load a texture file and convert it for use with PS2Icon::SetTextureData()
+ * @param[in,out] ctx Conversion context; receives the texture in ctx.texture_data
+ * @param[in] fname Path to the texture file
+ * @param[in] opt Conversion settings
+ * @param[out] log Destination for messages
+ * @throw Ghulbus::gbException GB_FAILED indicates that the file could not be used
+ * @note Textures of other sizes than 128x128 are resampled.
  */
-GhulbusUtil::gbImageLoader* LoadTexture()
+void LoadTexture(ConversionContext& ctx, char const* fname, ConversionOptions const& opt, std::ostream& log)
 {
-	GhulbusUtil::gbImageLoader* ret = NULL;
-	if(IsBMP(texture_input_file)) {
+	if(ctx.texture_file == fname) { return; }		//already converted for a previous item
+	GB_STATS_TIMER("texture.convert");
+	ctx.texture_file.clear();
+	if(IsBMP(fname)) {
 		try {
-			ret = new GhulbusUtil::gbImageLoader( texture_input_file, GhulbusUtil::gbImageType_BMP() );
-		} catch( Ghulbus::gbException e ) {
-			std::cout << "\"" << texture_input_file << "\" is no valid BMP file." << std::endl;
-			exit(1);
+			ctx.img_loader.Map( fname, &ctx.bmp_type, GhulbusUtil::gbImageLoader::ROWS_BOTTOM_UP );
+		} catch( Ghulbus::gbException& ) {
+			log << "\"" << fname << "\" is no valid BMP file." << std::endl;
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Invalid BMP file" ) );
 		}
 	} else {
 		try {
-			ret = new GhulbusUtil::gbImageLoader( texture_input_file, GhulbusUtil::gbImageType_TGA() );
-		} catch( Ghulbus::gbException e ) {
-			std::cout << "\"" << texture_input_file << "\" is no valid TGA file." << std::endl;
-			exit(1);
+			ctx.img_loader.Map( fname, &ctx.tga_type, GhulbusUtil::gbImageLoader::ROWS_BOTTOM_UP );
+		} catch( Ghulbus::gbException& ) {
+			log << "\"" << fname << "\" is no valid TGA file." << std::endl;
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Invalid TGA file" ) );
 		}
 	}
-	if( (ret->GetWidth() != 128) || (ret->GetHeight() != 128) ) {
-		std::cout << "Only Textures of size 128x128 allowed! \"" << texture_input_file << "\" has "
-			<< ret->GetWidth() << "x" << ret->GetHeight() << std::endl;
-		exit(1);
+	//icon textures are stored bottom row first; the loader already delivers the rows in that order:
+	ctx.texture_data.resize(128*128);
+	if( (ctx.img_loader.GetWidth() == 128) && (ctx.img_loader.GetHeight() == 128) ) {
+		ctx.img_loader.GetImageData32(&ctx.texture_data[0]);
+	} else {
+		if(opt.verbose)
+			log << " * Resampling texture \"" << fname << "\" from "
+				<< ctx.img_loader.GetWidth() << "x" << ctx.img_loader.GetHeight() << " to 128x128" << std::endl;
+		try {
+			GhulbusUtil::ResampleImage(ctx.img_loader, &ctx.texture_data[0], 128, 128,
+			                           opt.texture_filter, opt.gamma_correct);
+		} catch( Ghulbus::gbException& ) {
+			log << "\"" << fname << "\" could not be resampled." << std::endl;
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Texture could not be resampled" ) );
+		}
 	}
-	return ret;
+	ctx.texture_file = fname;
+}
+
+/** Run the geometry optimization stage
+ * @param[in,out] optimizer Receives the optimized geometry
+ * @param[in] mesh The mesh to convert
+ * @param[in] scale_factor Scale factor applied to the geometry
+ * @param[in] opt Conversion settings
+ * @param[out] log Destination for messages
+ * @throw std::bad_alloc
+ */
+void OptimizeGeometry(PS2MeshOptimizer& optimizer, OBJ_Mesh const& mesh, float scale_factor,
+                      ConversionOptions const& opt, std::ostream& log)
+{
+	GB_STATS_TIMER("geometry.optimize");
+	optimizer.SetGeometry(mesh, scale_factor);
+	int const n_vertices = optimizer.GetNVertices();
+	if(opt.optimize) {
+		int const n = optimizer.RemoveDegenerateTriangles();
+		if(opt.verbose)
+			log << "\n    Removed " << n << " degenerate triangles ...";
+	}
+	if((opt.max_vertices > 0) && (optimizer.GetNVertices() > opt.max_vertices)) {
+		int const n = optimizer.Decimate(opt.max_vertices);
+		//quantization may collapse triangles that were thinned out by the decimation:
+		int const n_degenerate = optimizer.RemoveDegenerateTriangles();
+		if(opt.verbose)
+			log << "\n    Decimation removed " << (n + n_degenerate) << " triangles ...";
+		if(optimizer.GetNVertices() > opt.max_vertices) {
+			log << "\n!WARNING! Mesh could only be reduced to " << optimizer.GetNVertices()
+			    << " vertices.\n    ";
+		}
+	}
+	if(opt.optimize) {
+		optimizer.ReorderTriangles();
+	}
+	if(opt.verbose)
+		log << "\n    Vertex count " << n_vertices << " -> " << optimizer.GetNVertices() << " ...";
 }
 
 /** Write a PS2Icon file
+ * @param[in,out] ctx Conversion context holding the loaded obj file and texture
+ * @param[in] item The item to convert
+ * @param[in] opt Conversion settings
+ * @param[out] log Destination for messages
+ * @throw Ghulbus::gbException GB_FAILED indicates a file access error
  */
-void WriteOutputFile(OBJ_FileLoader const* obj_file, GhulbusUtil::gbImageLoader* img_loader)
+void WriteOutputFile(ConversionContext& ctx, BatchItem const& item, ConversionOptions const& opt, std::ostream& log)
 {
-	PS2Icon ps2_icon;
-	if(img_loader) {
-		if(verbose_output)
-			std::cout << " * Copying texture data from \"" << texture_input_file << "\"...";
-		unsigned int* tmp = new unsigned int[img_loader->GetWidth() * img_loader->GetHeight()];
-		img_loader->FlipV();
-		img_loader->GetImageData32(tmp);
-		ps2_icon.SetTextureData(tmp);
-		delete[] tmp;
-		if(verbose_output)
-			std::cout << "done." << std::endl;
-	}
-	OBJ_Mesh const* tmp = obj_file->GetMesh(obj_mesh_index);
-	if(verbose_output)
-		std::cout << " * Copying geometry data from \"" << obj_input_file << "\": Mesh #" << obj_mesh_index
+	PS2Icon& ps2_icon = ctx.ps2_icon;
+	ps2_icon.Clear();
+	ps2_icon.SetTextureEncoding(opt.texture_encoding);
+	if(!item.texture.empty()) {
+		if(opt.verbose)
+			log << " * Copying texture data from \"" << item.texture << "\"...";
+		ps2_icon.SetTextureData(&ctx.texture_data[0]);
+		if(opt.verbose)
+			log << "done." << std::endl;
+	}
+	OBJ_Mesh const* tmp = ctx.obj_file.GetMesh(opt.mesh_index);
+	if(opt.verbose)
+		log << " * Copying geometry data from \"" << item.input << "\": Mesh #" << opt.mesh_index
 			<< " - " << tmp->GetName() << "...";
-	if(obj_scale_factor != 0.0f) {
-		if(verbose_output)
-			std::cout << "\n    Scale factor is " << obj_scale_factor << " ...";
-		if(obj_scale_factor < 0.0f) {
-			std::cout << "\n!WARNING! Scale factor is negative.\n    ";
+	if(opt.scale_factor != 0.0f) {
+		if(opt.verbose)
+			log << "\n    Scale factor is " << opt.scale_factor << " ...";
+		if(opt.scale_factor < 0.0f) {
+			log << "\n!WARNING! Scale factor is negative.\n    ";
 		}
-		ps2_icon.SetGeometry(*tmp, obj_scale_factor);
+	}
+	float const scale_factor = (opt.scale_factor != 0.0f) ? opt.scale_factor : 1.0f;
+	if(!opt.anim_frames.empty()) {
+		std::vector<OBJ_Mesh const*> shapes(1, tmp);
+		for(size_t i=0; i<opt.anim_frames.size(); i++) {
+			shapes.push_back(ctx.anim_files[i]->GetMesh(opt.mesh_index));
+		}
+		if(opt.verbose)
+			log << "\n    Animation with " << shapes.size() << " shapes ...";
+		try {
+			ps2_icon.SetAnimation(&shapes[0], static_cast<int>(shapes.size()), scale_factor, opt.frame_time);
+		} catch(Ghulbus::gbException&) {
+			log << "\nAnimation frames do not have the faces of \"" << item.input << "\"" << std::endl;
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Animation topology mismatch" ) );
+		}
+	} else if(opt.optimize || (opt.max_vertices > 0)) {
+		OptimizeGeometry(ctx.mesh_optimizer, *tmp, scale_factor, opt, log);
+		PS2MeshOptimizer const& mesh = ctx.mesh_optimizer;
+		ps2_icon.SetGeometry(mesh.GetPositions(), mesh.GetNormals(), mesh.GetTextureCoords(), mesh.GetNVertices());
 	} else {
-		ps2_icon.SetGeometry(*tmp);
+		GB_STATS_TIMER("geometry.convert");
+		ps2_icon.SetGeometry(*tmp, scale_factor);
 	}
-	if(verbose_output)
-		std::cout << "done." << std::endl;
+	if(opt.verbose)
+		log << "done." << std::endl;
+	if(opt.verbose && (opt.texture_encoding != PS2Icon::TEXTURE_AS_HEADER))
+		log << " * Texture type is 0x" << std::hex << ps2_icon.GetTextureType() << std::dec << std::endl;
 	
-	if(verbose_output)
-		std::cout << " * Writing output to \"" << ps2_output_file << "\"...";
+	if(opt.verbose)
+		log << " * Writing output to \"" << item.output << "\"...";
 	try {
-		ps2_icon.WriteFile(ps2_output_file);
-	} catch(Ghulbus::gbException e) {
-		std::cout << "\nError while writing to \"" << ps2_output_file << "\"" << std::endl;
+		ps2_icon.WriteFile(item.output.c_str());
+	} catch(Ghulbus::gbException&) {
+		log << "\nError while writing to \"" << item.output << "\"" << std::endl;
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Error while writing output file" ) );
+	}
+	if(opt.verbose)
+		log << "done." << std::endl;
+}
+
+/** Compute the cache key of a conversion
+ * @param[in] item The item to convert
+ * @param[in] opt Conversion settings
+ * @return The key, covering the contents of all input files and all settings that affect the output
+ * @throw Ghulbus::gbException GB_FAILED indicates that an input file could not be read
+ */
+ConversionCache::Key_T GetCacheKey(BatchItem const& item, ConversionOptions const& opt)
+{
+	GhulbusUtil::gbHash64 hash;
+	//change the version whenever the output for the same input changes:
+	ConversionCache::AddString(hash, "obj_to_ps2icon 1");
+	ConversionCache::AddFile(hash, item.input.c_str());
+	ConversionCache::AddString(hash, item.texture.empty() ? "" : "texture");
+	if(!item.texture.empty()) {
+		ConversionCache::AddFile(hash, item.texture.c_str());
+	}
+	for(size_t i=0; i<opt.anim_frames.size(); i++) {
+		ConversionCache::AddFile(hash, opt.anim_frames[i].c_str());
+	}
+	int const settings[] = { opt.mesh_index, static_cast<int>(opt.texture_encoding), static_cast<int>(opt.texture_filter),
+	                         opt.gamma_correct ? 1 : 0, opt.optimize ? 1 : 0, opt.max_vertices, opt.frame_time,
+	                         static_cast<int>(opt.anim_frames.size()) };
+	ConversionCache::AddData(hash, settings, sizeof(settings));
+	ConversionCache::AddData(hash, &opt.scale_factor, sizeof(opt.scale_factor));
+	return hash.GetDigest();
+}
+
+/** Perform all steps of a single conversion
+ * @param[in,out] ctx Conversion context that is reused between items
+ * @param[in] item The item to convert; if no output is given, no file is written
+ * @param[in] opt Conversion settings
+ * @param[out] log Destination for messages
+ * @throw Ghulbus::gbException GB_FAILED indicates that the conversion failed
+ * @throw std::bad_alloc
+ */
+void ConvertItem(ConversionContext& ctx, BatchItem const& item, ConversionOptions const& opt, std::ostream& log)
+{
+	bool use_cache = opt.cache && (!item.output.empty()) && (!opt.list_obj_file);
+	ConversionCache::Key_T key = 0;
+	std::vector<std::string> outputs(1, item.output);
+	if(use_cache) {
+		try {
+			key = GetCacheKey(item, opt);
+		} catch(Ghulbus::gbException&) {
+			//missing inputs are reported by the conversion below
+			use_cache = false;
+		}
+		if(use_cache && opt.cache->Fetch(key, outputs)) {
+			if(opt.verbose)
+				log << " * Copied cached output to \"" << item.output << "\"" << std::endl;
+			return;
+		}
+	}
+
+	LoadOBJFile(ctx.obj_file, item.input.c_str(), opt, log);
+	if(!opt.anim_frames.empty()) {
+		LoadAnimationFrames(ctx, opt, log);
+	}
+
+	if(opt.list_obj_file) {
+		ListOBJFile(ctx.obj_file, item.input.c_str(), log);
+	}
+
+	if(!item.texture.empty()) {
+		LoadTexture(ctx, item.texture.c_str(), opt, log);
+	}
+	
+	if(!item.output.empty()) {
+		WriteOutputFile(ctx, item, opt, log);
+	}
+
+	if(use_cache) {
+		try {
+			opt.cache->Store(key, outputs);
+		} catch(Ghulbus::gbException&) {
+			log << "!WARNING! Output of \"" << item.input << "\" could not be stored in the cache." << std::endl;
+		}
+	}
+}
+
+/** Collect the items of a batch conversion from manifest and input directory
+ * @param[out] items Receives the items to convert
+ */
+void CollectBatchItems(std::vector<BatchItem>& items)
+{
+	try {
+		if(batch_manifest) {
+			ReadBatchManifest(batch_manifest, items);
+		}
+		if(batch_input_dir) {
+			std::vector<std::string> files;
+			ListDirectory(batch_input_dir, ".obj", files);
+			for(std::vector<std::string>::const_iterator it = files.begin(); it != files.end(); ++it) {
+				BatchItem item;
+				item.input = *it;
+				items.push_back(item);
+			}
+		}
+	} catch(Ghulbus::gbException& e) {
+		std::cout << e.GetErrorString() << ": \"" << (batch_manifest ? batch_manifest : batch_input_dir) << "\"" << std::endl;
 		exit(1);
 	}
-	if(verbose_output)
-		std::cout << "done." << std::endl;
+	//fill in defaults:
+	for(std::vector<BatchItem>::iterator it = items.begin(); it != items.end(); ++it) {
+		if(it->output.empty()) {
+			if(batch_output_dir) {
+				it->output = JoinPath(batch_output_dir, ReplaceExtension(GetFileName(it->input), ".icn"));
+			} else {
+				it->output = ReplaceExtension(it->input, ".icn");
+			}
+		}
+		if(it->texture.empty() && texture_input_file) {
+			it->texture = texture_input_file;
+		}
+	}
 }
 
+/** Converts the items of a batch, using one ConversionContext per worker
+ */
+class OBJToPS2IconConverter: public BatchConverter {
+private:
+	ConversionOptions const& m_options;				///< settings for all items
+	std::vector<ConversionContext*> m_contexts;		///< one context per worker
+public:
+	/** Constructor
+	 * @param[in] opt Settings for all items; must outlive the converter
+	 */
+	explicit OBJToPS2IconConverter(ConversionOptions const& opt): m_options(opt) {}
+	~OBJToPS2IconConverter() {
+		for(size_t i=0; i<m_contexts.size(); i++) { delete m_contexts[i]; }
+	}
+	void Prepare(int n_workers) {
+		while(static_cast<int>(m_contexts.size()) < n_workers) {
+			m_contexts.push_back(new ConversionContext);
+		}
+	}
+	void Convert(BatchItem const& item, int worker, std::ostream& log) {
+		ConvertItem(*m_contexts[worker], item, m_options, log);
+	}
+};
+
 int main(int argc, char* argv[])
 {
 	ParseCommandLine(argc, argv);
 
-	if(!obj_input_file) {
+	bool const batch_mode = (batch_manifest || batch_input_dir);
+	if(batch_mode && (obj_input_file || ps2_output_file)) {
+		std::cout << "Batch mode can not be combined with -f or -o." << std::endl << std::endl;
+		PrintHelp(argv[0]);
+		exit(1);
+	}
+	if(batch_mode && (!options.anim_frames.empty())) {
+		std::cout << "Batch mode can not be combined with -a." << std::endl << std::endl;
+		PrintHelp(argv[0]);
+		exit(1);
+	}
+	if((!options.anim_frames.empty()) && (options.optimize || (options.max_vertices > 0))) {
+		std::cout << "Animations can not be combined with -O or --max-vertices." << std::endl << std::endl;
+		PrintHelp(argv[0]);
+		exit(1);
+	}
+	if(options.frame_time < 1) {
+		std::cout << "Invalid frame time." << std::endl << std::endl;
+		PrintHelp(argv[0]);
+		exit(1);
+	}
+	if((!obj_input_file) && (!batch_mode)) {
 		std::cout << "No input file specified." << std::endl << std::endl;
 		PrintHelp(argv[0]);
 		exit(1);
 	}
 	std::cout << "OBJ to PS2Icon Converter  V-1.0\n by Ghulbus Inc.  (http://www.ghulbus-inc.de/)\n" << std::endl;
-	if((!list_obj_file) && (!ps2_output_file)) { ps2_output_file = "default.icn"; }
-
-	OBJ_FileLoader* obj_file = LoadOBJFile();
 
-	if(list_obj_file) {
-		ListOBJFile(obj_file);
+	ConversionCache cache;
+	if(cache_dir) {
+		try {
+			cache.Open(cache_dir);
+		} catch(Ghulbus::gbException& e) {
+			std::cout << e.GetErrorString() << ": \"" << cache_dir << "\"" << std::endl;
+			exit(1);
+		}
+		options.cache = &cache;
 	}
 
-	GhulbusUtil::gbImageLoader* img_loader = NULL;
-	if(texture_input_file) {
-		img_loader = LoadTexture();
-	}
-	
-	if(ps2_output_file) {
-		WriteOutputFile(obj_file, img_loader);
+	if(batch_mode) {
+		std::vector<BatchItem> items;
+		CollectBatchItems(items);
+		OBJToPS2IconConverter converter(options);
+		BatchReport report;
+		try {
+			RunBatch(items, converter, options.jobs, std::cout, report, batch_prefetch);
+		} catch(Ghulbus::gbException& e) {
+			std::cout << e.GetErrorString() << std::endl;
+			return 1;
+		}
+		report.Print(std::cout);
+		return (report.GetNFailed() > 0) ? 1 : 0;
 	}
 
-	delete img_loader;
-	delete obj_file;
+	if((!options.list_obj_file) && (!ps2_output_file)) { ps2_output_file = "default.icn"; }
+
+	BatchItem item;
+	item.input = obj_input_file;
+	if(ps2_output_file)    { item.output  = ps2_output_file; }
+	if(texture_input_file) { item.texture = texture_input_file; }
+
+	ConversionContext ctx;
+	try {
+		ConvertItem(ctx, item, options, std::cout);
+	} catch(Ghulbus::gbException&) {
+		exit(1);
+	}
 
 	std::cout << "Success :)" << std::endl;
 
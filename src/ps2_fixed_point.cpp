@@ -0,0 +1,89 @@
+/**
+ * @file src/ps2_fixed_point.cpp
+ *
+ * @brief Implementation of the fixed point block conversionsbuild_header/
+ */
+#include "../include/ps2_fixed_point.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#	define PS2_FIXED_POINT_SSE2
+#	include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#	define PS2_FIXED_POINT_NEON
+#	include <arm_neon.h>
+#endif
+
+/* Both kernels handle two coordinate sets per iteration. Sets are moved with 4-wide
+ * loads and stores whose fourth lane overlaps the following set; the loops therefore
+ * stop while at least one more set remains, which is then handled by the scalar tail.
+ * Multiplying by 1/4096 is exact, so the vector results match the scalar functions.
+ */
+
+void PS2_UnpackFixed16Coords(short const* src, float* dst, size_t n_coords)
+{
+	size_t i = 0;
+#if defined(PS2_FIXED_POINT_SSE2)
+	__m128 const scale = _mm_set1_ps(1.0f / 4096.0f);
+	for(; i + 2 < n_coords; i += 2) {
+		__m128i const v  = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i*4));
+		//sign extend to 32 bit:
+		__m128i const lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i const hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_ps(dst + i*3,     _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(dst + i*3 + 3, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+#elif defined(PS2_FIXED_POINT_NEON)
+	for(; i + 2 < n_coords; i += 2) {
+		int16x8_t const v = vld1q_s16(src + i*4);
+		float32x4_t const lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+		float32x4_t const hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+		vst1q_f32(dst + i*3,     vmulq_n_f32(lo, 1.0f / 4096.0f));
+		vst1q_f32(dst + i*3 + 3, vmulq_n_f32(hi, 1.0f / 4096.0f));
+	}
+#endif
+	for(; i < n_coords; i++) {
+		dst[i*3]     = PS2_Fixed16ToFloat(src[i*4]);
+		dst[i*3 + 1] = PS2_Fixed16ToFloat(src[i*4 + 1]);
+		dst[i*3 + 2] = PS2_Fixed16ToFloat(src[i*4 + 2]);
+	}
+}
+
+void PS2_PackFixed16Coords(float const* src, short* dst, size_t n_coords)
+{
+	size_t i = 0;
+#if defined(PS2_FIXED_POINT_SSE2)
+	__m128 const scale  = _mm_set1_ps(4096.0f);
+	__m128 const min    = _mm_set1_ps(-32768.0f);
+	__m128 const max    = _mm_set1_ps(32767.0f);
+	__m128i const mask  = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+	for(; i + 2 < n_coords; i += 2) {
+		//clamp before converting; max(NaN, min) yields min like the scalar version:
+		__m128 a = _mm_mul_ps(_mm_loadu_ps(src + i*3), scale);
+		__m128 b = _mm_mul_ps(_mm_loadu_ps(src + i*3 + 3), scale);
+		a = _mm_min_ps(_mm_max_ps(a, min), max);
+		b = _mm_min_ps(_mm_max_ps(b, min), max);
+		__m128i const v = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i*4), _mm_and_si128(v, mask));
+	}
+#elif defined(PS2_FIXED_POINT_NEON)
+	static short const mask_values[8] = { -1, -1, -1, 0, -1, -1, -1, 0 };
+	int16x8_t const mask = vld1q_s16(mask_values);
+	float32x4_t const min = vdupq_n_f32(-32768.0f);
+	for(; i + 2 < n_coords; i += 2) {
+		float32x4_t a = vmulq_n_f32(vld1q_f32(src + i*3), 4096.0f);
+		float32x4_t b = vmulq_n_f32(vld1q_f32(src + i*3 + 3), 4096.0f);
+		//NaN converts to 0 on NEON; map it to the minimum like the scalar version:
+		a = vbslq_f32(vceqq_f32(a, a), a, min);
+		b = vbslq_f32(vceqq_f32(b, b), b, min);
+		//the conversion to int32 and the narrowing both saturate:
+		int16x8_t const v = vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)), vqmovn_s32(vcvtq_s32_f32(b)));
+		vst1q_s16(dst + i*4, vandq_s16(v, mask));
+	}
+#endif
+	for(; i < n_coords; i++) {
+		dst[i*4]     = PS2_FloatToFixed16(src[i*3]);
+		dst[i*4 + 1] = PS2_FloatToFixed16(src[i*3 + 1]);
+		dst[i*4 + 2] = PS2_FloatToFixed16(src[i*3 + 2]);
+		dst[i*4 + 3] = 0;
+	}
+}
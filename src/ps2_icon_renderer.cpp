@@ -0,0 +1,438 @@
+/**
+ * @file src/ps2_icon_renderer.cpp
+ *
+ * @brief Implementation of the PS2IconRenderer classbuild_header/
+ */
+#include "../include/ps2_icon_renderer.hpp"
+#include "../gbLib/include/gbImageLoader.hpp"
+#include "../gbLib/include/gbStats.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#	define PS2_ICON_RENDERER_SSE2
+#	include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#	define PS2_ICON_RENDERER_NEON
+#	include <arm_neon.h>
+#endif
+
+/* The span loop of RenderTile() handles four pixels per iteration. Groups start at a
+ * multiple of 4 inside the tile, so they never leave the row of the tile buffers; lanes
+ * outside the span are masked. Attributes are evaluated as (row value + x * step) on all
+ * paths, and clamping before truncation matches the scalar conversions, so the vector
+ * paths draw the same image as the scalar code.
+ */
+
+static int const SUBPIXEL_BITS = 4;						///< fractional bits of fixed point screen coordinates
+static int const SUBPIXEL_ONE  = 1 << SUBPIXEL_BITS;	///< 1.0 in fixed point screen coordinates
+static float const FRAME_MARGIN = 0.05f;				///< free border around the icon, relative to the image size
+
+/** Helper function: converts a color channel to [0..255] with saturation
+ */
+inline unsigned int saturate_channel(float f) {
+	return (f >= 255.0f) ? 255u : ((f <= 0.0f) ? 0u : static_cast<unsigned int>(f));
+}
+
+#if defined(PS2_ICON_RENDERER_SSE2)
+/** Helper function: evaluates an attribute plane for four pixels of a row
+ */
+inline __m128 interpolate(float row_value, float step, __m128 fx) {
+	return _mm_add_ps(_mm_set1_ps(row_value), _mm_mul_ps(fx, _mm_set1_ps(step)));
+}
+
+/** Helper function: clamps to [0..max] and truncates to int
+ */
+inline __m128i clamp_truncate(__m128 f, float max) {
+	return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(f, _mm_setzero_ps()), _mm_set1_ps(max)));
+}
+
+/** Helper function: scales the lowest byte of each lane by the light, see saturate_channel()
+ */
+inline __m128i shade_channel(__m128i texel, __m128 light) {
+	__m128 const c = _mm_cvtepi32_ps(_mm_and_si128(texel, _mm_set1_epi32(0xFF)));
+	return clamp_truncate(_mm_mul_ps(c, light), 255.0f);
+}
+#elif defined(PS2_ICON_RENDERER_NEON)
+/** Helper function: evaluates an attribute plane for four pixels of a row
+ */
+inline float32x4_t interpolate(float row_value, float step, float32x4_t fx) {
+	return vaddq_f32(vdupq_n_f32(row_value), vmulq_n_f32(fx, step));
+}
+
+/** Helper function: clamps to [0..max] and truncates to unsigned int
+ */
+inline uint32x4_t clamp_truncate(float32x4_t f, float max) {
+	return vcvtq_u32_f32(vminq_f32(vmaxq_f32(f, vdupq_n_f32(0.0f)), vdupq_n_f32(max)));
+}
+
+/** Helper function: scales the lowest byte of each lane by the light, see saturate_channel()
+ */
+inline uint32x4_t shade_channel(uint32x4_t texel, float32x4_t light) {
+	float32x4_t const c = vcvtq_f32_u32(vandq_u32(texel, vdupq_n_u32(0xFF)));
+	return clamp_truncate(vmulq_f32(c, light), 255.0f);
+}
+#endif
+
+/** Helper function: normalizes a 3D vector; the null vector is left unchanged
+ */
+inline void normalize3(float* v) {
+	float const len = std::sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+	if(len > 0.0f) { v[0] /= len; v[1] /= len; v[2] /= len; }
+}
+
+PS2IconRenderer::PS2IconRenderer()
+	:m_width(0), m_height(0), m_background(0)
+{
+	IconSys defaults;
+	SetLights(defaults);
+	SetSize(128, 128);
+}
+
+void PS2IconRenderer::SetSize(int width, int height)
+{
+	if((width < 1) || (width > MAX_SIZE) || (height < 1) || (height > MAX_SIZE)) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
+	}
+	m_image.resize(static_cast<size_t>(width) * height);
+	m_width  = width;
+	m_height = height;
+	std::fill(m_image.begin(), m_image.end(), m_background);
+}
+
+int PS2IconRenderer::GetWidth() const {
+	return m_width;
+}
+
+int PS2IconRenderer::GetHeight() const {
+	return m_height;
+}
+
+void PS2IconRenderer::SetLights(IconSys const& icon_sys)
+{
+	SetLight(0, icon_sys.GetLight1Dir(), icon_sys.GetLight1Color());
+	SetLight(1, icon_sys.GetLight2Dir(), icon_sys.GetLight2Color());
+	SetLight(2, icon_sys.GetLight3Dir(), icon_sys.GetLight3Color());
+	SetAmbient(icon_sys.GetLightAmbientColor());
+}
+
+void PS2IconRenderer::SetLight(int index, IconSys::IconSys_LightVec const& dir, IconSys::IconSys_LightColor const& color)
+{
+	if((index < 0) || (index > 2)) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
+	}
+	m_lightDir[index][0] = dir.GetX();
+	m_lightDir[index][1] = dir.GetY();
+	m_lightDir[index][2] = dir.GetZ();
+	normalize3(m_lightDir[index]);
+	m_lightColor[index][0] = color.GetR();
+	m_lightColor[index][1] = color.GetG();
+	m_lightColor[index][2] = color.GetB();
+}
+
+void PS2IconRenderer::SetAmbient(IconSys::IconSys_LightColor const& color)
+{
+	m_ambient[0] = color.GetR();
+	m_ambient[1] = color.GetG();
+	m_ambient[2] = color.GetB();
+}
+
+void PS2IconRenderer::SetBackground(unsigned int color)
+{
+	m_background = color;
+}
+
+void PS2IconRenderer::Render(PS2Icon const& icon, int frame)
+{
+	GB_STATS_TIMER("preview.render");
+	int const shape = (frame < 0) ? 0 : icon.GetFrameShape(frame);
+	if(shape >= icon.GetNShapes()) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Frame references a missing shape" ) );
+	}
+	size_t const n_vertices = static_cast<size_t>(icon.GetNVertices());
+	size_t const n_shapes   = static_cast<size_t>(icon.GetNShapes());
+	//one spare element, so the fields are never empty:
+	m_positions.resize(n_vertices * 3 + 3);
+	m_allShapes.resize(n_vertices * n_shapes * 3 + 3);
+	m_normals.resize(n_vertices * 3 + 3);
+	m_texcoords.resize(n_vertices * 2 + 2);
+	m_colors.resize(n_vertices + 1);
+	m_texture.resize(128*128);
+	icon.GetVertexData(&m_positions[0], shape);
+	icon.GetVertexData(&m_allShapes[0], -1);
+	icon.GetNormalData(&m_normals[0]);
+	icon.GetVertexTextureData(&m_texcoords[0]);
+	icon.GetVertexColorData(&m_colors[0]);
+	icon.GetTextureData(&m_texture[0]);
+
+	SetupTriangles(static_cast<int>(n_vertices), static_cast<int>(n_shapes));
+	GB_STATS_COUNT("preview.triangles", m_triangles.size());
+
+	int const n_tiles_x = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+	for(size_t i=0; i<m_bins.size(); i++) {
+		RenderTile(static_cast<int>(i % n_tiles_x) * TILE_SIZE, static_cast<int>(i / n_tiles_x) * TILE_SIZE, m_bins[i]);
+	}
+}
+
+void PS2IconRenderer::SetupTriangles(int n_vertices, int n_shapes)
+{
+	//frame all shapes, keeping the aspect ratio:
+	float min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX;
+	for(size_t i=0; i<static_cast<size_t>(n_vertices) * n_shapes; i++) {
+		min_x = std::min(min_x, m_allShapes[i*3]);
+		max_x = std::max(max_x, m_allShapes[i*3]);
+		min_y = std::min(min_y, m_allShapes[i*3 + 1]);
+		max_y = std::max(max_y, m_allShapes[i*3 + 1]);
+	}
+	float const extent = std::max(max_x - min_x, max_y - min_y);
+	float const image_size = static_cast<float>(std::min(m_width, m_height)) * (1.0f - 2.0f * FRAME_MARGIN);
+	float const scale = (extent > 0.0f) ? (image_size / extent) : 1.0f;
+	float const center_x = (min_x + max_x) * 0.5f;
+	float const center_y = (min_y + max_y) * 0.5f;
+
+	int const n_tiles_x = (m_width  + TILE_SIZE - 1) / TILE_SIZE;
+	int const n_tiles_y = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+	m_bins.resize(n_tiles_x * n_tiles_y);
+	for(size_t i=0; i<m_bins.size(); i++) { m_bins[i].clear(); }
+	m_triangles.clear();
+	m_triangles.reserve(n_vertices / 3);
+
+	for(int t=0; t<n_vertices/3; t++) {
+		int fx[3], fy[3];
+		float attr[3][6];
+		for(int k=0; k<3; k++) {
+			size_t const v = static_cast<size_t>(t) * 3 + k;
+			//screen space in fixed point; y points down on screen as in icon space:
+			float const sx = (m_positions[v*3]     - center_x) * scale + static_cast<float>(m_width)  * 0.5f;
+			float const sy = (m_positions[v*3 + 1] - center_y) * scale + static_cast<float>(m_height) * 0.5f;
+			fx[k] = static_cast<int>(std::floor(sx * SUBPIXEL_ONE + 0.5f));
+			fy[k] = static_cast<int>(std::floor(sy * SUBPIXEL_ONE + 0.5f));
+			//per vertex lighting, modulated by the vertex color:
+			float n[3] = { m_normals[v*3], m_normals[v*3 + 1], m_normals[v*3 + 2] };
+			normalize3(n);
+			float light[3] = { m_ambient[0], m_ambient[1], m_ambient[2] };
+			for(int l=0; l<3; l++) {
+				float const d = n[0]*m_lightDir[l][0] + n[1]*m_lightDir[l][1] + n[2]*m_lightDir[l][2];
+				if(d > 0.0f) {
+					light[0] += d * m_lightColor[l][0];
+					light[1] += d * m_lightColor[l][1];
+					light[2] += d * m_lightColor[l][2];
+				}
+			}
+			unsigned int const c = m_colors[v];
+			attr[k][0] = m_positions[v*3 + 2];
+			attr[k][1] = m_texcoords[v*2]     * 128.0f;
+			attr[k][2] = m_texcoords[v*2 + 1] * 128.0f;
+			attr[k][3] = light[0] * static_cast<float>( c        & 0xFF) / 255.0f;
+			attr[k][4] = light[1] * static_cast<float>((c >> 8)  & 0xFF) / 255.0f;
+			attr[k][5] = light[2] * static_cast<float>((c >> 16) & 0xFF) / 255.0f;
+		}
+		int area = (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fy[1] - fy[0]) * (fx[2] - fx[0]);
+		if(area == 0) { continue; }
+		if(area < 0) {
+			//no culling; flip the winding so that the inside is positive for all edges:
+			std::swap(fx[1], fx[2]);
+			std::swap(fy[1], fy[2]);
+			for(int a=0; a<6; a++) { std::swap(attr[1][a], attr[2][a]); }
+			area = -area;
+		}
+		Triangle tri;
+		tri.min_x = std::max(0,            (std::min(fx[0], std::min(fx[1], fx[2]))) >> SUBPIXEL_BITS);
+		tri.min_y = std::max(0,            (std::min(fy[0], std::min(fy[1], fy[2]))) >> SUBPIXEL_BITS);
+		tri.max_x = std::min(m_width  - 1, (std::max(fx[0], std::max(fx[1], fx[2]))) >> SUBPIXEL_BITS);
+		tri.max_y = std::min(m_height - 1, (std::max(fy[0], std::max(fy[1], fy[2]))) >> SUBPIXEL_BITS);
+		if((tri.min_x > tri.max_x) || (tri.min_y > tri.max_y)) { continue; }
+		int const half = SUBPIXEL_ONE / 2;
+		for(int e=0; e<3; e++) {
+			int const a = e, b = (e + 1) % 3;
+			int const dx = fx[b] - fx[a];
+			int const dy = fy[b] - fy[a];
+			tri.edge_a[e] = -dy * SUBPIXEL_ONE;
+			tri.edge_b[e] =  dx * SUBPIXEL_ONE;
+			tri.edge_c[e] = dx * (half - fy[a]) - dy * (half - fx[a]);
+			//top-left fill rule: pixels on other edges belong to the neighbouring triangle
+			bool const top_left = (dy < 0) || ((dy == 0) && (dx > 0));
+			if(!top_left) { tri.edge_c[e] -= 1; }
+		}
+		//attribute planes through the snapped corners, in pixel units:
+		float const x1 = static_cast<float>(fx[1] - fx[0]) / SUBPIXEL_ONE;
+		float const y1 = static_cast<float>(fy[1] - fy[0]) / SUBPIXEL_ONE;
+		float const x2 = static_cast<float>(fx[2] - fx[0]) / SUBPIXEL_ONE;
+		float const y2 = static_cast<float>(fy[2] - fy[0]) / SUBPIXEL_ONE;
+		float const inv_det = 1.0f / (x1 * y2 - x2 * y1);
+		float const ox = 0.5f - static_cast<float>(fx[0]) / SUBPIXEL_ONE;
+		float const oy = 0.5f - static_cast<float>(fy[0]) / SUBPIXEL_ONE;
+		for(int a=0; a<6; a++) {
+			float const d1 = attr[1][a] - attr[0][a];
+			float const d2 = attr[2][a] - attr[0][a];
+			float const ax = (d1 * y2 - d2 * y1) * inv_det;
+			float const ay = (d2 * x1 - d1 * x2) * inv_det;
+			tri.attr[a][0] = attr[0][a] + ax * ox + ay * oy;
+			tri.attr[a][1] = ax;
+			tri.attr[a][2] = ay;
+		}
+		int const index = static_cast<int>(m_triangles.size());
+		m_triangles.push_back(tri);
+		for(int ty=tri.min_y/TILE_SIZE; ty<=tri.max_y/TILE_SIZE; ty++) {
+			for(int tx=tri.min_x/TILE_SIZE; tx<=tri.max_x/TILE_SIZE; tx++) {
+				m_bins[ty * n_tiles_x + tx].push_back(index);
+			}
+		}
+	}
+}
+
+void PS2IconRenderer::RenderTile(int tile_x, int tile_y, std::vector<int> const& bin)
+{
+	GhulbusGraphics::GBCOLOR color[TILE_SIZE * TILE_SIZE];
+	float depth[TILE_SIZE * TILE_SIZE];
+	std::fill(color, color + TILE_SIZE * TILE_SIZE, m_background);
+	std::fill(depth, depth + TILE_SIZE * TILE_SIZE, FLT_MAX);
+	int const tile_w = std::min(static_cast<int>(TILE_SIZE), m_width  - tile_x);
+	int const tile_h = std::min(static_cast<int>(TILE_SIZE), m_height - tile_y);
+	unsigned int const* texture = &m_texture[0];
+
+	for(size_t i=0; i<bin.size(); i++) {
+		Triangle const& tri = m_triangles[bin[i]];
+		int const x0 = std::max(tri.min_x, tile_x), x1 = std::min(tri.max_x, tile_x + tile_w - 1);
+		int const y0 = std::max(tri.min_y, tile_y), y1 = std::min(tri.max_y, tile_y + tile_h - 1);
+		//the edge functions are linear, so checking the corners tells whether the area is covered completely:
+		bool covered = true;
+		for(int e=0; e<3; e++) {
+			int const a = tri.edge_a[e], b = tri.edge_b[e];
+			int const c = tri.edge_c[e] + ((a < 0) ? x1 : x0) * a + ((b < 0) ? y1 : y0) * b;
+			if(c < 0) { covered = false; }
+		}
+		for(int y=y0; y<=y1; y++) {
+			float const fy = static_cast<float>(y);
+			float base[6];
+			for(int a=0; a<6; a++) { base[a] = tri.attr[a][0] + fy * tri.attr[a][2]; }
+			int const row = (y - tile_y) * TILE_SIZE - tile_x;
+			int x = x0;
+#if defined(PS2_ICON_RENDERER_SSE2)
+			__m128i const lane = _mm_set_epi32(3, 2, 1, 0);
+			__m128i const first = _mm_set1_epi32(x0 - 1), last = _mm_set1_epi32(x1 + 1);
+			__m128i const alpha = _mm_set1_epi32(0xFF000000);
+			for(x = tile_x + ((x0 - tile_x) & ~3); x <= x1; x += 4) {
+				__m128i const xi = _mm_add_epi32(_mm_set1_epi32(x), lane);
+				__m128i mask = _mm_and_si128(_mm_cmpgt_epi32(xi, first), _mm_cmplt_epi32(xi, last));
+				if(!covered) {
+					__m128i e = _mm_setzero_si128();
+					for(int k=0; k<3; k++) {
+						int const a = tri.edge_a[k];
+						int const c = tri.edge_c[k] + x * a + y * tri.edge_b[k];
+						e = _mm_or_si128(e, _mm_add_epi32(_mm_set1_epi32(c), _mm_set_epi32(3*a, 2*a, a, 0)));
+					}
+					mask = _mm_and_si128(mask, _mm_cmpgt_epi32(e, _mm_set1_epi32(-1)));
+				}
+				//smaller z is closer; the viewer looks along the positive z axis
+				__m128 const fx = _mm_cvtepi32_ps(xi);
+				__m128 const z = interpolate(base[0], tri.attr[0][1], fx);
+				__m128 const old_depth = _mm_loadu_ps(depth + row + x);
+				mask = _mm_and_si128(mask, _mm_castps_si128(_mm_cmplt_ps(z, old_depth)));
+				if(_mm_movemask_epi8(mask) == 0) { continue; }
+				__m128 const u = interpolate(base[1], tri.attr[1][1], fx);
+				__m128 const v = interpolate(base[2], tri.attr[2][1], fx);
+				__m128i const tu = clamp_truncate(u, 127.0f);
+				__m128i const tv = clamp_truncate(v, 127.0f);
+				//icon textures are stored bottom row first, matching v pointing up:
+				int index[4];
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(index), _mm_add_epi32(_mm_slli_epi32(tv, 7), tu));
+				__m128i const texel = _mm_set_epi32(texture[index[3]], texture[index[2]], texture[index[1]], texture[index[0]]);
+				__m128i const red   = shade_channel(_mm_srli_epi32(texel, 16), interpolate(base[3], tri.attr[3][1], fx));
+				__m128i const green = shade_channel(_mm_srli_epi32(texel, 8),  interpolate(base[4], tri.attr[4][1], fx));
+				__m128i const blue  = shade_channel(texel,                     interpolate(base[5], tri.attr[5][1], fx));
+				__m128i const rgb = _mm_or_si128(_mm_or_si128(alpha, _mm_slli_epi32(red, 16)),
+				                                 _mm_or_si128(_mm_slli_epi32(green, 8), blue));
+				__m128i const old_color = _mm_loadu_si128(reinterpret_cast<__m128i const*>(color + row + x));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(color + row + x),
+				                 _mm_or_si128(_mm_and_si128(mask, rgb), _mm_andnot_si128(mask, old_color)));
+				__m128 const fmask = _mm_castsi128_ps(mask);
+				_mm_storeu_ps(depth + row + x, _mm_or_ps(_mm_and_ps(fmask, z), _mm_andnot_ps(fmask, old_depth)));
+			}
+#elif defined(PS2_ICON_RENDERER_NEON)
+			static int const lane_init[4] = { 0, 1, 2, 3 };
+			int32x4_t const lane = vld1q_s32(lane_init);
+			for(x = tile_x + ((x0 - tile_x) & ~3); x <= x1; x += 4) {
+				int32x4_t const xi = vaddq_s32(vdupq_n_s32(x), lane);
+				uint32x4_t mask = vandq_u32(vcgeq_s32(xi, vdupq_n_s32(x0)), vcleq_s32(xi, vdupq_n_s32(x1)));
+				if(!covered) {
+					int32x4_t e = vdupq_n_s32(0);
+					for(int k=0; k<3; k++) {
+						int const a = tri.edge_a[k];
+						int const c = tri.edge_c[k] + x * a + y * tri.edge_b[k];
+						e = vorrq_s32(e, vmlaq_n_s32(vdupq_n_s32(c), lane, a));
+					}
+					mask = vandq_u32(mask, vcgeq_s32(e, vdupq_n_s32(0)));
+				}
+				//smaller z is closer; the viewer looks along the positive z axis
+				float32x4_t const fx = vcvtq_f32_s32(xi);
+				float32x4_t const z = interpolate(base[0], tri.attr[0][1], fx);
+				float32x4_t const old_depth = vld1q_f32(depth + row + x);
+				mask = vandq_u32(mask, vcltq_f32(z, old_depth));
+				if((vgetq_lane_u32(mask, 0) | vgetq_lane_u32(mask, 1) | vgetq_lane_u32(mask, 2) | vgetq_lane_u32(mask, 3)) == 0) {
+					continue;
+				}
+				float32x4_t const u = interpolate(base[1], tri.attr[1][1], fx);
+				float32x4_t const v = interpolate(base[2], tri.attr[2][1], fx);
+				uint32x4_t const tu = clamp_truncate(u, 127.0f);
+				uint32x4_t const tv = clamp_truncate(v, 127.0f);
+				//icon textures are stored bottom row first, matching v pointing up:
+				unsigned int index[4];
+				vst1q_u32(index, vaddq_u32(vshlq_n_u32(tv, 7), tu));
+				unsigned int const texels[4] = { texture[index[0]], texture[index[1]], texture[index[2]], texture[index[3]] };
+				uint32x4_t const texel = vld1q_u32(texels);
+				uint32x4_t const red   = shade_channel(vshrq_n_u32(texel, 16), interpolate(base[3], tri.attr[3][1], fx));
+				uint32x4_t const green = shade_channel(vshrq_n_u32(texel, 8),  interpolate(base[4], tri.attr[4][1], fx));
+				uint32x4_t const blue  = shade_channel(texel,                   interpolate(base[5], tri.attr[5][1], fx));
+				uint32x4_t const rgb = vorrq_u32(vorrq_u32(vdupq_n_u32(0xFF000000u), vshlq_n_u32(red, 16)),
+				                                 vorrq_u32(vshlq_n_u32(green, 8), blue));
+				uint32x4_t const old_color = vld1q_u32(reinterpret_cast<unsigned int const*>(color + row + x));
+				vst1q_u32(reinterpret_cast<unsigned int*>(color + row + x), vbslq_u32(mask, rgb, old_color));
+				vst1q_f32(depth + row + x, vbslq_f32(mask, z, old_depth));
+			}
+#endif
+			for(; x<=x1; x++) {
+				int const e0 = tri.edge_c[0] + x * tri.edge_a[0] + y * tri.edge_b[0];
+				int const e1 = tri.edge_c[1] + x * tri.edge_a[1] + y * tri.edge_b[1];
+				int const e2 = tri.edge_c[2] + x * tri.edge_a[2] + y * tri.edge_b[2];
+				float const fx = static_cast<float>(x);
+				float const z = base[0] + fx * tri.attr[0][1];
+				//smaller z is closer; the viewer looks along the positive z axis
+				if( (covered || ((e0 | e1 | e2) >= 0)) && (z < depth[row + x]) ) {
+					depth[row + x] = z;
+					float const u = base[1] + fx * tri.attr[1][1];
+					float const v = base[2] + fx * tri.attr[2][1];
+					float const r = base[3] + fx * tri.attr[3][1];
+					float const g = base[4] + fx * tri.attr[4][1];
+					float const b = base[5] + fx * tri.attr[5][1];
+					int const tu = std::min(std::max(static_cast<int>(u), 0), 127);
+					int const tv = std::min(std::max(static_cast<int>(v), 0), 127);
+					//icon textures are stored bottom row first, matching v pointing up:
+					unsigned int const texel = texture[tv * 128 + tu];
+					color[row + x] = 0xFF000000u |
+						(saturate_channel(static_cast<float>((texel >> 16) & 0xFF) * r) << 16) |
+						(saturate_channel(static_cast<float>((texel >> 8)  & 0xFF) * g) << 8)  |
+						 saturate_channel(static_cast<float>( texel        & 0xFF) * b);
+				}
+			}
+		}
+	}
+
+	for(int y=0; y<tile_h; y++) {
+		std::copy(color + y * TILE_SIZE, color + y * TILE_SIZE + tile_w,
+		          m_image.begin() + static_cast<size_t>(tile_y + y) * m_width + tile_x);
+	}
+}
+
+GhulbusGraphics::GBCOLOR const* PS2IconRenderer::GetImage() const {
+	return &m_image[0];
+}
+
+void PS2IconRenderer::WriteImage(std::vector<unsigned char>& out, bool rle) const {
+	GhulbusUtil::WriteImage(out, &m_image[0], m_width, m_height, false, rle);
+}
+
+void PS2IconRenderer::WriteFile(char const* fname, bool rle) const {
+	GhulbusUtil::WriteImage(fname, &m_image[0], m_width, m_height, false, rle);
+}
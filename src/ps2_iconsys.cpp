@@ -4,6 +4,11 @@
  * @brief Implementation of the icon.sys file loaderbuild_header/
  */
 #include "../include/ps2_iconsys.hpp"
+#include "../include/ps2_title_codec.hpp"
+#include "../gbLib/include/gbStats.hpp"
+#include "../gbLib/include/gbMappedFile.hpp"
+#include "../gbLib/include/gbFileBackend.hpp"
+#include <cstddef>
 #include <cstring>
 #include <climits>
 
@@ -21,124 +26,6 @@ bool IconSys::CheckValidity(IconSys::File_t const& f)
 	return true;
 }
 
-void IconSys::DecodeTitle(unsigned char const * str_in, char* str_out)
-{
-	unsigned char t1, t2;
-
-	for(int i=0; i<68; i+=2) {
-		t1 = str_in[i];		//each S-JIS character consists of two bytes
-		t2 = str_in[i+1];
-
-		switch(t1) {
-			case 0x00:
-				if(t2 == 0x00) {
-					str_out[i>>1] = '\0';
-					return;
-				} else {
-					str_out[i>>1] = '?';
-				}
-				break;
-			case 0x81:
-				if(t2 == 0x40) {
-					str_out[i>>1] = ' ';
-				} else if(t2 == 0x46) {
-					str_out[i>>1] = ':';
-				} else if(t2 == 0x5E) {
-					str_out[i>>1] = '/';
-				} else if(t2 == 0x69) {
-					str_out[i>>1] = '(';
-				} else if(t2 == 0x6A) {
-					str_out[i>>1] = ')';
-				} else if(t2 == 0x6D) {
-					str_out[i>>1] = '[';
-				} else if(t2 == 0x6E) {
-					str_out[i>>1] = ']';
-				} else if(t2 == 0x6F) {
-					str_out[i>>1] = '{';
-				} else if(t2 == 0x70) {
-					str_out[i>>1] = '}';
-				} else {
-					str_out[i>>1] = '?';
-				}
-				break;
-			case 0x82:
-				if((t2 >= 0x4f) && (t2 <= 0x7A)) {
-					//digits (0-9), capital letters (A-Z)
-					str_out[i>>1] = t2-31;
-				} else if( (t2 >= 0x81) && (t2 <= 0x9B) ) {
-					//lowercase letters (a-z)
-					str_out[i>>1] = t2-32;
-				} else if(t2 == 0x3F) {
-					str_out[i>>1] = ' ';
-				}  else {
-					str_out[i>>1] = '?';
-				}
-				break;			
-			default:
-				str_out[i>>1] = '?';
-				break;
-		}
-	}
-}
-
-void IconSys::EncodeTitle(char const* str_in, unsigned char* str_out) {
-	int sjis_count = 0;
-	for(size_t i=0; i<strlen(str_in); i++) {
-		switch(str_in[i]) {
-			case ' ':
-				str_out[sjis_count++] = 0x82;
-				str_out[sjis_count++] = 0x3F;
-				break;
-			case ':':
-				str_out[sjis_count++] = 0x81;
-				str_out[sjis_count++] = 0x46;
-				break;
-			case '/':
-				str_out[sjis_count++] = 0x81;
-				str_out[sjis_count++] = 0x5E;
-				break;
-			case '(':
-				str_out[sjis_count++] = 0x81;
-				str_out[sjis_count++] = 0x69;
-				break;
-			case ')':
-				str_out[sjis_count++] = 0x81;
-				str_out[sjis_count++] = 0x6A;
-				break;
-			case '[':
-				str_out[sjis_count++] = 0x81;
-				str_out[sjis_count++] = 0x6D;
-				break;
-			case ']':
-				str_out[sjis_count++] = 0x81;
-				str_out[sjis_count++] = 0x6E;
-				break;
-			case '{':
-				str_out[sjis_count++] = 0x81;
-				str_out[sjis_count++] = 0x6F;
-				break;
-			case '}':
-				str_out[sjis_count++] = 0x81;
-				str_out[sjis_count++] = 0x70;
-				break;
-			default:
-				if((str_in[i] >= 48) && (str_in[i] <= 90)) {
-					//digits (0-9), capital letters (A-Z)
-					str_out[sjis_count++] = 0x82;
-					str_out[sjis_count++] = str_in[i] + 31;
-				} else if((str_in[i] >= 97) && (str_in[i] <= 122)) {
-					//lowercase letters (a-z)
-					str_out[sjis_count++] = 0x82;
-					str_out[sjis_count++] = str_in[i] + 32;
-				}
-				break;
-		}
-	}
-	for(; sjis_count < 68; sjis_count++) {
-		str_out[sjis_count] = 0;
-	}	
-}
-
 void IconSys::GetTitleString(char const * str_in, unsigned int pos_linebreak, char * str_out)
 {
 	unsigned int i, j;
@@ -164,29 +51,64 @@ IconSys::IconSys()
 
 IconSys::IconSys(const char* fname)
 {
-	std::ifstream fin(fname, std::ios_base::in | std::ios_base::binary);
-	if(fin.fail()) { throw( Ghulbus::gbException(Ghulbus::gbException::GB_FAILED,
-	                                             "Could not open icon file for read") ); }
-
-	fin.read( reinterpret_cast<char*>(&File), sizeof(File) );
-	if(fin.fail()) {
-		fin.close();
+	GhulbusUtil::gbMappedFile file;
+	try {
+		file.Open(fname);
+	} catch(Ghulbus::gbException&) {
+		throw( Ghulbus::gbException(Ghulbus::gbException::GB_FAILED,
+		                            "Could not open icon file for read") );
+	}
+	if(file.GetSize() < sizeof(File)) {
 		throw( Ghulbus::gbException(Ghulbus::gbException::GB_FAILED,
 			                        "File read error") ); 
 	}
-	fin.close();
+	memcpy(&File, file.GetData(), sizeof(File));
+	GB_STATS_COUNT("iconsys.bytes_read", sizeof(File));
 
 	/*if(!CheckValidity(File)) { 
 		throw( Ghulbus::gbException(Ghulbus::gbException::GB_FAILED,
 			                        "File seems to be corrupted") ); 
 	}*/
 
-	DecodeTitle(File.title, decoded_title);
+	DecodeStrings();
+};
+
+IconSys::IconSys(void const* data, size_t size)
+{
+	if(size < GetHeaderSize()) {
+		throw( Ghulbus::gbException(Ghulbus::gbException::GB_FAILED,
+			                        "File read error") ); 
+	}
+	memset(&File, 0, sizeof(File));
+	memcpy(&File, data, (size < sizeof(File)) ? size : sizeof(File));
+	GB_STATS_COUNT("iconsys.bytes_read", (size < sizeof(File)) ? size : sizeof(File));
+	DecodeStrings();
+}
+
+size_t IconSys::GetFileSize()
+{
+	return sizeof(File_t);
+}
+
+size_t IconSys::GetHeaderSize()
+{
+	return offsetof(File_t, reserve3);
+}
+
+void const* IconSys::GetFileData() const
+{
+	return &File;
+}
+
+void IconSys::DecodeStrings()
+{
+	GB_STATS_TIMER("iconsys.decode");
+	PS2TitleCodec::Decode(File.title, decoded_title);
 	GetTitleString(decoded_title, File.offset_2nd_line, title_str);
 	strcpy(title_str_single_line, title_str);
 	char* tmp = strchr(title_str_single_line, '\n');
 	if(tmp) { *tmp = ' '; }
-};
+}
 
 IconSys::~IconSys()
 {
@@ -242,7 +164,8 @@ void IconSys::SetTitle(char const* str) {
 	//write ASCII string:
 	memcpy(decoded_title, str, len+1);
 	//write S-JIS string:
-	EncodeTitle(decoded_title, File.title);
+	GB_STATS_TIMER("iconsys.encode");
+	PS2TitleCodec::Encode(decoded_title, File.title);
 	//update linebreaks (remember the / 2 since File is referring to SJIS):
 	SetLinebreak(File.offset_2nd_line / 2);
 }
@@ -394,21 +317,13 @@ void IconSys::SetLight3Dir(IconSys_LightVec const& v) {
 }
 
 void IconSys::WriteFile(const char * fname) {
-	std::ofstream fout(fname, std::ios_base::out | std::ios_base::binary);
-	if(fout.fail()) {
-		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
-			                         "Error opening output file for icon.sys") );
-	}
-	fout.seekp(std::ios::beg);
-
-	//write data:
-	fout.write( reinterpret_cast<char*>(&File), sizeof(File) );
-	if(fout.fail()) {
-		fout.close();
+	try {
+		GhulbusUtil::GetFileBackend().WriteFile(fname, &File, sizeof(File));
+	} catch(Ghulbus::gbException&) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
 			                         "Error writing output file for icon.sys") );
 	}
-	fout.close();
+	GB_STATS_COUNT("iconsys.bytes_written", sizeof(File));
 }
 
 
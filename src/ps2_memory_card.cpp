@@ -0,0 +1,271 @@
+/**
+ * @file src/ps2_memory_card.cpp
+ *
+ * @brief Implementation of the PS2MemoryCard classbuild_header/
+ */
+#include "../include/ps2_memory_card.hpp"
+#include <algorithm>
+#include <cstring>
+
+/** Helper function: reads a little endian 16 bit value
+ */
+inline unsigned int read_u16(unsigned char const* p) {
+	return static_cast<unsigned int>(p[0]) | (static_cast<unsigned int>(p[1]) << 8);
+}
+
+/** Helper function: reads a little endian 32 bit value
+ */
+inline unsigned int read_u32(unsigned char const* p) {
+	return static_cast<unsigned int>(p[0])         | (static_cast<unsigned int>(p[1]) << 8) |
+	       (static_cast<unsigned int>(p[2]) << 16) | (static_cast<unsigned int>(p[3]) << 24);
+}
+
+/** Helper function: throws the exception for corrupted images
+ */
+inline void throw_corrupted() {
+	throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Memory card image is corrupted" ) );
+}
+
+static size_t const DIR_ENTRY_SIZE = 512;				///< size of a directory entry in bytes
+static unsigned int const FAT_ALLOCATED = 0x80000000;	///< allocation table flag for used clusters
+static unsigned int const FAT_CHAIN_END = 0x7FFFFFFF;	///< allocation table entry terminating a chain
+static size_t const MAX_IFC_CLUSTERS = 32;				///< number of indirect table clusters in the superblock
+
+PS2MemoryCard::PS2MemoryCard()
+	:m_data(NULL), m_size(0), m_pageSize(0), m_rawPageSize(0), m_pagesPerCluster(0), m_clusterSize(0),
+	 m_allocOffset(0), m_allocEnd(0)
+{
+}
+
+PS2MemoryCard::PS2MemoryCard(char const* fname)
+	:m_data(NULL), m_size(0), m_pageSize(0), m_rawPageSize(0), m_pagesPerCluster(0), m_clusterSize(0),
+	 m_allocOffset(0), m_allocEnd(0)
+{
+	Open(fname);
+}
+
+PS2MemoryCard::PS2MemoryCard(void const* data, size_t size)
+	:m_data(NULL), m_size(0), m_pageSize(0), m_rawPageSize(0), m_pagesPerCluster(0), m_clusterSize(0),
+	 m_allocOffset(0), m_allocEnd(0)
+{
+	Load(data, size);
+}
+
+PS2MemoryCard::~PS2MemoryCard()
+{
+	Close();
+}
+
+void PS2MemoryCard::Open(char const* fname)
+{
+	Close();
+	try {
+		m_file.Open(fname);
+	} catch(Ghulbus::gbException&) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
+		                             "Could not open memory card image for read" ) );
+	}
+	try {
+		Load(m_file.GetData(), m_file.GetSize());
+	} catch(...) {
+		m_file.Close();
+		throw;
+	}
+}
+
+void PS2MemoryCard::Load(void const* data, size_t size)
+{
+	m_fat.clear();
+	m_saves.clear();
+	m_data = static_cast<unsigned char const*>(data);
+	m_size = size;
+	try {
+		ReadAllocationTable();
+		ReadDirectories();
+	} catch(...) {
+		m_fat.clear();
+		m_saves.clear();
+		m_data = NULL;
+		m_size = 0;
+		throw;
+	}
+}
+
+void PS2MemoryCard::Close()
+{
+	m_fat.clear();
+	m_saves.clear();
+	m_data = NULL;
+	m_size = 0;
+	m_file.Close();
+}
+
+void PS2MemoryCard::ReadAllocationTable()
+{
+	//superblock:
+	if(m_size < 0x154) { throw_corrupted(); }
+	if(memcmp(m_data, "Sony PS2 Memory Card Format ", 28) != 0) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "No PS2 memory card image" ) );
+	}
+	m_pageSize        = read_u16(m_data + 0x28);
+	m_pagesPerCluster = read_u16(m_data + 0x2A);
+	size_t const n_clusters = read_u32(m_data + 0x30);
+	m_allocOffset     = read_u32(m_data + 0x34);
+	m_allocEnd        = read_u32(m_data + 0x38);
+	m_clusterSize     = m_pageSize * m_pagesPerCluster;
+	if( (m_pageSize < DIR_ENTRY_SIZE) || (m_pageSize % DIR_ENTRY_SIZE != 0) || (m_pagesPerCluster == 0) ||
+		(m_allocOffset > n_clusters) || (m_allocEnd > n_clusters - m_allocOffset) ) {
+		throw_corrupted();
+	}
+	//the spare area holds 16 bytes of ECC data for every 512 bytes of a page:
+	size_t const n_pages = n_clusters * m_pagesPerCluster;
+	if(m_size / (m_pageSize + m_pageSize / 32) >= n_pages) {
+		m_rawPageSize = m_pageSize + m_pageSize / 32;
+	} else if(m_size / m_pageSize >= n_pages) {
+		m_rawPageSize = m_pageSize;
+	} else {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Memory card image is truncated" ) );
+	}
+
+	//allocation table, found through the indirect table clusters:
+	size_t const entries_per_cluster = m_clusterSize / 4;
+	size_t const n_fat_clusters = (m_allocEnd + entries_per_cluster - 1) / entries_per_cluster;
+	size_t const n_ifc_clusters = (n_fat_clusters + entries_per_cluster - 1) / entries_per_cluster;
+	if(n_ifc_clusters > MAX_IFC_CLUSTERS) { throw_corrupted(); }
+	size_t const entries_per_page = m_pageSize / 4;
+	m_fat.resize(m_allocEnd);
+	for(size_t i=0; i<n_fat_clusters; i++) {
+		size_t const ifc_cluster = read_u32(m_data + 0x50 + 4 * (i / entries_per_cluster));
+		size_t const ifc_entry   = i % entries_per_cluster;
+		size_t const fat_cluster = read_u32(GetPage(ifc_cluster, ifc_entry / entries_per_page) +
+		                                    4 * (ifc_entry % entries_per_page));
+		size_t const first = i * entries_per_cluster;
+		size_t const count = std::min<size_t>(entries_per_cluster, m_allocEnd - first);
+		for(size_t j=0; j<count; j++) {
+			m_fat[first + j] = read_u32(GetPage(fat_cluster, j / entries_per_page) + 4 * (j % entries_per_page));
+		}
+	}
+}
+
+void PS2MemoryCard::ReadDirectories()
+{
+	//the "." entry of the root directory holds the number of entries:
+	unsigned int const root_cluster = read_u32(m_data + 0x3C);
+	std::vector<size_t> chain;
+	GetClusterChain(root_cluster, 1, chain);
+	size_t const n_entries = read_u32(GetPage(chain[0], 0) + 0x04);
+
+	std::vector<Entry> root;
+	ReadDirectory(root_cluster, n_entries, root);
+	for(size_t i=0; i<root.size(); i++) {
+		if(!(root[i].mode & MODE_DIRECTORY)) { continue; }
+		SaveDirectory save;
+		save.entry = root[i];
+		std::vector<Entry> entries;
+		ReadDirectory(root[i].cluster, root[i].length, entries);
+		for(size_t j=0; j<entries.size(); j++) {
+			if(entries[j].mode & MODE_FILE) { save.files.push_back(entries[j]); }
+		}
+		m_saves.push_back(save);
+	}
+}
+
+void PS2MemoryCard::ReadDirectory(unsigned int cluster, size_t n_entries, std::vector<Entry>& entries) const
+{
+	size_t const entries_per_page    = m_pageSize / DIR_ENTRY_SIZE;
+	size_t const entries_per_cluster = m_clusterSize / DIR_ENTRY_SIZE;
+	if(n_entries > m_allocEnd * entries_per_cluster) { throw_corrupted(); }
+	std::vector<size_t> chain;
+	GetClusterChain(cluster, (n_entries + entries_per_cluster - 1) / entries_per_cluster, chain);
+	for(size_t i=2; i<n_entries; i++) {
+		size_t const index = i % entries_per_cluster;
+		unsigned char const* p = GetPage(chain[i / entries_per_cluster], index / entries_per_page) +
+		                         DIR_ENTRY_SIZE * (index % entries_per_page);
+		Entry entry;
+		entry.mode = read_u16(p);
+		if(!(entry.mode & MODE_EXISTS)) { continue; }
+		entry.length  = read_u32(p + 0x04);
+		entry.cluster = read_u32(p + 0x10);
+		char const* name = reinterpret_cast<char const*>(p + 0x40);
+		entry.name.assign(name, std::find(name, name + 32, '\0'));
+		entries.push_back(entry);
+	}
+}
+
+void PS2MemoryCard::GetClusterChain(unsigned int cluster, size_t n_clusters, std::vector<size_t>& chain) const
+{
+	chain.clear();
+	if(n_clusters > m_allocEnd) { throw_corrupted(); }
+	chain.reserve(n_clusters);
+	for(size_t i=0; i<n_clusters; i++) {
+		if(cluster >= m_allocEnd) { throw_corrupted(); }
+		chain.push_back(m_allocOffset + cluster);
+		unsigned int const entry = m_fat[cluster];
+		if(!(entry & FAT_ALLOCATED)) { throw_corrupted(); }
+		cluster = entry & ~FAT_ALLOCATED;
+		if((cluster == FAT_CHAIN_END) && (i + 1 < n_clusters)) { throw_corrupted(); }
+	}
+}
+
+unsigned char const* PS2MemoryCard::GetPage(size_t cluster, size_t page) const
+{
+	if( (page >= m_pagesPerCluster) || (cluster >= (m_size / m_rawPageSize) / m_pagesPerCluster) ) {
+		throw_corrupted();
+	}
+	return m_data + (cluster * m_pagesPerCluster + page) * m_rawPageSize;
+}
+
+bool PS2MemoryCard::HasSpareData() const {
+	return (m_rawPageSize != m_pageSize);
+}
+
+int PS2MemoryCard::GetNSaves() const {
+	return static_cast<int>(m_saves.size());
+}
+
+PS2MemoryCard::SaveDirectory const& PS2MemoryCard::GetSave(int index) const {
+	if(static_cast<size_t>(index) >= m_saves.size()) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
+	}
+	return m_saves[index];
+}
+
+PS2MemoryCard::SaveDirectory const* PS2MemoryCard::FindSave(char const* name) const {
+	for(size_t i=0; i<m_saves.size(); i++) {
+		if(m_saves[i].entry.name == name) { return &m_saves[i]; }
+	}
+	return NULL;
+}
+
+PS2MemoryCard::Entry const* PS2MemoryCard::FindFile(SaveDirectory const& save, char const* name) const {
+	for(size_t i=0; i<save.files.size(); i++) {
+		if(save.files[i].name == name) { return &save.files[i]; }
+	}
+	return NULL;
+}
+
+unsigned char const* PS2MemoryCard::GetFileData(Entry const& file, std::vector<unsigned char>& buffer) const
+{
+	if(file.length == 0) { return NULL; }
+	std::vector<size_t> chain;
+	GetClusterChain(file.cluster, (file.length + m_clusterSize - 1) / m_clusterSize, chain);
+	//without spare data, consecutive clusters are consecutive in the image:
+	bool contiguous = !HasSpareData();
+	for(size_t i=1; contiguous && (i<chain.size()); i++) {
+		contiguous = (chain[i] == chain[0] + i);
+	}
+	if(contiguous) {
+		GetPage(chain.back(), m_pagesPerCluster - 1);		//bounds check
+		return GetPage(chain[0], 0);
+	}
+	buffer.resize(file.length);
+	size_t offset = 0;
+	for(size_t i=0; i<chain.size(); i++) {
+		for(size_t j=0; (j<m_pagesPerCluster) && (offset < file.length); j++) {
+			size_t const n = std::min<size_t>(m_pageSize, file.length - offset);
+			memcpy(&buffer[offset], GetPage(chain[i], j), n);
+			offset += n;
+		}
+	}
+	return &buffer[0];
+}
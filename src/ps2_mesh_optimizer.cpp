@@ -0,0 +1,433 @@
+/**
+ * @file src/ps2_mesh_optimizer.cpp
+ *
+ * @brief Implementation of the icon geometry optimizerbuild_header/
+ */
+#include "../include/ps2_mesh_optimizer.hpp"
+#include "../include/ps2_fixed_point.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <utility>
+
+/** Weight of the planes keeping open borders in place, relative to the triangle planes
+ */
+static double const BORDER_WEIGHT = 1000.0;
+
+/** Helper: symmetric 4x4 matrix measuring the squared distance of a point to a set of planes
+ */
+struct Quadric {
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+	Quadric(): a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+	/** Add the plane a*x + b*y + c*z + d = 0 (with unit normal), weighted by w
+	 */
+	void AddPlane(double a, double b, double c, double d, double w) {
+		a2 += w*a*a; ab += w*a*b; ac += w*a*c; ad += w*a*d;
+		b2 += w*b*b; bc += w*b*c; bd += w*b*d;
+		c2 += w*c*c; cd += w*c*d;
+		d2 += w*d*d;
+	}
+	void Add(Quadric const& q) {
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+		bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+	}
+	/** Evaluate the error of point p
+	 */
+	double Error(double const* p) const {
+		double const x = p[0], y = p[1], z = p[2];
+		return a2*x*x + 2.0*ab*x*y + 2.0*ac*x*z + 2.0*ad*x
+		     + b2*y*y + 2.0*bc*y*z + 2.0*bd*y
+		     + c2*z*z + 2.0*cd*z
+		     + d2;
+	}
+};
+
+/** Helper: a candidate edge collapse
+ */
+struct Collapse {
+	double cost;				///< error introduced by the collapse
+	int from;					///< vertex that is removed
+	int to;						///< vertex that from is joined into
+	unsigned int stamp_from;	///< modification count of from when the cost was computed
+	unsigned int stamp_to;		///< modification count of to when the cost was computed
+	/** Reversed ordering, so std::priority_queue yields the cheapest collapse first
+	 */
+	bool operator<(Collapse const& rhs) const { return cost > rhs.cost; }
+};
+
+/** Helper function: cross product of (b - a) and (c - a)
+ */
+inline void triangle_normal(double const* a, double const* b, double const* c, double* n) {
+	double const u[3] = { b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+	double const v[3] = { c[0]-a[0], c[1]-a[1], c[2]-a[2] };
+	n[0] = u[1]*v[2] - u[2]*v[1];
+	n[1] = u[2]*v[0] - u[0]*v[2];
+	n[2] = u[0]*v[1] - u[1]*v[0];
+}
+
+/** Helper function: hash of a position (FNV-1a over the bit patterns)
+ */
+inline size_t hash_position(float const* p) {
+	unsigned int bits[3];
+	memcpy(bits, p, sizeof(bits));
+	unsigned int h = 2166136261u;
+	for(int i=0; i<3; i++) {
+		h = (h ^ bits[i]) * 16777619u;
+	}
+	return static_cast<size_t>(h ^ (h >> 15));
+}
+
+/** Helper function: joins corners with identical positions into vertices
+ * @param[in] positions 3 floats per corner
+ * @param[in] n_corners Number of corners
+ * @param[out] corner_vertex Receives the vertex of each corner
+ * @param[out] vertex_pos Receives 3 doubles per vertex
+ */
+static void JoinPositions(float const* positions, size_t n_corners,
+                          std::vector<int>& corner_vertex, std::vector<double>& vertex_pos)
+{
+	corner_vertex.resize(n_corners);
+	vertex_pos.clear();
+	std::vector<size_t> first_corner;		//a corner of each vertex
+	//open addressing with linear probing; slots hold vertex+1, 0 marks an empty slot:
+	size_t table_size = 16;
+	while(table_size < 2 * n_corners) { table_size *= 2; }
+	std::vector<int> table(table_size, 0);
+	for(size_t i=0; i<n_corners; i++) {
+		float const* p = positions + i*3;
+		size_t slot = hash_position(p) & (table_size - 1);
+		for(;;) {
+			int const entry = table[slot];
+			if(entry == 0) {
+				first_corner.push_back(i);
+				for(int j=0; j<3; j++) { vertex_pos.push_back(p[j]); }
+				table[slot] = static_cast<int>(first_corner.size());
+				corner_vertex[i] = static_cast<int>(first_corner.size()) - 1;
+				break;
+			}
+			if(memcmp(positions + first_corner[entry - 1]*3, p, sizeof(float) * 3) == 0) {
+				corner_vertex[i] = entry - 1;
+				break;
+			}
+			slot = (slot + 1) & (table_size - 1);
+		}
+	}
+}
+
+/** Helper: state of the edge collapse in PS2MeshOptimizer::Decimate()
+ */
+struct DecimationMesh {
+	std::vector<double> pos;						///< 3 doubles per vertex
+	std::vector<int> face_vertex;					///< 3 vertices per face
+	std::vector<char> face_alive;					///< per face
+	std::vector<char> vertex_alive;					///< per vertex
+	std::vector<unsigned int> stamp;				///< modification count per vertex
+	std::vector<Quadric> quadric;					///< per vertex
+	std::vector<std::vector<int> > vertex_faces;	///< faces using each vertex (may include dead ones)
+
+	bool FaceHas(int f, int v) const {
+		return (face_vertex[f*3] == v) || (face_vertex[f*3+1] == v) || (face_vertex[f*3+2] == v);
+	}
+	/** Sorted list of the vertices sharing an alive face with v
+	 */
+	void GetNeighbours(int v, std::vector<int>& out) const {
+		out.clear();
+		std::vector<int> const& faces = vertex_faces[v];
+		for(size_t i=0; i<faces.size(); i++) {
+			if(!face_alive[faces[i]]) { continue; }
+			for(int k=0; k<3; k++) {
+				int const w = face_vertex[faces[i]*3 + k];
+				if(w != v) { out.push_back(w); }
+			}
+		}
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+	}
+	/** Build the cheaper collapse of the edge between a and b
+	 */
+	Collapse MakeCollapse(int a, int b) const {
+		Quadric q = quadric[a];
+		q.Add(quadric[b]);
+		double const cost_ab = q.Error(&pos[b*3]);
+		double const cost_ba = q.Error(&pos[a*3]);
+		Collapse c;
+		if(cost_ab <= cost_ba) {
+			c.cost = cost_ab; c.from = a; c.to = b;
+		} else {
+			c.cost = cost_ba; c.from = b; c.to = a;
+		}
+		c.stamp_from = stamp[c.from];
+		c.stamp_to   = stamp[c.to];
+		return c;
+	}
+	/** Check whether joining u into v keeps the surface intact
+	 */
+	bool CanCollapse(int u, int v, std::vector<int>& tmp_u, std::vector<int>& tmp_v) const {
+		//faces moving with u must not flip or lose their area:
+		std::vector<int> const& faces = vertex_faces[u];
+		int shared_faces = 0;
+		for(size_t i=0; i<faces.size(); i++) {
+			int const f = faces[i];
+			if(!face_alive[f]) { continue; }
+			if(FaceHas(f, v)) { shared_faces++; continue; }
+			double const* p[3];
+			double const* q[3];
+			for(int k=0; k<3; k++) {
+				int const w = face_vertex[f*3 + k];
+				p[k] = &pos[w*3];
+				q[k] = (w == u) ? &pos[v*3] : p[k];
+			}
+			double n_old[3], n_new[3];
+			triangle_normal(p[0], p[1], p[2], n_old);
+			triangle_normal(q[0], q[1], q[2], n_new);
+			if(n_old[0]*n_new[0] + n_old[1]*n_new[1] + n_old[2]*n_new[2] <= 0.0) { return false; }
+		}
+		//link condition: u and v may only have the neighbours in common that close their shared faces:
+		GetNeighbours(u, tmp_u);
+		GetNeighbours(v, tmp_v);
+		int common = 0;
+		for(size_t i=0, j=0; (i < tmp_u.size()) && (j < tmp_v.size()); ) {
+			if(tmp_u[i] < tmp_v[j])      { i++; }
+			else if(tmp_v[j] < tmp_u[i]) { j++; }
+			else                         { common++; i++; j++; }
+		}
+		return (common <= shared_faces);
+	}
+};
+
+PS2MeshOptimizer::PS2MeshOptimizer()
+{
+	;
+}
+
+void PS2MeshOptimizer::SetGeometry(OBJ_Mesh const& mesh, float scale_factor)
+{
+	size_t const n_vertices = static_cast<size_t>(mesh.GetNFaces()) * 3;
+	m_positions.resize(n_vertices * 3);
+	m_normals.resize(n_vertices * 3);
+	m_texcoords.resize(n_vertices * 2);
+	if(n_vertices > 0) {
+		mesh.ExtractUnindexed(OBJ_ArrayOutput<float, 3>(&m_positions[0]), OBJ_ArrayOutput<float, 3>(&m_normals[0]),
+		                      OBJ_ArrayOutput<float, 2>(&m_texcoords[0]), scale_factor);
+	}
+}
+
+int PS2MeshOptimizer::GetNVertices() const {
+	return static_cast<int>(m_positions.size() / 3);
+}
+float const* PS2MeshOptimizer::GetPositions() const {
+	return (m_positions.empty()) ? NULL : &m_positions[0];
+}
+float const* PS2MeshOptimizer::GetNormals() const {
+	return (m_normals.empty()) ? NULL : &m_normals[0];
+}
+float const* PS2MeshOptimizer::GetTextureCoords() const {
+	return (m_texcoords.empty()) ? NULL : &m_texcoords[0];
+}
+
+void PS2MeshOptimizer::SelectTriangles(std::vector<int> const& triangles)
+{
+	std::vector<float> positions(triangles.size() * 9);
+	std::vector<float> normals(triangles.size() * 9);
+	std::vector<float> texcoords(triangles.size() * 6);
+	for(size_t i=0; i<triangles.size(); i++) {
+		size_t const t = static_cast<size_t>(triangles[i]);
+		memcpy(&positions[i*9], &m_positions[t*9], sizeof(float) * 9);
+		memcpy(&normals[i*9],   &m_normals[t*9],   sizeof(float) * 9);
+		memcpy(&texcoords[i*6], &m_texcoords[t*6], sizeof(float) * 6);
+	}
+	m_positions.swap(positions);
+	m_normals.swap(normals);
+	m_texcoords.swap(texcoords);
+}
+
+int PS2MeshOptimizer::RemoveDegenerateTriangles()
+{
+	int const n_triangles = GetNVertices() / 3;
+	std::vector<int> keep;
+	keep.reserve(n_triangles);
+	for(int t=0; t<n_triangles; t++) {
+		//the products of 16 bit differences are exact in double precision:
+		double p[3][3];
+		for(int k=0; k<3; k++) {
+			for(int j=0; j<3; j++) {
+				p[k][j] = PS2_FloatToFixed16(m_positions[(t*3 + k)*3 + j]);
+			}
+		}
+		double n[3];
+		triangle_normal(p[0], p[1], p[2], n);
+		if((n[0] != 0.0) || (n[1] != 0.0) || (n[2] != 0.0)) { keep.push_back(t); }
+	}
+	int const removed = n_triangles - static_cast<int>(keep.size());
+	if(removed > 0) { SelectTriangles(keep); }
+	return removed;
+}
+
+int PS2MeshOptimizer::Decimate(int max_vertices)
+{
+	int const n_triangles = GetNVertices() / 3;
+	//the mesh is never simplified away completely:
+	int const max_triangles = std::max(max_vertices / 3, 1);
+	if(n_triangles <= max_triangles) { return 0; }
+
+	DecimationMesh m;
+	JoinPositions(&m_positions[0], m_positions.size() / 3, m.face_vertex, m.pos);
+	int const n_verts = static_cast<int>(m.pos.size() / 3);
+	m.face_alive.assign(n_triangles, 1);
+	m.vertex_alive.assign(n_verts, 1);
+	m.stamp.assign(n_verts, 0);
+	m.quadric.resize(n_verts);
+	m.vertex_faces.resize(n_verts);
+
+	//planes of the triangles, weighted by area; edges for the border and the candidates:
+	int alive_triangles = n_triangles;
+	std::vector<std::pair<std::pair<int, int>, int> > edges;		//((lower, higher vertex), face)
+	edges.reserve(n_triangles * 3);
+	for(int f=0; f<n_triangles; f++) {
+		int const* v = &m.face_vertex[f*3];
+		if((v[0] == v[1]) || (v[1] == v[2]) || (v[0] == v[2])) {
+			m.face_alive[f] = 0;
+			alive_triangles--;
+			continue;
+		}
+		double n[3];
+		triangle_normal(&m.pos[v[0]*3], &m.pos[v[1]*3], &m.pos[v[2]*3], n);
+		double const len = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+		for(int k=0; k<3; k++) {
+			m.vertex_faces[v[k]].push_back(f);
+			edges.push_back(std::make_pair(std::make_pair(std::min(v[k], v[(k+1)%3]), std::max(v[k], v[(k+1)%3])), f));
+		}
+		if(len == 0.0) { continue; }
+		double const a = n[0]/len, b = n[1]/len, c = n[2]/len;
+		double const d = -(a*m.pos[v[0]*3] + b*m.pos[v[0]*3+1] + c*m.pos[v[0]*3+2]);
+		for(int k=0; k<3; k++) {
+			m.quadric[v[k]].AddPlane(a, b, c, d, 0.5 * len);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	std::priority_queue<Collapse> queue;
+	for(size_t i=0; i<edges.size(); ) {
+		size_t j = i + 1;
+		while((j < edges.size()) && (edges[j].first == edges[i].first)) { j++; }
+		int const a = edges[i].first.first, b = edges[i].first.second;
+		if(j == i + 1) {
+			//open border: add a plane through the edge, perpendicular to its face
+			int const* v = &m.face_vertex[edges[i].second*3];
+			double n[3];
+			triangle_normal(&m.pos[v[0]*3], &m.pos[v[1]*3], &m.pos[v[2]*3], n);
+			double const e[3] = { m.pos[b*3]-m.pos[a*3], m.pos[b*3+1]-m.pos[a*3+1], m.pos[b*3+2]-m.pos[a*3+2] };
+			double const p[3] = { e[1]*n[2] - e[2]*n[1], e[2]*n[0] - e[0]*n[2], e[0]*n[1] - e[1]*n[0] };
+			double const len = std::sqrt(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+			if(len > 0.0) {
+				double const d = -(p[0]*m.pos[a*3] + p[1]*m.pos[a*3+1] + p[2]*m.pos[a*3+2]) / len;
+				double const w = BORDER_WEIGHT * (e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+				m.quadric[a].AddPlane(p[0]/len, p[1]/len, p[2]/len, d, w);
+				m.quadric[b].AddPlane(p[0]/len, p[1]/len, p[2]/len, d, w);
+			}
+		}
+		i = j;
+	}
+	for(size_t i=0; i<edges.size(); i++) {
+		if((i > 0) && (edges[i].first == edges[i-1].first)) { continue; }
+		queue.push(m.MakeCollapse(edges[i].first.first, edges[i].first.second));
+	}
+
+	std::vector<int> tmp_u, tmp_v;
+	while((alive_triangles > max_triangles) && !queue.empty()) {
+		Collapse const c = queue.top();
+		queue.pop();
+		int const u = c.from, v = c.to;
+		if(!m.vertex_alive[u] || !m.vertex_alive[v] ||
+		   (m.stamp[u] != c.stamp_from) || (m.stamp[v] != c.stamp_to)) {
+			continue;		//outdated
+		}
+		if(!m.CanCollapse(u, v, tmp_u, tmp_v)) { continue; }
+		std::vector<int>& faces_u = m.vertex_faces[u];
+		std::vector<int>& faces_v = m.vertex_faces[v];
+		int n_removed = 0;
+		for(size_t i=0; i<faces_u.size(); i++) {
+			if(m.face_alive[faces_u[i]] && m.FaceHas(faces_u[i], v)) { n_removed++; }
+		}
+		if(alive_triangles - n_removed < 1) { continue; }
+
+		//join u into v:
+		for(size_t i=0; i<faces_u.size(); i++) {
+			int const f = faces_u[i];
+			if(!m.face_alive[f]) { continue; }
+			if(m.FaceHas(f, v)) {
+				m.face_alive[f] = 0;
+				alive_triangles--;
+			} else {
+				for(int k=0; k<3; k++) {
+					if(m.face_vertex[f*3 + k] == u) { m.face_vertex[f*3 + k] = v; }
+				}
+				faces_v.push_back(f);
+			}
+		}
+		std::vector<int>().swap(faces_u);
+		m.vertex_alive[u] = 0;
+		m.quadric[v].Add(m.quadric[u]);
+		m.stamp[v]++;
+		size_t n_alive = 0;
+		for(size_t i=0; i<faces_v.size(); i++) {
+			if(m.face_alive[faces_v[i]]) { faces_v[n_alive++] = faces_v[i]; }
+		}
+		faces_v.resize(n_alive);
+
+		m.GetNeighbours(v, tmp_v);
+		for(size_t i=0; i<tmp_v.size(); i++) {
+			queue.push(m.MakeCollapse(v, tmp_v[i]));
+		}
+	}
+
+	//write back the moved positions and drop the removed triangles:
+	std::vector<int> keep;
+	keep.reserve(alive_triangles);
+	for(int f=0; f<n_triangles; f++) {
+		if(!m.face_alive[f]) { continue; }
+		keep.push_back(f);
+		for(int k=0; k<3; k++) {
+			double const* p = &m.pos[m.face_vertex[f*3 + k]*3];
+			for(int j=0; j<3; j++) { m_positions[(f*3 + k)*3 + j] = static_cast<float>(p[j]); }
+		}
+	}
+	SelectTriangles(keep);
+	return n_triangles - alive_triangles;
+}
+
+/** Helper function: spreads the lower 10 bits of x to the even bits of the result
+ */
+inline unsigned int spread_bits(unsigned int x) {
+	x &= 0x3ff;
+	x = (x | (x << 8)) & 0x00ff00ff;
+	x = (x | (x << 4)) & 0x0f0f0f0f;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+	return x;
+}
+
+void PS2MeshOptimizer::ReorderTriangles()
+{
+	int const n_triangles = GetNVertices() / 3;
+	std::vector<std::pair<unsigned int, int> > order(n_triangles);
+	for(int t=0; t<n_triangles; t++) {
+		float const* uv = &m_texcoords[t*6];
+		float u = (uv[0] + uv[2] + uv[4]) / 3.0f;
+		float v = (uv[1] + uv[3] + uv[5]) / 3.0f;
+		//textures repeat, so only the fractional part counts:
+		u -= std::floor(u);
+		v -= std::floor(v);
+		if(!(u >= 0.0f)) { u = 0.0f; }		//NaN
+		if(!(v >= 0.0f)) { v = 0.0f; }
+		unsigned int const iu = std::min(static_cast<unsigned int>(u * 1024.0f), 1023u);
+		unsigned int const iv = std::min(static_cast<unsigned int>(v * 1024.0f), 1023u);
+		//pairs with the original index keep the order of triangles in the same spot:
+		order[t] = std::make_pair(spread_bits(iu) | (spread_bits(iv) << 1), t);
+	}
+	std::sort(order.begin(), order.end());
+	std::vector<int> triangles(n_triangles);
+	for(int t=0; t<n_triangles; t++) { triangles[t] = order[t].second; }
+	SelectTriangles(triangles);
+}
@@ -4,19 +4,93 @@
  * @brief Implementation of the PS2Icon classbuild_header/
  */
 #include "../include/ps2_ps2icon.hpp"
+#include "../include/ps2_fixed_point.hpp"
+#include "../gbLib/include/gbMappedFile.hpp"
+#include "../gbLib/include/gbFileBackend.hpp"
+#include "../gbLib/include/gbStats.hpp"
 #include <cstring>
 #include <climits>
 
 /** Helper function: converts float32 to float16
  */
 inline short convert_f32_to_f16(float const& f) {
-	return( static_cast<short>(f * 4096.0f) );
+	return( PS2_FloatToFixed16(f) );
 }
 
 /** Helper function: converts float16 to float32
  */
 inline float convert_f16_to_f32(short const& i) {
-	return( static_cast<float>(i) / 4096.0f );	
+	return( PS2_Fixed16ToFloat(i) );
+}
+
+/** Helper function: copies a block of data to a buffer
+ */
+inline unsigned char* write_block(unsigned char* p, void const* src, size_t n) {
+	if(n > 0) { memcpy(p, src, n); }
+	return p + n;
+}
+
+PS2IconPool::PS2IconPool(size_t max_blocks)
+	:m_maxBlocks(max_blocks)
+{
+	m_free.reserve(max_blocks);
+}
+
+PS2IconPool::~PS2IconPool()
+{
+	for(size_t i=0; i<m_free.size(); i++) {
+		delete[] m_free[i].data;
+	}
+}
+
+unsigned char* PS2IconPool::Acquire(size_t size, size_t* capacity)
+{
+	{
+		GhulbusUtil::gbLock lock(m_mutex);
+		//best fit:
+		size_t best = m_free.size();
+		for(size_t i=0; i<m_free.size(); i++) {
+			if( (m_free[i].size >= size) && ((best == m_free.size()) || (m_free[i].size < m_free[best].size)) ) {
+				best = i;
+			}
+		}
+		if(best < m_free.size()) {
+			Block const ret = m_free[best];
+			m_free[best] = m_free.back();
+			m_free.pop_back();
+			*capacity = ret.size;
+			return ret.data;
+		}
+	}
+	//round up to 64 KiB, so that blocks fit a range of similar icons:
+	size_t const rounded = (size + 0xFFFF) & ~static_cast<size_t>(0xFFFF);
+	unsigned char* ret = new unsigned char[rounded];
+	*capacity = rounded;
+	return ret;
+}
+
+void PS2IconPool::Release(unsigned char* data, size_t capacity)
+{
+	if(!data) { return; }
+	GhulbusUtil::gbLock lock(m_mutex);
+	if(m_free.size() >= m_maxBlocks) {
+		//drop the smallest block:
+		size_t smallest = 0;
+		for(size_t i=1; i<m_free.size(); i++) {
+			if(m_free[i].size < m_free[smallest].size) { smallest = i; }
+		}
+		if(m_free.empty() || (m_free[smallest].size >= capacity)) {
+			delete[] data;
+			return;
+		}
+		delete[] m_free[smallest].data;
+		m_free[smallest] = m_free.back();
+		m_free.pop_back();
+	}
+	Block block;
+	block.data = data;
+	block.size = capacity;
+	m_free.push_back(block);
 }
 
 bool PS2Icon::CheckValidity(PS2Icon::Icon_Header const& p) {
@@ -37,25 +111,70 @@ bool PS2Icon::CheckValidity(PS2Icon::Icon_Header const& p) {
 	return true;
 }
 
-PS2Icon::PS2Icon(const char *fname): vertices(NULL), normals(NULL), vert_texture(NULL),
-fvertices(NULL), fnormals(NULL), animation(NULL), anim_keys(NULL)
+PS2Icon::PS2Icon(const char *fname, PS2IconPool* pool): vertices(NULL), normals(NULL), vert_texture(NULL),
+fvertices(NULL), fnormals(NULL), animation(NULL), anim_keys(NULL), frame_keys(NULL), texture(NULL),
+m_arena(NULL), m_arenaSize(0), m_pool(pool),
+m_source(NULL), m_sourceSize(0), m_pending(0), m_animOffset(0), m_textureOffset(0),
+m_nSourceFrames(0), m_nSourceKeys(0), m_encodedTextureValid(false), m_textureEncoding(TEXTURE_AS_HEADER)
 {
-	std::ifstream fin(fname, std::ios_base::in | std::ios_base::binary);
-	if(fin.fail()) { throw( Ghulbus::gbException(Ghulbus::gbException::GB_FAILED,
-	                                             "Could not open icon file for read") ); }
-	//read icon data from file:
+	Load(fname);
+}
+
+PS2Icon::PS2Icon(void const* data, size_t size, PS2IconPool* pool): vertices(NULL), normals(NULL), vert_texture(NULL),
+fvertices(NULL), fnormals(NULL), animation(NULL), anim_keys(NULL), frame_keys(NULL), texture(NULL),
+m_arena(NULL), m_arenaSize(0), m_pool(pool),
+m_source(NULL), m_sourceSize(0), m_pending(0), m_animOffset(0), m_textureOffset(0),
+m_nSourceFrames(0), m_nSourceKeys(0), m_encodedTextureValid(false), m_textureEncoding(TEXTURE_AS_HEADER)
+{
+	Load(data, size);
+}
+
+PS2Icon::PS2Icon(PS2IconPool* pool): vertices(NULL), normals(NULL), vert_texture(NULL),
+fvertices(NULL), fnormals(NULL), animation(NULL), anim_keys(NULL), frame_keys(NULL), texture(NULL),
+m_arena(NULL), m_arenaSize(0), m_pool(pool),
+m_source(NULL), m_sourceSize(0), m_pending(0), m_animOffset(0), m_textureOffset(0),
+m_nSourceFrames(0), m_nSourceKeys(0), m_encodedTextureValid(false), m_textureEncoding(TEXTURE_AS_HEADER)
+{
+	Clear();
+}
+
+void PS2Icon::Load(char const* fname)
+{
+	Load(fname, false);
+}
+
+void PS2Icon::Load(char const* fname, bool lazy)
+{
+	//map the whole file and decode from memory:
+	Clear();
 	try {
-		ReadFile(fin);
-	} catch(std::exception) {
-		fin.close();
-		throw;
+		m_sourceFile.Open(fname);
+	} catch(Ghulbus::gbException&) {
+		Clear();
+		throw( Ghulbus::gbException(Ghulbus::gbException::GB_FAILED,
+		                            "Could not open icon file for read") );
 	}
-	fin.close();
+	//the mapping is kept open for as long as sections are still pending:
+	LoadFromSource(m_sourceFile.GetData(), m_sourceFile.GetSize(), lazy);
 }
 
-PS2Icon::PS2Icon(): vertices(NULL), normals(NULL), vert_texture(NULL), 
-fvertices(NULL), fnormals(NULL), animation(NULL), anim_keys(NULL)
+void PS2Icon::Load(void const* data, size_t size)
 {
+	Load(data, size, false);
+}
+
+void PS2Icon::Load(void const* data, size_t size, bool lazy)
+{
+	Clear();
+	LoadFromSource(static_cast<unsigned char const*>(data), size, lazy);
+}
+
+void PS2Icon::Clear()
+{
+	//the storage block is kept for the next icon:
+	ReleaseSource();
+	m_pending = 0;
+
 	header.file_id          = 0x010000;
 	header.animation_shapes = 1;
 	header.texture_type     = 0x07;
@@ -68,136 +187,244 @@ fvertices(NULL), fnormals(NULL), animation(NULL), anim_keys(NULL)
 	anim_header.play_offset  = 0;
 	anim_header.n_frames     = 0;
 	
+	SetupStorage(0, 1, 0, 0);
 	memset(texture, 0, sizeof(unsigned int)*16384);
+	m_encodedTextureValid = false;
+	m_textureEncoding     = TEXTURE_AS_HEADER;
 }
 
-void PS2Icon::ReadFile(std::ifstream & fin)
+void PS2Icon::LoadFromSource(unsigned char const* data, size_t size, bool lazy)
 {
+	GB_STATS_TIMER("ps2icon.load");
+	GB_STATS_COUNT("ps2icon.bytes_read", size);
+	try {
+		m_source     = data;
+		m_sourceSize = size;
+		ReadHeader();
+		GB_STATS_COUNT("ps2icon.vertices_read", header.n_vertices);
+		SetupStorage(header.n_vertices, header.animation_shapes, m_nSourceFrames, m_nSourceKeys);
+		m_pending = PENDING_GEOMETRY | PENDING_ANIMATION | PENDING_TEXTURE;
+		if(!lazy) {
+			DecodeGeometry();
+			DecodeAnimation();
+			DecodeTexture();
+		}
+	} catch(...) {
+		Clear();
+		throw;
+	}
+}
+
+void PS2Icon::ReadHeader()
+{
+	GhulbusUtil::gbMemoryReader reader(m_source, m_sourceSize);
 	//read header:
-	fin.read( reinterpret_cast<char*>(&header), sizeof(header) );
+	reader.Read(&header, sizeof(header));
 
 	if(!CheckValidity(header)) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Icon Header seems to be corrupted" ) );
 	}
 
-	//allocate memory for vertex data:
-	AllocateVertexMemory();
-
-	//read icon data from file:
 	///Vertex data
 	// each vertex consists of animation_shapes tuples for vertex coordinates,
 	// followed by one vertex coordinate tuple for normal coordinates
 	// followed by one texture data tuple for texture coordinates and color
-	for(unsigned int i=0; i<header.n_vertices; i++) {
-		fin.read( reinterpret_cast<char*>(&vertices[i*header.animation_shapes]), 
-			      sizeof(Vertex_Coord) * header.animation_shapes );
-		fin.read( reinterpret_cast<char*>(&normals[i]), sizeof(Vertex_Coord) );
-		fin.read( reinterpret_cast<char*>(&vert_texture[i]), sizeof(Texture_Data) );
-		
-		for(unsigned int j=0; j<header.animation_shapes; j++) {
-			fvertices[(i*header.animation_shapes + j) * 3] = 
-				convert_f16_to_f32(vertices[i*header.animation_shapes + j].f16_x);
-			fvertices[(i*header.animation_shapes + j) * 3 + 1] = 
-				convert_f16_to_f32(vertices[i*header.animation_shapes + j].f16_y);
-			fvertices[(i*header.animation_shapes + j) * 3 + 2] = 
-				convert_f16_to_f32(vertices[i*header.animation_shapes + j].f16_z);
+	// check the size of the segment before allocating anything:
+	if( (header.animation_shapes == 0) ||
+		(header.animation_shapes > (reader.GetRemaining() / sizeof(Vertex_Coord))) ) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Icon Header seems to be corrupted" ) );
+	}
+	size_t const vertex_size = sizeof(Vertex_Coord) * (header.animation_shapes + 1) + sizeof(Texture_Data);
+	if(header.n_vertices > (reader.GetRemaining() / vertex_size)) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Unexpected end of vertex data" ) );
+	}
+	m_animOffset    = reader.GetPosition() + vertex_size * header.n_vertices;
+
+	//walk the frame table to get the size of the animation segment:
+	reader.Seek(m_animOffset);
+	Animation_Header tmp_header;
+	reader.Read(&tmp_header, sizeof(Animation_Header));
+	if(tmp_header.n_frames > (reader.GetRemaining() / sizeof(Frame_Data))) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Unexpected end of animation data" ) );
+	}
+	m_nSourceFrames = tmp_header.n_frames;
+	m_nSourceKeys   = 0;
+	for(unsigned int i=0; i<tmp_header.n_frames; i++) {
+		Frame_Data frame;
+		reader.Read(&frame, sizeof(Frame_Data));
+		if(frame.n_keys > (reader.GetRemaining() / sizeof(Frame_Key))) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Unexpected end of animation data" ) );
 		}
-		fnormals[i*3]     = convert_f16_to_f32(normals[i].f16_x);
-		fnormals[i*3 + 1] = convert_f16_to_f32(normals[i].f16_y);
-		fnormals[i*3 + 2] = convert_f16_to_f32(normals[i].f16_z);
+		reader.Skip(sizeof(Frame_Key) * frame.n_keys);
+		m_nSourceKeys += frame.n_keys;
 	}
+	m_textureOffset = reader.GetPosition();
+}
 
-	//animation data
-	// preceeded by an animation header, there is a frame data/key set for every frame:
-	fin.read( reinterpret_cast<char*>(&anim_header), sizeof(Animation_Header) );
+void PS2Icon::DecodeGeometry()
+{
+	GhulbusUtil::gbMemoryReader reader(m_source, m_sourceSize);
+	reader.Seek(sizeof(Icon_Header));
+	size_t const vertex_size = sizeof(Vertex_Coord) * (header.animation_shapes + 1) + sizeof(Texture_Data);
+	unsigned char const* vertex_data = reader.Skip(vertex_size * header.n_vertices);
 
-	//allocate memory for animation data:
-	animation = new Frame_Data[anim_header.n_frames];
-	anim_keys = new Frame_Key*[anim_header.n_frames];
-	//read animation data:
+	for(unsigned int i=0; i<header.n_vertices; i++) {
+		memcpy( &vertices[i*header.animation_shapes], vertex_data, sizeof(Vertex_Coord) * header.animation_shapes );
+		vertex_data += sizeof(Vertex_Coord) * header.animation_shapes;
+		memcpy( &normals[i], vertex_data, sizeof(Vertex_Coord) );
+		vertex_data += sizeof(Vertex_Coord);
+		memcpy( &vert_texture[i], vertex_data, sizeof(Texture_Data) );
+		vertex_data += sizeof(Texture_Data);
+	}
+	//convert all shapes and normals in one go:
+	if((header.n_vertices > 0) && (header.animation_shapes > 0)) {
+		PS2_UnpackFixed16Coords(&vertices[0].f16_x, fvertices,
+		                        static_cast<size_t>(header.n_vertices) * header.animation_shapes);
+	}
+	if(header.n_vertices > 0) {
+		PS2_UnpackFixed16Coords(&normals[0].f16_x, fnormals, header.n_vertices);
+	}
+	SectionDecoded(PENDING_GEOMETRY);
+}
+
+void PS2Icon::DecodeAnimation()
+{
+	GhulbusUtil::gbMemoryReader reader(m_source, m_sourceSize);
+	reader.Seek(m_animOffset);
+	//animation data
+	// preceeded by an animation header, there is a frame data/key set for every frame;
+	// the segment was validated and its storage laid out by ReadHeader():
+	reader.Read(&anim_header, sizeof(Animation_Header));
+	Frame_Key* keys = frame_keys;
 	for(unsigned int i=0; i<anim_header.n_frames; i++) {
-		fin.read( reinterpret_cast<char*>(&animation[i]), sizeof(Frame_Data) );
+		reader.Read(&animation[i], sizeof(Frame_Data));
+		anim_keys[i] = NULL;
 		if(animation[i].n_keys > 0) {
-			anim_keys[i] = new Frame_Key[animation[i].n_keys];
-			fin.read( reinterpret_cast<char*>(anim_keys[i]), sizeof(Frame_Key)*animation[i].n_keys);
-		} else {
-			anim_keys[i] = NULL;
+			anim_keys[i] = keys;
+			reader.Read(anim_keys[i], sizeof(Frame_Key)*animation[i].n_keys);
+			keys += animation[i].n_keys;
 		}
 	}
+	SectionDecoded(PENDING_ANIMATION);
+}
 
+void PS2Icon::DecodeTexture()
+{
+	GhulbusUtil::gbMemoryReader reader(m_source, m_sourceSize);
+	reader.Seek(m_textureOffset);
 	//read texture data:
 	if(header.texture_type <= 0x07) {	//uncompressed textures
-		unsigned short c;
-		for(int i=0; i<16384; i++) {
-			fin.read( reinterpret_cast<char*>(&c), 2 );
-			unsigned char r = static_cast<unsigned char>( ( c        & 0x1f) << 3 );
-			unsigned char g = static_cast<unsigned char>( ((c >> 5)  & 0x1f) << 3 );
-			unsigned char b = static_cast<unsigned char>( ((c >> 10)       ) << 3 );
-			texture[i] =  static_cast<unsigned int>( (    (0xff)<<24) |
-				                                     (((r)&0xff)<<16) | 
-										             (((g)&0xff)<<8)  |
-										             ( (b)&0xff)  );
-		}
+		PS2TextureCodec::UnpackTexels(reader.Skip(16384 * 2), texture, 16384);
 	} else {							//compressed textures
 		//simple rle encoding:
 		// first 32 bits hold size of texture data
 		unsigned int data_size;
-		fin.read( reinterpret_cast<char*>(&data_size), 4 );
-		unsigned int limit = fin.tellg();
-		limit += data_size;
-		if(limit > INT_MAX) { throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, 
-			                                               "File size is bigger than INT_MAX" ) ); }
-		unsigned int index = 0;
-		while( fin.tellg() < static_cast<int>(limit) ) {
-			//next 16 bits indicate the type of data to follow:
-			unsigned short rep_count;
-			fin.read( reinterpret_cast<char*>(&rep_count), 2 );
-			if(rep_count < 0xFF00) {			//repeat the pixel rep_count times
-				unsigned short c;
-				fin.read( reinterpret_cast<char*>(&c), 2 );
-				unsigned char r = static_cast<unsigned char>( ( c        & 0x1f) << 3 );
-				unsigned char g = static_cast<unsigned char>( ((c >> 5)  & 0x1f) << 3 );
-				unsigned char b = static_cast<unsigned char>( ((c >> 10)       ) << 3 );
-				for(int i=0; i<rep_count; i++) {
-					texture[index++] = static_cast<unsigned int> (     ((0xff)<<24) |
-				                                                   (((r)&0xff)<<16) | 
-										                           (((g)&0xff)<<8)  |
-										                           ( (b)&0xff)  );
-				}
-			} else {							//copy the next rep_count pixels directly
-				for(unsigned int i=0; i<=(0xFFFF ^ static_cast<unsigned int>(rep_count)); i++) {
-					unsigned short c;
-					fin.read( reinterpret_cast<char*>(&c), 2 );
-					unsigned char r = static_cast<unsigned char>( ( c        & 0x1f) << 3 );
-					unsigned char g = static_cast<unsigned char>( ((c >> 5)  & 0x1f) << 3 );
-					unsigned char b = static_cast<unsigned char>( ((c >> 10)       ) << 3 );
-					texture[index++] = static_cast<unsigned int>(     ((0xff)<<24) |
-				                                                  (((r)&0xff)<<16) | 
-										                          (((g)&0xff)<<8)  |
-										                          ( (b)&0xff)  );
-				}
-			}
-		}
+		reader.Read(&data_size, 4);
+		if(data_size > INT_MAX) { throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, 
+			                                                   "File size is bigger than INT_MAX" ) ); }
+		PS2TextureCodec::Decode(reader.Skip(data_size), data_size, texture);
+	}
+	SectionDecoded(PENDING_TEXTURE);
+}
+
+void PS2Icon::SectionDecoded(unsigned int section)
+{
+	m_pending &= ~section;
+	if(section & PENDING_TEXTURE) {
+		//texture changed; any cached encoding is stale:
+		m_encodedTextureValid = false;
+	}
+	if(m_pending == 0) {
+		//everything is decoded; the source is no longer needed:
+		ReleaseSource();
 	}
+}
+
+void PS2Icon::ReleaseSource()
+{
+	m_sourceFile.Close();
+	m_source     = NULL;
+	m_sourceSize = 0;
+}
+
+void PS2Icon::EnsureGeometry() const
+{
+	if(m_pending & PENDING_GEOMETRY) { const_cast<PS2Icon*>(this)->DecodeGeometry(); }
+}
+
+void PS2Icon::EnsureAnimation() const
+{
+	if(m_pending & PENDING_ANIMATION) { const_cast<PS2Icon*>(this)->DecodeAnimation(); }
+}
+
+void PS2Icon::EnsureTexture() const
+{
+	if(m_pending & PENDING_TEXTURE) { const_cast<PS2Icon*>(this)->DecodeTexture(); }
+}
+
+/** Helper function: rounds a storage block offset up to a multiple of 16 bytes
+ */
+inline size_t align_block(size_t offset) {
+	return (offset + 15) & ~static_cast<size_t>(15);
+}
 
-	if(fin.fail()) { throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
-	                                              "File read error" ) ); }
+void PS2Icon::SetupStorage(size_t n_vertices, size_t n_shapes, size_t n_frames, size_t n_keys)
+{
+	//storage block layout; the texture always comes first, so that it survives a relayout:
+	size_t const texture_offset      = 0;
+	size_t const vertices_offset     = align_block(texture_offset      + sizeof(unsigned int) * 16384);
+	size_t const normals_offset      = align_block(vertices_offset     + sizeof(Vertex_Coord) * n_vertices * n_shapes);
+	size_t const vert_texture_offset = align_block(normals_offset      + sizeof(Vertex_Coord) * n_vertices);
+	size_t const fvertices_offset    = align_block(vert_texture_offset + sizeof(Texture_Data) * n_vertices);
+	size_t const fnormals_offset     = align_block(fvertices_offset    + sizeof(float) * 3 * n_vertices * n_shapes);
+	size_t const animation_offset    = align_block(fnormals_offset     + sizeof(float) * 3 * n_vertices);
+	size_t const anim_keys_offset    = align_block(animation_offset    + sizeof(Frame_Data) * n_frames);
+	size_t const frame_keys_offset   = align_block(anim_keys_offset    + sizeof(Frame_Key*) * n_frames);
+	size_t const size                = frame_keys_offset + sizeof(Frame_Key) * n_keys;
+
+	if(size > m_arenaSize) {
+		size_t capacity = size;
+		unsigned char* block = (m_pool) ? m_pool->Acquire(size, &capacity) : new unsigned char[size];
+		GB_STATS_COUNT("alloc.count", 1);
+		GB_STATS_COUNT("alloc.bytes", capacity);
+		if(m_arena) {
+			memcpy(block + texture_offset, m_arena + texture_offset, sizeof(unsigned int) * 16384);
+			ReleaseStorage();
+		}
+		m_arena     = block;
+		m_arenaSize = capacity;
+	}
+	texture      = reinterpret_cast<unsigned int*>(m_arena + texture_offset);
+	vertices     = reinterpret_cast<Vertex_Coord*>(m_arena + vertices_offset);
+	normals      = reinterpret_cast<Vertex_Coord*>(m_arena + normals_offset);
+	vert_texture = reinterpret_cast<Texture_Data*>(m_arena + vert_texture_offset);
+	fvertices    = reinterpret_cast<float*>(m_arena + fvertices_offset);
+	fnormals     = reinterpret_cast<float*>(m_arena + fnormals_offset);
+	animation    = reinterpret_cast<Frame_Data*>(m_arena + animation_offset);
+	anim_keys    = reinterpret_cast<Frame_Key**>(m_arena + anim_keys_offset);
+	frame_keys   = reinterpret_cast<Frame_Key*>(m_arena + frame_keys_offset);
 }
 
-void PS2Icon::AllocateVertexMemory() 
+void PS2Icon::ReleaseStorage()
 {
-	//helper function that reallocates all per-vertex storage fields based 
-	//on the information stored in the header struct
-	if(vertices)     { delete[] vertices;          vertices = NULL; }
-	if(fvertices)    { delete[] fvertices;        fvertices = NULL; }
-	if(normals)      { delete[] normals;            normals = NULL; }
-	if(fnormals)     { delete[] fnormals;          fnormals = NULL; }
-	if(vert_texture) { delete[] vert_texture;  vert_texture = NULL; }
-	vertices     = new Vertex_Coord[header.n_vertices * header.animation_shapes];
-	fvertices    = new        float[header.n_vertices * header.animation_shapes * 3];
-	normals      = new Vertex_Coord[header.n_vertices];
-	fnormals     = new        float[header.n_vertices * 3];
-	vert_texture = new Texture_Data[header.n_vertices];
+	if(m_arena) {
+		if(m_pool) {
+			m_pool->Release(m_arena, m_arenaSize);
+		} else {
+			delete[] m_arena;
+		}
+	}
+	m_arena      = NULL;
+	m_arenaSize  = 0;
+	vertices     = NULL;
+	normals      = NULL;
+	vert_texture = NULL;
+	fvertices    = NULL;
+	fnormals     = NULL;
+	animation    = NULL;
+	anim_keys    = NULL;
+	frame_keys   = NULL;
+	texture      = NULL;
 }
 
 void PS2Icon::SetGeometry(OBJ_Mesh const& mesh)
@@ -213,48 +440,27 @@ void PS2Icon::SetGeometry(OBJ_Mesh const& mesh, float scale_factor)
 	header.n_vertices = mesh.GetNFaces() * 3;
 
 	//copy animation data:
-	AllocateVertexMemory();
-	float* tmptexture = new float[mesh.GetNFaces() * 9];
-
-	mesh.GetMeshGeometryUnindexed(fvertices, fnormals, tmptexture, scale_factor);
-	for(int i=0; i<mesh.GetNFaces() * 3; i++) {
-		vertices[i].f16_x = convert_f32_to_f16(fvertices[i*3]);
-		vertices[i].f16_y = convert_f32_to_f16(fvertices[i*3 + 1]);
-		vertices[i].f16_z = convert_f32_to_f16(fvertices[i*3 + 2]);
-		vertices[i].f16_unknown = 0;
-
-		normals[i].f16_x = convert_f32_to_f16(fnormals[i*3]);
-		normals[i].f16_y = convert_f32_to_f16(fnormals[i*3 + 1]);
-		normals[i].f16_z = convert_f32_to_f16(fnormals[i*3 + 2]);
-		normals[i].f16_unknown = 0;
-
-		vert_texture[i].f16_u = convert_f32_to_f16(tmptexture[i*3]);
-		vert_texture[i].f16_v = convert_f32_to_f16(tmptexture[i*3 + 1]);
+	SetupStorage(header.n_vertices, 1, 1, 1);
+	if(header.n_vertices > 0) {
+		//texture coordinates go straight into the interleaved Texture_Data fields:
+		mesh.ExtractUnindexed(OBJ_ArrayOutput<float, 3>(fvertices), OBJ_ArrayOutput<float, 3>(fnormals),
+		                      OBJ_Fixed16Output<2>(&vert_texture[0].f16_u, sizeof(Texture_Data) / sizeof(short)),
+		                      scale_factor);
+		PS2_PackFixed16Coords(fvertices, &vertices[0].f16_x, header.n_vertices);
+		PS2_PackFixed16Coords(fnormals, &normals[0].f16_x, header.n_vertices);
+	}
+	for(unsigned int i=0; i<header.n_vertices; i++) {
 		vert_texture[i].color = 0xFFFFFFFF;
 	}
-	delete[] tmptexture;
 
-	//rewrite animation data:
-	if(animation)    { delete[] animation;        animation = NULL; }
-	if(anim_keys)    {
-		for(unsigned int i=0; i<anim_header.n_frames; i++) {
-			if(anim_keys[i]) {
-				delete[] anim_keys[i];
-				anim_keys[i] = NULL;
-			}
-		}
-		delete[] anim_keys;
-		anim_keys = NULL;
-	}
-	//insert default values for no animation:
+	//rewrite animation data with default values for no animation:
 	anim_header.n_frames = 1;
-	animation = new Frame_Data[1];
 	animation->n_keys   = 1;
 	animation->shape_id = 0;
-	anim_keys = new Frame_Key*[1];
-	anim_keys[0] = new Frame_Key[1];
+	anim_keys[0] = frame_keys;
 	anim_keys[0]->time  = 0.0f;
 	anim_keys[0]->value = 1.0f;
+	SectionDecoded(PENDING_GEOMETRY | PENDING_ANIMATION);
 }
 
 void PS2Icon::SetGeometry(float const* pverts, float const* pnormals, float const* ptexture, int n_vertices) 
@@ -265,109 +471,244 @@ void PS2Icon::SetGeometry(float const* pverts, float const* pnormals, float cons
 	header.n_vertices = n_vertices;
 
 	//copy animation data:
-	AllocateVertexMemory();
-	memcpy(fvertices, pverts, sizeof(float) * 3 * n_vertices);
-	memcpy(fnormals, pnormals, sizeof(float) * 3 * n_vertices);
-	float* tmptexture = new float[2*n_vertices];
-	memcpy(vert_texture, ptexture, sizeof(float) * 2 * n_vertices);
-
+	SetupStorage(header.n_vertices, 1, 1, 1);
+	if(n_vertices > 0) {
+		memcpy(fvertices, pverts, sizeof(float) * 3 * n_vertices);
+		memcpy(fnormals, pnormals, sizeof(float) * 3 * n_vertices);
+		PS2_PackFixed16Coords(fvertices, &vertices[0].f16_x, n_vertices);
+		PS2_PackFixed16Coords(fnormals, &normals[0].f16_x, n_vertices);
+	}
 	for(int i=0; i<n_vertices; i++) {
-		vertices[i].f16_x = convert_f32_to_f16(fvertices[i*3]);
-		vertices[i].f16_y = convert_f32_to_f16(fvertices[i*3 + 1]);
-		vertices[i].f16_z = convert_f32_to_f16(fvertices[i*3 + 2]);
-		vertices[i].f16_unknown = 0;
-
-		normals[i].f16_x = convert_f32_to_f16(fnormals[i*3]);
-		normals[i].f16_y = convert_f32_to_f16(fnormals[i*3 + 1]);
-		normals[i].f16_z = convert_f32_to_f16(fnormals[i*3 + 2]);
-		normals[i].f16_unknown = 0;
-
-		vert_texture[i].f16_u = convert_f32_to_f16(tmptexture[i*2]);
-		vert_texture[i].f16_v = convert_f32_to_f16(tmptexture[i*2 + 1]);
+		vert_texture[i].f16_u = convert_f32_to_f16(ptexture[i*2]);
+		vert_texture[i].f16_v = convert_f32_to_f16(ptexture[i*2 + 1]);
 		vert_texture[i].color = 0xFFFFFFFF;
 	}
-	delete[] tmptexture;
 
-	//rewrite animation data:
-	if(animation)    { delete[] animation;        animation = NULL; }
-	if(anim_keys)    {
-		for(unsigned int i=0; i<anim_header.n_frames; i++) {
-			if(anim_keys[i]) {
-				delete[] anim_keys[i];
-				anim_keys[i] = NULL;
-			}
-		}
-		delete[] anim_keys;
-		anim_keys = NULL;
-	}
-	//insert default values for no animation:
+	//rewrite animation data with default values for no animation:
 	anim_header.n_frames = 1;
-	animation = new Frame_Data[1];
 	animation->n_keys   = 1;
 	animation->shape_id = 0;
-	anim_keys = new Frame_Key*[1];
-	anim_keys[0] = new Frame_Key[1];
+	anim_keys[0] = frame_keys;
 	anim_keys[0]->time  = 0.0f;
 	anim_keys[0]->value = 1.0f;
+	SectionDecoded(PENDING_GEOMETRY | PENDING_ANIMATION);
+}
+
+/** Helper function: appends a key to a list of frame keys
+ */
+inline void add_frame_key(std::vector<PS2Icon::Frame_Key>& keys, float time, float value) {
+	PS2Icon::Frame_Key key;
+	key.time  = time;
+	key.value = value;
+	keys.push_back(key);
+}
+
+void PS2Icon::SetAnimation(OBJ_Mesh const* const* shapes, int n_shapes, float scale_factor, int frame_time)
+{
+	if((n_shapes < 1) || (frame_time < 1)) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
+	}
+	//all shapes must share the faces of the first one:
+	std::vector<OBJ_Mesh::Face> const& faces = shapes[0]->GetFaceData();
+	for(int s=1; s<n_shapes; s++) {
+		std::vector<OBJ_Mesh::Face> const& shape_faces = shapes[s]->GetFaceData();
+		bool match = (shape_faces.size() == faces.size());
+		for(size_t i=0; match && (i<faces.size()); i++) {
+			match = (shape_faces[i].vert1 == faces[i].vert1) &&
+			        (shape_faces[i].vert2 == faces[i].vert2) &&
+			        (shape_faces[i].vert3 == faces[i].vert3);
+		}
+		if(!match) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER,
+			                             "Animation shapes differ in topology" ) );
+		}
+	}
+
+	//frame keys: each shape fades in from its predecessor and out to its successor;
+	// the first shape also closes the loop at the end of the animation:
+	std::vector<Frame_Key> keys;
+	std::vector<unsigned int> n_keys(n_shapes);
+	float const d = static_cast<float>(frame_time);
+	for(int s=0; s<n_shapes; s++) {
+		size_t const first = keys.size();
+		if(n_shapes == 1) {
+			add_frame_key(keys, 0.0f, 1.0f);
+		} else if(s == 0) {
+			add_frame_key(keys, 0.0f, 1.0f);
+			add_frame_key(keys, d, 0.0f);
+			if(n_shapes > 2) { add_frame_key(keys, d * (n_shapes - 1), 0.0f); }
+			add_frame_key(keys, d * n_shapes, 1.0f);
+		} else {
+			add_frame_key(keys, d * (s - 1), 0.0f);
+			add_frame_key(keys, d * s, 1.0f);
+			add_frame_key(keys, d * (s + 1), 0.0f);
+		}
+		n_keys[s] = static_cast<unsigned int>(keys.size() - first);
+	}
+
+	//rewrite header:
+	header.file_id = 0x010000;	header.reserved = 0x3F800000;
+	header.animation_shapes = n_shapes;
+	header.n_vertices = static_cast<unsigned int>(faces.size()) * 3;
+	size_t const n_vertices = header.n_vertices;
+
+	//copy animation data; shapes are interleaved per vertex, as in the file:
+	SetupStorage(n_vertices, n_shapes, n_shapes, keys.size());
+	if(n_vertices > 0) {
+		//each shape is written to its slot of the interleaved field; the first one also provides
+		// normals and texture coordinates:
+		size_t const stride = static_cast<size_t>(n_shapes) * 3;
+		shapes[0]->ExtractUnindexed(OBJ_ArrayOutput<float, 3>(fvertices, stride), OBJ_ArrayOutput<float, 3>(fnormals),
+		                            OBJ_Fixed16Output<2>(&vert_texture[0].f16_u, sizeof(Texture_Data) / sizeof(short)),
+		                            scale_factor);
+		for(int s=1; s<n_shapes; s++) {
+			shapes[s]->ExtractUnindexed(OBJ_ArrayOutput<float, 3>(fvertices + s*3, stride), OBJ_NoOutput(), OBJ_NoOutput(),
+			                            scale_factor);
+		}
+		//convert all shapes in one go:
+		PS2_PackFixed16Coords(fvertices, &vertices[0].f16_x, n_vertices * n_shapes);
+		PS2_PackFixed16Coords(fnormals, &normals[0].f16_x, n_vertices);
+	}
+	for(size_t i=0; i<n_vertices; i++) {
+		vert_texture[i].color = 0xFFFFFFFF;
+	}
+
+	//one frame per shape:
+	anim_header.frame_length = static_cast<unsigned int>(frame_time) * n_shapes;
+	anim_header.n_frames = n_shapes;
+	Frame_Key* frame_key = frame_keys;
+	for(int s=0; s<n_shapes; s++) {
+		animation[s].shape_id = s;
+		animation[s].n_keys   = n_keys[s];
+		anim_keys[s] = frame_key;
+		frame_key += n_keys[s];
+	}
+	memcpy(frame_keys, &keys[0], sizeof(Frame_Key) * keys.size());
+	SectionDecoded(PENDING_GEOMETRY | PENDING_ANIMATION);
+}
+
+void PS2Icon::SetTextureEncoding(TextureEncoding_T encoding) {
+	switch(encoding) {
+	case TEXTURE_UNCOMPRESSED:
+		header.texture_type = 0x07;
+		break;
+	case TEXTURE_RLE:
+	case TEXTURE_RLE_OPTIMAL:
+		header.texture_type = 0x0f;
+		break;
+	default:
+		break;
+	}
+	if(encoding != m_textureEncoding) {
+		m_textureEncoding     = encoding;
+		m_encodedTextureValid = false;
+	}
 }
 
 void PS2Icon::SetTextureData(unsigned int const* data) {
 	for(unsigned int i=0; i<16384; i++) {
 		texture[i] = data[i];
 	}
+	SectionDecoded(PENDING_TEXTURE);
 }
 
-void PS2Icon::BuildMesh(OBJ_Mesh* mesh) {
-	float* tf = new float[header.n_vertices*3];
-	this->GetVertexData(tf, 0);
-	mesh->SetGeometry(tf, header.n_vertices*3);
-	delete[] tf;
-	mesh->SetNormals(fnormals, header.n_vertices*3);
-	
-	mesh->ClearTextureData();
-	float tmp;
-	for(unsigned int i=0; i<header.n_vertices; i++) {
-		//texture data has to be converted by hand (2D -> 3D)
-		tmp = convert_f16_to_f32(vert_texture[i].f16_u);
-		mesh->AddTextureData(&tmp, 1);
-		tmp = convert_f16_to_f32(vert_texture[i].f16_v);
-		mesh->AddTextureData(&tmp, 1);
-		tmp = 0.0f;
-		mesh->AddTextureData(&tmp, 1);
-	}
-
-	mesh->ClearFaceData();
-	OBJ_Mesh::Face face;
-	for(unsigned int i=0; i<header.n_vertices/3; i++) {
-		//face indices are calculated straightforward
-		///@todo: vertex recycling?
-		face.vert1 = face.normal1 = face.texture1 = i*3;
-		face.vert2 = face.normal2 = face.texture2 = i*3 + 1;
-		face.vert3 = face.normal3 = face.texture3 = i*3 + 2;
+/** Helper function: hash of a vertex key (FNV-1a over the 16 bit values)
+ */
+inline size_t hash_vertex_key(short const* key, int n) {
+	unsigned int h = 2166136261u;
+	for(int i=0; i<n; i++) {
+		h = (h ^ static_cast<unsigned short>(key[i])) * 16777619u;
+	}
+	return static_cast<size_t>(h ^ (h >> 15));
+}
+
+void PS2Icon::WeldVertices(std::vector<unsigned int>& remap, std::vector<unsigned int>& unique) const {
+	enum { KEY_SIZE = 8 };		//position, normal and texture coordinates
+	unsigned int const n = header.n_vertices;
+	remap.resize(n);
+	unique.clear();
+	//open addressing with linear probing; slots hold index+1 into unique, 0 marks an empty slot:
+	size_t table_size = 16;
+	while(table_size < 2 * static_cast<size_t>(n)) { table_size *= 2; }
+	std::vector<unsigned int> table(table_size, 0);
+	std::vector<short> keys(static_cast<size_t>(n) * KEY_SIZE);
+	for(unsigned int i=0; i<n; i++) {
+		short* const key = &keys[static_cast<size_t>(i) * KEY_SIZE];
+		Vertex_Coord const& v = vertices[i * header.animation_shapes];
+		key[0] = v.f16_x;              key[1] = v.f16_y;              key[2] = v.f16_z;
+		key[3] = normals[i].f16_x;     key[4] = normals[i].f16_y;     key[5] = normals[i].f16_z;
+		key[6] = vert_texture[i].f16_u; key[7] = vert_texture[i].f16_v;
+		size_t slot = hash_vertex_key(key, KEY_SIZE) & (table_size - 1);
+		for(;;) {
+			unsigned int const entry = table[slot];
+			if(entry == 0) {
+				unique.push_back(i);
+				table[slot] = static_cast<unsigned int>(unique.size());
+				remap[i] = static_cast<unsigned int>(unique.size() - 1);
+				break;
+			}
+			if(memcmp(&keys[static_cast<size_t>(unique[entry - 1]) * KEY_SIZE], key, sizeof(short) * KEY_SIZE) == 0) {
+				remap[i] = entry - 1;
+				break;
+			}
+			slot = (slot + 1) & (table_size - 1);
+		}
+	}
+}
 
+void PS2Icon::BuildMesh(OBJ_Mesh* mesh, bool weld) {
+	EnsureGeometry();
+	unsigned int const n_vertices = header.n_vertices;
+	std::vector<unsigned int> remap;		//output vertex of each icon vertex
+	std::vector<unsigned int> unique;		//icon vertex of each output vertex
+	if(weld) {
+		WeldVertices(remap, unique);
+	} else {
+		remap.resize(n_vertices);
+		for(unsigned int i=0; i<n_vertices; i++) { remap[i] = i; }
+		unique = remap;
+	}
+	size_t const n_out = unique.size();
+
+	//one spare element, so the fields are never empty:
+	std::vector<float> tf(n_out * 3 + 3);
+	std::vector<float> tn(n_out * 3 + 3);
+	std::vector<float> tt(n_out * 3 + 3);
+	for(size_t i=0; i<n_out; i++) {
+		unsigned int const src = unique[i];
+		memcpy(&tf[i*3], &fvertices[static_cast<size_t>(src) * header.animation_shapes * 3], sizeof(float) * 3);
+		memcpy(&tn[i*3], &fnormals[static_cast<size_t>(src) * 3], sizeof(float) * 3);
+		//texture data has to be converted by hand (2D -> 3D)
+		tt[i*3]     = convert_f16_to_f32(vert_texture[src].f16_u);
+		tt[i*3 + 1] = convert_f16_to_f32(vert_texture[src].f16_v);
+		tt[i*3 + 2] = 0.0f;
+	}
+	mesh->SetGeometry(&tf[0], static_cast<int>(n_out * 3));
+	mesh->SetNormals(&tn[0], static_cast<int>(n_out * 3));
+	mesh->SetTextureData(&tt[0], static_cast<int>(n_out * 3));
+
+	std::vector<OBJ_Mesh::Face> faces(n_vertices / 3);
+	for(unsigned int i=0; i<n_vertices/3; i++) {
+		OBJ_Mesh::Face& face = faces[i];
+		face.vert1 = face.normal1 = face.texture1 = static_cast<int>(remap[i*3]);
+		face.vert2 = face.normal2 = face.texture2 = static_cast<int>(remap[i*3 + 1]);
+		face.vert3 = face.normal3 = face.texture3 = static_cast<int>(remap[i*3 + 2]);
 		face.smoothing_group = 1;
-		mesh->AddFaceData(&face, 1);
-	}		
+	}
+	mesh->SetFaceData(faces);
 }
 
 PS2Icon::~PS2Icon() 
 {
-	if(vertices)     { delete[] vertices;          vertices = NULL; }
-	if(fvertices)    { delete[] fvertices;        fvertices = NULL; }
-	if(normals)      { delete[] normals;            normals = NULL; }
-	if(fnormals)     { delete[] fnormals;          fnormals = NULL; }
-	if(vert_texture) { delete[] vert_texture;  vert_texture = NULL; }
-	if(animation)    { delete[] animation;        animation = NULL; }
-	if(anim_keys)    {
-		for(unsigned int i=0; i<anim_header.n_frames; i++) {
-			if(anim_keys[i]) {
-				delete[] anim_keys[i];
-				anim_keys[i] = NULL;
-			}
-		}
-		delete[] anim_keys;
-		anim_keys = NULL;
-	}
+	ReleaseMemory();
+}
+
+void PS2Icon::ReleaseMemory()
+{
+	ReleaseSource();
+	ReleaseStorage();
+	m_pending = 0;
+	anim_header.n_frames = 0;
 }
 
 int PS2Icon::GetNVertices() const {
@@ -379,10 +720,12 @@ int PS2Icon::GetNShapes() const {
 	return (int)header.animation_shapes;
 }
 int PS2Icon::GetNFrames() const {
+	EnsureAnimation();
 	if(anim_header.n_frames > INT_MAX) { throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED ) ); }
 	return static_cast<int>(anim_header.n_frames);
 }
 int PS2Icon::GetFrameShape(int frame) const {
+	EnsureAnimation();
 	if(static_cast<unsigned int>(frame) >= anim_header.n_frames) { 
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) ); 
 	}
@@ -390,6 +733,7 @@ int PS2Icon::GetFrameShape(int frame) const {
 	return static_cast<int>(animation[frame].shape_id);
 }
 int PS2Icon::GetNFrameKeys(int frame) const {
+	EnsureAnimation();
 	if(static_cast<unsigned int>(frame) >= anim_header.n_frames) { 
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) ); 
 	}
@@ -397,6 +741,7 @@ int PS2Icon::GetNFrameKeys(int frame) const {
 	return static_cast<int>(animation[frame].n_keys);
 }
 float PS2Icon::GetFrameKeyTime(int frame, int key) const {
+	EnsureAnimation();
 	if((static_cast<unsigned int>(frame) >= anim_header.n_frames) ||
 	   (static_cast<unsigned int>(key) >= animation[frame].n_keys) ) {
 		   throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );;
@@ -404,6 +749,7 @@ float PS2Icon::GetFrameKeyTime(int frame, int key) const {
 	return anim_keys[frame][key].time;
 }
 float PS2Icon::GetFrameKeyValue(int frame, int key) const {
+	EnsureAnimation();
 	if((static_cast<unsigned int>(frame) >= anim_header.n_frames) ||
 	   (static_cast<unsigned int>(key) >= animation[frame].n_keys) ) {
 		   throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
@@ -411,10 +757,15 @@ float PS2Icon::GetFrameKeyValue(int frame, int key) const {
 	return anim_keys[frame][key].value;
 }
 int PS2Icon::GetTextureType() const {
-	if(header.texture_type > INT_MAX) { throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED ) ); }
-	return static_cast<int>(header.texture_type);
+	unsigned int const texture_type = GetSerializedTextureType();
+	if(texture_type > INT_MAX) { throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED ) ); }
+	return static_cast<int>(texture_type);
+}
+PS2Icon::TextureEncoding_T PS2Icon::GetTextureEncoding() const {
+	return m_textureEncoding;
 }
 void PS2Icon::GetVertexData(float* data, int shape) const {
+	EnsureGeometry();
 	if(shape >= static_cast<int>(header.animation_shapes)) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) ); 
 	}
@@ -435,23 +786,28 @@ void PS2Icon::GetVertexData(float* data, int shape) const {
 	}
 }
 void PS2Icon::GetVertexColorData(unsigned int* data) const {
+	EnsureGeometry();
 	for(unsigned int i=0; i<header.n_vertices; i++) {
 		data[i] = vert_texture[i].color;
 	}
 }
 void PS2Icon::GetNormalData(float* data) const {
+	EnsureGeometry();
 	memcpy(data, fnormals, sizeof(float)*header.n_vertices*3);
 }
 void PS2Icon::GetVertexTextureData(float* data) const {
+	EnsureGeometry();
 	for(unsigned int i=0; i<header.n_vertices; i++) {
 		data[i*2]   = convert_f16_to_f32(vert_texture[i].f16_u);
 		data[i*2+1] = convert_f16_to_f32(vert_texture[i].f16_v);
 	}
 }
 void PS2Icon::GetTextureData(unsigned int* data) const {
+	EnsureTexture();
 	memcpy(data, texture, sizeof(unsigned int)*16384);
 }
 void PS2Icon::GetTextureData(unsigned int* data, int pitch) const {
+	EnsureTexture();
 	if((pitch < 512) || (pitch % 4 != 0)) { 
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
 	}
@@ -463,101 +819,114 @@ unsigned int PS2Icon::GetTextureData(int x, int y) const {
 	if((x < 0) || (x >= 128) || (y < 0) || (y >= 128)) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER ) );
 	}
+	EnsureTexture();
 	return texture[y*128 + x];
 }
 
 void PS2Icon::WriteFile(const char * fname) const {
-	std::ofstream fout(fname, std::ios_base::out | std::ios_base::binary);
-	if(fout.fail()) { 
+	//build the file image first, so that the file is written with a single call:
+	std::vector<unsigned char> buffer;
+	Serialize(buffer);
+
+	GB_STATS_TIMER("ps2icon.write_file");
+	try {
+		GhulbusUtil::GetFileBackend().WriteFile(fname, &buffer[0], buffer.size());
+	} catch(Ghulbus::gbException&) {
 		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
-			                         "Output icon file could not be opened") );
+			                         "Error while writing output icon file") );
+	}
+	GB_STATS_COUNT("ps2icon.bytes_written", buffer.size());
+}
+
+size_t PS2Icon::GetSerializedSize() const {
+	EnsureGeometry();
+	EnsureAnimation();
+	EnsureTexture();
+	size_t size = sizeof(Icon_Header);
+	//vertex segment:
+	size += (sizeof(Vertex_Coord) * (header.animation_shapes + 1) + sizeof(Texture_Data)) * header.n_vertices;
+	//animation segment:
+	size += sizeof(Animation_Header);
+	for(unsigned int i=0; i<anim_header.n_frames; i++) {
+		size += sizeof(Frame_Data) + sizeof(Frame_Key) * animation[i].n_keys;
+	}
+	//texture segment:
+	if(GetSerializedTextureType() <= 0x07) {
+		size += 16384 * 2;
+	} else {
+		size += 4 + EncodeTexture().size();
 	}
-	fout.seekp(std::ios::beg);
+	return size;
+}
+
+void PS2Icon::Serialize(std::vector<unsigned char>& buffer) const {
+	buffer.resize(GetSerializedSize());
+	Serialize(&buffer[0], buffer.size());
+}
+
+size_t PS2Icon::Serialize(void* dst, size_t cap) const {
+	GB_STATS_TIMER("ps2icon.serialize");
+	size_t const size = GetSerializedSize();
+	if(cap < size) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Destination buffer is too small" ) );
+	}
+	unsigned char* p = static_cast<unsigned char*>(dst);
 
 	//write header:
-	fout.write( reinterpret_cast<char const*>(&header), sizeof(Icon_Header) );
+	Icon_Header file_header = header;
+	file_header.texture_type = GetSerializedTextureType();
+	p = write_block(p, &file_header, sizeof(Icon_Header));
 
 	//write vertex segment:
 	for(unsigned int i=0; i<header.n_vertices; i++) {
 		//vertex coordinates, one for each shape:
-		fout.write( reinterpret_cast<char*>(&vertices[i*header.animation_shapes]),
-			        sizeof(Vertex_Coord) * header.animation_shapes );
+		p = write_block(p, &vertices[i*header.animation_shapes], sizeof(Vertex_Coord) * header.animation_shapes);
 		//normal coordinates:
-		fout.write( reinterpret_cast<char*>(&normals[i]), sizeof(Vertex_Coord) );
+		p = write_block(p, &normals[i], sizeof(Vertex_Coord));
 		//texture coordinates:
-		fout.write( reinterpret_cast<char*>(&vert_texture[i]), sizeof(Texture_Data) );
+		p = write_block(p, &vert_texture[i], sizeof(Texture_Data));
 	}
 
 	//write animation segment:
 	//header:
-	fout.write( reinterpret_cast<char const*>(&anim_header), sizeof(Animation_Header) );
+	p = write_block(p, &anim_header, sizeof(Animation_Header));
 	//data:
 	for(unsigned int i=0; i<anim_header.n_frames; i++) {
-		fout.write( reinterpret_cast<char*>(&animation[i]), sizeof(Frame_Data) );
-		fout.write( reinterpret_cast<char*>(anim_keys[i]), sizeof(Frame_Key) * animation[i].n_keys );
+		p = write_block(p, &animation[i], sizeof(Frame_Data));
+		p = write_block(p, anim_keys[i], sizeof(Frame_Key) * animation[i].n_keys);
 	}
 
 	//write texture segment:
-	if(header.texture_type <= 0x07) {
+	if(file_header.texture_type <= 0x07) {
 		//uncompressed:
-		unsigned short c;
-		for(int i=0; i<16384; i++) {
-			unsigned char r = static_cast<unsigned char>( (texture[i] >> 16) & 0xff );
-			unsigned char g = static_cast<unsigned char>( (texture[i] >>  8) & 0xff );
-			unsigned char b = static_cast<unsigned char>(  texture[i]        & 0xff );
-			c = static_cast<unsigned short>( ((r >> 3) & 0x001f) | ((g << 2) & 0x03e0) | ((b << 7) & 0x7c00) );
-			fout.write( reinterpret_cast<char*>(&c), 2 );
-		}
+		PS2TextureCodec::PackTexels(texture, p, 16384);
+		p += 16384 * 2;
 	} else {
-		//compressed textures:
-		//allocate space for size info:
-		int base = fout.tellp();
-		unsigned int size = 0;
-		fout.write( reinterpret_cast<char*>(&base), 4 );	//dummy data
-		//rle main loop:
-		int i=0;
-		while(i<16384) {
-			//rle step 1: count replication
-			int rep_count = 1;
-			while( (texture[i] == texture[i+rep_count]) ) { rep_count++; }
-			if(rep_count > 1) {		//pixels are replicated rep_count times
-				unsigned char r = static_cast<unsigned char>( (texture[i] >> 16) & 0xff );
-				unsigned char g = static_cast<unsigned char>( (texture[i] >>  8) & 0xff );
-				unsigned char b = static_cast<unsigned char>(  texture[i]        & 0xff );
-				unsigned short c = ((unsigned short)(r >> 3) | (g << 2) | (b << 7) );
-				fout.write( reinterpret_cast<char*>(&rep_count), 2 );
-				fout.write( reinterpret_cast<char*>(&c), 2 );
-				i += rep_count;
-			} else {				//no replication
-				unsigned short pix_count = 0;	//number of non equal subsequent pixels
-				while((texture[i+pix_count] != texture[i+pix_count+1]) &&
-				      (pix_count < 255) ) { pix_count++; }
-				pix_count = 0xFFFF ^ (pix_count-1);
-				fout.write( reinterpret_cast<char*>(&pix_count), 2 );
-				pix_count ^= 0xFFFF;
-				for(unsigned short j=0; j<=pix_count; j++) {		//insert pixels:
-					unsigned char r = static_cast<unsigned char>( (texture[i] >> 16) & 0xff );
-					unsigned char g = static_cast<unsigned char>( (texture[i] >>  8) & 0xff );
-					unsigned char b = static_cast<unsigned char>(  texture[i]        & 0xff );
-					unsigned short c = ((unsigned short)(r >> 3) | (g << 2) | (b << 7) );
-					fout.write( reinterpret_cast<char*>(&c), 2 );
-					i++;
-				}
-			}
-		}
-		//finalize: write size of the encoded segment to base:
-		size = fout.tellp();
-		size -= (base + 4);
-
-		fout.seekp(base);
-		fout.write( reinterpret_cast<char*>(&size), 4 );
+		//compressed textures; the encoding was cached by GetSerializedSize():
+		std::vector<unsigned char> const& rle = EncodeTexture();
+		unsigned int const rle_size = static_cast<unsigned int>(rle.size());
+		p = write_block(p, &rle_size, 4);
+		p = write_block(p, &rle[0], rle.size());
 	}
+	GB_STATS_COUNT("ps2icon.vertices_written", header.n_vertices);
+	return size;
+}
 
-	fout.close();
-	if(fout.fail()) { 
-		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED,
-			                         "Error while writing output icon file") );
+std::vector<unsigned char> const& PS2Icon::EncodeTexture() const {
+	EnsureTexture();
+	if(!m_encodedTextureValid) {
+		bool const optimal = (m_textureEncoding == TEXTURE_RLE_OPTIMAL) || (m_textureEncoding == TEXTURE_AUTO);
+		PS2TextureCodec::Encode(texture, m_encodedTexture,
+		                        (optimal) ? PS2TextureCodec::RLE_OPTIMAL : PS2TextureCodec::RLE_GREEDY);
+		m_encodedTextureValid = true;
 	}
+	return m_encodedTexture;
+}
+
+unsigned int PS2Icon::GetSerializedTextureType() const {
+	if(m_textureEncoding != TEXTURE_AUTO) { return header.texture_type; }
+	//rle data is preceded by a 32 bit size field:
+	return (EncodeTexture().size() + 4 < 16384 * 2) ? 0x0f : 0x07;
 }
 
 ///@todo support for alpha bit (bit #16) in texture
@@ -0,0 +1,372 @@
+/**
+ * @file src/ps2_texture_codec.cpp
+ *
+ * @brief Implementation of the PS2 icon texture codecbuild_header/
+ */
+#include "../include/ps2_texture_codec.hpp"
+#include "../gbLib/include/gbMappedFile.hpp"
+#include "../gbLib/include/gbStats.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#	define PS2_TEXTURE_CODEC_SSE2
+#	include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#	define PS2_TEXTURE_CODEC_NEON
+#	include <arm_neon.h>
+#endif
+#ifdef _MSC_VER
+#	include <intrin.h>
+#endif
+
+/** Helper function: number of trailing zero bits of a non-zero value
+ */
+inline unsigned int count_trailing_zeros(unsigned int x) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, x);
+	return static_cast<unsigned int>(index);
+#else
+	return static_cast<unsigned int>(__builtin_ctz(x));
+#endif
+}
+
+/** Helper function: reads an unaligned texel
+ */
+inline unsigned short load_texel(unsigned char const* p) {
+	unsigned short ret;
+	memcpy(&ret, p, 2);
+	return ret;
+}
+
+/** Helper function: writes an unaligned 16 bit value to a buffer
+ */
+inline unsigned char* store_u16(unsigned char* p, unsigned short v) {
+	memcpy(p, &v, 2);
+	return p + 2;
+}
+
+void PS2TextureCodec::PackTexels(unsigned int const* src, void* dst, size_t n)
+{
+	unsigned char* p = static_cast<unsigned char*>(dst);
+	size_t i = 0;
+#if defined(PS2_TEXTURE_CODEC_SSE2)
+	__m128i const mask_r = _mm_set1_epi32(0x001f);
+	__m128i const mask_g = _mm_set1_epi32(0x03e0);
+	__m128i const mask_b = _mm_set1_epi32(0x7c00);
+	for(; i + 8 <= n; i += 8) {
+		__m128i const a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+		__m128i const b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i + 4));
+		__m128i const ta = _mm_or_si128( _mm_or_si128( _mm_and_si128(_mm_srli_epi32(a, 19), mask_r),
+		                                               _mm_and_si128(_mm_srli_epi32(a,  6), mask_g) ),
+		                                 _mm_and_si128(_mm_slli_epi32(a, 7), mask_b) );
+		__m128i const tb = _mm_or_si128( _mm_or_si128( _mm_and_si128(_mm_srli_epi32(b, 19), mask_r),
+		                                               _mm_and_si128(_mm_srli_epi32(b,  6), mask_g) ),
+		                                 _mm_and_si128(_mm_slli_epi32(b, 7), mask_b) );
+		//texels are below 0x8000, so the signed saturation never triggers:
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p + i*2), _mm_packs_epi32(ta, tb));
+	}
+#elif defined(PS2_TEXTURE_CODEC_NEON)
+	uint32x4_t const mask_r = vdupq_n_u32(0x001f);
+	uint32x4_t const mask_g = vdupq_n_u32(0x03e0);
+	uint32x4_t const mask_b = vdupq_n_u32(0x7c00);
+	for(; i + 8 <= n; i += 8) {
+		uint32x4_t const a = vld1q_u32(src + i);
+		uint32x4_t const b = vld1q_u32(src + i + 4);
+		uint32x4_t const ta = vorrq_u32( vorrq_u32( vandq_u32(vshrq_n_u32(a, 19), mask_r),
+		                                            vandq_u32(vshrq_n_u32(a,  6), mask_g) ),
+		                                 vandq_u32(vshlq_n_u32(a, 7), mask_b) );
+		uint32x4_t const tb = vorrq_u32( vorrq_u32( vandq_u32(vshrq_n_u32(b, 19), mask_r),
+		                                            vandq_u32(vshrq_n_u32(b,  6), mask_g) ),
+		                                 vandq_u32(vshlq_n_u32(b, 7), mask_b) );
+		uint16x8_t const t = vcombine_u16(vmovn_u32(ta), vmovn_u32(tb));
+		vst1q_u8(p + i*2, vreinterpretq_u8_u16(t));
+	}
+#endif
+	for(; i < n; i++) {
+		store_u16(p + i*2, PS2_ARGB32ToTexel(src[i]));
+	}
+}
+
+void PS2TextureCodec::UnpackTexels(void const* src, unsigned int* dst, size_t n)
+{
+	unsigned char const* p = static_cast<unsigned char const*>(src);
+	size_t i = 0;
+#if defined(PS2_TEXTURE_CODEC_SSE2)
+	__m128i const zero   = _mm_setzero_si128();
+	__m128i const alpha  = _mm_set1_epi32(static_cast<int>(0xff000000));
+	__m128i const mask_r = _mm_set1_epi32(0x001f);
+	__m128i const mask_g = _mm_set1_epi32(0x03e0);
+	__m128i const mask_b = _mm_set1_epi32(0x7c00);
+	for(; i + 8 <= n; i += 8) {
+		__m128i const v  = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i*2));
+		__m128i const lo = _mm_unpacklo_epi16(v, zero);
+		__m128i const hi = _mm_unpackhi_epi16(v, zero);
+		__m128i const ca = _mm_or_si128( _mm_or_si128(alpha, _mm_slli_epi32(_mm_and_si128(lo, mask_r), 19)),
+		                                 _mm_or_si128( _mm_slli_epi32(_mm_and_si128(lo, mask_g), 6),
+		                                               _mm_srli_epi32(_mm_and_si128(lo, mask_b), 7) ) );
+		__m128i const cb = _mm_or_si128( _mm_or_si128(alpha, _mm_slli_epi32(_mm_and_si128(hi, mask_r), 19)),
+		                                 _mm_or_si128( _mm_slli_epi32(_mm_and_si128(hi, mask_g), 6),
+		                                               _mm_srli_epi32(_mm_and_si128(hi, mask_b), 7) ) );
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),     ca);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), cb);
+	}
+#elif defined(PS2_TEXTURE_CODEC_NEON)
+	uint32x4_t const alpha  = vdupq_n_u32(0xff000000);
+	uint32x4_t const mask_r = vdupq_n_u32(0x001f);
+	uint32x4_t const mask_g = vdupq_n_u32(0x03e0);
+	uint32x4_t const mask_b = vdupq_n_u32(0x7c00);
+	for(; i + 8 <= n; i += 8) {
+		uint16x8_t const v  = vreinterpretq_u16_u8(vld1q_u8(p + i*2));
+		uint32x4_t const lo = vmovl_u16(vget_low_u16(v));
+		uint32x4_t const hi = vmovl_u16(vget_high_u16(v));
+		uint32x4_t const ca = vorrq_u32( vorrq_u32(alpha, vshlq_n_u32(vandq_u32(lo, mask_r), 19)),
+		                                 vorrq_u32( vshlq_n_u32(vandq_u32(lo, mask_g), 6),
+		                                            vshrq_n_u32(vandq_u32(lo, mask_b), 7) ) );
+		uint32x4_t const cb = vorrq_u32( vorrq_u32(alpha, vshlq_n_u32(vandq_u32(hi, mask_r), 19)),
+		                                 vorrq_u32( vshlq_n_u32(vandq_u32(hi, mask_g), 6),
+		                                            vshrq_n_u32(vandq_u32(hi, mask_b), 7) ) );
+		vst1q_u32(dst + i,     ca);
+		vst1q_u32(dst + i + 4, cb);
+	}
+#endif
+	for(; i < n; i++) {
+		dst[i] = PS2_TexelToARGB32(load_texel(p + i*2));
+	}
+}
+
+/** Helper function: builds a bit mask with bit i set if texel i equals texel i+1
+ * @param[in] texels A field of size (N_TEXELS + 8); the padding is read but never reported
+ * @param[out] mask A field of size (N_TEXELS / 32)
+ */
+static void BuildRunMask(unsigned short const* texels, unsigned int* mask)
+{
+	size_t const n_words = PS2TextureCodec::N_TEXELS / 32;
+	for(size_t w=0; w<n_words; w++) {
+		unsigned short const* t = texels + w*32;
+#if defined(PS2_TEXTURE_CODEC_SSE2)
+		__m128i eq[4];
+		for(int j=0; j<4; j++) {
+			eq[j] = _mm_cmpeq_epi16( _mm_loadu_si128(reinterpret_cast<__m128i const*>(t + j*8)),
+			                         _mm_loadu_si128(reinterpret_cast<__m128i const*>(t + j*8 + 1)) );
+		}
+		unsigned int const lo = static_cast<unsigned int>(_mm_movemask_epi8(_mm_packs_epi16(eq[0], eq[1])));
+		unsigned int const hi = static_cast<unsigned int>(_mm_movemask_epi8(_mm_packs_epi16(eq[2], eq[3])));
+		mask[w] = lo | (hi << 16);
+#elif defined(PS2_TEXTURE_CODEC_NEON)
+		static unsigned short const weight_values[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+		uint16x8_t const weights = vld1q_u16(weight_values);
+		unsigned int bits = 0;
+		for(int j=0; j<4; j++) {
+			uint16x8_t const eq = vceqq_u16(vld1q_u16(t + j*8), vld1q_u16(t + j*8 + 1));
+			uint64x2_t const sum = vpaddlq_u32(vpaddlq_u16(vandq_u16(eq, weights)));
+			bits |= static_cast<unsigned int>(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1)) << (j*8);
+		}
+		mask[w] = bits;
+#else
+		unsigned int bits = 0;
+		for(unsigned int j=0; j<32; j++) {
+			if(t[j] == t[j+1]) { bits |= (1u << j); }
+		}
+		mask[w] = bits;
+#endif
+	}
+	//the last texel never continues a run:
+	mask[n_words - 1] &= 0x7fffffff;
+}
+
+/** Helper function: length of the sequence of equal bits starting at a position
+ * @param[in] mask Bit mask built by BuildRunMask()
+ * @param[in] start First bit of the sequence
+ * @param[in] value true to count set bits, false to count cleared bits
+ * @param[in] limit Maximum length to report
+ */
+static size_t CountRunBits(unsigned int const* mask, size_t start, bool value, size_t limit)
+{
+	size_t const end = std::min(start + limit, static_cast<size_t>(PS2TextureCodec::N_TEXELS));
+	size_t pos = start;
+	while(pos < end) {
+		unsigned int const word  = (value) ? mask[pos >> 5] : ~mask[pos >> 5];
+		unsigned int const shift = static_cast<unsigned int>(pos & 31);
+		//bits shifted in from the top end the sequence at the word boundary:
+		unsigned int const rest  = ~(word >> shift);
+		if(rest == 0) {
+			pos += 32;
+		} else {
+			unsigned int const n = count_trailing_zeros(rest);
+			pos += n;
+			if(n < 32 - shift) { break; }
+		}
+	}
+	return std::min(pos, end) - start;
+}
+
+/** Helper function: writes a repetition to the RLE stream
+ */
+inline unsigned char* store_repeat(unsigned char* p, unsigned short texel, size_t rep_count) {
+	p = store_u16(p, static_cast<unsigned short>(rep_count));
+	return store_u16(p, texel);
+}
+
+/** Helper function: writes a literal run to the RLE stream
+ */
+inline unsigned char* store_literal(unsigned char* p, unsigned short const* texels, size_t pix_count) {
+	p = store_u16(p, static_cast<unsigned short>(0xFFFF ^ (pix_count - 1)));
+	memcpy(p, texels, pix_count * 2);
+	return p + pix_count * 2;
+}
+
+/** Helper function: greedy RLE encoding
+ * @param[in] texels The packed texture
+ * @param[in] mask Bit mask built by BuildRunMask()
+ * @param[out] p Destination for the encoded stream
+ * @return End of the encoded stream
+ */
+static unsigned char* EncodeGreedy(unsigned short const* texels, unsigned int const* mask, unsigned char* p)
+{
+	size_t i = 0;
+	while(i < PS2TextureCodec::N_TEXELS) {
+		if(mask[i >> 5] & (1u << (i & 31))) {
+			//pixel is replicated rep_count times:
+			size_t const rep_count = CountRunBits(mask, i, true, PS2TextureCodec::N_TEXELS) + 1;
+			p = store_repeat(p, texels[i], rep_count);
+			i += rep_count;
+		} else {
+			//sequence of non equal pixels; the last pixel of the texture always ends a sequence:
+			size_t const pix_count = CountRunBits(mask, i, false, 255);
+			p = store_literal(p, texels + i, pix_count);
+			i += pix_count;
+		}
+	}
+	return p;
+}
+
+/** Helper function: RLE encoding of minimal size
+ * @param[in] texels The packed texture
+ * @param[in] mask Bit mask built by BuildRunMask()
+ * @param[out] p Destination for the encoded stream
+ * @return End of the encoded stream
+ * @note A repetition that ends inside a run of equal pixels is only useful if it is followed
+ *       by a literal run covering the rest of the run; otherwise merging the two would be
+ *       cheaper. Only repetitions that end at most 255 pixels before the end of their run
+ *       are therefore considered.
+ * @throw std::bad_alloc
+ */
+static unsigned char* EncodeOptimal(unsigned short const* texels, unsigned int const* mask, unsigned char* p)
+{
+	size_t const n = PS2TextureCodec::N_TEXELS;
+	size_t const max_literal = 256;
+	//cost[i]: minimal encoded size of the pixels [i, n); length/repeat: first run of that encoding
+	std::vector<unsigned int> cost(n + 1);
+	std::vector<unsigned short> length(n);
+	std::vector<unsigned char> repeat(n);
+	size_t run_length = 0;		//number of pixels equal to texel i, starting at i
+	cost[n] = 0;
+	for(size_t i=n; i-- > 0; ) {
+		run_length = (mask[i >> 5] & (1u << (i & 31))) ? (run_length + 1) : 1;
+		unsigned int best = cost[i + run_length] + 4;
+		size_t best_length = run_length;
+		bool best_repeat = true;
+		for(size_t l = run_length - 1; (l > 0) && (l + 255 >= run_length); l--) {
+			if(cost[i + l] + 4 < best) {
+				best = cost[i + l] + 4;
+				best_length = l;
+			}
+		}
+		size_t const literal_end = std::min(max_literal, n - i);
+		for(size_t l=1; l<=literal_end; l++) {
+			unsigned int const c = cost[i + l] + 2 + 2*static_cast<unsigned int>(l);
+			if(c < best) {
+				best = c;
+				best_length = l;
+				best_repeat = false;
+			}
+		}
+		cost[i]   = best;
+		length[i] = static_cast<unsigned short>(best_length);
+		repeat[i] = (best_repeat) ? 1 : 0;
+	}
+	for(size_t i=0; i<n; i += length[i]) {
+		if(repeat[i]) {
+			p = store_repeat(p, texels[i], length[i]);
+		} else {
+			p = store_literal(p, texels + i, length[i]);
+		}
+	}
+	return p;
+}
+
+#ifndef GB_NO_STATS
+/** Helper function: counts the repetitions and literal runs of an RLE stream for gbStats
+ */
+static void CountRuns(unsigned char const* p, unsigned char const* end)
+{
+	unsigned long long runs = 0, literals = 0;
+	while(p < end) {
+		unsigned int const rep_count = load_texel(p);
+		if(rep_count < 0xFF00) {
+			runs++;
+			p += 4;
+		} else {
+			literals++;
+			p += 2 + 2 * ((0xFFFF ^ rep_count) + 1);
+		}
+	}
+	GB_STATS_COUNT("texture.rle_runs_encoded", runs);
+	GB_STATS_COUNT("texture.rle_literals_encoded", literals);
+}
+#endif
+
+void PS2TextureCodec::Encode(unsigned int const* src, std::vector<unsigned char>& out, RLE_Mode_T mode)
+{
+	GB_STATS_TIMER("texture.rle_encode");
+	//kept off the stack, as encoding runs on worker threads; the padding starts out zeroed:
+	std::vector<unsigned short> texels(N_TEXELS + 8);
+	PackTexels(src, &texels[0], N_TEXELS);
+	std::vector<unsigned int> mask(N_TEXELS / 32);
+	BuildRunMask(&texels[0], &mask[0]);
+
+	//a literal pixel costs at most 4 bytes, as it is always followed by a run:
+	out.resize(N_TEXELS * 4);
+	unsigned char* const start = &out[0];
+	unsigned char* const end = (mode == RLE_OPTIMAL) ? EncodeOptimal(&texels[0], &mask[0], start) :
+	                                                   EncodeGreedy(&texels[0], &mask[0], start);
+	out.resize(end - start);
+#ifndef GB_NO_STATS
+	if(GhulbusUtil::gbStats::IsEnabled()) { CountRuns(start, end); }
+#endif
+}
+
+void PS2TextureCodec::Decode(void const* src, size_t size, unsigned int* dst)
+{
+	GB_STATS_TIMER("texture.rle_decode");
+	GhulbusUtil::gbMemoryReader rle(static_cast<unsigned char const*>(src), size);
+	size_t index = 0;
+	unsigned long long runs = 0, literals = 0;
+	while( rle.GetRemaining() > 0 ) {
+		//next 16 bits indicate the type of data to follow:
+		unsigned int const rep_count = load_texel(rle.Skip(2));
+		if(rep_count < 0xFF00) {			//repeat the pixel rep_count times
+			unsigned int const c = PS2_TexelToARGB32(load_texel(rle.Skip(2)));
+			if(rep_count > (N_TEXELS - index)) {
+				throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "RLE texture data is corrupted" ) );
+			}
+			std::fill(dst + index, dst + index + rep_count, c);
+			index += rep_count;
+			runs++;
+		} else {							//copy the next pix_count pixels directly
+			unsigned int const pix_count = (0xFFFF ^ rep_count) + 1;
+			if(pix_count > (N_TEXELS - index)) {
+				throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "RLE texture data is corrupted" ) );
+			}
+			UnpackTexels(rle.Skip(pix_count * 2), dst + index, pix_count);
+			index += pix_count;
+			literals++;
+		}
+	}
+	//pixels not covered by the rle stream are left black:
+	std::fill(dst + index, dst + N_TEXELS, 0u);
+	GB_STATS_COUNT("texture.rle_runs_decoded", runs);
+	GB_STATS_COUNT("texture.rle_literals_decoded", literals);
+}
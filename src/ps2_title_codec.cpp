@@ -0,0 +1,176 @@
+/**
+ * @file src/ps2_title_codec.cpp
+ *
+ * @brief Implementation of the PS2TitleCodec classbuild_header/
+ */
+#include "../include/ps2_title_codec.hpp"
+
+/** S-JIS character for each ASCII character (lead byte in the high byte)
+ */
+static unsigned short const SJIS_ENCODE_TABLE[256] = {
+	0x0000, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0x00
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0x08
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0x10
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0x18
+	0x823F, 0x8149, 0x8168, 0x8194, 0x8190, 0x8193, 0x8195, 0x8166,		// 0x20
+	0x8169, 0x816A, 0x8196, 0x817B, 0x8143, 0x817C, 0x8144, 0x815E,		// 0x28
+	0x824F, 0x8250, 0x8251, 0x8252, 0x8253, 0x8254, 0x8255, 0x8256,		// 0x30
+	0x8257, 0x8258, 0x8146, 0x825A, 0x825B, 0x825C, 0x825D, 0x825E,		// 0x38
+	0x825F, 0x8260, 0x8261, 0x8262, 0x8263, 0x8264, 0x8265, 0x8266,		// 0x40
+	0x8267, 0x8268, 0x8269, 0x826A, 0x826B, 0x826C, 0x826D, 0x826E,		// 0x48
+	0x826F, 0x8270, 0x8271, 0x8272, 0x8273, 0x8274, 0x8275, 0x8276,		// 0x50
+	0x8277, 0x8278, 0x8279, 0x816D, 0x815F, 0x816E, 0x814F, 0x8151,		// 0x58
+	0x814D, 0x8281, 0x8282, 0x8283, 0x8284, 0x8285, 0x8286, 0x8287,		// 0x60
+	0x8288, 0x8289, 0x828A, 0x828B, 0x828C, 0x828D, 0x828E, 0x828F,		// 0x68
+	0x8290, 0x8291, 0x8292, 0x8293, 0x8294, 0x8295, 0x8296, 0x8297,		// 0x70
+	0x8298, 0x8299, 0x829A, 0x816F, 0x8162, 0x8170, 0x8160, 0x8148,		// 0x78
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0x80
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0x88
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0x90
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0x98
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0xA0
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0xA8
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0xB0
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0xB8
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0xC0
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0xC8
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0xD0
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0xD8
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0xE0
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0xE8
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148,		// 0xF0
+	0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148, 0x8148		// 0xF8
+};
+
+/** ASCII character for each trail byte, one row per supported lead byte
+ */
+static char const SJIS_DECODE_TABLE[4][256] = {
+	{	// unsupported lead bytes
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x00
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x10
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x20
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x30
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x40
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x50
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x60
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x70
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x80
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x90
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xA0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xB0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xC0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xD0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xE0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?'	// 0xF0
+	},
+	{	// lead byte 0x00
+		'\0', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x00
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x10
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x20
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x30
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x40
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x50
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x60
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x70
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x80
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x90
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xA0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xB0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xC0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xD0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xE0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?'	// 0xF0
+	},
+	{	// lead byte 0x81
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x00
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x10
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x20
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x30
+		' ', '?', '?', ',', '.', '?', ':', ';', '?', '!', '?', '?', '?', '`', '?', '^',	// 0x40
+		'?', '_', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '/', '\\',	// 0x50
+		'~', '?', '|', '?', '?', '\'', '\'', '"', '"', '(', ')', '?', '?', '[', ']', '{',	// 0x60
+		'}', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '+', '-', '?', '?', '?',	// 0x70
+		'?', '=', '?', '<', '>', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x80
+		'$', '?', '?', '%', '#', '&', '*', '@', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x90
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xA0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xB0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xC0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xD0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xE0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?'	// 0xF0
+	},
+	{	// lead byte 0x82
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x00
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x10
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0x20
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', ' ',	// 0x30
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '0',	// 0x40
+		'1', '2', '3', '4', '5', '6', '7', '8', '9', ':', ';', '<', '=', '>', '?', '@',	// 0x50
+		'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',	// 0x60
+		'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', '[', '?', '?', '?', '?', '?',	// 0x70
+		'?', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o',	// 0x80
+		'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', '{', '?', '?', '?', '?',	// 0x90
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xA0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xB0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xC0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xD0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?',	// 0xE0
+		'?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?', '?'	// 0xF0
+	}
+};
+
+/** Row of SJIS_DECODE_TABLE for each lead byte
+ */
+static unsigned char const SJIS_DECODE_ROW[256] = {
+	1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0x00
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0x10
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0x20
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0x30
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0x40
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0x50
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0x60
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0x70
+	0, 2, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0x80
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0x90
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0xA0
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0xB0
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0xC0
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0xD0
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,		// 0xE0
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0		// 0xF0
+};
+
+unsigned short PS2TitleCodec::EncodeChar(unsigned char c)
+{
+	return SJIS_ENCODE_TABLE[c];
+}
+
+char PS2TitleCodec::DecodeChar(unsigned char lead, unsigned char trail)
+{
+	return SJIS_DECODE_TABLE[SJIS_DECODE_ROW[lead]][trail];
+}
+
+int PS2TitleCodec::Encode(char const* str_in, unsigned char* str_out)
+{
+	int i;
+	for(i=0; (i < TITLE_CHARS-1) && (str_in[i] != '\0'); i++) {
+		unsigned short const c = SJIS_ENCODE_TABLE[static_cast<unsigned char>(str_in[i])];
+		str_out[2*i]   = static_cast<unsigned char>(c >> 8);
+		str_out[2*i+1] = static_cast<unsigned char>(c & 0xFF);
+	}
+	for(int j=2*i; j<TITLE_BYTES; j++) {
+		str_out[j] = 0;
+	}
+	return i;
+}
+
+int PS2TitleCodec::Decode(unsigned char const* str_in, char* str_out)
+{
+	int i;
+	for(i=0; i<TITLE_CHARS; i++) {
+		str_out[i] = SJIS_DECODE_TABLE[SJIS_DECODE_ROW[str_in[2*i]]][str_in[2*i+1]];
+		if(str_out[i] == '\0') { return i; }
+	}
+	str_out[i] = '\0';
+	return i;
+}
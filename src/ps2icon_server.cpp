@@ -0,0 +1,635 @@
+/**
+ * @file src/ps2icon_server.cpp
+ *
+ * @brief A resident conversion service reading jobs from stdinbuild_header/
+ */
+#include <iostream>
+#include "../include/ps2_ps2icon.hpp"
+#include "../include/ps2_iconsys.hpp"
+#include "../include/ps2_icon_renderer.hpp"
+#include "../include/obj_loader.hpp"
+#include "../include/batch_util.hpp"
+#include "../gbLib/include/gbException.hpp"
+#include "../gbLib/include/gbImageLoader.hpp"
+#include "../gbLib/include/gbImageResample.hpp"
+#include "../gbLib/include/gbThreadPool.hpp"
+#include "../gbLib/include/gbStats.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef WIN32
+#	include <fcntl.h>
+#	include <io.h>
+#endif
+
+static size_t const MAX_PAYLOAD_SIZE = 64 * 1024 * 1024;	///< largest payload accepted in a request
+static size_t const MAX_HEADER_SIZE  = 4096;				///< longest header line accepted in a request
+
+/** A named block of data in a request or response
+ */
+struct Payload {
+	std::string name;							///< name of the payload, e.g. "icon"
+	std::vector<unsigned char> data;			///< contents
+};
+
+/** A job read from stdin
+ */
+struct Request {
+	std::string command;						///< name of the command
+	std::string id;								///< id chosen by the client, repeated in the response
+	std::vector<std::string> keys;				///< names of the options
+	std::vector<std::string> values;			///< values of the options
+	std::vector<Payload> payloads;				///< input data, in the order of the header
+	/** Get an option
+	 * @param[in] key Name of the option
+	 * @param[in] def Value returned if the option is not given
+	 * @return The value of the option
+	 */
+	char const* GetOption(char const* key, char const* def) const {
+		for(size_t i=0; i<keys.size(); i++) {
+			if(keys[i] == key) { return values[i].c_str(); }
+		}
+		return def;
+	}
+	/** Get a payload
+	 * @param[in] name Name of the payload
+	 * @return The payload or NULL if there is none of that name
+	 */
+	Payload const* GetPayload(char const* name) const {
+		for(size_t i=0; i<payloads.size(); i++) {
+			if(payloads[i].name == name) { return &payloads[i]; }
+		}
+		return NULL;
+	}
+};
+
+/** Objects that are reused between the jobs of a worker
+ * Keeping them alive avoids reallocating the icon storage, OBJ meshes and image buffers
+ * for every job.
+ */
+struct ServerContext {
+	PS2Icon ps2_icon;							///< icon of the current job
+	OBJ_FileLoader obj_file;					///< OBJ input or output of the current job
+	OBJ_Mesh obj_mesh;							///< geometry of an icon converted to OBJ
+	GhulbusUtil::gbImageLoader img_loader;		///< loader for texture inputs
+	GhulbusUtil::gbImageType_BMP_T bmp_type;	///< loading strategy for BMP textures
+	GhulbusUtil::gbImageType_TGA_T tga_type;	///< loading strategy for TGA textures
+	std::vector<unsigned int> texture_data;		///< texture of the current job
+	std::vector<unsigned int> thumbnail_data;	///< resampled texture for thumbnails
+	PS2IconRenderer renderer;					///< renderer for previews
+	std::ostringstream obj_stream;				///< OBJ output of the current job
+	Request request;							///< the current job
+	std::vector<Payload> response;				///< output of the current job
+	/** Constructor
+	 */
+	ServerContext(): obj_mesh("") {}
+};
+
+/** State shared by all workers
+ */
+struct Server {
+	GhulbusUtil::gbMutex input_mutex;			///< serializes reading jobs from stdin
+	GhulbusUtil::gbMutex output_mutex;			///< serializes writing responses to stdout
+	std::vector<ServerContext*> contexts;		///< one context per worker
+	bool done;									///< set at end of input, "quit" or a framing error; guarded by input_mutex
+	bool failed;								///< set on a framing error; guarded by input_mutex
+	/** Constructor
+	 */
+	Server(): done(false), failed(false) {}
+	/** Destructor
+	 */
+	~Server() {
+		for(size_t i=0; i<contexts.size(); i++) { delete contexts[i]; }
+	}
+};
+
+int n_jobs = 0;									///< number of worker threads; < 1 selects the number of processors
+
+/** Print a help text on screen
+ * @param[in] self Name of the executable (e.g. obtained from argv[0])
+ */
+void PrintHelp(char* self)
+{
+	std::cerr << "********************************************************"  << "\n"
+		      << " *** PS2Icon Conversion Server  V-1.0               ***"   << "\n"
+		      << "  **  by Ghulbus Inc.  (http://www.ghulbus-inc.de/) **"    << "\n"
+			  << "   **************************************************"     << "\n"
+			  << "\n"
+			  << " Usage: " << self << " [OPTION]..."                        << "\n"
+			  << "Run conversion jobs read from stdin; results are written to stdout."    << "\n"
+			  << "\n"
+			  << "  -h, --help           display this help"                  << "\n"
+			  << "  -j, --jobs           Number of jobs processed in parallel"            << "\n"
+			  << "      --stats          Print timings and counters of all stages to stderr" << "\n"
+			  << "                       when done; --stats=json prints them as JSON"       << "\n"
+			  << "\n"
+			  << " Protocol:"                                                             << "\n"
+			  << "A job is a header line followed by the payloads it announces:"          << "\n"
+			  << "  <command> <id> [option=value]... [payload:size]...\\n<payload bytes>"  << "\n"
+			  << "Every job is answered with one of"                                      << "\n"
+			  << "  ok <id> [payload:size]...\\n<payload bytes>"                           << "\n"
+			  << "  error <id> <message>\\n"                                               << "\n"
+			  << "Responses are written as jobs complete, which is not necessarily in the" << "\n"
+			  << "order of the requests when more than one job runs in parallel."          << "\n"
+			  << "\n"
+			  << " Commands:"                                                             << "\n"
+			  << "  icon2obj   icon               -> obj, tga    options: weld=1, rle=1"   << "\n"
+			  << "  obj2icon   obj [texture]      -> icon        options: mesh=N, scale=F," << "\n"
+			  << "             encoding=header|greedy|optimal|auto,"                    << "\n"
+			  << "             filter=box|bilinear|lanczos, gamma=1"                  << "\n"
+			  << "  iconsys    [iconsys] [title]  -> iconsys     options: linebreak=N,"     << "\n"
+			  << "             icon=NAME, copy=NAME, delete=NAME, opacity=N"              << "\n"
+			  << "  thumbnail  icon               -> tga         options: size=N (default 64)," << "\n"
+			  << "             filter=box|bilinear|lanczos, rle=1"                         << "\n"
+			  << "  preview    icon [iconsys]     -> tga         options: size=N (default 128)," << "\n"
+			  << "             frame=N, background=AARRGGBB, rle=1; lights from iconsys"    << "\n"
+			  << "  ping                          -> (nothing)"                            << "\n"
+			  << "  quit                          -> (nothing); stops reading jobs"        << "\n"
+			  << std::endl;
+}
+
+/** Parse the command line arguments and set globals accordingly
+ * @param[in] argc argc
+ * @param[in] argv argv
+ */
+void ParseCommandLine(int argc, char* argv[])
+{
+	for(int i=1; i<argc; i++) {
+		if( (strcmp( argv[i], "-h" ) == 0) || (strcmp( argv[i], "--help" ) == 0) ) {
+			PrintHelp(argv[0]);
+			exit(0);
+		} else if( EnableStatsOption(argv[i]) ) {
+			//statistics are written when the program exits
+		} else if( (i < argc-1) && ((strcmp( argv[i], "-j" ) == 0) || (strcmp( argv[i], "--jobs" ) == 0)) ) {
+			n_jobs = atoi(argv[++i]);
+		} else {
+			std::cerr << "Invalid argument." << std::endl << std::endl;
+			PrintHelp(argv[0]);
+			exit(1);
+		}
+	}
+}
+
+/** Helper function: throws the exception for invalid option values
+ * @param[in] message Description of the error; must be a string literal, as gbException keeps the pointer
+ */
+static void ThrowInvalidOption(char const* message)
+{
+	throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER, message ) );
+}
+
+/** Helper function: get a required payload
+ * @throw Ghulbus::gbException GB_ILLEGALPARAMETER if the payload is missing or empty
+ */
+static Payload const& GetInput(Request const& req, char const* name)
+{
+	Payload const* p = req.GetPayload(name);
+	if((!p) || p->data.empty()) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER, "Missing or empty input payload" ) );
+	}
+	return *p;
+}
+
+/** Helper function: get a numeric option
+ * @throw Ghulbus::gbException GB_ILLEGALPARAMETER if the value is no number
+ */
+static double GetNumber(Request const& req, char const* key, double def)
+{
+	char const* str = req.GetOption(key, NULL);
+	if(!str) { return def; }
+	char* end;
+	double const d = strtod(str, &end);
+	if((end == str) || (*end != '\0')) { ThrowInvalidOption("Invalid number in option"); }
+	return d;
+}
+
+/** Helper function: get a resampling filter option
+ * @throw Ghulbus::gbException GB_ILLEGALPARAMETER for unknown filters
+ */
+static GhulbusUtil::gbResampleFilter_T GetFilter(Request const& req)
+{
+	char const* str = req.GetOption("filter", "box");
+	if(strcmp(str, "box") == 0)      { return GhulbusUtil::GB_RESAMPLE_BOX; }
+	if(strcmp(str, "bilinear") == 0) { return GhulbusUtil::GB_RESAMPLE_BILINEAR; }
+	if(strcmp(str, "lanczos") == 0)  { return GhulbusUtil::GB_RESAMPLE_LANCZOS3; }
+	ThrowInvalidOption("Invalid value for option filter");
+	return GhulbusUtil::GB_RESAMPLE_BOX;
+}
+
+/** Helper function: add an empty payload to the response
+ * @return The data field of the new payload
+ */
+static std::vector<unsigned char>& AddOutput(ServerContext& ctx, char const* name)
+{
+	ctx.response.push_back(Payload());
+	ctx.response.back().name = name;
+	return ctx.response.back().data;
+}
+
+/** Convert an icon to OBJ and TGA
+ * @param[in,out] ctx Context of the worker; receives the response
+ * @throw Ghulbus::gbException
+ * @throw std::bad_alloc
+ */
+void CommandIconToOBJ(ServerContext& ctx)
+{
+	Request const& req = ctx.request;
+	Payload const& icon = GetInput(req, "icon");
+	ctx.ps2_icon.Load(&icon.data[0], icon.data.size());
+
+	ctx.obj_mesh.SetName(req.GetOption("name", "icon"));
+	{
+		GB_STATS_TIMER("geometry.convert");
+		ctx.ps2_icon.BuildMesh(&ctx.obj_mesh, strcmp(req.GetOption("weld", "0"), "0") != 0);
+	}
+	ctx.obj_file.Clear();
+	ctx.obj_file.AddMesh(ctx.obj_mesh);
+	ctx.obj_stream.str(std::string());
+	ctx.obj_file.Write(ctx.obj_stream);
+	std::string const obj = ctx.obj_stream.str();
+	AddOutput(ctx, "obj").assign(obj.begin(), obj.end());
+
+	ctx.texture_data.resize(128*128);
+	ctx.ps2_icon.GetTextureData(&ctx.texture_data[0]);
+	//icon textures are stored bottom row first:
+	GhulbusUtil::WriteImage(AddOutput(ctx, "tga"), &ctx.texture_data[0], 128, 128, true,
+	                        strcmp(req.GetOption("rle", "0"), "0") != 0);
+}
+
+/** Build an icon from an OBJ file and an optional texture
+ * @param[in,out] ctx Context of the worker; receives the response
+ * @throw Ghulbus::gbException
+ * @throw std::bad_alloc
+ */
+void CommandOBJToIcon(ServerContext& ctx)
+{
+	Request const& req = ctx.request;
+	Payload const& obj = GetInput(req, "obj");
+	ctx.obj_file.Load(&obj.data[0], obj.data.size(), OBJ_AttributeArray::STORAGE_FLOAT);
+	int const mesh_index = static_cast<int>(GetNumber(req, "mesh", 0.0));
+	if((mesh_index < 0) || (mesh_index >= ctx.obj_file.GetNMeshes())) {
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_ILLEGALPARAMETER, "Invalid mesh index" ) );
+	}
+	float const scale_factor = static_cast<float>(GetNumber(req, "scale", 1.0));
+
+	PS2Icon::TextureEncoding_T encoding = PS2Icon::TEXTURE_AS_HEADER;
+	char const* str = req.GetOption("encoding", "header");
+	if(strcmp(str, "greedy") == 0) {
+		encoding = PS2Icon::TEXTURE_RLE;
+	} else if(strcmp(str, "optimal") == 0) {
+		encoding = PS2Icon::TEXTURE_RLE_OPTIMAL;
+	} else if(strcmp(str, "auto") == 0) {
+		encoding = PS2Icon::TEXTURE_AUTO;
+	} else if(strcmp(str, "header") != 0) {
+		ThrowInvalidOption("Invalid value for option encoding");
+	}
+
+	PS2Icon& ps2_icon = ctx.ps2_icon;
+	ps2_icon.Clear();
+	ps2_icon.SetTextureEncoding(encoding);
+	Payload const* texture = req.GetPayload("texture");
+	if(texture && (!texture->data.empty())) {
+		GB_STATS_TIMER("texture.convert");
+		bool const is_bmp = (texture->data.size() >= 2) && (texture->data[0] == 'B') && (texture->data[1] == 'M');
+		ctx.img_loader.Load(&texture->data[0], texture->data.size(),
+		                    (is_bmp) ? static_cast<GhulbusUtil::gbImageLoader::gbImageType*>(&ctx.bmp_type) : &ctx.tga_type,
+		                    GhulbusUtil::gbImageLoader::ROWS_BOTTOM_UP);
+		ctx.texture_data.resize(128*128);
+		if( (ctx.img_loader.GetWidth() == 128) && (ctx.img_loader.GetHeight() == 128) ) {
+			ctx.img_loader.GetImageData32(&ctx.texture_data[0]);
+		} else {
+			GhulbusUtil::ResampleImage(ctx.img_loader, &ctx.texture_data[0], 128, 128, GetFilter(req),
+			                           strcmp(req.GetOption("gamma", "0"), "0") != 0);
+		}
+		ps2_icon.SetTextureData(&ctx.texture_data[0]);
+	}
+	{
+		GB_STATS_TIMER("geometry.convert");
+		ps2_icon.SetGeometry(*ctx.obj_file.GetMesh(mesh_index), scale_factor);
+	}
+	ps2_icon.Serialize(AddOutput(ctx, "icon"));
+}
+
+/** Helper function: applies the options of an iconsys job
+ * Options correspond to those of iconsys_builder: "icon" sets all three icon filenames,
+ * and the linebreak is set whenever the title is, defaulting to the end of the title.
+ */
+static void EditIconSys(Request const& req, IconSys& icon_sys, bool set_defaults)
+{
+	Payload const* title = req.GetPayload("title");
+	if(title) {
+		std::string const str(title->data.begin(), title->data.end());
+		icon_sys.SetTitle(str.c_str());
+	}
+	if(set_defaults || title || req.GetOption("linebreak", NULL)) {
+		icon_sys.SetLinebreak(static_cast<int>(GetNumber(req, "linebreak", 32.0)));
+	}
+	if(req.GetOption("icon", NULL)) {
+		icon_sys.SetIconFilename(req.GetOption("icon", NULL));
+		icon_sys.SetIconCopyFilename(req.GetOption("icon", NULL));
+		icon_sys.SetIconDeleteFilename(req.GetOption("icon", NULL));
+	}
+	if(req.GetOption("copy", NULL))   { icon_sys.SetIconCopyFilename(req.GetOption("copy", NULL)); }
+	if(req.GetOption("delete", NULL)) { icon_sys.SetIconDeleteFilename(req.GetOption("delete", NULL)); }
+	if(set_defaults || req.GetOption("opacity", NULL)) {
+		icon_sys.SetBackgroundOpacity(static_cast<int>(GetNumber(req, "opacity", 0.0)));
+	}
+}
+
+/** Create or edit an icon.sys file
+ * Without an iconsys payload, the options are applied to a file holding the default values.
+ * @param[in,out] ctx Context of the worker; receives the response
+ * @throw Ghulbus::gbException
+ * @throw std::bad_alloc
+ */
+void CommandIconSys(ServerContext& ctx)
+{
+	Request const& req = ctx.request;
+	Payload const* input = req.GetPayload("iconsys");
+	unsigned char const* data;
+	if(input && (!input->data.empty())) {
+		IconSys icon_sys(&input->data[0], input->data.size());
+		EditIconSys(req, icon_sys, false);
+		data = static_cast<unsigned char const*>(icon_sys.GetFileData());
+		AddOutput(ctx, "iconsys").assign(data, data + IconSys::GetFileSize());
+	} else {
+		IconSys icon_sys;
+		EditIconSys(req, icon_sys, true);
+		data = static_cast<unsigned char const*>(icon_sys.GetFileData());
+		AddOutput(ctx, "iconsys").assign(data, data + IconSys::GetFileSize());
+	}
+}
+
+/** Write a downscaled copy of an icon's texture
+ * @param[in,out] ctx Context of the worker; receives the response
+ * @throw Ghulbus::gbException
+ * @throw std::bad_alloc
+ */
+void CommandThumbnail(ServerContext& ctx)
+{
+	Request const& req = ctx.request;
+	Payload const& icon = GetInput(req, "icon");
+	int const size = static_cast<int>(GetNumber(req, "size", 64.0));
+	if((size < 1) || (size > 1024)) { ThrowInvalidOption("Invalid value for option size"); }
+	//only the texture is decoded:
+	ctx.ps2_icon.Load(&icon.data[0], icon.data.size(), true);
+	ctx.texture_data.resize(128*128);
+	ctx.ps2_icon.GetTextureData(&ctx.texture_data[0]);
+	unsigned int const* pixels = &ctx.texture_data[0];
+	if(size != 128) {
+		ctx.thumbnail_data.resize(static_cast<size_t>(size) * size);
+		GhulbusUtil::ResampleImage(&ctx.texture_data[0], 128, 128, &ctx.thumbnail_data[0], size, size, GetFilter(req));
+		pixels = &ctx.thumbnail_data[0];
+	}
+	GhulbusUtil::WriteImage(AddOutput(ctx, "tga"), pixels, size, size, true,
+	                        strcmp(req.GetOption("rle", "0"), "0") != 0);
+}
+
+/** Render a lit preview of an icon
+ * @param[in,out] ctx Context of the worker; receives the response
+ * @throw Ghulbus::gbException
+ * @throw std::bad_alloc
+ */
+void CommandPreview(ServerContext& ctx)
+{
+	Request const& req = ctx.request;
+	Payload const& icon = GetInput(req, "icon");
+	int const size = static_cast<int>(GetNumber(req, "size", 128.0));
+	if((size < 1) || (size > PS2IconRenderer::MAX_SIZE)) { ThrowInvalidOption("Invalid value for option size"); }
+	unsigned int background = 0;
+	char const* str = req.GetOption("background", NULL);
+	if(str) {
+		char* end;
+		background = static_cast<unsigned int>(strtoul(str, &end, 16));
+		if((end == str) || (*end != '\0')) { ThrowInvalidOption("Invalid value for option background"); }
+	}
+	ctx.ps2_icon.Load(&icon.data[0], icon.data.size());
+	PS2IconRenderer& renderer = ctx.renderer;
+	Payload const* lights = req.GetPayload("iconsys");
+	if(lights && (!lights->data.empty())) {
+		IconSys icon_sys(&lights->data[0], lights->data.size());
+		renderer.SetLights(icon_sys);
+	} else {
+		IconSys icon_sys;
+		renderer.SetLights(icon_sys);
+	}
+	renderer.SetBackground(background);
+	renderer.SetSize(size, size);
+	renderer.Render(ctx.ps2_icon, static_cast<int>(GetNumber(req, "frame", -1.0)));
+	renderer.WriteImage(AddOutput(ctx, "tga"), strcmp(req.GetOption("rle", "0"), "0") != 0);
+}
+
+/** Helper function: splits a header line at blanks
+ */
+static void SplitTokens(std::string const& line, std::vector<std::string>& tokens)
+{
+	tokens.clear();
+	size_t pos = 0;
+	while(pos < line.size()) {
+		size_t const end = line.find(' ', pos);
+		size_t const len = ((end == std::string::npos) ? line.size() : end) - pos;
+		if(len > 0) { tokens.push_back(line.substr(pos, len)); }
+		pos += len + 1;
+	}
+}
+
+/** Read the next job from stdin
+ * @param[out] req Receives the job
+ * @param[out] error Receives a description of framing errors
+ * @return true if a job was read; false at the end of the input or on a framing error,
+ *         in which case error is not empty
+ * @throw std::bad_alloc
+ * @note Framing errors can not be recovered from, as the end of the job is unknown.
+ */
+bool ReadRequest(Request& req, std::string& error)
+{
+	error.clear();
+	std::string line;
+	if(!std::getline(std::cin, line)) { return false; }
+	if((!line.empty()) && (line[line.size()-1] == '\r')) { line.erase(line.size()-1); }
+	if(line.size() > MAX_HEADER_SIZE) {
+		error = "Header line too long";
+		return false;
+	}
+	std::vector<std::string> tokens;
+	SplitTokens(line, tokens);
+	if(tokens.size() < 2) {
+		error = "Header line needs a command and an id";
+		return false;
+	}
+	req.command = tokens[0];
+	req.id      = tokens[1];
+	req.keys.clear();
+	req.values.clear();
+	size_t n_payloads = 0;
+	for(size_t i=2; i<tokens.size(); i++) {
+		size_t const colon = tokens[i].find(':');
+		size_t const equal = tokens[i].find('=');
+		if((colon != std::string::npos) && ((equal == std::string::npos) || (colon < equal))) {
+			char const* size_str = tokens[i].c_str() + colon + 1;
+			char* end;
+			unsigned long const size = strtoul(size_str, &end, 10);
+			if((end == size_str) || (*end != '\0') || (size > MAX_PAYLOAD_SIZE)) {
+				error = "Invalid payload size \"" + tokens[i] + "\"";
+				return false;
+			}
+			if(n_payloads == req.payloads.size()) { req.payloads.push_back(Payload()); }
+			Payload& p = req.payloads[n_payloads++];
+			p.name = tokens[i].substr(0, colon);
+			p.data.resize(size);
+		} else if(equal != std::string::npos) {
+			req.keys.push_back(tokens[i].substr(0, equal));
+			req.values.push_back(tokens[i].substr(equal + 1));
+		} else {
+			error = "Invalid token \"" + tokens[i] + "\"";
+			return false;
+		}
+	}
+	//payload buffers are kept between jobs; only their contents are replaced:
+	req.payloads.resize(n_payloads);
+	for(size_t i=0; i<req.payloads.size(); i++) {
+		std::vector<unsigned char>& data = req.payloads[i].data;
+		if(data.empty()) { continue; }
+		std::cin.read(reinterpret_cast<char*>(&data[0]), static_cast<std::streamsize>(data.size()));
+		if(static_cast<size_t>(std::cin.gcount()) != data.size()) {
+			error = "Unexpected end of input in payload \"" + req.payloads[i].name + "\"";
+			return false;
+		}
+	}
+	return true;
+}
+
+/** Write the response of a job to stdout
+ * @param[in] id Id of the job
+ * @param[in] error Error message; empty if the job succeeded
+ * @param[in] payloads Output of the job; only written on success
+ */
+void WriteResponse(std::string const& id, std::string const& error, std::vector<Payload> const& payloads)
+{
+	if(!error.empty()) {
+		std::string message = error;
+		for(size_t i=0; i<message.size(); i++) {
+			if((message[i] == '\n') || (message[i] == '\r')) { message[i] = ' '; }
+		}
+		std::cout << "error " << id << " " << message << "\n";
+	} else {
+		std::cout << "ok " << id;
+		for(size_t i=0; i<payloads.size(); i++) {
+			std::cout << " " << payloads[i].name << ":" << payloads[i].data.size();
+		}
+		std::cout << "\n";
+		for(size_t i=0; i<payloads.size(); i++) {
+			if(payloads[i].data.empty()) { continue; }
+			std::cout.write(reinterpret_cast<char const*>(&payloads[i].data[0]),
+			                static_cast<std::streamsize>(payloads[i].data.size()));
+		}
+	}
+	std::cout.flush();
+}
+
+/** Run a single job
+ * @param[in,out] ctx Context of the worker holding the job; receives the response
+ * @param[out] error Receives the error message if the job failed
+ * @note "quit" is handled by the worker loop before the job is run.
+ */
+void RunRequest(ServerContext& ctx, std::string& error)
+{
+	GB_STATS_TIMER("server.job");
+	std::string const& command = ctx.request.command;
+	ctx.response.clear();
+	error.clear();
+	try {
+		if(command == "icon2obj") {
+			CommandIconToOBJ(ctx);
+		} else if(command == "obj2icon") {
+			CommandOBJToIcon(ctx);
+		} else if(command == "iconsys") {
+			CommandIconSys(ctx);
+		} else if(command == "thumbnail") {
+			CommandThumbnail(ctx);
+		} else if(command == "preview") {
+			CommandPreview(ctx);
+		} else if(command != "ping") {
+			error = "Unknown command \"" + command + "\"";
+		}
+	} catch(Ghulbus::gbException& e) {
+		error = (e.GetErrorString()[0] != '\0') ? e.GetErrorString() : e.what();
+	} catch(std::bad_alloc&) {
+		error = "Out of memory";
+	} catch(std::exception& e) {
+		error = e.what();
+	}
+	if(!error.empty()) {
+		GB_STATS_COUNT("server.jobs_failed", 1);
+		ctx.response.clear();
+	}
+	GB_STATS_COUNT("server.jobs", 1);
+}
+
+/** Worker loop: reads and runs jobs until the input ends
+ */
+static void ServeWork(int, int worker, void* user)
+{
+	Server& server = *static_cast<Server*>(user);
+	ServerContext& ctx = *server.contexts[worker];
+	std::string error;
+	bool quit = false;
+	for(;;) {
+		{
+			GhulbusUtil::gbLock lock(server.input_mutex);
+			if(server.done) { return; }
+			if(!ReadRequest(ctx.request, error)) {
+				server.done = true;
+				if(!error.empty()) {
+					server.failed = true;
+					GhulbusUtil::gbLock out_lock(server.output_mutex);
+					WriteResponse("-", error, ctx.response);
+				}
+				return;
+			}
+			//stop reading before the input lock goes to another worker:
+			quit = (ctx.request.command == "quit");
+			if(quit) { server.done = true; }
+		}
+		if(quit) {
+			error.clear();
+			ctx.response.clear();
+		} else {
+			RunRequest(ctx, error);
+		}
+		{
+			GhulbusUtil::gbLock lock(server.output_mutex);
+			WriteResponse(ctx.request.id, error, ctx.response);
+		}
+		if(quit) { return; }
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	ParseCommandLine(argc, argv);
+#ifdef WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	std::ios_base::sync_with_stdio(false);
+	std::cin.tie(NULL);
+
+	Server server;
+	GhulbusUtil::gbThreadPool pool(n_jobs);
+	for(int i=0; i<pool.GetNThreads(); i++) {
+		server.contexts.push_back(new ServerContext);
+	}
+	//every worker runs a single item that loops over the jobs:
+	try {
+		pool.Run(pool.GetNThreads(), ServeWork, &server);
+	} catch(Ghulbus::gbException& e) {
+		std::cerr << "Server failed: " << e.GetErrorString() << std::endl;
+		return 1;
+	}
+	return (server.failed) ? 1 : 0;
+}
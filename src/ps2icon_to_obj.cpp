@@ -5,15 +5,64 @@
  */
 #include <iostream>
 #include "../include/ps2_ps2icon.hpp"
+#include "../include/ps2_iconsys.hpp"
+#include "../include/ps2_icon_renderer.hpp"
+#include "../include/ps2_memory_card.hpp"
 #include "../include/obj_loader.hpp"
+#include "../include/batch_util.hpp"
+#include "../include/conversion_cache.hpp"
 #include "../gbLib/include/gbException.hpp"
 #include "../gbLib/include/gbColor.hpp"
 #include "../gbLib/include/gbImageLoader.hpp"
+#include "../gbLib/include/gbStats.hpp"
+#include <algorithm>
+#include <vector>
+#include <string>
+
+/** Settings that apply to every conversion
+ */
+struct ConversionOptions {
+	bool verbose;							///< flag for verbose output
+	bool rle_texture;						///< write textures as RLE compressed TGA
+	bool weld;								///< share vertices between triangles in the obj output
+	int preview_size;						///< width and height of rendered previews (0: no previews)
+	int preview_frame;						///< animation frame shown in previews (-1: first shape)
+	IconSys const* preview_lights;			///< icon.sys providing the lights of previews (NULL: defaults)
+	PS2MemoryCard const* card;				///< memory card holding the input files (or NULL)
+	ConversionCache const* cache;			///< cache for the output files (or NULL)
+	/** Constructor
+	 */
+	ConversionOptions(): verbose(false), rle_texture(false), weld(false), preview_size(0), preview_frame(-1),
+	                     preview_lights(NULL), card(NULL), cache(NULL) {}
+};
 
 char const* ps2_input_file      = NULL;		///< path to the input file
 char const* obj_output_file     = NULL;		///< path to the output file
 char const* texture_output_file = NULL;		///< path to the output texture file
-bool verbose_output             = false;	///< flag for verbose output
+char const* batch_manifest      = NULL;		///< path to the batch manifest file
+char const* batch_input_dir     = NULL;		///< path to the batch input directory
+char const* batch_output_dir    = NULL;		///< path to the batch output directory
+int batch_jobs                  = 0;		///< number of worker threads for batch conversion (0: one per processor)
+int batch_prefetch              = 0;		///< number of files read ahead in batch mode (0: direct file access)
+char const* card_input_file     = NULL;		///< path to the memory card image
+char const* card_save           = NULL;		///< name of the save directory to convert from the card (NULL: all)
+char const* cache_dir           = NULL;		///< path to the cache directory
+char const* preview_lights_file = NULL;		///< path to the icon.sys file providing the lights of previews
+ConversionOptions options;					///< settings from the command line
+
+/** Objects that are reused between the items of a batch conversion
+ * @note Every worker thread owns a separate context.
+ */
+struct ConversionContext {
+	PS2Icon ps2_icon;				///< the icon being converted
+	OBJ_FileLoader obj_file;		///< writer for the obj output
+	OBJ_Mesh obj_mesh;				///< geometry of the icon
+	std::vector<unsigned char> card_buffer;	///< icon file from the memory card, if not stored contiguously
+	PS2IconRenderer renderer;		///< renderer for previews
+	/** Constructor
+	 */
+	ConversionContext(): obj_mesh("") {}
+};
 
 /** Print a help text on screen
  * @param[in] self Name of the executable (e.g. obtained from argv[0])
@@ -32,7 +81,28 @@ void PrintHelp(char* self)
 			  << "  -f,  --input-file      PS2Icon file used as input"         << "\n"
 			  << "  -o,  --output-file     Name of the OBJ destination file"   << "\n"
 			  << "  -ot, --output-texture  Texture file output (TGA)"          << "\n"
+			  << "       --texture-rle     Write RLE compressed TGA textures"  << "\n"
+			  << "  -w,  --weld            Merge identical vertices in the OBJ output" << "\n"
 			  << "  -v,  --verbose         activate verbose output"            << "\n"
+			  << "       --stats           Print timings and counters of all stages to stderr" << "\n"
+			  << "                         when done; --stats=json prints them as JSON"       << "\n"
+			  << "  -b,  --batch           Convert all files listed in a manifest"   << "\n"
+			  << "  -d,  --input-dir       Convert all icon files in a directory"    << "\n"
+			  << "       --output-dir      Destination directory for batch conversion" << "\n"
+			  << "  -j,  --jobs            Number of files converted in parallel (batch mode)" << "\n"
+			  << "       --prefetch        Read this many input files ahead and write the"    << "\n"
+			  << "                         outputs in the background (batch mode); speeds up" << "\n"
+			  << "                         conversions on network storage"                   << "\n"
+			  << "  -c,  --card            Convert the icons of all saves on a memory card image" << "\n"
+			  << "       --save            Only convert the icons of this save directory (card mode)" << "\n"
+			  << "       --cache-dir       Reuse the output of earlier runs with the same input" << "\n"
+			  << "                         files and options from this directory"               << "\n"
+			  << "  -p,  --preview         Also render a lit preview of the icon to a TGA file" << "\n"
+			  << "                         named after the texture file, with suffix _preview" << "\n"
+			  << "       --preview-size    Width and height of previews in pixels (default 128)" << "\n"
+			  << "       --preview-frame   Animation frame shown in previews; icons with fewer"  << "\n"
+			  << "                         frames show their first shape (default)"             << "\n"
+			  << "       --preview-lights  icon.sys file providing the lights of previews"       << "\n"
 			  << "\n"
 			  << " Examples:"                                                             << "\n"
 			  << "  " << self << " -f foo.icn"                                            << "\n"
@@ -42,6 +112,17 @@ void PrintHelp(char* self)
 			  << "  " << self << " -f foo.icn -o out.obj -ot out.tga"                     << "\n"
 			  << "Extracts geometry and texture info from foo.icn and saves it out to"    << "\n"
 			  << "out.obj and out.tga."                                                   << "\n"
+			  << "\n"
+			  << "  " << self << " -d icons --output-dir models"                         << "\n"
+			  << "Extracts every .icn and .ico file in directory icons to OBJ and TGA"    << "\n"
+			  << "files of the same name in directory models."                            << "\n"
+			  << "A manifest given with -b lists one conversion per line as"              << "\n"
+			  << "tab-separated input, output and texture paths; only input is required." << "\n"
+			  << "\n"
+			  << "  " << self << " -c card.ps2 --output-dir models"                      << "\n"
+			  << "Extracts the icons referenced by the icon.sys of every save on the"     << "\n"
+			  << "memory card image card.ps2 to files <save>_<icon>.obj and .tga in"      << "\n"
+			  << "directory models, without extracting the card first."                  << "\n"
 			  << std::endl;
 }
 
@@ -57,7 +138,15 @@ void ParseCommandLine(int argc, char* argv[])
 			PrintHelp(argv[0]);
 			exit(0);
 		} else if( (strcmp( argv[i], "-v" ) == 0) || (strcmp( argv[i], "--verbose" ) == 0) ) {
-			verbose_output = true;
+			options.verbose = true;
+		} else if( EnableStatsOption(argv[i]) ) {
+			//statistics are written when the program exits
+		} else if( strcmp( argv[i], "--texture-rle" ) == 0 ) {
+			options.rle_texture = true;
+		} else if( (strcmp( argv[i], "-w" ) == 0) || (strcmp( argv[i], "--weld" ) == 0) ) {
+			options.weld = true;
+		} else if( (strcmp( argv[i], "-p" ) == 0) || (strcmp( argv[i], "--preview" ) == 0) ) {
+			if(options.preview_size == 0) { options.preview_size = 128; }
 		} else if(i < argc-1) {
 		//Parameters with 1 argument
 			if( (strcmp( argv[i], "-f" ) == 0) || (strcmp( argv[i], "--input-file" ) == 0) ) {
@@ -66,6 +155,32 @@ void ParseCommandLine(int argc, char* argv[])
 				obj_output_file = argv[++i];
 			} else if( (strcmp( argv[i], "-ot" ) == 0) || (strcmp( argv[i], "--output-texture" ) == 0) ) {
 				texture_output_file = argv[++i];
+			} else if( (strcmp( argv[i], "-b" ) == 0) || (strcmp( argv[i], "--batch" ) == 0) ) {
+				batch_manifest = argv[++i];
+			} else if( (strcmp( argv[i], "-d" ) == 0) || (strcmp( argv[i], "--input-dir" ) == 0) ) {
+				batch_input_dir = argv[++i];
+			} else if( strcmp( argv[i], "--output-dir" ) == 0 ) {
+				batch_output_dir = argv[++i];
+			} else if( (strcmp( argv[i], "-j" ) == 0) || (strcmp( argv[i], "--jobs" ) == 0) ) {
+				batch_jobs = atoi(argv[++i]);
+			} else if( strcmp( argv[i], "--prefetch" ) == 0 ) {
+				batch_prefetch = atoi(argv[++i]);
+			} else if( (strcmp( argv[i], "-c" ) == 0) || (strcmp( argv[i], "--card" ) == 0) ) {
+				card_input_file = argv[++i];
+			} else if( strcmp( argv[i], "--save" ) == 0 ) {
+				card_save = argv[++i];
+			} else if( strcmp( argv[i], "--cache-dir" ) == 0 ) {
+				cache_dir = argv[++i];
+			} else if( strcmp( argv[i], "--preview-size" ) == 0 ) {
+				options.preview_size = atoi(argv[++i]);
+				if( (options.preview_size < 1) || (options.preview_size > PS2IconRenderer::MAX_SIZE) ) {
+					std::cout << "Invalid preview size.\n" << std::endl;
+					exit(1);
+				}
+			} else if( strcmp( argv[i], "--preview-frame" ) == 0 ) {
+				options.preview_frame = atoi(argv[++i]);
+			} else if( strcmp( argv[i], "--preview-lights" ) == 0 ) {
+				preview_lights_file = argv[++i];
 			} else {
 				std::cout << "Invalid argument.\n" << std::endl;
 				PrintHelp(argv[0]);
@@ -79,106 +194,466 @@ void ParseCommandLine(int argc, char* argv[])
 	}
 }
 
-PS2Icon* LoadPS2Icon()
+/** Load a PS2Icon file
+ * @param[in,out] ps2_icon Icon that receives the file contents
+ * @param[in] fname Path to the icon file
+ * @param[in] opt Conversion settings
+ * @param[out] log Destination for messages
+ * @throw Ghulbus::gbException GB_FAILED indicates that the file could not be read
+ */
+void LoadPS2Icon(PS2Icon& ps2_icon, char const* fname, ConversionOptions const& opt, std::ostream& log)
 {
-	PS2Icon* ret = NULL;
-	if(verbose_output)
-		std::cout << " * Reading PS2Icon file \"" << ps2_input_file << "\"...\n";
+	if(opt.verbose)
+		log << " * Reading PS2Icon file \"" << fname << "\"...\n";
 	try {
-		ret = new PS2Icon(ps2_input_file);
-	} catch( std::exception e ) {
-		std::cout << "File read error: \"" << ps2_input_file << "\"" << std::endl;
-		exit(1);
+		ps2_icon.Load(fname);
+	} catch( std::exception& ) {
+		log << "File read error: \"" << fname << "\"" << std::endl;
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "File read error" ) );
 	}
-	if(verbose_output)
-		std::cout << " **  Found geometry - " << ret->GetNVertices() << " vertices, " 
-			<< ret->GetNShapes() << " shapes." << std::endl;
-	if(ret->GetNFrames() > 1) {
-		std::cout << " **  Found animation - " << ret->GetNFrames() << " frames." << std::endl;
+	if(opt.verbose)
+		log << " **  Found geometry - " << ps2_icon.GetNVertices() << " vertices, " 
+			<< ps2_icon.GetNShapes() << " shapes." << std::endl;
+	if(ps2_icon.GetNFrames() > 1) {
+		log << " **  Found animation - " << ps2_icon.GetNFrames() << " frames." << std::endl;
 	}
-	if(verbose_output)
-		std::cout << " *  done." << std::endl;
-	return ret;
+	if(opt.verbose)
+		log << " *  done." << std::endl;
 }
 
-void WriteOBJFile(PS2Icon* ps2_icon)
+/** Find a file on the memory card
+ * @param[in] card The memory card
+ * @param[in] path Path of the file on the card as save directory and file name, separated by '/'
+ * @return The file entry or NULL if there is no such file
+ */
+PS2MemoryCard::Entry const* FindCardFile(PS2MemoryCard const& card, std::string const& path)
 {
-	OBJ_FileLoader obj_file;
-	OBJ_Mesh obj_mesh(ps2_input_file);
-	if(verbose_output)
-		std::cout << " * Convert geometry data from \"" << ps2_input_file << "\"...";
-	ps2_icon->BuildMesh(&obj_mesh);
-	if(verbose_output)
-		std::cout << "done." << std::endl;
-
-	if(verbose_output)
-		std::cout << " * Writing geometry output to file \"" << obj_output_file << "\"...";
+	size_t const separator = path.find('/');
+	if(separator == std::string::npos) { return NULL; }
+	PS2MemoryCard::SaveDirectory const* save = card.FindSave(path.substr(0, separator).c_str());
+	return (save) ? card.FindFile(*save, path.substr(separator + 1).c_str()) : NULL;
+}
+
+/** Load a PS2Icon file from the memory card
+ * @param[in,out] ctx Conversion context; receives the icon in ctx.ps2_icon
+ * @param[in] path Path of the icon file on the card as save directory and file name, separated by '/'
+ * @param[in] opt Conversion settings
+ * @param[out] log Destination for messages
+ * @throw Ghulbus::gbException GB_FAILED indicates that the file could not be read
+ */
+void LoadPS2IconFromCard(ConversionContext& ctx, std::string const& path, ConversionOptions const& opt, std::ostream& log)
+{
+	if(opt.verbose)
+		log << " * Reading PS2Icon file \"" << path << "\" from memory card...\n";
+	PS2MemoryCard::Entry const* file = FindCardFile(*opt.card, path);
+	if(!file) {
+		log << "File not found on memory card: \"" << path << "\"" << std::endl;
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "File not found on memory card" ) );
+	}
+	try {
+		//the icon is decoded straight from the card image where possible:
+		ctx.ps2_icon.Load(opt.card->GetFileData(*file, ctx.card_buffer), file->length);
+	} catch( std::exception& ) {
+		log << "File read error: \"" << path << "\"" << std::endl;
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "File read error" ) );
+	}
+	if(opt.verbose)
+		log << " **  Found geometry - " << ctx.ps2_icon.GetNVertices() << " vertices, " 
+			<< ctx.ps2_icon.GetNShapes() << " shapes." << std::endl;
+	if(ctx.ps2_icon.GetNFrames() > 1) {
+		log << " **  Found animation - " << ctx.ps2_icon.GetNFrames() << " frames." << std::endl;
+	}
+	if(opt.verbose)
+		log << " *  done." << std::endl;
+}
+
+/** Write the icon geometry to an OBJ file
+ * @param[in,out] ctx Conversion context holding the loaded icon
+ * @param[in] item The item to convert
+ * @param[in] opt Conversion settings
+ * @param[out] log Destination for messages
+ * @throw Ghulbus::gbException GB_FAILED indicates a file access error
+ */
+void WriteOBJFile(ConversionContext& ctx, BatchItem const& item, ConversionOptions const& opt, std::ostream& log)
+{
+	OBJ_FileLoader& obj_file = ctx.obj_file;
+	OBJ_Mesh& obj_mesh = ctx.obj_mesh;
+	obj_mesh.SetName(item.input.c_str());
+	if(opt.verbose)
+		log << " * Convert geometry data from \"" << item.input << "\"...";
+	{
+		GB_STATS_TIMER("geometry.convert");
+		ctx.ps2_icon.BuildMesh(&obj_mesh, opt.weld);
+	}
+	if(opt.verbose)
+		log << "done." << std::endl;
+
+	if(opt.verbose)
+		log << " * Writing geometry output to file \"" << item.output << "\"...";
+	obj_file.Clear();
 	obj_file.AddMesh(obj_mesh);
 	try {
-		obj_file.WriteFile(obj_output_file);
-	} catch( Ghulbus::gbException e ) {
-		std::cout << "\nError while writing to \"" << obj_output_file << "\"" << std::endl;
-		exit(1);
+		obj_file.WriteFile(item.output.c_str());
+	} catch( Ghulbus::gbException& ) {
+		log << "\nError while writing to \"" << item.output << "\"" << std::endl;
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Error while writing OBJ file" ) );
 	}
-	if(verbose_output)
-		std::cout << "done." << std::endl;
+	if(opt.verbose)
+		log << "done." << std::endl;
 }
 
-void WriteTextureFile(PS2Icon* ps2_icon)
+/** Write the icon texture to a TGA file
+ * @param[in,out] ctx Conversion context holding the loaded icon
+ * @param[in] item The item to convert
+ * @param[in] opt Conversion settings
+ * @param[out] log Destination for messages
+ * @throw Ghulbus::gbException GB_FAILED indicates a file access error
+ */
+void WriteTextureFile(ConversionContext& ctx, BatchItem const& item, ConversionOptions const& opt, std::ostream& log)
 {
 	unsigned int texture_data[128*128];
-	if(verbose_output)
-		std::cout << " * Convert texture data from \"" << ps2_input_file << "\"..." ;
-	ps2_icon->GetTextureData(texture_data);
-	//manual conversion required, since WriteImage() requires 
-	// GBCOLOR32 data, whose bit pattern is not fix;
-	for(int i=0; i<16384; i++) {
-		texture_data[i] = GhulbusGraphics::GBCOLOR32::ARGB( static_cast<int>((texture_data[i] >> 24) & 0xff),
-															static_cast<int>((texture_data[i] >> 16) & 0xff),
-															static_cast<int>((texture_data[i] >>  8) & 0xff),
-															static_cast<int>((texture_data[i])       & 0xff) );
-	}
-	//in addition the texture is flipped horizontally:
-	for(int row=0; row<64; row++) {
-		for(int i=0; i<128; i++) {
-			texture_data[row*128 + i] ^= texture_data[(127-row)*128 + i] 
-				^= texture_data[row*128 + i] ^= texture_data[(127-row)*128 + i];
-		}
-	}
-
-	if(verbose_output)
-		std::cout << "done." << std::endl;
-
-	if(verbose_output)
-		std::cout << " * Writing texture to file \"" << texture_output_file << "\"...";
+	if(opt.verbose)
+		log << " * Convert texture data from \"" << item.input << "\"..." ;
+	//PS2Icon textures use the A8R8G8B8 layout of GBCOLOR, so no conversion is required:
+	ctx.ps2_icon.GetTextureData(texture_data);
+
+	if(opt.verbose)
+		log << "done." << std::endl;
+
+	if(opt.verbose)
+		log << " * Writing texture to file \"" << item.texture << "\"...";
+	try {
+		//icon textures are stored bottom row first:
+		GhulbusUtil::WriteImage(item.texture.c_str(), texture_data, 128, 128, true, opt.rle_texture);
+	} catch( Ghulbus::gbException& ) {
+		log << "\nError while writing to \"" << item.texture << "\"" << std::endl;
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Error while writing texture file" ) );
+	}
+	if(opt.verbose)
+		log << "done." << std::endl;
+}
+
+/** Get the path of the preview of an item
+ * @param[in] item The item to convert
+ * @return The texture path with suffix "_preview"
+ */
+std::string GetPreviewFile(BatchItem const& item)
+{
+	return ReplaceExtension(item.texture, "_preview.tga");
+}
+
+/** Render a preview of the icon to a TGA file
+ * @param[in,out] ctx Conversion context holding the loaded icon
+ * @param[in] item The item to convert
+ * @param[in] opt Conversion settings
+ * @param[out] log Destination for messages
+ * @throw Ghulbus::gbException GB_FAILED indicates that the preview could not be rendered or written
+ */
+void WritePreviewFile(ConversionContext& ctx, BatchItem const& item, ConversionOptions const& opt, std::ostream& log)
+{
+	std::string const fname = GetPreviewFile(item);
+	if(opt.verbose)
+		log << " * Rendering preview of \"" << item.input << "\"...";
+	try {
+		ctx.renderer.SetSize(opt.preview_size, opt.preview_size);
+		if(opt.preview_lights) {
+			ctx.renderer.SetLights(*opt.preview_lights);
+		}
+		//icons without animation only have the first shape:
+		ctx.renderer.Render(ctx.ps2_icon, (ctx.ps2_icon.GetNFrames() > opt.preview_frame) ? opt.preview_frame : -1);
+	} catch( Ghulbus::gbException& ) {
+		log << "\nPreview of \"" << item.input << "\" could not be rendered" << std::endl;
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Error while rendering preview" ) );
+	}
+	if(opt.verbose)
+		log << "done." << std::endl;
+
+	if(opt.verbose)
+		log << " * Writing preview to file \"" << fname << "\"...";
+	try {
+		ctx.renderer.WriteFile(fname.c_str(), opt.rle_texture);
+	} catch( Ghulbus::gbException& ) {
+		log << "\nError while writing to \"" << fname << "\"" << std::endl;
+		throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "Error while writing preview file" ) );
+	}
+	if(opt.verbose)
+		log << "done." << std::endl;
+}
+
+/** Compute the cache key of a conversion
+ * @param[in,out] ctx Conversion context; ctx.card_buffer is used for icons on a memory card
+ * @param[in] item The item to convert
+ * @param[in] opt Conversion settings
+ * @return The key, covering the contents of the icon and all settings that affect the output
+ * @throw Ghulbus::gbException GB_FAILED indicates that the icon could not be read
+ * @throw std::bad_alloc
+ */
+ConversionCache::Key_T GetCacheKey(ConversionContext& ctx, BatchItem const& item, ConversionOptions const& opt)
+{
+	GhulbusUtil::gbHash64 hash;
+	//change the version whenever the output for the same input changes:
+	ConversionCache::AddString(hash, "ps2icon_to_obj 1");
+	//the input path is written to the obj file as mesh name:
+	ConversionCache::AddString(hash, item.input);
+	if(opt.card) {
+		PS2MemoryCard::Entry const* file = FindCardFile(*opt.card, item.input);
+		if(!file) {
+			throw( Ghulbus::gbException( Ghulbus::gbException::GB_FAILED, "File not found on memory card" ) );
+		}
+		ConversionCache::AddData(hash, opt.card->GetFileData(*file, ctx.card_buffer), file->length);
+	} else {
+		ConversionCache::AddFile(hash, item.input.c_str());
+	}
+	int const settings[] = { opt.weld ? 1 : 0, opt.rle_texture ? 1 : 0 };
+	ConversionCache::AddData(hash, settings, sizeof(settings));
+	if(opt.preview_size > 0) {
+		int const preview_settings[] = { opt.preview_size, opt.preview_frame };
+		ConversionCache::AddData(hash, preview_settings, sizeof(preview_settings));
+		if(opt.preview_lights) {
+			ConversionCache::AddData(hash, opt.preview_lights->GetFileData(), IconSys::GetFileSize());
+		}
+	}
+	return hash.GetDigest();
+}
+
+/** Perform all steps of a single conversion
+ * @param[in,out] ctx Conversion context that is reused between items
+ * @param[in] item The item to convert
+ * @param[in] opt Conversion settings
+ * @param[out] log Destination for messages
+ * @throw Ghulbus::gbException GB_FAILED indicates that the conversion failed
+ * @throw std::bad_alloc
+ */
+void ConvertItem(ConversionContext& ctx, BatchItem const& item, ConversionOptions const& opt, std::ostream& log)
+{
+	bool use_cache = (opt.cache != NULL);
+	ConversionCache::Key_T key = 0;
+	std::vector<std::string> outputs;
+	outputs.push_back(item.output);
+	outputs.push_back(item.texture);
+	if(opt.preview_size > 0) {
+		outputs.push_back(GetPreviewFile(item));
+	}
+	if(use_cache) {
+		try {
+			key = GetCacheKey(ctx, item, opt);
+		} catch(Ghulbus::gbException&) {
+			//missing inputs are reported by the conversion below
+			use_cache = false;
+		}
+		if(use_cache && opt.cache->Fetch(key, outputs)) {
+			if(opt.verbose)
+				log << " * Copied cached output to \"" << item.output << "\" and \"" << item.texture << "\"" << std::endl;
+			return;
+		}
+	}
+
+	if(opt.card) {
+		LoadPS2IconFromCard(ctx, item.input, opt, log);
+	} else {
+		LoadPS2Icon(ctx.ps2_icon, item.input.c_str(), opt, log);
+	}
+
+	WriteOBJFile(ctx, item, opt, log);
+
+	WriteTextureFile(ctx, item, opt, log);
+
+	if(opt.preview_size > 0) {
+		WritePreviewFile(ctx, item, opt, log);
+	}
+
+	if(use_cache) {
+		try {
+			opt.cache->Store(key, outputs);
+		} catch(Ghulbus::gbException&) {
+			log << "!WARNING! Output of \"" << item.input << "\" could not be stored in the cache." << std::endl;
+		}
+	}
+}
+
+/** Collect the icons referenced by the icon.sys files of a memory card
+ * @param[in] card The memory card
+ * @param[out] items Receives one item for every icon; outputs are named after save directory and icon
+ * @note Saves without a valid icon.sys are skipped.
+ */
+void CollectCardItems(PS2MemoryCard const& card, std::vector<BatchItem>& items)
+{
+	std::vector<unsigned char> buffer;
+	for(int i=0; i<card.GetNSaves(); i++) {
+		PS2MemoryCard::SaveDirectory const& save = card.GetSave(i);
+		if(card_save && (save.entry.name != card_save)) { continue; }
+		PS2MemoryCard::Entry const* file = card.FindFile(save, "icon.sys");
+		if(!file) { continue; }
+		std::vector<std::string> icons;
+		try {
+			IconSys icon_sys(card.GetFileData(*file, buffer), file->length);
+			char const* names[3] = { icon_sys.GetIconFilename(), icon_sys.GetIconCopyFilename(),
+			                         icon_sys.GetIconDeleteFilename() };
+			for(int j=0; j<3; j++) {
+				if((names[j][0] != '\0') && (std::find(icons.begin(), icons.end(), names[j]) == icons.end())) {
+					icons.push_back(names[j]);
+				}
+			}
+		} catch(Ghulbus::gbException&) {
+			std::cout << " * Skipping \"" << save.entry.name << "\": icon.sys could not be read" << std::endl;
+			continue;
+		}
+		for(size_t j=0; j<icons.size(); j++) {
+			BatchItem item;
+			item.input = save.entry.name + "/" + icons[j];
+			std::string const base = JoinPath((batch_output_dir) ? batch_output_dir : "",
+			                                  save.entry.name + "_" + icons[j]);
+			item.output  = ReplaceExtension(base, ".obj");
+			item.texture = ReplaceExtension(base, ".tga");
+			items.push_back(item);
+		}
+	}
+}
+
+/** Collect the items of a batch conversion from manifest and input directory
+ * @param[out] items Receives the items to convert
+ */
+void CollectBatchItems(std::vector<BatchItem>& items)
+{
 	try {
-		GhulbusUtil::WriteImage(texture_output_file, texture_data, 128, 128);
-	} catch( Ghulbus::gbException e ) {
-		std::cout << "\nError while writing to \"" << texture_output_file << "\"" << std::endl;
+		if(batch_manifest) {
+			ReadBatchManifest(batch_manifest, items);
+		}
+		if(batch_input_dir) {
+			std::vector<std::string> files;
+			ListDirectory(batch_input_dir, ".icn", files);
+			ListDirectory(batch_input_dir, ".ico", files);
+			for(std::vector<std::string>::const_iterator it = files.begin(); it != files.end(); ++it) {
+				BatchItem item;
+				item.input = *it;
+				items.push_back(item);
+			}
+		}
+	} catch(Ghulbus::gbException& e) {
+		std::cout << e.GetErrorString() << ": \"" << (batch_manifest ? batch_manifest : batch_input_dir) << "\"" << std::endl;
 		exit(1);
 	}
-	if(verbose_output)
-		std::cout << "done." << std::endl;
+	//fill in defaults:
+	for(std::vector<BatchItem>::iterator it = items.begin(); it != items.end(); ++it) {
+		std::string base = (batch_output_dir) ? JoinPath(batch_output_dir, GetFileName(it->input)) : it->input;
+		if(it->output.empty())  { it->output  = ReplaceExtension(base, ".obj"); }
+		if(it->texture.empty()) { it->texture = ReplaceExtension(base, ".tga"); }
+	}
 }
 
+/** Converts the items of a batch, using one ConversionContext per worker
+ */
+class PS2IconToOBJConverter: public BatchConverter {
+private:
+	ConversionOptions const& m_options;				///< settings for all items
+	std::vector<ConversionContext*> m_contexts;		///< one context per worker
+public:
+	/** Constructor
+	 * @param[in] opt Settings for all items; must outlive the converter
+	 */
+	explicit PS2IconToOBJConverter(ConversionOptions const& opt): m_options(opt) {}
+	~PS2IconToOBJConverter() {
+		for(size_t i=0; i<m_contexts.size(); i++) { delete m_contexts[i]; }
+	}
+	void Prepare(int n_workers) {
+		while(static_cast<int>(m_contexts.size()) < n_workers) {
+			m_contexts.push_back(new ConversionContext);
+		}
+	}
+	void Convert(BatchItem const& item, int worker, std::ostream& log) {
+		ConvertItem(*m_contexts[worker], item, m_options, log);
+	}
+};
+
 int main(int argc, char* argv[])
 {
 	ParseCommandLine(argc, argv);
 
-	if(!ps2_input_file) {
+	bool const batch_mode = (batch_manifest || batch_input_dir || card_input_file);
+	if(batch_mode && (ps2_input_file || obj_output_file || texture_output_file)) {
+		std::cout << "Batch mode can not be combined with -f, -o or -ot.\n" << std::endl;
+		PrintHelp(argv[0]);
+		exit(1);
+	}
+	if(card_input_file && (batch_manifest || batch_input_dir)) {
+		std::cout << "Card mode can not be combined with -b or -d.\n" << std::endl;
+		PrintHelp(argv[0]);
+		exit(1);
+	}
+	if((!ps2_input_file) && (!batch_mode)) {
 		std::cout << "No input file specified.\n" << std::endl;
 		PrintHelp(argv[0]);
 		exit(1);
 	}
 	std::cout << "PS2Icon to OBJ Converter  V-1.0\n by Ghulbus Inc.  (http://www.ghulbus-inc.de/)\n" << std::endl;
+
+	ConversionCache cache;
+	if(cache_dir) {
+		try {
+			cache.Open(cache_dir);
+		} catch(Ghulbus::gbException& e) {
+			std::cout << e.GetErrorString() << ": \"" << cache_dir << "\"" << std::endl;
+			exit(1);
+		}
+		options.cache = &cache;
+	}
+
+	IconSys* preview_lights = NULL;
+	if(preview_lights_file) {
+		try {
+			preview_lights = new IconSys(preview_lights_file);
+		} catch(Ghulbus::gbException&) {
+			std::cout << "File read error: \"" << preview_lights_file << "\"" << std::endl;
+			exit(1);
+		}
+		options.preview_lights = preview_lights;
+	}
+
+	if(batch_mode) {
+		std::vector<BatchItem> items;
+		PS2MemoryCard card;
+		if(card_input_file) {
+			try {
+				card.Open(card_input_file);
+			} catch(Ghulbus::gbException& e) {
+				std::cout << e.GetErrorString() << ": \"" << card_input_file << "\"" << std::endl;
+				exit(1);
+			}
+			options.card = &card;
+			CollectCardItems(card, items);
+		} else {
+			CollectBatchItems(items);
+		}
+		PS2IconToOBJConverter converter(options);
+		BatchReport report;
+		try {
+			//icons on a memory card are read from the card image:
+			RunBatch(items, converter, batch_jobs, std::cout, report, (options.card) ? 0 : batch_prefetch);
+		} catch(Ghulbus::gbException& e) {
+			std::cout << e.GetErrorString() << std::endl;
+			delete preview_lights;
+			return 1;
+		}
+		report.Print(std::cout);
+		delete preview_lights;
+		return (report.GetNFailed() > 0) ? 1 : 0;
+	}
+
 	if(!obj_output_file)     { obj_output_file = "default.obj"; }
 	if(!texture_output_file) { texture_output_file = "default.tga"; }
 
-	PS2Icon* ps2_icon = LoadPS2Icon();
-
-	WriteOBJFile(ps2_icon);
+	BatchItem item;
+	item.input   = ps2_input_file;
+	item.output  = obj_output_file;
+	item.texture = texture_output_file;
 
-	WriteTextureFile(ps2_icon);
+	ConversionContext ctx;
+	try {
+		ConvertItem(ctx, item, options, std::cout);
+	} catch(Ghulbus::gbException&) {
+		exit(1);
+	}
+	delete preview_lights;
 	
 	std::cout << "Success :)" << std::endl;
 